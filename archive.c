@@ -0,0 +1,617 @@
+/*
+ * Compressed long-term reading archive
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "archive.h"
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160010
+  Function Name	: arc_zigzag / arc_unzigzag
+  Returns Type	: static uint64_t / int64_t
+  ----Parameter List
+  1. int64_t v / uint64_t v ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Small magnitudes of either sign to small unsigned values,
+	0, -1, 1, -2... to 0, 1, 2, 3...
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static uint64_t arc_zigzag(int64_t v) {
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t arc_unzigzag(uint64_t v) {
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160022
+  Function Name	: arc_put
+  Returns Type	: static void
+  ----Parameter List
+  1. struct arc *a,
+  2. uint64_t v ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Varint, 7 bits per byte, low bits first, top bit set on all
+	but the last byte
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void arc_put(struct arc *a, uint64_t v) {
+	while (v >= 0x80) {
+		a->buf[a->used++] = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	a->buf[a->used++] = (uint8_t)v;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160035
+  Function Name	: arc_get
+  Returns Type	: static int
+  ----Parameter List
+  1. struct arc_reader *ar,
+  2. uint64_t *v ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = ran off the end of the block
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int arc_get(struct arc_reader *ar, uint64_t *v) {
+	int shift = 0;
+
+	*v = 0;
+	while (ar->pos < ar->h.bytes) {
+		uint8_t b = ar->buf[ar->pos++];
+
+		*v |= (uint64_t)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0) return 0;
+		shift += 7;
+		if (shift > 63) return -1;
+	}
+
+	return -1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160048
+  Function Name	: arc_put_run
+  Returns Type	: static void
+  ----Parameter List
+  1. struct arc *a ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void arc_put_run(struct arc *a) {
+	if (a->run == 0) return;
+
+	arc_put(a, ((uint64_t)a->run << 2) | ARC_RUN);
+	a->run = 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160100
+  Function Name	: arc_open
+  Returns Type	: int
+  ----Parameter List
+  1. struct arc *a,
+  2. const char *fn,
+  3. uint32_t flush_ms, close a block once it spans this long, 0 = only when full
+  ------------------
+  Exit Codes	: 0 = ok, -1 = can't open, -2 = not an archive
+  Side Effects	: writes the header if the file is new
+  --------------------------------------------------------------------
+Comments:
+	Archives are always appended to
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int arc_open(struct arc *a, const char *fn, uint32_t flush_ms) {
+	struct arc_header h;
+	long size;
+
+	memset(a, 0, sizeof(struct arc));
+	a->flush_ticks = (uint32_t)((uint64_t)flush_ms * 1000000ULL / ARC_TICK_NS);
+
+	a->f = fopen(fn, "ab");
+	if (a->f == NULL) return -1;
+
+	fseek(a->f, 0, SEEK_END);
+	size = ftell(a->f);
+
+	if (size == 0) {
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, ARC_MAGIC, sizeof(h.magic));
+		h.version = ARC_VERSION;
+		h.header_size = ARC_HEADER_SIZE;
+		h.block_header_size = ARC_BLOCK_HEADER_SIZE;
+		h.tick_ns = ARC_TICK_NS;
+		if (fwrite(&h, sizeof(h), 1, a->f) != 1) return -1;
+		a->bytes += sizeof(h);
+
+	} else {
+		FILE *f = fopen(fn, "rb");
+
+		if ((f == NULL)
+				|| (fread(&h, sizeof(h), 1, f) != 1)
+				|| (memcmp(h.magic, ARC_MAGIC, sizeof(h.magic)) != 0)
+				|| (h.version != ARC_VERSION)
+				|| (h.tick_ns != ARC_TICK_NS)) {
+			if (f) fclose(f);
+			fclose(a->f);
+			a->f = NULL;
+			return -2;
+		}
+		fclose(f);
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160112
+  Function Name	: arc_session
+  Returns Type	: int
+  ----Parameter List
+  1. struct arc *a,
+  2. int64_t wall_ns, Unix epoch ns at tick 0 of the session, 0 if unknown
+  ------------------
+  Exit Codes	: 0 = ok, -1 = write failed
+  Side Effects	: closes the current block
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int arc_session(struct arc *a, int64_t wall_ns) {
+	int r = arc_flush(a);
+
+	a->wall_ns = wall_ns;
+	a->h.flags = ARC_BLOCK_SESSION;
+
+	return r;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160125
+  Function Name	: arc_append
+  Returns Type	: int
+  ----Parameter List
+  1. struct arc *a,
+  2. const struct arc_sample *s ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = write failed
+  Side Effects	: may write out a block
+  --------------------------------------------------------------------
+Comments:
+	Runs of unchanged readings at an unchanged gap aren't written
+	until something breaks the run or the block closes.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int arc_append(struct arc *a, const struct arc_sample *s) {
+	int64_t dt, dod;
+	double v;
+
+	if (a->f == NULL) return -1;
+
+	if (a->h.samples
+			&& ((a->h.samples >= ARC_BLOCK_SAMPLES)
+				|| (a->used > ARC_BLOCK_BYTES - ARC_RECORD_MAX)
+				|| (a->flush_ticks && (s->t - a->h.t_first >= a->flush_ticks)))) {
+		if (arc_flush(a) != 0) return -1;
+	}
+
+	if (a->h.samples == 0) {
+		uint8_t flags = a->h.flags;
+
+		memset(&(a->h), 0, sizeof(a->h));
+		memcpy(a->h.magic, ARC_BLOCK_MAGIC, sizeof(a->h.magic));
+		a->h.flags = flags;
+		a->h.wall_ns = a->wall_ns;
+		a->h.t_first = s->t;
+		a->used = 0;
+		a->run = 0;
+		a->last = *s;
+		a->last_dt = 0;
+		dt = dod = 0;
+
+	} else {
+		dt = s->t - a->last.t;
+		dod = dt - a->last_dt;
+	}
+
+	if ((a->h.samples == 0)
+			|| (s->unit != a->last.unit)
+			|| (s->exp10 != a->last.exp10)
+			|| (s->flags != a->last.flags)) {
+		arc_put_run(a);
+		arc_put(a, (arc_zigzag(dod) << 2) | ARC_STATE);
+		a->buf[a->used++] = s->unit;
+		a->buf[a->used++] = s->flags;
+		arc_put(a, arc_zigzag(s->exp10));
+		arc_put(a, arc_zigzag(s->mantissa));
+
+	} else if ((s->mantissa == a->last.mantissa) && (dod == 0)) {
+		a->run++;
+
+	} else {
+		arc_put_run(a);
+		if (s->mantissa == a->last.mantissa) {
+			arc_put(a, (arc_zigzag(dod) << 2) | ARC_SAME);
+		} else {
+			arc_put(a, (arc_zigzag(dod) << 2) | ARC_DELTA);
+			arc_put(a, arc_zigzag((int64_t)s->mantissa - a->last.mantissa));
+		}
+	}
+
+	a->last = *s;
+	a->last_dt = dt;
+	a->samples++;
+	a->h.samples++;
+	a->h.t_last = s->t;
+
+	if ((s->flags & STATUS_OL) == 0) {
+		v = arc_value(s);
+		if ((a->h.values == 0) || (v < a->h.min)) a->h.min = v;
+		if ((a->h.values == 0) || (v > a->h.max)) a->h.max = v;
+		a->h.values++;
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160138
+  Function Name	: arc_flush
+  Returns Type	: int
+  ----Parameter List
+  1. struct arc *a ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = write failed
+  Side Effects	: writes out and closes the current block
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int arc_flush(struct arc *a) {
+	int r = 0;
+
+	if ((a->f == NULL) || (a->h.samples == 0)) return 0;
+
+	arc_put_run(a);
+	a->h.bytes = a->used;
+
+	if ((fwrite(&(a->h), sizeof(a->h), 1, a->f) != 1)
+			|| (fwrite(a->buf, 1, a->used, a->f) != a->used)
+			|| (fflush(a->f) != 0)) {
+		r = -1;
+	}
+	a->bytes += sizeof(a->h) + a->used;
+
+	a->h.samples = 0;
+	a->h.flags = 0;
+	a->used = 0;
+
+	return r;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160150
+  Function Name	: arc_close
+  Returns Type	: void
+  ----Parameter List
+  1. struct arc *a ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void arc_close(struct arc *a) {
+	if (a->f == NULL) return;
+
+	arc_flush(a);
+	fclose(a->f);
+	a->f = NULL;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160202
+  Function Name	: arc_reader_open
+  Returns Type	: int
+  ----Parameter List
+  1. struct arc_reader *ar,
+  2. const char *fn ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = can't open, -2 = not an archive
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int arc_reader_open(struct arc_reader *ar, const char *fn) {
+	struct arc_header h;
+
+	memset(ar, 0, sizeof(struct arc_reader));
+
+	ar->f = fopen(fn, "rb");
+	if (ar->f == NULL) return -1;
+
+	if ((fread(&h, sizeof(h), 1, ar->f) != 1)
+			|| (memcmp(h.magic, ARC_MAGIC, sizeof(h.magic)) != 0)
+			|| (h.version != ARC_VERSION)
+			|| (h.block_header_size != ARC_BLOCK_HEADER_SIZE)) {
+		fclose(ar->f);
+		ar->f = NULL;
+		return -2;
+	}
+	ar->tick_ns = h.tick_ns;
+	fseek(ar->f, h.header_size, SEEK_SET);
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160215
+  Function Name	: arc_next_block
+  Returns Type	: int
+  ----Parameter List
+  1. struct arc_reader *ar,
+  2. int load, 0 = only read the header and skip the records
+  ------------------
+  Exit Codes	: 1 = block header in ar->h, 0 = end of archive, -1 = corrupt
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Walking the block headers with load = 0 is the archive's index,
+	load the blocks that are wanted and arc_next() their readings.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int arc_next_block(struct arc_reader *ar, int load) {
+	size_t n;
+
+	ar->left = 0;
+	ar->run = 0;
+
+	n = fread(&(ar->h), 1, sizeof(ar->h), ar->f);
+	if (n == 0) return 0;
+	if ((n != sizeof(ar->h))
+			|| (memcmp(ar->h.magic, ARC_BLOCK_MAGIC, sizeof(ar->h.magic)) != 0)
+			|| (ar->h.bytes > ARC_BLOCK_BYTES)) {
+		return -1;
+	}
+
+	if (load) {
+		if (fread(ar->buf, 1, ar->h.bytes, ar->f) != ar->h.bytes) return -1;
+		ar->pos = 0;
+		ar->left = ar->h.samples;
+		ar->last.t = ar->h.t_first;
+		ar->last_dt = 0;
+	} else {
+		if (fseek(ar->f, ar->h.bytes, SEEK_CUR) != 0) return -1;
+	}
+
+	return 1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160228
+  Function Name	: arc_next
+  Returns Type	: int
+  ----Parameter List
+  1. struct arc_reader *ar,
+  2. struct arc_sample *s ,
+  ------------------
+  Exit Codes	: 1 = reading in s, 0 = end of the block, -1 = corrupt
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int arc_next(struct arc_reader *ar, struct arc_sample *s) {
+	uint64_t v, x;
+
+	if (ar->left == 0) return 0;
+
+	if (ar->run) {
+		ar->run--;
+		ar->last.t += ar->last_dt;
+
+	} else {
+		if (arc_get(ar, &v) != 0) return -1;
+
+		switch (v & 0x03) {
+			case ARC_RUN:
+				if ((v >> 2) == 0) return -1;
+				ar->run = (uint32_t)(v >> 2) -1;
+				ar->last.t += ar->last_dt;
+				break;
+
+			case ARC_SAME:
+				ar->last_dt += arc_unzigzag(v >> 2);
+				ar->last.t += ar->last_dt;
+				break;
+
+			case ARC_DELTA:
+				ar->last_dt += arc_unzigzag(v >> 2);
+				ar->last.t += ar->last_dt;
+				if (arc_get(ar, &x) != 0) return -1;
+				ar->last.mantissa += (int32_t)arc_unzigzag(x);
+				break;
+
+			case ARC_STATE:
+				ar->last_dt += arc_unzigzag(v >> 2);
+				ar->last.t += ar->last_dt;
+				if (ar->pos + 2 > ar->h.bytes) return -1;
+				ar->last.unit = ar->buf[ar->pos++];
+				ar->last.flags = ar->buf[ar->pos++];
+				if (arc_get(ar, &x) != 0) return -1;
+				ar->last.exp10 = (int8_t)arc_unzigzag(x);
+				if (arc_get(ar, &x) != 0) return -1;
+				ar->last.mantissa = (int32_t)arc_unzigzag(x);
+				if (ar->last.unit >= BK390A_UNIT_COUNT) return -1;
+				break;
+		}
+	}
+
+	ar->left--;
+	*s = ar->last;
+
+	return 1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160240
+  Function Name	: arc_reader_close
+  Returns Type	: void
+  ----Parameter List
+  1. struct arc_reader *ar ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void arc_reader_close(struct arc_reader *ar) {
+	if (ar->f) fclose(ar->f);
+	ar->f = NULL;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160252
+  Function Name	: arc_value
+  Returns Type	: double
+  ----Parameter List
+  1. const struct arc_sample *s ,
+  ------------------
+  Exit Codes	: reading in SI base units
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	As bk390a_value(), scaled by an exact power of ten
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+double arc_value(const struct arc_sample *s) {
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	int e = s->exp10;
+
+	if (e < -22) e = -22;
+	if (e > 22) e = 22;
+	if (e < 0) return s->mantissa / pow10[-e];
+
+	return s->mantissa * pow10[e];
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-160305
+  Function Name	: arc_value_str
+  Returns Type	: int
+  ----Parameter List
+  1. const struct arc_sample *s,
+  2. char *buf,
+  3. size_t len ,
+  ------------------
+  Exit Codes	: characters written
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Exactly the text bk390a_value_str() gives for the reading the
+	sample came from, built from the digits rather than a double
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int arc_value_str(const struct arc_sample *s, char *buf, size_t len) {
+	char digits[32];		// least significant first
+	char out[64];
+	uint64_t m = (s->mantissa < 0) ? (uint64_t)(-(int64_t)s->mantissa) : (uint64_t)s->mantissa;
+	int e = s->exp10;
+	int i, n = 0, o = 0;
+
+	if (e < -24) e = -24;
+	if (e > 24) e = 24;
+
+	do {
+		digits[n++] = '0' + (m % 10);
+		m /= 10;
+	} while (m);
+
+	if (s->mantissa < 0) out[o++] = '-';
+
+	if (e >= 0) {
+		for (i = n -1; i >= 0; i--) out[o++] = digits[i];
+		if (s->mantissa != 0) for (i = 0; i < e; i++) out[o++] = '0';
+
+	} else {
+		while (n < -e +1) digits[n++] = '0';
+		for (i = n -1; i >= 0; i--) {
+			if (i == -e -1) out[o++] = '.';
+			out[o++] = digits[i];
+		}
+	}
+	out[o] = '\0';
+
+	return snprintf(buf, len, "%s", out);
+}
@@ -0,0 +1,143 @@
+/*
+ * Compressed long-term reading archive
+ *
+ * For multi-week soak runs where readings mostly repeat or move by a
+ * few counts.  A 64 byte file header is followed by blocks; each block
+ * is a 64 byte header (sample count, first/last time, min/max, the
+ * session's wall clock anchor) and a run of variable length records.
+ * The block headers are the index, a reader can hop from one to the
+ * next by the byte count without decoding anything in between, and
+ * each block decodes on its own.
+ *
+ * Times are in ticks (ARC_TICK_NS, 1ms) since the session anchor and
+ * are stored as the change in the gap between readings, so a meter
+ * reading at a steady rate costs next to nothing.  Values are the
+ * reading's exact decimal, mantissa x 10^exp10, with the mantissa
+ * stored as the change from the last one.  Every record starts with
+ * one varint; its low two bits are the record type, the rest;
+ *
+ *	ARC_SAME	zig-zag change in gap, value unchanged
+ *	ARC_DELTA	zig-zag change in gap, then a zig-zag mantissa change
+ *	ARC_RUN		count of readings with the same gap and value
+ *	ARC_STATE	zig-zag change in gap, then unit, flags, zig-zag
+ *			exp10 and zig-zag mantissa; the first record of
+ *			every block, and whenever unit, range or flags change
+ *
+ * A steady signal is one byte per reading, or a few bytes per run
+ * when the timing is steady too.  All values little-endian.
+ *
+ */
+#ifndef __BK390A_ARCHIVE_H__
+#define __BK390A_ARCHIVE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include "decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARC_MAGIC "BK390ARC"
+#define ARC_BLOCK_MAGIC "BKAB"
+#define ARC_VERSION 1
+#define ARC_HEADER_SIZE 64
+#define ARC_BLOCK_HEADER_SIZE 64
+#define ARC_TICK_NS 1000000ULL	// 1ms, the text log's resolution
+#define ARC_BLOCK_SAMPLES 4096
+#define ARC_BLOCK_BYTES 65536	// a block is also closed when this nearly fills
+#define ARC_RECORD_MAX 32		// longest a reading can encode to, run included
+#define ARC_DEFAULT_FLUSH_MS 60000	// live capture, at most a minute of readings in memory
+
+/*
+ * Record types
+ */
+#define ARC_SAME 0
+#define ARC_DELTA 1
+#define ARC_RUN 2
+#define ARC_STATE 3
+
+#define ARC_BLOCK_SESSION 0x01	// first block of a capture session
+
+struct arc_header {
+	char magic[8];			// ARC_MAGIC, not terminated
+	uint16_t version;
+	uint16_t header_size;
+	uint16_t block_header_size;
+	uint16_t reserved0;
+	uint64_t tick_ns;
+	uint8_t reserved[40];
+};
+
+struct arc_block_header {
+	char magic[4];			// ARC_BLOCK_MAGIC
+	uint32_t bytes;			// record bytes following the header
+	uint32_t samples;
+	uint32_t values;		// samples that aren't O.L., min/max are of these
+	int64_t wall_ns;		// session anchor; Unix epoch ns at tick 0
+	int64_t t_first;		// ticks
+	int64_t t_last;
+	double min, max;		// SI base units
+	uint8_t flags;			// ARC_BLOCK_SESSION
+	uint8_t reserved[7];
+};
+
+struct arc_sample {
+	int64_t t;				// ticks since the session anchor
+	int32_t mantissa;
+	int8_t exp10;
+	uint8_t unit;			// enum bk390a_unit
+	uint8_t flags;			// STATUS_OL, STATUS_BATT
+};
+
+/*
+ * Writer
+ */
+struct arc {
+	FILE *f;
+	uint32_t flush_ticks;	// close a block after it spans this long, 0 = only when full
+	int64_t wall_ns;
+	struct arc_block_header h;
+	uint32_t used;
+	uint32_t run;			// ARC_RUN readings not yet written
+	struct arc_sample last;
+	int64_t last_dt;
+	uint64_t samples;
+	uint64_t bytes;			// written, headers included
+	uint8_t buf[ARC_BLOCK_BYTES];
+};
+
+/*
+ * Reader
+ */
+struct arc_reader {
+	FILE *f;
+	uint64_t tick_ns;
+	struct arc_block_header h;
+	uint32_t pos;
+	uint32_t left;			// samples left in the block
+	uint32_t run;
+	struct arc_sample last;
+	int64_t last_dt;
+	uint8_t buf[ARC_BLOCK_BYTES];
+};
+
+int arc_open(struct arc *a, const char *fn, uint32_t flush_ms);
+int arc_session(struct arc *a, int64_t wall_ns);
+int arc_append(struct arc *a, const struct arc_sample *s);
+int arc_flush(struct arc *a);
+void arc_close(struct arc *a);
+
+int arc_reader_open(struct arc_reader *ar, const char *fn);
+int arc_next_block(struct arc_reader *ar, int load);
+int arc_next(struct arc_reader *ar, struct arc_sample *s);
+void arc_reader_close(struct arc_reader *ar);
+
+double arc_value(const struct arc_sample *s);
+int arc_value_str(const struct arc_sample *s, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
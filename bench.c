@@ -0,0 +1,709 @@
+/*
+ * BK Precision Model 390A decoder and pipeline benchmarks
+ *
+ * Times each stage of the capture pipeline on its own (framing,
+ * decode, batch decode with each implementation the CPU has, display
+ * formatting, old snprintf() formatting for
+ * comparison, OBS text file write, text log write and binary log
+ * write) and then all of them together, and reports
+ * frames/s, ns/frame and heap allocations per stage as JSON so that
+ * runs from different versions can be compared.
+ *
+ * Run;
+ *		make bench
+ *		./bk390a-bench -n 500000 -i capture.raw -L v0.2 > bench.json
+ *
+ * The frames are synthetic (a mix of every function and range, some
+ * O.L. and negative) unless -i gives a recorded raw byte stream, either
+ * the bare bytes or a bk390a -w capture.
+ *
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "decode.h"
+#include "decbatch.h"
+#include "dispfmt.h"
+#include "framer.h"
+#include "proto.h"
+#include "timebase.h"
+#include "binlog.h"
+#include "rawcap.h"
+#include "obsfile.h"
+
+#define BENCH_DEFAULT_FRAMES 200000
+#define BENCH_CHUNK 64		// bytes handed to the framer per "read"
+
+char VERSION[] = "v0.1-Alpha";
+char help[] = " [-n <frames>] [-i <raw capture>] [-L <label>] [-h]\r\n"\
+			   "\n"\
+			   "\t\tBK-Precision 390A decoder and pipeline benchmarks\r\n"\
+			   "\r\n"\
+			   "\t-h: This help\r\n"\
+			   "\t-n <frames>: Frames per benchmark (default 200000)\r\n"\
+			   "\t-i <filename>: Use a recorded raw byte stream instead of synthetic frames\r\n"\
+			   "\t-L <label>: Label for the results, eg a version or git hash\r\n"\
+			   "\t-v: show version\r\n"\
+			   "\n\n\texample: bk390a-bench -n 1000000 -L $(git describe --always) > bench.json\r\n"\
+			   "\r\n";
+
+struct glb {
+	uint64_t frames;
+	char *input_filename;
+	char *label;
+};
+
+struct result {
+	const char *name;
+	uint64_t frames;
+	uint64_t ns;
+	uint64_t allocs;
+	uint64_t alloc_bytes;
+};
+
+/*
+ * Input, the byte stream and the frames the framer found in it
+ */
+uint8_t *stream;
+size_t stream_len;
+uint8_t (*payloads)[BK390A_PAYLOAD_SIZE];
+uint64_t payload_count;
+
+volatile uint64_t sink;	// keeps the compiler from dropping the work
+
+/*
+ * Heap allocation counting, glibc lets us interpose malloc() and
+ * friends and still reach the real allocator
+ */
+uint64_t alloc_count, alloc_bytes;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+void *malloc(size_t n) { alloc_count++; alloc_bytes += n; return __libc_malloc(n); }
+void *calloc(size_t n, size_t s) { alloc_count++; alloc_bytes += n * s; return __libc_calloc(n, s); }
+void *realloc(void *p, size_t n) { alloc_count++; alloc_bytes += n; return __libc_realloc(p, n); }
+#endif
+
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-130210
+  Function Name	: init
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int init( struct glb *g ) {
+	g->frames = BENCH_DEFAULT_FRAMES;
+	g->input_filename = NULL;
+	g->label = "";
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-130222
+  Function Name	: parse_parameters
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g,
+  2.  int argc,
+  3.  char **argv ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int parse_parameters( struct glb *g, int argc, char **argv ) {
+	int i;
+
+	for (i = 1; i < argc; i++) {
+
+		if (argv[i][0] == '-') {
+
+			/* parameter */
+			switch (argv[i][1]) {
+				case 'h':
+					fprintf(stdout,"Usage: %s %s", argv[0], help);
+					exit(1);
+					break;
+
+				case 'n':
+				case 'i':
+				case 'L':
+					if (i +1 >= argc) {
+						fprintf(stderr,"Insufficient parameters; -%c <value>\n", argv[i][1]);
+						exit(1);
+					}
+					switch (argv[i][1]) {
+						case 'n': g->frames = strtoull(argv[i+1], NULL, 10); break;
+						case 'i': g->input_filename = argv[i+1]; break;
+						case 'L': g->label = argv[i+1]; break;
+					}
+					i++;
+					break;
+
+				case 'v':
+					fprintf(stdout,"%s\r\n", VERSION);
+					exit(0);
+					break;
+
+				default:
+					break;
+			} // switch
+		}
+	}
+
+	if (g->frames == 0) g->frames = 1;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-130235
+  Function Name	: load_stream
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = couldn't read input or no frames in it
+  Side Effects	: fills stream/payloads
+  --------------------------------------------------------------------
+Comments:
+	A recorded stream is repeated until it holds g->frames worth
+	of bytes.  Synthetic readings step through every function, JUDGE
+	and range with a changing count, every 16th is O.L. and every
+	4th negative, each reading repeated for 8 frames.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int load_stream( struct glb *g ) {
+	static const uint8_t functions[] = {
+		FUNCTION_VOLTAGE, FUNCTION_CURRENT_UA, FUNCTION_CURRENT_MA, FUNCTION_CURRENT_A,
+		FUNCTION_OHMS, FUNCTION_CONTINUITY, FUNCTION_DIODE, FUNCTION_FQ_RPM,
+		FUNCTION_CAPACITANCE, FUNCTION_TEMPERATURE
+	};
+	struct framer fr;
+	uint64_t i;
+
+	stream_len = g->frames * BK390A_FRAME_SIZE;
+	stream = malloc(stream_len);
+	payloads = malloc(g->frames * BK390A_PAYLOAD_SIZE);
+	if ((stream == NULL) || (payloads == NULL)) return -1;
+
+	if (g->input_filename) {
+		static struct rawcap_reader rr;
+		struct rawcap_record rec;
+		FILE *f;
+		size_t n = 0, r;
+
+		/*
+		 * A -w capture's data records, as fast as they can be
+		 * taken, otherwise the file is the bytes themselves
+		 */
+		switch (rawcap_replay_open(&rr, g->input_filename, 0)) {
+			case 0:
+				while ((n < stream_len) && (rawcap_replay_next(&rr, &rec, stream + n, stream_len - n) == 1)) {
+					if (rec.type == RAWCAP_DATA) n += rec.len;
+				}
+				rawcap_replay_close(&rr);
+				break;
+
+			case -2:
+				f = fopen(g->input_filename, "rb");
+				if (f == NULL) return -1;
+				while ((n < stream_len) && ((r = fread(stream + n, 1, stream_len - n, f)) > 0)) n += r;
+				fclose(f);
+				break;
+
+			default:
+				return -1;
+		}
+		if (n == 0) return -1;
+		for (r = n; r < stream_len; r++) stream[r] = stream[r - n];
+
+	} else {
+		for (i = 0; i < g->frames; i++) {
+			uint8_t *p = stream + i * BK390A_FRAME_SIZE;
+			uint64_t k = i / 8;	// readings settle for a few frames, as on the meter
+			uint8_t function = functions[k % sizeof(functions)];
+			uint16_t count = (k * 37) % 10000;
+			uint8_t status = 0;
+
+			if ((k % 16) == 15) status |= STATUS_OL;
+			if ((k % 4) == 3) status |= STATUS_SIGN;
+			if ((k / sizeof(functions)) & 1) status |= STATUS_JUDGE;
+
+			p[BYTE_RANGE] = 0x30 | ((k / 20) % 6);
+			p[BYTE_DIGIT_3] = '0' + count / 1000;
+			p[BYTE_DIGIT_2] = '0' + (count / 100) % 10;
+			p[BYTE_DIGIT_1] = '0' + (count / 10) % 10;
+			p[BYTE_DIGIT_0] = '0' + count % 10;
+			p[BYTE_FUNCTION] = function;
+			p[BYTE_STATUS] = 0x30 | status;
+			p[BYTE_OPTION_1] = 0x30;
+			p[BYTE_OPTION_2] = 0x30 | OPTION2_AUTO | OPTION2_DC;
+			p[BK390A_PAYLOAD_SIZE] = '\r';
+			p[BK390A_PAYLOAD_SIZE +1] = '\n';
+		}
+	}
+
+	/*
+	 * The per stage benchmarks work on the frames as the framer
+	 * would hand them over
+	 */
+	framer_init(&fr);
+	payload_count = 0;
+	for (i = 0; i < stream_len; ) {
+		size_t n = stream_len - i;
+
+		if (n > BENCH_CHUNK) n = BENCH_CHUNK;
+		framer_push(&fr, stream + i, n, 0);
+		i += n;
+		while ((payload_count < g->frames) && framer_next(&fr, payloads[payload_count], NULL)) payload_count++;
+	}
+
+	return payload_count ? 0 : -1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-130250
+  Function Name	: format_reading_printf
+  Returns Type	: int
+  ----Parameter List
+  1. char *cmd,
+  2. size_t len,
+  3. const struct bk390a_reading *r,
+  ------------------
+  Exit Codes	: characters written
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The display/OBS string as bk390a built it with snprintf() before
+	dispfmt, kept to compare against and to check dispfmt with; the
+	390A's "% 06.*f", a digit wider for a meter with more digits.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int format_reading_printf( char *cmd, size_t len, const struct bk390a_reading *r ) {
+	static const double scale[] = { 1, 10, 100, 1000, 10000 };
+	const char *prefix = bk390a_prefix_str[BK390A_PREFIX_INDEX(r->si_exp)];
+	const char *units = bk390a_unit_str[r->unit];
+	int digits = proto_list[r->protocol]->layout->digits;
+
+	if (r->status & STATUS_OL) return snprintf(cmd, len, "O.L.");
+
+	return snprintf(cmd, len, "% 0*.*f%s%s", digits + 1 + (r->dps > 0), r->dps, r->count / scale[r->dps], prefix, units);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-215210
+  Function Name	: check_format_es51922
+  Returns Type	: void
+  ----Parameter List
+  ------------------
+  Exit Codes	:
+  Side Effects	: exits if dispfmt and snprintf differ
+  --------------------------------------------------------------------
+Comments:
+	Every function, JUDGE and range the ES51922 has, at counts up
+	to its 22000 and either sign; the 390A stream doesn't reach its
+	fifth digit or fourth decimal place.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void check_format_es51922( void ) {
+	static const int counts[] = { 0, 1, 9, 12345, 9999, 10000, 21999, 22000 };
+	struct bk390a_reading r;
+	uint8_t p[BK390A_PAYLOAD_MAX];
+	char ref[64], cmd[64];
+	int fn, judge, range, c, neg, checked = 0;
+
+	for (fn = 0x30; fn <= 0x3F; fn++) {
+		for (judge = 0; judge <= STATUS_JUDGE; judge += STATUS_JUDGE) {
+			for (range = 0; range < 8; range++) {
+				for (c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++) {
+					for (neg = 0; neg <= STATUS_SIGN; neg += STATUS_SIGN) {
+						memset(p, 0x30, sizeof(p));
+						p[0] = 0x30 | range;
+						snprintf((char *)&(p[1]), 6, "%05d", counts[c]);
+						p[6] = fn;
+						p[7] = 0x30 | judge | neg;
+						if (proto_es51922.decode(p, &r) != 0) continue;
+
+						format_reading_printf(ref, sizeof(ref), &r);
+						dispfmt_reading(&r, 0, cmd, sizeof(cmd));
+						if (strcmp(ref, cmd) != 0) {
+							fprintf(stderr,"dispfmt gave '%s' where snprintf gave '%s' (es51922)\r\n", cmd, ref);
+							exit(1);
+						}
+						checked++;
+					}
+				}
+			}
+		}
+	}
+
+	if (checked == 0) {
+		fprintf(stderr,"No ES51922 frames were decoded to check dispfmt with\r\n");
+		exit(1);
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-130305
+  Function Name	: bench_start / bench_stop
+  Returns Type	: void
+  ----Parameter List
+  1. struct result *res,
+  2. const char *name,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void bench_start( struct result *res, const char *name ) {
+	res->name = name;
+	res->frames = 0;
+	res->allocs = alloc_count;
+	res->alloc_bytes = alloc_bytes;
+	res->ns = timebase_now_ns();
+}
+
+void bench_stop( struct result *res, uint64_t frames ) {
+	res->ns = timebase_now_ns() - res->ns;
+	res->allocs = alloc_count - res->allocs;
+	res->alloc_bytes = alloc_bytes - res->alloc_bytes;
+	res->frames = frames;
+	if (res->ns == 0) res->ns = 1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-130320
+  Function Name	: main
+  Returns Type	: int
+  ----Parameter List
+  1. int argc,
+  2.  char **argv ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int main( int argc, char **argv ) {
+	struct glb g;
+	struct result res[16];
+	struct bk390a_reading r;
+	struct framer fr;
+	struct binlog bl;
+	char cmd[1024];
+	char value[32];
+	wchar_t wcmd[64];
+	char binlog_fn[] = "/tmp/bk390a-bench-XXXXXX";
+	char obs_fn[sizeof(binlog_fn) +4];
+	uint8_t d[BK390A_PAYLOAD_SIZE];
+	uint8_t (*es51922)[BK390A_PAYLOAD_MAX];
+	static const char *batch_names[BK390A_BATCH_BEST] = { "decode_batch_scalar", "decode_batch_sse2", "decode_batch_avx2" };
+	struct bk390a_batch batch;
+	struct obsfile obs;
+	FILE *fl;
+	uint64_t i, n, acc, t;
+	int nres = 0, fd, j;
+
+	init( &g );
+	parse_parameters( &g, argc, argv );
+
+	if (load_stream( &g ) != 0) {
+		fprintf(stderr,"Couldn't load any frames%s%s\r\n", g.input_filename ? " from " : "", g.input_filename ? g.input_filename : "");
+		exit(1);
+	}
+
+	fl = tmpfile();
+	fd = mkstemp(binlog_fn);
+	if ((fl == NULL) || (fd < 0)) {
+		fprintf(stderr,"Couldn't create temporary files\r\n");
+		exit(1);
+	}
+	fclose(fdopen(fd, "w"));
+	remove(binlog_fn);
+	snprintf(obs_fn, sizeof(obs_fn), "%s.txt", binlog_fn);
+
+	/*
+	 * Framing, the byte stream in BENCH_CHUNK sized reads
+	 */
+	bench_start(&res[nres], "framing");
+	framer_init(&fr);
+	for (i = 0, n = 0, acc = 0; i < stream_len; ) {
+		size_t wlen, c = stream_len - i;
+		uint8_t *wp = framer_write_ptr(&fr, &wlen);
+
+		if (c > BENCH_CHUNK) c = BENCH_CHUNK;
+		if (c > wlen) c = wlen;
+		memcpy(wp, stream + i, c);
+		framer_commit(&fr, c, timebase_now_ns());
+		i += c;
+		while (framer_next(&fr, d, &t)) { n++; acc += d[BYTE_DIGIT_0] + t; }
+	}
+	bench_stop(&res[nres++], n);
+	sink += acc;
+
+	/*
+	 * Decode
+	 */
+	bench_start(&res[nres], "decode");
+	for (i = 0, acc = 0; i < payload_count; i++) {
+		bk390a_decode(payloads[i], &r);
+		acc += r.count;
+	}
+	bench_stop(&res[nres++], payload_count);
+	sink += acc;
+
+	/*
+	 * Decode by a protocol layer decoder, the ES51922's, of the same
+	 * readings in its 12 byte payload, through its function pointer
+	 * as the capture loops call it
+	 */
+	es51922 = malloc(payload_count * BK390A_PAYLOAD_MAX);
+	if (es51922 == NULL) {
+		fprintf(stderr,"Couldn't allocate the ES51922 payloads\r\n");
+		exit(1);
+	}
+	for (i = 0; i < payload_count; i++) {
+		memset(es51922[i], 0x30, BK390A_PAYLOAD_MAX);
+		es51922[i][0] = payloads[i][BYTE_RANGE];
+		memcpy(&(es51922[i][2]), &(payloads[i][BYTE_DIGIT_3]), 4);
+		es51922[i][6] = payloads[i][BYTE_FUNCTION];
+		es51922[i][7] = payloads[i][BYTE_STATUS];
+		es51922[i][10] = payloads[i][BYTE_OPTION_2];
+	}
+
+	bench_start(&res[nres], "decode_es51922");
+	for (i = 0, acc = 0; i < payload_count; i++) {
+		proto_es51922.decode(es51922[i], &r);
+		acc += r.count;
+	}
+	bench_stop(&res[nres++], payload_count);
+	sink += acc;
+	free(es51922);
+
+	/*
+	 * Batch decode of every payload in one call, by each
+	 * implementation the CPU has, once checked against decode
+	 */
+	batch.count = malloc(payload_count * sizeof(int16_t));
+	batch.exp10 = malloc(payload_count);
+	batch.unit = malloc(payload_count);
+	batch.mode = malloc(payload_count);
+	batch.flags = malloc(payload_count);
+	if (!batch.count || !batch.exp10 || !batch.unit || !batch.mode || !batch.flags) {
+		fprintf(stderr,"Couldn't allocate the batch arrays\r\n");
+		exit(1);
+	}
+
+	for (j = BK390A_BATCH_SCALAR; j < BK390A_BATCH_BEST; j++) {
+		if (bk390a_decode_batch_use(j) != j) continue;
+
+		bk390a_decode_batch(payloads[0], BK390A_PAYLOAD_SIZE, payload_count, &batch);
+		for (i = 0; i < payload_count; i++) {
+			int ok = (bk390a_decode(payloads[i], &r) == 0);
+
+			if ((batch.count[i] != r.count)
+					|| (batch.flags[i] != (r.status | (r.option2 << 4)))
+					|| (batch.mode[i] != (ok ? r.mode : BK390A_MODE_UNKNOWN))
+					|| (ok && ((batch.exp10[i] != r.exp10) || (batch.unit[i] != r.unit)))) {
+				fprintf(stderr,"%s decoded frame %llu differently to decode\r\n", batch_names[j], (unsigned long long)i);
+				exit(1);
+			}
+		}
+
+		bench_start(&res[nres], batch_names[j]);
+		acc = bk390a_decode_batch(payloads[0], BK390A_PAYLOAD_SIZE, payload_count, &batch);
+		bench_stop(&res[nres++], payload_count);
+		sink += acc + batch.count[payload_count -1];
+	}
+	bk390a_decode_batch_use(BK390A_BATCH_BEST);
+
+	/*
+	 * Display string formatting
+	 */
+	for (i = 0; i < payload_count; i++) {
+		char ref[64];
+
+		bk390a_decode(payloads[i], &r);
+		format_reading_printf(ref, sizeof(ref), &r);
+		dispfmt_reading(&r, 0, cmd, sizeof(cmd));
+		if (strcmp(ref, cmd) != 0) {
+			fprintf(stderr,"dispfmt gave '%s' where snprintf gave '%s'\r\n", cmd, ref);
+			exit(1);
+		}
+	}
+	check_format_es51922();
+
+	bench_start(&res[nres], "format_printf");
+	for (i = 0, acc = 0; i < payload_count; i++) {
+		bk390a_decode(payloads[i], &r);
+		acc += format_reading_printf(cmd, sizeof(cmd), &r);
+	}
+	bench_stop(&res[nres++], payload_count);
+	sink += acc;
+
+	bench_start(&res[nres], "format");
+	for (i = 0, acc = 0; i < payload_count; i++) {
+		bk390a_decode(payloads[i], &r);
+		acc += dispfmt_reading(&r, 0, cmd, sizeof(cmd));
+	}
+	bench_stop(&res[nres++], payload_count);
+	sink += acc;
+
+	bench_start(&res[nres], "format_wide");
+	for (i = 0, acc = 0; i < payload_count; i++) {
+		bk390a_decode(payloads[i], &r);
+		acc += dispfmt_wreading(&r, DISPFMT_PREFIX_SPACE, wcmd, sizeof(wcmd) / sizeof(wcmd[0]));
+	}
+	bench_stop(&res[nres++], payload_count);
+	sink += acc;
+
+	/*
+	 * OBS text file, replaced when the display string changes
+	 */
+	obsfile_open(&obs, obs_fn);
+	bench_start(&res[nres], "text_write");
+	for (i = 0; i < payload_count; i++) {
+		bk390a_decode(payloads[i], &r);
+		dispfmt_reading(&r, 0, cmd, sizeof(cmd));
+		obsfile_update(&obs, cmd);
+	}
+	bench_stop(&res[nres++], payload_count);
+	obsfile_close(&obs);
+
+	/*
+	 * Text log, one line and flush per frame
+	 */
+	bench_start(&res[nres], "log_write");
+	for (i = 0; i < payload_count; i++) {
+		bk390a_decode(payloads[i], &r);
+		bk390a_value_str(&r, value, sizeof(value));
+		fprintf(fl, "%0.3f %s %s\n", i / 1000.0, value, bk390a_unit_str[r.unit]);
+		fflush(fl);
+	}
+	bench_stop(&res[nres++], payload_count);
+
+	/*
+	 * Binary log, buffered
+	 */
+	if (binlog_open(&bl, binlog_fn, BINLOG_DEFAULT_FLUSH_MS, NULL) != 0) {
+		fprintf(stderr,"Couldn't open temporary binary log\r\n");
+		exit(1);
+	}
+	bench_start(&res[nres], "binlog_write");
+	for (i = 0; i < payload_count; i++) {
+		bk390a_decode(payloads[i], &r);
+		binlog_append(&bl, 0, timebase_now_ns(), payloads[i], &r);
+	}
+	binlog_flush(&bl);
+	bench_stop(&res[nres++], payload_count);
+	binlog_close(&bl);
+	remove(binlog_fn);
+
+	/*
+	 * End to end, bytes to every sink
+	 */
+	if (binlog_open(&bl, binlog_fn, BINLOG_DEFAULT_FLUSH_MS, NULL) != 0) {
+		fprintf(stderr,"Couldn't open temporary binary log\r\n");
+		exit(1);
+	}
+	obsfile_open(&obs, obs_fn);
+	bench_start(&res[nres], "end_to_end");
+	framer_init(&fr);
+	for (i = 0, n = 0; i < stream_len; ) {
+		size_t wlen, c = stream_len - i;
+		uint8_t *wp = framer_write_ptr(&fr, &wlen);
+
+		if (c > BENCH_CHUNK) c = BENCH_CHUNK;
+		if (c > wlen) c = wlen;
+		memcpy(wp, stream + i, c);
+		framer_commit(&fr, c, timebase_now_ns());
+		i += c;
+
+		while (framer_next(&fr, d, &t)) {
+			n++;
+			if (bk390a_decode(d, &r) != 0) continue;
+			dispfmt_reading(&r, 0, cmd, sizeof(cmd));
+
+			obsfile_update(&obs, cmd);
+
+			bk390a_value_str(&r, value, sizeof(value));
+			fprintf(fl, "%0.3f %s %s\n", t / 1e9, value, bk390a_unit_str[r.unit]);
+			fflush(fl);
+
+			binlog_append(&bl, 0, t, d, &r);
+		}
+	}
+	binlog_flush(&bl);
+	bench_stop(&res[nres++], n);
+	binlog_close(&bl);
+	remove(binlog_fn);
+
+	obsfile_close(&obs);
+	remove(obs_fn);
+	fclose(fl);
+
+	/*
+	 * Results
+	 */
+	fprintf(stdout,"{\n\t\"tool\": \"bk390a-bench\",\n\t\"version\": \"%s\",\n\t\"label\": \"%s\",\n"
+			, VERSION, g.label);
+	fprintf(stdout,"\t\"input\": \"%s\",\n\t\"frames\": %llu,\n\t\"benchmarks\": [\n"
+			, g.input_filename ? g.input_filename : "synthetic"
+			, (unsigned long long)payload_count);
+	for (j = 0; j < nres; j++) {
+		fprintf(stdout,"\t\t{ \"name\": \"%s\", \"frames\": %llu, \"ns\": %llu, \"ns_per_frame\": %.2f, \"frames_per_sec\": %.0f, \"allocs\": %llu, \"alloc_bytes\": %llu }%s\n"
+				, res[j].name
+				, (unsigned long long)res[j].frames
+				, (unsigned long long)res[j].ns
+				, res[j].frames ? (double)res[j].ns / res[j].frames : 0.0
+				, res[j].frames * 1e9 / res[j].ns
+				, (unsigned long long)res[j].allocs
+				, (unsigned long long)res[j].alloc_bytes
+				, (j +1 < nres) ? "," : ""
+			   );
+	}
+	fprintf(stdout,"\t]\n}\n");
+
+	return 0;
+}
@@ -0,0 +1,365 @@
+/*
+ * Compact binary log
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "binlog.h"
+#include "timebase.h"
+
+typedef char binlog_header_size_check[(sizeof(struct binlog_header) == BINLOG_HEADER_SIZE) ? 1 : -1];
+typedef char binlog_record_size_check[(sizeof(struct binlog_record) == BINLOG_RECORD_SIZE) ? 1 : -1];
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-170010
+  Function Name	: binlog_header_init
+  Returns Type	: void
+  ----Parameter List
+  1. struct binlog_header *h ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void binlog_header_init(struct binlog_header *h) {
+	memset(h, 0, sizeof(struct binlog_header));
+	memcpy(h->magic, BINLOG_MAGIC, sizeof(h->magic));
+	h->version = BINLOG_VERSION;
+	h->header_size = BINLOG_HEADER_SIZE;
+	h->record_size = BINLOG_RECORD_SIZE;
+	h->payload_size = BK390A_PAYLOAD_SIZE;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-170022
+  Function Name	: binlog_session_record
+  Returns Type	: void
+  ----Parameter List
+  1. struct binlog_record *rec,
+  2. const struct timebase_anchor *a ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void binlog_session_record(struct binlog_record *rec, const struct timebase_anchor *a) {
+	memset(rec, 0, sizeof(struct binlog_record));
+	rec->type = BINLOG_SESSION;
+	rec->t_ns = a->t_ns;
+	rec->v.wall_ns = a->wall_ns;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-170035
+  Function Name	: binlog_reading_record
+  Returns Type	: void
+  ----Parameter List
+  1. struct binlog_record *rec,
+  2. uint8_t meter, meter id
+  3. uint64_t t_ns, monotonic time stamp of the frame
+  4. const uint8_t *raw, frame payload, at least BK390A_PAYLOAD_SIZE bytes
+  5. const struct bk390a_reading *r, decoded frame
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void binlog_reading_record(struct binlog_record *rec, uint8_t meter, uint64_t t_ns, const uint8_t *raw, const struct bk390a_reading *r) {
+	rec->t_ns = t_ns;
+	rec->v.value = bk390a_value(r);
+	memcpy(rec->raw, raw, BK390A_PAYLOAD_SIZE);
+	rec->type = BINLOG_READING;
+	rec->meter = meter;
+	rec->mode = r->mode;
+	rec->unit = r->unit;
+	rec->flags = r->status;
+	rec->protocol = r->protocol;
+	rec->reserved[0] = 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-190510
+  Function Name	: binlog_outage_record
+  Returns Type	: void
+  ----Parameter List
+  1. struct binlog_record *rec,
+  2. uint8_t type, BINLOG_OUTAGE or BINLOG_RESUME
+  3. uint8_t meter, meter id
+  4. uint64_t t_ns, start or end of the outage
+  5. uint8_t cause, RECONN_LOST or RECONN_STALLED
+  6. double seconds, BINLOG_RESUME; how long it lasted ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void binlog_outage_record(struct binlog_record *rec, uint8_t type, uint8_t meter, uint64_t t_ns, uint8_t cause, double seconds) {
+	memset(rec, 0, sizeof(struct binlog_record));
+	rec->type = type;
+	rec->meter = meter;
+	rec->t_ns = t_ns;
+	rec->v.value = seconds;
+	rec->flags = cause;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-113240
+  Function Name	: binlog_open
+  Returns Type	: int
+  ----Parameter List
+  1. struct binlog *bl,
+  2. const char *fn,
+  3. uint32_t flush_ms, longest time a record is held in the buffer
+  4. const struct timebase_anchor *a, the session's, NULL for now ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = couldn't open, -2 = not a compatible log
+  Side Effects	: writes the header if the file is new, and a
+				  BINLOG_SESSION record
+  --------------------------------------------------------------------
+Comments:
+	Given the capture's own anchor, the binary log maps times to
+	wall clock exactly as the text log does, and a replay's to the
+	recording's wall clock.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int binlog_open(struct binlog *bl, const char *fn, uint32_t flush_ms, const struct timebase_anchor *a) {
+	struct binlog_header h;
+	struct timebase_anchor now;
+	long size;
+
+	bl->used = 0;
+	bl->flush_interval_ns = (uint64_t)flush_ms * 1000000ULL;
+	bl->last_flush_ns = timebase_now_ns();
+
+	bl->f = fopen(fn, "ab");
+	if (bl->f == NULL) return -1;
+
+	fseek(bl->f, 0, SEEK_END);
+	size = ftell(bl->f);
+
+	if (size == 0) {
+		binlog_header_init(&h);
+		fwrite(&h, sizeof(h), 1, bl->f);
+
+	} else {
+		/*
+		 * Appending, so make sure it's one of ours
+		 */
+		FILE *f = fopen(fn, "rb");
+
+		if ((f == NULL)
+				|| (fread(&h, sizeof(h), 1, f) != 1)
+				|| (memcmp(h.magic, BINLOG_MAGIC, sizeof(h.magic)) != 0)
+				|| (h.version != BINLOG_VERSION)
+				|| (h.record_size != BINLOG_RECORD_SIZE)) {
+			if (f) fclose(f);
+			fclose(bl->f);
+			bl->f = NULL;
+			return -2;
+		}
+		fclose(f);
+	}
+
+	if (a == NULL) {
+		timebase_anchor(&now);
+		a = &now;
+	}
+	binlog_session_record(&(bl->buf[bl->used++]), a);
+
+	return binlog_flush(bl);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-113301
+  Function Name	: binlog_append
+  Returns Type	: int
+  ----Parameter List
+  1. struct binlog *bl,
+  2. uint8_t meter, meter id
+  3. uint64_t t_ns, monotonic time stamp of the frame
+  4. const uint8_t *raw, frame payload
+  5. const struct bk390a_reading *r, decoded frame
+  ------------------
+  Exit Codes	: 0 = ok, -1 = write error
+  Side Effects	: may flush the buffer
+  --------------------------------------------------------------------
+Comments:
+	The flush interval goes by the monotonic clock, not t_ns, which
+	is the recording's own during a replay
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int binlog_append(struct binlog *bl, uint8_t meter, uint64_t t_ns, const uint8_t *raw, const struct bk390a_reading *r) {
+	if (bl->f == NULL) return -1;
+
+	binlog_reading_record(&(bl->buf[bl->used++]), meter, t_ns, raw, r);
+
+	if ((bl->used == BINLOG_BUFFER_RECORDS)
+			|| (timebase_now_ns() - bl->last_flush_ns >= bl->flush_interval_ns)) {
+		return binlog_flush(bl);
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-113308
+  Function Name	: binlog_due
+  Returns Type	: uint64_t
+  ----Parameter List
+  1. const struct binlog *bl ,
+  ------------------
+  Exit Codes	: monotonic ns the buffer is due to be flushed, 0 = empty
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	For the caller's timer; records are otherwise only flushed as
+	the next one is appended, which may be never on an idle port.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+uint64_t binlog_due(const struct binlog *bl) {
+	if ((bl->f == NULL) || (bl->used == 0)) return 0;
+
+	return bl->last_flush_ns + bl->flush_interval_ns;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-113311
+  Function Name	: binlog_tick
+  Returns Type	: int
+  ----Parameter List
+  1. struct binlog *bl,
+  2. uint64_t now_ns, monotonic ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = write error
+  Side Effects	: flushes the buffer if it's due
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int binlog_tick(struct binlog *bl, uint64_t now_ns) {
+	uint64_t due = binlog_due(bl);
+
+	if ((due == 0) || (now_ns < due)) return 0;
+
+	return binlog_flush(bl);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-190524
+  Function Name	: binlog_append_outage
+  Returns Type	: int
+  ----Parameter List
+  1. struct binlog *bl,
+  2. uint8_t type, BINLOG_OUTAGE or BINLOG_RESUME
+  3. uint8_t meter, meter id
+  4. uint64_t t_ns, start or end of the outage
+  5. uint8_t cause, RECONN_LOST or RECONN_STALLED
+  6. double seconds, BINLOG_RESUME; how long it lasted ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = write error
+  Side Effects	: flushes the buffer
+  --------------------------------------------------------------------
+Comments:
+	Flushed straight away, whatever led up to an outage is worth
+	having on disk
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int binlog_append_outage(struct binlog *bl, uint8_t type, uint8_t meter, uint64_t t_ns, uint8_t cause, double seconds) {
+	if (bl->f == NULL) return -1;
+
+	binlog_outage_record(&(bl->buf[bl->used++]), type, meter, t_ns, cause, seconds);
+
+	return binlog_flush(bl);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-113315
+  Function Name	: binlog_flush
+  Returns Type	: int
+  ----Parameter List
+  1. struct binlog *bl ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = write error
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int binlog_flush(struct binlog *bl) {
+	int r = 0;
+
+	if (bl->f == NULL) return -1;
+
+	if (bl->used) {
+		if (fwrite(bl->buf, sizeof(struct binlog_record), bl->used, bl->f) != (size_t)bl->used) r = -1;
+		bl->used = 0;
+	}
+	if (fflush(bl->f) != 0) r = -1;
+	bl->last_flush_ns = timebase_now_ns();
+
+	return r;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-113327
+  Function Name	: binlog_close
+  Returns Type	: void
+  ----Parameter List
+  1. struct binlog *bl ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void binlog_close(struct binlog *bl) {
+	if (bl->f == NULL) return;
+
+	binlog_flush(bl);
+	fclose(bl->f);
+	bl->f = NULL;
+}
@@ -0,0 +1,94 @@
+/*
+ * Compact binary log
+ *
+ * A 64 byte header describing the schema followed by fixed size 32
+ * byte records, all little-endian.  Records are buffered and written
+ * out when the buffer fills or the flush interval has passed, rather
+ * than an fprintf/fflush per sample.  The writer calls binlog_tick()
+ * by binlog_due() so a quiet meter's last readings still go out.
+ *
+ * Record timestamps are monotonic nanoseconds (timebase_now_ns()); each
+ * time a capture session opens the log a BINLOG_SESSION record is
+ * written holding the wall clock (Unix epoch ns) at that moment, so
+ * readers can map timestamps back to wall time and sessions can be
+ * appended to the same file.
+ *
+ */
+#ifndef __BK390A_BINLOG_H__
+#define __BK390A_BINLOG_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include "decode.h"
+#include "timebase.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BINLOG_MAGIC "BK390LOG"
+#define BINLOG_VERSION 1
+#define BINLOG_HEADER_SIZE 64
+#define BINLOG_RECORD_SIZE 32
+#define BINLOG_BUFFER_RECORDS 2048
+#define BINLOG_DEFAULT_FLUSH_MS 1000
+
+/*
+ * Record types
+ */
+#define BINLOG_READING 0
+#define BINLOG_SESSION 1	// wall clock anchor, value holds wall_ns
+#define BINLOG_OUTAGE 2		// no readings from t_ns, flags holds the cause (RECONN_*)
+#define BINLOG_RESUME 3		// readings again from t_ns, value holds the outage's seconds
+
+struct binlog_header {
+	char magic[8];			// BINLOG_MAGIC, not terminated
+	uint16_t version;
+	uint16_t header_size;
+	uint16_t record_size;
+	uint16_t payload_size;	// raw frame bytes per record, BK390A_PAYLOAD_SIZE
+	uint8_t reserved[48];
+};
+
+struct binlog_record {
+	uint64_t t_ns;			// monotonic ns
+	union {
+		double value;		// reading value in SI base units (V, A, Ohm...)
+		int64_t wall_ns;	// BINLOG_SESSION; Unix epoch ns at t_ns
+	} v;
+	uint8_t raw[BK390A_PAYLOAD_SIZE];	// frame payload as received, the first 9 bytes of longer ones
+	uint8_t type;			// BINLOG_READING, BINLOG_SESSION, BINLOG_OUTAGE, BINLOG_RESUME
+	uint8_t meter;			// meter id, 1.. (0 for single meter tools)
+	uint8_t mode;			// enum bk390a_mode
+	uint8_t unit;			// enum bk390a_unit
+	uint8_t flags;			// STATUS_* bits
+	uint8_t protocol;		// enum bk390a_protocol the raw payload is in, 0 = 390A
+	uint8_t reserved[1];
+};
+
+struct binlog {
+	FILE *f;
+	uint64_t flush_interval_ns;
+	uint64_t last_flush_ns;
+	int used;
+	struct binlog_record buf[BINLOG_BUFFER_RECORDS];
+};
+
+void binlog_header_init(struct binlog_header *h);
+void binlog_session_record(struct binlog_record *rec, const struct timebase_anchor *a);
+void binlog_reading_record(struct binlog_record *rec, uint8_t meter, uint64_t t_ns, const uint8_t *raw, const struct bk390a_reading *r);
+void binlog_outage_record(struct binlog_record *rec, uint8_t type, uint8_t meter, uint64_t t_ns, uint8_t cause, double seconds);
+
+int binlog_open(struct binlog *bl, const char *fn, uint32_t flush_ms, const struct timebase_anchor *a);
+int binlog_append(struct binlog *bl, uint8_t meter, uint64_t t_ns, const uint8_t *raw, const struct bk390a_reading *r);
+int binlog_append_outage(struct binlog *bl, uint8_t type, uint8_t meter, uint64_t t_ns, uint8_t cause, double seconds);
+uint64_t binlog_due(const struct binlog *bl);
+int binlog_tick(struct binlog *bl, uint64_t now_ns);
+int binlog_flush(struct binlog *bl);
+void binlog_close(struct binlog *bl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,502 @@
+/*
+ * BK Precision Model 390A reading archive tool
+ *
+ * Converts -l text logs to the compressed archive format (archive.h)
+ * and back, and lists an archive's block index.  Converting a log to
+ * an archive and back gives the same log, byte for byte.
+ *
+ * Build;
+ *		make bk390a-arc
+ *
+ * Run;
+ *		./bk390a-arc -c soak.log soak.arc
+ *		./bk390a-arc -x soak.arc > soak.log
+ *		./bk390a-arc -i soak.arc
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "decode.h"
+#include "archive.h"
+#include "timebase.h"
+
+char VERSION[] = "v0.1-Alpha";
+char help[] = " [-c <text log>] [-x] [-i] [-q] <archive>\r\n"\
+			   "\n"\
+			   "\t\tBK-Precision 390A reading archive tool\r\n"\
+			   "\r\n"\
+			   "\t-h: This help\r\n"\
+			   "\t-c <text log>: Compress a -l text log in to (the end of) the archive, '-' for stdin\r\n"\
+			   "\t-x: Extract the archive as a -l text log on stdout\r\n"\
+			   "\t-i: List the archive's blocks; times, samples, min and max\r\n"\
+			   "\t-q: quiet, no compression summary\r\n"\
+			   "\t-v: show version\r\n"\
+			   "\n\n\texample: bk390a-arc -c soak.log soak.arc\r\n"\
+			   "\r\n";
+
+struct glb {
+	uint8_t quiet;
+	uint8_t extract;
+	uint8_t index;
+	char *log_filename;
+	char *arc_filename;
+};
+
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-161010
+  Function Name	: init
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int init( struct glb *g ) {
+	g->quiet = 0;
+	g->extract = 0;
+	g->index = 0;
+	g->log_filename = NULL;
+	g->arc_filename = NULL;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-161022
+  Function Name	: parse_parameters
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g,
+  2.  int argc,
+  3.  char **argv ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int parse_parameters( struct glb *g, int argc, char **argv ) {
+	int i;
+
+	for (i = 1; i < argc; i++) {
+
+		if ((argv[i][0] == '-') && argv[i][1]) {
+
+			/* parameter */
+			switch (argv[i][1]) {
+				case 'h':
+					fprintf(stdout,"Usage: %s %s", argv[0], help);
+					exit(1);
+					break;
+
+				case 'c':
+					i++;
+					if (i < argc) g->log_filename = argv[i];
+					else {
+						fprintf(stderr,"Require text log filename; -c <text log>\n");
+						exit(1);
+					}
+					break;
+
+				case 'x':
+					g->extract = 1;
+					break;
+
+				case 'i':
+					g->index = 1;
+					break;
+
+				case 'q':
+					g->quiet = 1;
+					break;
+
+				case 'v':
+					fprintf(stdout,"%s\r\n", VERSION);
+					exit(0);
+					break;
+
+				default:
+					break;
+			} // switch
+
+		} else {
+			g->arc_filename = argv[i];
+		}
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-161035
+  Function Name	: parse_seconds
+  Returns Type	: char *
+  ----Parameter List
+  1. char *p,
+  2. int64_t *t, ticks
+  ------------------
+  Exit Codes	: past the number, NULL if there isn't one
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	'12.345' is 12345 ticks, older logs' '12.3' is 12300
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+char *parse_seconds( char *p, int64_t *t ) {
+	int64_t s = 0, ms = 0;
+	int n = 0, dp = 0;
+
+	while ((*p >= '0') && (*p <= '9')) { s = s * 10 + (*p++ - '0'); n++; }
+	if (*p == '.') {
+		p++;
+		while ((*p >= '0') && (*p <= '9')) {
+			if (dp < 3) { ms = ms * 10 + (*p - '0'); dp++; }
+			p++;
+		}
+	}
+	if (n == 0) return NULL;
+	while (dp++ < 3) ms *= 10;
+
+	*t = s * 1000 + ms;
+
+	return p;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-161048
+  Function Name	: parse_value
+  Returns Type	: char *
+  ----Parameter List
+  1. char *p,
+  2. struct arc_sample *s, mantissa, exp10 and flags set
+  ------------------
+  Exit Codes	: past the value, NULL if it isn't one
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The decimal places written are the meter's resolution so they're
+	kept; '0.01230' is 1230 x 10^-5.  Whole numbers lose trailing
+	zeros to the exponent, '1230000' is 123 x 10^4, which prints the
+	same.  A zero with no point keeps the previous exponent so that
+	it doesn't start a new state.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+char *parse_value( char *p, struct arc_sample *s ) {
+	int64_t m = 0;
+	int neg = 0, n = 0, dp = -1;
+
+	if (strncmp(p, "O.L.", 4) == 0) {
+		s->mantissa = 0;
+		s->flags = STATUS_OL;
+		return p + 4;
+	}
+
+	if (*p == '-') { neg = 1; p++; }
+	while (((*p >= '0') && (*p <= '9')) || ((*p == '.') && (dp < 0))) {
+		if (*p == '.') dp = 0;
+		else {
+			m = m * 10 + (*p - '0');
+			if (dp >= 0) dp++;
+			n++;
+			if (m > 999999999) return NULL;
+		}
+		p++;
+	}
+	if (n == 0) return NULL;
+
+	s->flags = 0;
+	if (dp > 0) {
+		s->exp10 = -dp;
+	} else if (m == 0) {
+		if (s->exp10 < 0) s->exp10 = 0;
+	} else {
+		s->exp10 = 0;
+		while ((m % 10) == 0) { m /= 10; s->exp10++; }
+	}
+	s->mantissa = (int32_t)(neg ? -m : m);
+
+	return p;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-161100
+  Function Name	: compress
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	: 0 = ok, 1 = couldn't
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Each '# session ... wall_ns <n>' line starts a session anchored
+	at that wall time.  Logs from before those lines have none, a
+	time going backwards starts a new (unanchored) session instead.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int compress( struct glb *g ) {
+	struct arc a;
+	struct arc_sample s;
+	char line[1024];
+	FILE *f;
+	int64_t last_t = -1;
+	uint64_t bad = 0;
+	int i;
+
+	if (strcmp(g->log_filename, "-") == 0) f = stdin;
+	else f = fopen(g->log_filename, "r");
+	if (f == NULL) {
+		fprintf(stderr,"Couldn't open '%s'\r\n", g->log_filename);
+		return 1;
+	}
+
+	switch (arc_open(&a, g->arc_filename, 0)) {
+		case 0: break;
+		case -2: fprintf(stderr,"'%s' isn't a compatible archive\r\n", g->arc_filename); return 1;
+		default: fprintf(stderr,"Couldn't open '%s' to write/append\r\n", g->arc_filename); return 1;
+	}
+
+	memset(&s, 0, sizeof(s));
+	arc_session(&a, 0);
+
+	while (fgets(line, sizeof(line), f)) {
+		char *p, *u;
+
+		line[strcspn(line, "\r\n")] = '\0';
+
+		if (line[0] == '#') {
+			p = strstr(line, " wall_ns ");
+			if ((strncmp(line, "# session ", 10) == 0) && p) {
+				arc_session(&a, strtoll(p + 9, NULL, 10));
+				last_t = -1;
+			}
+			continue;
+		}
+
+		p = parse_seconds(line, &(s.t));
+		if ((p == NULL) || (*p != ' ')) { bad++; continue; }
+		p = parse_value(p + 1, &s);
+		if ((p == NULL) || (*p != ' ')) { bad++; continue; }
+
+		u = p + 1;
+		for (i = 0; i < BK390A_UNIT_COUNT; i++) {
+			if (strcmp(u, bk390a_unit_str[i]) == 0) break;
+		}
+		if (i == BK390A_UNIT_COUNT) { bad++; continue; }
+		s.unit = i;
+
+		if (s.t < last_t) arc_session(&a, 0);
+		last_t = s.t;
+
+		if (arc_append(&a, &s) != 0) {
+			fprintf(stderr,"Error writing to '%s'\r\n", g->arc_filename);
+			return 1;
+		}
+	}
+
+	if (f != stdin) fclose(f);
+	arc_close(&a);
+
+	if (!g->quiet) {
+		fprintf(stderr,"%llu readings, %llu bytes, %0.2f bytes/reading (%llu lines not understood)\r\n"
+				, (unsigned long long)a.samples
+				, (unsigned long long)a.bytes
+				, a.samples ? (double)a.bytes / a.samples : 0.0
+				, (unsigned long long)bad
+			   );
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-161112
+  Function Name	: extract
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	: 0 = ok, 1 = couldn't, 2 = archive damaged
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Same line format as bk390a -l writes
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int extract( struct glb *g ) {
+	struct arc_reader ar;
+	struct arc_sample s;
+	char value[64], wall[64];
+	uint64_t blocks = 0;
+	int r;
+
+	switch (arc_reader_open(&ar, g->arc_filename)) {
+		case 0: break;
+		case -2: fprintf(stderr,"'%s' isn't a compatible archive\r\n", g->arc_filename); return 1;
+		default: fprintf(stderr,"Couldn't open '%s'\r\n", g->arc_filename); return 1;
+	}
+
+	while ((r = arc_next_block(&ar, 1)) == 1) {
+		if ((ar.h.flags & ARC_BLOCK_SESSION) && ar.h.wall_ns) {
+			timebase_wall_str(ar.h.wall_ns, wall, sizeof(wall));
+			fprintf(stdout, "# session %s wall_ns %lld\n", wall, (long long)ar.h.wall_ns);
+		}
+
+		while ((r = arc_next(&ar, &s)) == 1) {
+			if (s.flags & STATUS_OL) snprintf(value, sizeof(value), "O.L.");
+			else arc_value_str(&s, value, sizeof(value));
+
+			fprintf(stdout, "%lld.%03lld %s %s\n"
+					, (long long)(s.t / 1000)
+					, (long long)(s.t % 1000)
+					, value
+					, bk390a_unit_str[s.unit]
+				   );
+		}
+		if (r < 0) break;
+		blocks++;
+	}
+
+	arc_reader_close(&ar);
+
+	if (r < 0) {
+		fprintf(stderr,"'%s' is damaged at block %llu, stopped there\r\n", g->arc_filename, (unsigned long long)blocks);
+		return 2;
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-161125
+  Function Name	: list_index
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	: 0 = ok, 1 = couldn't, 2 = archive damaged
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Only the block headers are read
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int list_index( struct glb *g ) {
+	struct arc_reader ar;
+	char from[64], to[64];
+	uint64_t blocks = 0, samples = 0, bytes = ARC_HEADER_SIZE;
+	int r;
+
+	switch (arc_reader_open(&ar, g->arc_filename)) {
+		case 0: break;
+		case -2: fprintf(stderr,"'%s' isn't a compatible archive\r\n", g->arc_filename); return 1;
+		default: fprintf(stderr,"Couldn't open '%s'\r\n", g->arc_filename); return 1;
+	}
+
+	fprintf(stdout, "# block from to samples bytes min max\n");
+	while ((r = arc_next_block(&ar, 0)) == 1) {
+		if (ar.h.wall_ns) {
+			timebase_wall_str(ar.h.wall_ns + ar.h.t_first * (int64_t)ar.tick_ns, from, sizeof(from));
+			timebase_wall_str(ar.h.wall_ns + ar.h.t_last * (int64_t)ar.tick_ns, to, sizeof(to));
+		} else {
+			snprintf(from, sizeof(from), "%0.3fs", ar.h.t_first * (ar.tick_ns / 1e9));
+			snprintf(to, sizeof(to), "%0.3fs", ar.h.t_last * (ar.tick_ns / 1e9));
+		}
+
+		fprintf(stdout, "%llu%s %s %s %u %u"
+				, (unsigned long long)blocks
+				, (ar.h.flags & ARC_BLOCK_SESSION) ? "*" : ""
+				, from
+				, to
+				, ar.h.samples
+				, ar.h.bytes + ARC_BLOCK_HEADER_SIZE
+			   );
+		if (ar.h.values) fprintf(stdout, " %0.9g %0.9g\n", ar.h.min, ar.h.max);
+		else fprintf(stdout, " O.L. O.L.\n");
+
+		blocks++;
+		samples += ar.h.samples;
+		bytes += ar.h.bytes + ARC_BLOCK_HEADER_SIZE;
+	}
+
+	arc_reader_close(&ar);
+
+	fprintf(stdout, "# %llu blocks (* session start), %llu readings, %llu bytes, %0.2f bytes/reading\n"
+			, (unsigned long long)blocks
+			, (unsigned long long)samples
+			, (unsigned long long)bytes
+			, samples ? (double)bytes / samples : 0.0
+		   );
+
+	if (r < 0) {
+		fprintf(stderr,"'%s' is damaged after block %llu\r\n", g->arc_filename, (unsigned long long)blocks);
+		return 2;
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-161138
+  Function Name	: main
+  Returns Type	: int
+  ----Parameter List
+  1. int argc,
+  2.  char **argv ,
+  ------------------
+  Exit Codes	: 0 = ok, 1 = couldn't, 2 = archive damaged
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int main( int argc, char **argv ) {
+	struct glb g;
+
+	init( &g );
+	parse_parameters( &g, argc, argv );
+
+	if ((g.arc_filename == NULL) || ((g.log_filename == NULL) && !g.extract && !g.index)) {
+		fprintf(stdout,"Usage: %s %s", argv[0], help);
+		exit(1);
+	}
+
+	if (g.log_filename && compress( &g )) return 1;
+	if (g.extract) return extract( &g );
+	if (g.index) return list_index( &g );
+
+	return 0;
+}
@@ -0,0 +1,680 @@
+/*
+ * BK Precision Model 390A binary log query tool
+ *
+ * Answers time-range, min/max/mean and threshold-crossing queries on
+ * the -b binary logs written by bk390a/bk390ad without reading the
+ * whole file.  The log is mmap()ed and a sparse index of wall clock
+ * time every QUERY_INDEX_STRIDE records is kept beside it in
+ * <log>.idx, so repeated queries go straight to the right block.  The
+ * index is extended, not rebuilt, when the log has grown.
+ *
+ * Build on Linux;
+ *		make bk390a-query
+ *
+ * Run;
+ *		./bk390a-query -f "14:02" -t "14:05" -m 3 rack.bin
+ *		./bk390a-query -f "2026-10-16 14:02" -t "2026-10-16 14:05" -S rack.bin
+ *		./bk390a-query -x 4.5 -m 1 -u V rack.bin
+ *
+ * With -D every reading is decoded again from the raw frame stored in
+ * its record, a block of records at a time through the batch decoder,
+ * rather than taking the value the capture decoded; for logs written
+ * before a decoder fix.
+ *
+ */
+
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "decode.h"
+#include "decbatch.h"
+#include "binlog.h"
+#include "reconn.h"
+
+#define QUERY_INDEX_MAGIC "BK390IDX"
+#define QUERY_INDEX_VERSION 1
+#define QUERY_INDEX_STRIDE 1024
+#define QUERY_DECODE_BLOCK 4096	// records per bk390a_decode_batch(), -D
+
+char VERSION[] = "v0.1-Alpha";
+char help[] = " [-f <time>] [-t <time>] [-m <meter>] [-u <unit>] [-S] [-x <threshold>] [-D] [-r] [-q] <binary log>\r\n"\
+			   "\n"\
+			   "\t\tBK-Precision 390A binary log query tool\r\n"\
+			   "\r\n"\
+			   "\t-h: This help\r\n"\
+			   "\t-f <time>: From time, 'YYYY-MM-DD HH:MM[:SS]', 'HH:MM[:SS]' (on the log's first day) or '@<unix seconds>'\r\n"\
+			   "\t-t <time>: To time, same formats as -f\r\n"\
+			   "\t-m <meter>: Only readings from this meter id\r\n"\
+			   "\t-u <unit>: Only readings in this unit; V, A, ohm, Hz, rpm, F, C or 'F\r\n"\
+			   "\t-S: Statistics only; count, min, max, mean, for each unit\r\n"\
+			   "\t-x <threshold>: Report the times the value crosses the threshold, within one unit\r\n"\
+			   "\t-D: Decode the readings again from their raw frames, rather than use the logged values\r\n"\
+			   "\t-r: Rebuild the index\r\n"\
+			   "\t-q: quiet, no index build messages\r\n"\
+			   "\t-v: show version\r\n"\
+			   "\n\n\texample: bk390a-query -f 14:02 -t 14:05 -m 3 rack.bin\r\n"\
+			   "\r\n";
+
+struct index_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t stride;
+	uint64_t log_records;	// records covered when the index was written
+	uint64_t entries;
+};
+
+struct index_entry {
+	int64_t wall_ns;		// wall time of the block's first record
+	uint64_t record;		// first record of the block
+	uint64_t anchor_t_ns;	// session anchor in force at the block start
+	int64_t anchor_wall_ns;
+};
+
+struct glb {
+	uint8_t quiet;
+	uint8_t stats_only;
+	uint8_t crossings;
+	uint8_t rebuild;
+	uint8_t redecode;
+	int meter;				// -1 = all
+	int unit;				// -1 = all
+
+	int64_t from_ns, to_ns;	// wall time range
+	char *from_str, *to_str;
+	double threshold;
+
+	char *log_filename;
+};
+
+struct logmap {
+	const uint8_t *base;
+	size_t size;
+	uint64_t records;
+	const struct binlog_record *rec;
+};
+
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-120110
+  Function Name	: init
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int init( struct glb *g ) {
+	g->quiet = 0;
+	g->stats_only = 0;
+	g->crossings = 0;
+	g->rebuild = 0;
+	g->redecode = 0;
+	g->meter = -1;
+	g->unit = -1;
+	g->from_ns = INT64_MIN;
+	g->to_ns = INT64_MAX;
+	g->from_str = g->to_str = NULL;
+	g->threshold = 0.0;
+	g->log_filename = NULL;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-120116
+  Function Name	: parse_unit
+  Returns Type	: int
+  ----Parameter List
+  1. const char *s ,
+  ------------------
+  Exit Codes	: BK390A_UNIT_*, -1 = not a unit
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	As the readings print them, or ohm, C and F ('F is Fahrenheit)
+	for the ones awkward to type.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int parse_unit( const char *s ) {
+	int u;
+
+	if (strcasecmp(s, "ohm") == 0) return BK390A_UNIT_OHM;
+	if (strcmp(s, "C") == 0) return BK390A_UNIT_DEGC;
+	for (u = BK390A_UNIT_NONE +1; u < BK390A_UNIT_COUNT; u++) {
+		if (strcmp(s, bk390a_unit_str[u]) == 0) return u;
+	}
+
+	return -1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-120122
+  Function Name	: parse_parameters
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g,
+  2.  int argc,
+  3.  char **argv ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int parse_parameters( struct glb *g, int argc, char **argv ) {
+	int i;
+
+	for (i = 1; i < argc; i++) {
+
+		if (argv[i][0] == '-') {
+
+			/* parameter */
+			switch (argv[i][1]) {
+				case 'h':
+					fprintf(stdout,"Usage: %s %s", argv[0], help);
+					exit(1);
+					break;
+
+				case 'f':
+				case 't':
+				case 'm':
+				case 'u':
+				case 'x':
+					if (i +1 >= argc) {
+						fprintf(stderr,"Insufficient parameters; -%c <value>\n", argv[i][1]);
+						exit(1);
+					}
+					if (argv[i][1] == 'f') g->from_str = argv[i+1];
+					else if (argv[i][1] == 't') g->to_str = argv[i+1];
+					else if (argv[i][1] == 'm') g->meter = atoi(argv[i+1]);
+					else if (argv[i][1] == 'u') {
+						g->unit = parse_unit(argv[i+1]);
+						if (g->unit < 0) {
+							fprintf(stderr,"Unknown unit '%s'\r\n", argv[i+1]);
+							exit(1);
+						}
+					}
+					else { g->threshold = strtod(argv[i+1], NULL); g->crossings = 1; }
+					i++;
+					break;
+
+				case 'S': g->stats_only = 1; break;
+				case 'r': g->rebuild = 1; break;
+				case 'D': g->redecode = 1; break;
+				case 'q': g->quiet = 1; break;
+
+				case 'v':
+					fprintf(stdout,"%s\r\n", VERSION);
+					exit(0);
+					break;
+
+				default:
+					break;
+			} // switch
+
+		} else {
+			g->log_filename = argv[i];
+		}
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-120140
+  Function Name	: parse_time
+  Returns Type	: int
+  ----Parameter List
+  1. const char *s,
+  2. int64_t day_ns, wall time on the day to use for HH:MM forms
+  3. int64_t *ns, result
+  ------------------
+  Exit Codes	: 0 = ok, -1 = not understood
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Times are local time.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int parse_time( const char *s, int64_t day_ns, int64_t *ns ) {
+	struct tm tm;
+	const char *e;
+	time_t t;
+
+	if (s[0] == '@') {
+		*ns = (int64_t)(strtod(s +1, NULL) * 1e9);
+		return 0;
+	}
+
+	memset(&tm, 0, sizeof(tm));
+	if (((e = strptime(s, "%Y-%m-%d %H:%M:%S", &tm)) == NULL) || *e) {
+		memset(&tm, 0, sizeof(tm));
+		if (((e = strptime(s, "%Y-%m-%d %H:%M", &tm)) == NULL) || *e) {
+			time_t day = day_ns / 1000000000LL;
+
+			localtime_r(&day, &tm);
+			tm.tm_sec = 0;
+			if ((((e = strptime(s, "%H:%M:%S", &tm)) == NULL) || *e)
+					&& (((e = strptime(s, "%H:%M", &tm)) == NULL) || *e)) {
+				return -1;
+			}
+		}
+	}
+
+	tm.tm_isdst = -1;
+	t = mktime(&tm);
+	*ns = (int64_t)t * 1000000000LL;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-120155
+  Function Name	: format_time
+  Returns Type	: char *
+  ----Parameter List
+  1. int64_t ns, wall time
+  2. char *buf,
+  3. size_t len ,
+  ------------------
+  Exit Codes	: buf
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+char *format_time( int64_t ns, char *buf, size_t len ) {
+	time_t t = ns / 1000000000LL;
+	struct tm tm;
+	size_t n;
+
+	localtime_r(&t, &tm);
+	n = strftime(buf, len, "%Y-%m-%d %H:%M:%S", &tm);
+	snprintf(buf +n, len -n, ".%03d", (int)((ns % 1000000000LL) / 1000000));
+
+	return buf;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-120210
+  Function Name	: index_build
+  Returns Type	: struct index_entry *
+  ----Parameter List
+  1. struct glb *g,
+  2. const struct logmap *lm,
+  3. uint64_t *count, number of entries
+  ------------------
+  Exit Codes	: index entries (malloc'd), NULL on error
+  Side Effects	: writes <log>.idx
+  --------------------------------------------------------------------
+Comments:
+	An existing index is reused as-is if it covers the whole log,
+	extended from its last block if the log has grown, and rebuilt
+	if it doesn't match (or -r).
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+struct index_entry *index_build( struct glb *g, const struct logmap *lm, uint64_t *count ) {
+	struct index_header h;
+	struct index_entry *idx = NULL;
+	uint64_t n = 0, alloc, r;
+	uint64_t anchor_t = 0;
+	int64_t anchor_wall = 0;
+	char fn[4096];
+	FILE *f;
+
+	snprintf(fn, sizeof(fn), "%s.idx", g->log_filename);
+	alloc = lm->records / QUERY_INDEX_STRIDE + 2;
+	idx = malloc(alloc * sizeof(struct index_entry));
+	if (idx == NULL) return NULL;
+
+	/*
+	 * Try the cached index first
+	 */
+	f = fopen(fn, "rb");
+	if (f && !g->rebuild) {
+		if ((fread(&h, sizeof(h), 1, f) == 1)
+				&& (memcmp(h.magic, QUERY_INDEX_MAGIC, sizeof(h.magic)) == 0)
+				&& (h.version == QUERY_INDEX_VERSION)
+				&& (h.stride == QUERY_INDEX_STRIDE)
+				&& (h.log_records <= lm->records)
+				&& (h.entries <= alloc)
+				&& (fread(idx, sizeof(struct index_entry), h.entries, f) == h.entries)) {
+			n = h.entries;
+			if (h.log_records == lm->records) {
+				fclose(f);
+				*count = n;
+				return idx;
+			}
+		}
+	}
+	if (f) fclose(f);
+
+	/*
+	 * (Re)index from the start of the last, possibly partial, block
+	 */
+	r = 0;
+	if (n > 0) {
+		n--;
+		r = idx[n].record;
+		anchor_t = idx[n].anchor_t_ns;
+		anchor_wall = idx[n].anchor_wall_ns;
+	}
+
+	if (!g->quiet) fprintf(stderr,"Indexing %s from record %llu\r\n", g->log_filename, (unsigned long long)r);
+
+	for (; r < lm->records; r++) {
+		const struct binlog_record *rec = &(lm->rec[r]);
+
+		if ((r % QUERY_INDEX_STRIDE) == 0) {
+			idx[n].record = r;
+			idx[n].anchor_t_ns = anchor_t;
+			idx[n].anchor_wall_ns = anchor_wall;
+			if (rec->type == BINLOG_SESSION) idx[n].wall_ns = rec->v.wall_ns;
+			else idx[n].wall_ns = anchor_wall + (int64_t)(rec->t_ns - anchor_t);
+			n++;
+		}
+
+		if (rec->type == BINLOG_SESSION) {
+			anchor_t = rec->t_ns;
+			anchor_wall = rec->v.wall_ns;
+		}
+	}
+
+	f = fopen(fn, "wb");
+	if (f) {
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, QUERY_INDEX_MAGIC, sizeof(h.magic));
+		h.version = QUERY_INDEX_VERSION;
+		h.stride = QUERY_INDEX_STRIDE;
+		h.log_records = lm->records;
+		h.entries = n;
+		fwrite(&h, sizeof(h), 1, f);
+		fwrite(idx, sizeof(struct index_entry), n, f);
+		fclose(f);
+	} else if (!g->quiet) {
+		fprintf(stderr,"Couldn't write index '%s' (%s), continuing without caching it\r\n", fn, strerror(errno));
+	}
+
+	*count = n;
+
+	return idx;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-120230
+  Function Name	: main
+  Returns Type	: int
+  ----Parameter List
+  1. int argc,
+  2.  char **argv ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int main( int argc, char **argv ) {
+	struct glb g;
+	struct logmap lm;
+	const struct binlog_header *h;
+	struct index_entry *idx;
+	uint64_t entries, r, lo, hi;
+	uint64_t anchor_t;
+	int64_t anchor_wall;
+	uint64_t count[BK390A_UNIT_COUNT];	// -S, each unit separately
+	double vmin[BK390A_UNIT_COUNT], vmax[BK390A_UNIT_COUNT], sum[BK390A_UNIT_COUNT];
+	uint64_t total = 0;
+	static int16_t b_count[QUERY_DECODE_BLOCK];
+	static int8_t b_exp10[QUERY_DECODE_BLOCK];
+	static uint8_t b_unit[QUERY_DECODE_BLOCK], b_mode[QUERY_DECODE_BLOCK], b_flags[QUERY_DECODE_BLOCK];
+	struct bk390a_batch b = { b_count, b_exp10, b_unit, b_mode, b_flags };
+	uint64_t block = 0, block_end = 0, rejected = 0;
+	int last_side[256];
+	uint8_t last_unit[256];
+	struct stat st;
+	char tbuf[64];
+	int fd, i;
+
+	if (argc == 1) {
+		fprintf(stdout,"Usage: %s %s", argv[0], help);
+		exit(1);
+	}
+
+	init( &g );
+	parse_parameters( &g, argc, argv );
+
+	if (g.log_filename == NULL) {
+		fprintf(stderr,"Require a binary log file\r\n");
+		exit(1);
+	}
+
+	fd = open(g.log_filename, O_RDONLY);
+	if ((fd < 0) || (fstat(fd, &st) != 0)) {
+		fprintf(stderr,"Couldn't open '%s' (%s)\r\n", g.log_filename, strerror(errno));
+		exit(1);
+	}
+
+	if (st.st_size < BINLOG_HEADER_SIZE) {
+		fprintf(stderr,"'%s' is too short to be a binary log\r\n", g.log_filename);
+		exit(1);
+	}
+
+	lm.size = st.st_size;
+	lm.base = mmap(NULL, lm.size, PROT_READ, MAP_SHARED, fd, 0);
+	if (lm.base == MAP_FAILED) {
+		fprintf(stderr,"Couldn't mmap '%s' (%s)\r\n", g.log_filename, strerror(errno));
+		exit(1);
+	}
+	close(fd);
+
+	h = (const struct binlog_header *)lm.base;
+	if ((memcmp(h->magic, BINLOG_MAGIC, sizeof(h->magic)) != 0)
+			|| (h->version != BINLOG_VERSION)
+			|| (h->record_size != BINLOG_RECORD_SIZE)) {
+		fprintf(stderr,"'%s' isn't a compatible binary log\r\n", g.log_filename);
+		exit(1);
+	}
+
+	lm.rec = (const struct binlog_record *)(lm.base + h->header_size);
+	lm.records = (lm.size - h->header_size) / BINLOG_RECORD_SIZE;
+
+	idx = index_build( &g, &lm, &entries );
+	if (idx == NULL) {
+		fprintf(stderr,"Couldn't build the index\r\n");
+		exit(1);
+	}
+	if (entries == 0) return 0;
+
+	/*
+	 * Resolve the -f/-t times, HH:MM forms are on the log's first day
+	 */
+	if (g.from_str && parse_time(g.from_str, idx[0].wall_ns, &g.from_ns) != 0) {
+		fprintf(stderr,"Couldn't understand time '%s'\r\n", g.from_str);
+		exit(1);
+	}
+	if (g.to_str && parse_time(g.to_str, idx[0].wall_ns, &g.to_ns) != 0) {
+		fprintf(stderr,"Couldn't understand time '%s'\r\n", g.to_str);
+		exit(1);
+	}
+
+	/*
+	 * Binary search for the last block starting before -f
+	 */
+	lo = 0;
+	hi = entries;
+	while (hi - lo > 1) {
+		uint64_t mid = (lo + hi) / 2;
+
+		if (idx[mid].wall_ns <= g.from_ns) lo = mid;
+		else hi = mid;
+	}
+
+	anchor_t = idx[lo].anchor_t_ns;
+	anchor_wall = idx[lo].anchor_wall_ns;
+	for (i = 0; i < 256; i++) last_side[i] = -1;
+	for (i = 0; i < BK390A_UNIT_COUNT; i++) {
+		count[i] = 0;
+		vmin[i] = INFINITY;
+		vmax[i] = -INFINITY;
+		sum[i] = 0.0;
+	}
+
+	for (r = idx[lo].record; r < lm.records; r++) {
+		const struct binlog_record *rec = &(lm.rec[r]);
+		int64_t wall;
+		double value;
+		uint8_t unit, flags;
+
+		if (rec->type == BINLOG_SESSION) {
+			anchor_t = rec->t_ns;
+			anchor_wall = rec->v.wall_ns;
+			for (i = 0; i < 256; i++) last_side[i] = -1;
+			continue;
+		}
+
+		wall = anchor_wall + (int64_t)(rec->t_ns - anchor_t);
+		if (wall > g.to_ns) break;
+		if (wall < g.from_ns) continue;
+		if ((g.meter >= 0) && (rec->meter != g.meter)) continue;
+
+		/*
+		 * Outages are listed, and no crossing is reported across one
+		 */
+		if ((rec->type == BINLOG_OUTAGE) || (rec->type == BINLOG_RESUME)) {
+			last_side[rec->meter] = -1;
+			if (g.crossings || g.stats_only) continue;
+			if (rec->type == BINLOG_OUTAGE) {
+				fprintf(stdout,"%s %d outage %s\n"
+						, format_time(wall, tbuf, sizeof(tbuf))
+						, rec->meter
+						, reconn_cause_str[rec->flags ? RECONN_STALLED : RECONN_LOST]
+					   );
+			} else {
+				fprintf(stdout,"%s %d resumed after %0.3fs\n"
+						, format_time(wall, tbuf, sizeof(tbuf))
+						, rec->meter
+						, rec->v.value
+					   );
+			}
+			continue;
+		}
+		if (rec->type != BINLOG_READING) continue;
+
+		value = rec->v.value;
+		unit = rec->unit;
+		flags = rec->flags;
+
+		/*
+		 * -D; the records from here are decoded a block at a time,
+		 * the frames read in place.  Only the 390A's frames are held
+		 * whole, other protocols' readings keep their logged values.
+		 */
+		if (g.redecode && (rec->protocol == BK390A_PROTOCOL_BK390A)) {
+			if ((r < block) || (r >= block_end)) {
+				block = r;
+				block_end = (lm.records - r > QUERY_DECODE_BLOCK) ? r + QUERY_DECODE_BLOCK : lm.records;
+				bk390a_decode_batch(rec->raw, sizeof(struct binlog_record), block_end - block, &b);
+			}
+			if (b.mode[r - block] == BK390A_MODE_UNKNOWN) {
+				rejected++;
+				continue;
+			}
+			value = bk390a_batch_value(&b, r - block);
+			unit = b.unit[r - block];
+			flags = BK390A_BATCH_STATUS(b.flags[r - block]);
+		}
+		if (flags & STATUS_OL) continue;
+		if (unit >= BK390A_UNIT_COUNT) unit = BK390A_UNIT_NONE;
+		if ((g.unit >= 0) && (unit != g.unit)) continue;
+
+		count[unit]++;
+		sum[unit] += value;
+		if (value < vmin[unit]) vmin[unit] = value;
+		if (value > vmax[unit]) vmax[unit] = value;
+
+		if (g.crossings) {
+			int side = (value >= g.threshold);
+
+			/*
+			 * A change of unit (the meter's dial turned) isn't a crossing
+			 */
+			if ((last_side[rec->meter] >= 0) && (unit != last_unit[rec->meter])) last_side[rec->meter] = -1;
+			last_unit[rec->meter] = unit;
+
+			if ((last_side[rec->meter] >= 0) && (side != last_side[rec->meter])) {
+				fprintf(stdout,"%s %d %s %g %s\n"
+						, format_time(wall, tbuf, sizeof(tbuf))
+						, rec->meter
+						, side ? "rising" : "falling"
+						, value
+						, bk390a_unit_str[unit]
+					   );
+			}
+			last_side[rec->meter] = side;
+
+		} else if (!g.stats_only) {
+			fprintf(stdout,"%s %d %g %s\n"
+					, format_time(wall, tbuf, sizeof(tbuf))
+					, rec->meter
+					, value
+					, bk390a_unit_str[unit]
+				   );
+		}
+	}
+
+	if (rejected && !g.quiet) fprintf(stderr,"%llu readings rejected by this decoder\r\n", (unsigned long long)rejected);
+
+	/*
+	 * One line per unit, readings in volts and amps don't make one mean
+	 */
+	if (g.stats_only) {
+		for (i = 0; i < BK390A_UNIT_COUNT; i++) {
+			if (count[i] == 0) continue;
+			fprintf(stdout,"count %llu min %g max %g mean %g %s\n", (unsigned long long)count[i], vmin[i], vmax[i], sum[i] / count[i], bk390a_unit_str[i]);
+			total += count[i];
+		}
+		if (total == 0) fprintf(stdout,"count 0\n");
+	}
+
+	free(idx);
+	munmap((void *)lm.base, lm.size);
+
+	return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * BK Precision Model 390A latest reading reader
+ *
+ * Prints the latest reading of each meter (or just one) from the
+ * shared memory segment published by bk390a/bk390ad -M, once or
+ * repeatedly.  Doubles as an example for other tools that want
+ * "the current reading of meter N"; see shmpub_attach() and
+ * shmpub_read().
+ *
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include "decode.h"
+#include "shmpub.h"
+#include "timebase.h"
+
+char VERSION[] = "v0.1-Alpha";
+char help[] = " [-M <name>] [-m <meter>] [-w <ms>] [-h]\r\n"\
+			   "\n"\
+			   "\t\tBK-Precision 390A latest reading reader\r\n"\
+			   "\r\n"\
+			   "\t-h: This help\r\n"\
+			   "\t-M <name>: Shared memory segment name (default /bk390a)\r\n"\
+			   "\t-m <meter>: Only this meter id\r\n"\
+			   "\t-w <ms>: Watch, print again every <ms> milliseconds\r\n"\
+			   "\t-v: show version\r\n"\
+			   "\n\n\texample: bk390a-shm -m 3 -w 250\r\n"\
+			   "\r\n";
+
+struct glb {
+	char *name;
+	int meter;
+	uint32_t watch_ms;
+};
+
+uint8_t sigint_pressed;
+
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-135010
+  Function Name	: init
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int init( struct glb *g ) {
+	g->name = SHMPUB_DEFAULT_NAME;
+	g->meter = -1;
+	g->watch_ms = 0;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-135022
+  Function Name	: parse_parameters
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g,
+  2.  int argc,
+  3.  char **argv ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int parse_parameters( struct glb *g, int argc, char **argv ) {
+	int i;
+
+	for (i = 1; i < argc; i++) {
+
+		if (argv[i][0] == '-') {
+
+			/* parameter */
+			switch (argv[i][1]) {
+				case 'h':
+					fprintf(stdout,"Usage: %s %s", argv[0], help);
+					exit(1);
+					break;
+
+				case 'M':
+				case 'm':
+				case 'w':
+					if (i +1 >= argc) {
+						fprintf(stderr,"Insufficient parameters; -%c <value>\n", argv[i][1]);
+						exit(1);
+					}
+					switch (argv[i][1]) {
+						case 'M': g->name = argv[i+1]; break;
+						case 'm': g->meter = atoi(argv[i+1]); break;
+						case 'w': g->watch_ms = strtoul(argv[i+1], NULL, 10); break;
+					}
+					i++;
+					break;
+
+				case 'v':
+					fprintf(stdout,"%s\r\n", VERSION);
+					exit(0);
+					break;
+
+				default:
+					break;
+			} // switch
+		}
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-135035
+  Function Name	: handle_sigint
+  Returns Type	: void
+  ----Parameter List
+  1. int a ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void handle_sigint( int a ) {
+	sigint_pressed = 1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-135048
+  Function Name	: main
+  Returns Type	: int
+  ----Parameter List
+  1. int argc,
+  2.  char **argv ,
+  ------------------
+  Exit Codes	: 0 = ok, 1 = no segment, 2 = meter not found
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int main( int argc, char **argv ) {
+	struct glb g;
+	struct shmpub sp;
+	struct shmpub_slot s;
+	int i, found;
+
+	init( &g );
+	parse_parameters( &g, argc, argv );
+
+	switch (shmpub_attach(&sp, g.name)) {
+		case 0: break;
+		case -2: fprintf(stderr,"'%s' isn't a compatible reading segment\r\n", g.name); exit(1);
+		default: fprintf(stderr,"No reading segment '%s', is bk390a/bk390ad running with -M?\r\n", g.name); exit(1);
+	}
+
+	sigint_pressed = 0;
+	signal(SIGINT, handle_sigint);
+
+	do {
+		int64_t now = timebase_wall_ns();
+
+		found = 0;
+		for (i = 0; i < sp.h->slots; i++) {
+			if (shmpub_read(&sp, i, &s) != 0) continue;
+			if (s.readings == 0) continue;
+			if ((g.meter >= 0) && (s.meter != g.meter)) continue;
+
+			found++;
+			fprintf(stdout,"%d %.*f%s%s %s %s%s%sage %0.3fs seq %u\n"
+					, s.meter
+					, (s.dps > 0) ? s.dps : 0
+					, s.count / (double)(s.dps == 1 ? 10 : s.dps == 2 ? 100 : s.dps == 3 ? 1000 : 1)
+					, bk390a_prefix_str[BK390A_PREFIX_INDEX(s.si_exp)]
+					, bk390a_unit_str[s.unit]
+					, bk390a_mode_str[s.mode]
+					, (s.status & STATUS_OL) ? "O.L. " : ""
+					, (s.status & STATUS_BATT) ? "BATT " : ""
+					, __atomic_load_n(&(sp.h->running), __ATOMIC_ACQUIRE) ? "" : "STOPPED "
+					, (now - s.wall_ns) / 1e9
+					, s.seq
+				   );
+		}
+		fflush(stdout);
+
+		if (g.watch_ms) usleep(g.watch_ms * 1000);
+
+	} while (g.watch_ms && !sigint_pressed);
+
+	shmpub_close(&sp);
+
+	return found ? 0 : 2;
+}
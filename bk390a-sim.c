@@ -0,0 +1,623 @@
+/*
+ * BK Precision Model 390A meter simulator
+ *
+ * Creates one or more pseudo-terminals and emits valid 390A frames on
+ * them, built from the BYTE_/FUNCTION_/STATUS_/OPTION bit layouts in
+ * decode.h, so the capture, logging and display paths can be run and
+ * load tested without a meter.
+ *
+ * Build on Linux;
+ *		make bk390a-sim
+ *
+ * Run;
+ *		./bk390a-sim -n 4 -r 100 -s all -L /tmp/bk390a-sim
+ *		./bk390a -p /tmp/bk390a-sim1 -m
+ *
+ * A scenario script has one frame description per line, cycled
+ * through in order, '#' starts a comment;
+ *
+ *		<mode> <range> <count> [neg] [ol] [batt] [ac] [dc] [auto] [min] [max] [x<repeat>]
+ *
+ * where mode is one of volts, ua, ma, amps, ohms, continuity, diode,
+ * hz, rpm, cap, degc, degf, adp0..adp3, eg;
+ *
+ *		volts 1 1234 dc auto x10
+ *		volts 0 0999 neg dc
+ *		ohms 5 0000 ol
+ *
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "decode.h"
+
+#define SIM_METERS_MAX 256
+#define SIM_STEPS_MAX 1024
+#define SIM_BATCH_MAX 64	// frames written per meter per wakeup when catching up
+
+char VERSION[] = "v0.1-Alpha";
+char help[] = " [-n <meters>] [-r <frames/s>] [-s <scenario>] [-f <script>] [-L <link prefix>] [-c <frames>] [-q]\r\n"\
+			   "\n"\
+			   "\t\tBK-Precision 390A meter simulator (pseudo-terminals)\r\n"\
+			   "\r\n"\
+			   "\t-h: This help\r\n"\
+			   "\t-n <meters>: Number of simulated meters (default 1)\r\n"\
+			   "\t-r <frames/s>: Frame rate per meter (default 2, the real meter is ~2-4)\r\n"\
+			   "\t-s <scenario>: steady, sweep, modes, ranges, ol, sign, batt or all (default steady)\r\n"\
+			   "\t-f <script>: Scenario script file, see the top of bk390a-sim.c\r\n"\
+			   "\t-L <prefix>: Create symlinks <prefix>1, <prefix>2... to the pseudo-terminals\r\n"\
+			   "\t-c <frames>: Stop after this many frames per meter\r\n"\
+			   "\t-q: quiet output\r\n"\
+			   "\t-v: show version\r\n"\
+			   "\n\n\texample: bk390a-sim -n 8 -r 50 -s all -L /tmp/bk390a-sim\r\n"\
+			   "\r\n";
+
+struct step {
+	uint8_t function;
+	uint8_t range;
+	uint16_t count;
+	uint8_t status;
+	uint8_t option1;
+	uint8_t option2;
+	int repeat;
+};
+
+struct sim_meter {
+	int master, slave;
+	char path[256];
+	char link[256];
+	int step, repeat;
+	uint64_t frames, dropped;
+};
+
+struct glb {
+	uint8_t quiet;
+	int meters;
+	double rate;
+	uint64_t max_frames;
+	char *scenario;
+	char *script_filename;
+	char *link_prefix;
+
+	int step_count;
+	struct step steps[SIM_STEPS_MAX];
+	struct sim_meter m[SIM_METERS_MAX];
+};
+
+struct mode_name {
+	const char *name;
+	uint8_t function;
+	uint8_t status;
+};
+
+static const struct mode_name mode_names[] = {
+	{ "volts", FUNCTION_VOLTAGE, 0 },
+	{ "ua", FUNCTION_CURRENT_UA, 0 },
+	{ "ma", FUNCTION_CURRENT_MA, 0 },
+	{ "amps", FUNCTION_CURRENT_A, 0 },
+	{ "ohms", FUNCTION_OHMS, 0 },
+	{ "continuity", FUNCTION_CONTINUITY, 0 },
+	{ "diode", FUNCTION_DIODE, 0 },
+	{ "hz", FUNCTION_FQ_RPM, STATUS_JUDGE },
+	{ "rpm", FUNCTION_FQ_RPM, 0 },
+	{ "cap", FUNCTION_CAPACITANCE, 0 },
+	{ "degc", FUNCTION_TEMPERATURE, STATUS_JUDGE },
+	{ "degf", FUNCTION_TEMPERATURE, 0 },
+	{ "adp0", FUNCTION_ADP0, 0 },
+	{ "adp1", FUNCTION_ADP1, 0 },
+	{ "adp2", FUNCTION_ADP2, 0 },
+	{ "adp3", FUNCTION_ADP3, 0 },
+	{ NULL, 0, 0 }
+};
+
+uint8_t sigint_pressed;
+struct glb *glbs;
+
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-124010
+  Function Name	: init
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int init( struct glb *g ) {
+	g->quiet = 0;
+	g->meters = 1;
+	g->rate = 2.0;
+	g->max_frames = 0;
+	g->scenario = "steady";
+	g->script_filename = NULL;
+	g->link_prefix = NULL;
+	g->step_count = 0;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-124022
+  Function Name	: parse_parameters
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g,
+  2.  int argc,
+  3.  char **argv ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int parse_parameters( struct glb *g, int argc, char **argv ) {
+	int i;
+
+	for (i = 1; i < argc; i++) {
+
+		if (argv[i][0] == '-') {
+
+			/* parameter */
+			switch (argv[i][1]) {
+				case 'h':
+					fprintf(stdout,"Usage: %s %s", argv[0], help);
+					exit(1);
+					break;
+
+				case 'n':
+				case 'r':
+				case 's':
+				case 'f':
+				case 'L':
+				case 'c':
+					if (i +1 >= argc) {
+						fprintf(stderr,"Insufficient parameters; -%c <value>\n", argv[i][1]);
+						exit(1);
+					}
+					switch (argv[i][1]) {
+						case 'n': g->meters = atoi(argv[i+1]); break;
+						case 'r': g->rate = strtod(argv[i+1], NULL); break;
+						case 's': g->scenario = argv[i+1]; break;
+						case 'f': g->script_filename = argv[i+1]; break;
+						case 'L': g->link_prefix = argv[i+1]; break;
+						case 'c': g->max_frames = strtoull(argv[i+1], NULL, 10); break;
+					}
+					i++;
+					break;
+
+				case 'q': g->quiet = 1; break;
+
+				case 'v':
+					fprintf(stdout,"%s\r\n", VERSION);
+					exit(0);
+					break;
+
+				default:
+					break;
+			} // switch
+		}
+	}
+
+	if ((g->meters < 1) || (g->meters > SIM_METERS_MAX)) {
+		fprintf(stderr,"Meters must be 1..%d\r\n", SIM_METERS_MAX);
+		exit(1);
+	}
+	if (g->rate <= 0.0) {
+		fprintf(stderr,"Frame rate must be > 0\r\n");
+		exit(1);
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-124035
+  Function Name	: add_step
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g,
+  2. const char *line, script line
+  ------------------
+  Exit Codes	: 0 = ok/blank, -1 = not understood
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int add_step( struct glb *g, const char *line ) {
+	char buf[1024], *tok, *save, *p;
+	struct step *s;
+	int i;
+
+	snprintf(buf, sizeof(buf), "%s", line);
+	p = strchr(buf, '#');
+	if (p) *p = '\0';
+
+	tok = strtok_r(buf, " \t\r\n", &save);
+	if (tok == NULL) return 0;
+
+	if (g->step_count >= SIM_STEPS_MAX) return -1;
+	s = &(g->steps[g->step_count]);
+	memset(s, 0, sizeof(struct step));
+	s->repeat = 1;
+
+	for (i = 0; mode_names[i].name; i++) {
+		if (strcmp(tok, mode_names[i].name) == 0) break;
+	}
+	if (mode_names[i].name == NULL) return -1;
+	s->function = mode_names[i].function;
+	s->status = mode_names[i].status;
+
+	tok = strtok_r(NULL, " \t\r\n", &save);
+	if (tok == NULL) return -1;
+	s->range = atoi(tok) & 0x07;
+
+	tok = strtok_r(NULL, " \t\r\n", &save);
+	if (tok == NULL) return -1;
+	s->count = atoi(tok) % 10000;
+
+	while ((tok = strtok_r(NULL, " \t\r\n", &save))) {
+		if (strcmp(tok, "neg") == 0) s->status |= STATUS_SIGN;
+		else if (strcmp(tok, "ol") == 0) s->status |= STATUS_OL;
+		else if (strcmp(tok, "batt") == 0) s->status |= STATUS_BATT;
+		else if (strcmp(tok, "ac") == 0) s->option2 |= OPTION2_AC;
+		else if (strcmp(tok, "dc") == 0) s->option2 |= OPTION2_DC;
+		else if (strcmp(tok, "auto") == 0) s->option2 |= OPTION2_AUTO;
+		else if (strcmp(tok, "min") == 0) s->option1 |= OPTION1_PMIN;
+		else if (strcmp(tok, "max") == 0) s->option1 |= OPTION1_PMAX;
+		else if (tok[0] == 'x') s->repeat = atoi(tok +1) > 0 ? atoi(tok +1) : 1;
+		else return -1;
+	}
+
+	g->step_count++;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-124050
+  Function Name	: load_scenario
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = unknown scenario or bad script
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The built in scenarios are just scripts
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int load_scenario( struct glb *g ) {
+	static const char *steady[] = { "volts 1 1234 dc auto", NULL };
+	static const char *sweep[] = { NULL };
+	static const char *modes[] = {
+		"volts 1 1234 dc auto x4", "ua 0 2345 dc x4", "ma 0 3456 dc x4", "amps 0 0512 dc x4",
+		"ohms 2 1000 auto x4", "continuity 0 0123 x4", "diode 0 0567 x4", "hz 1 5000 x4",
+		"rpm 1 1200 x4", "cap 3 0470 x4", "degc 0 0025 x4", "degf 0 0077 x4", NULL };
+	static const char *ranges[] = {
+		"volts 0 3999 dc x4", "volts 1 3999 dc x4", "volts 2 3999 dc x4", "volts 3 3999 dc x4", "volts 4 1000 dc x4",
+		"ohms 0 3999 x4", "ohms 1 3999 x4", "ohms 2 3999 x4", "ohms 3 3999 x4", "ohms 4 3999 x4", "ohms 5 3999 x4", NULL };
+	static const char *ol[] = { "ohms 5 1234 x4", "ohms 5 0000 ol x4", NULL };
+	static const char *sign[] = { "volts 1 1234 dc x2", "volts 1 1234 dc neg x2", NULL };
+	static const char *batt[] = { "volts 1 1234 dc x8", "volts 1 1234 dc batt x8", NULL };
+	const char **lines = NULL;
+	int i;
+
+	if (g->script_filename) {
+		FILE *f = fopen(g->script_filename, "r");
+		char line[1024];
+		int n = 0;
+
+		if (f == NULL) {
+			fprintf(stderr,"Couldn't open script '%s' (%s)\r\n", g->script_filename, strerror(errno));
+			return -1;
+		}
+		while (fgets(line, sizeof(line), f)) {
+			n++;
+			if (add_step(g, line) != 0) {
+				fprintf(stderr,"%s:%d: couldn't understand '%s'\r\n", g->script_filename, n, line);
+				fclose(f);
+				return -1;
+			}
+		}
+		fclose(f);
+		return g->step_count ? 0 : -1;
+	}
+
+	if (strcmp(g->scenario, "steady") == 0) lines = steady;
+	else if (strcmp(g->scenario, "sweep") == 0) lines = sweep;
+	else if (strcmp(g->scenario, "modes") == 0) lines = modes;
+	else if (strcmp(g->scenario, "ranges") == 0) lines = ranges;
+	else if (strcmp(g->scenario, "ol") == 0) lines = ol;
+	else if (strcmp(g->scenario, "sign") == 0) lines = sign;
+	else if (strcmp(g->scenario, "batt") == 0) lines = batt;
+	else if (strcmp(g->scenario, "all") != 0) {
+		fprintf(stderr,"Unknown scenario '%s'\r\n", g->scenario);
+		return -1;
+	}
+
+	if (lines == sweep) {
+		/*
+		 * -3999 .. 3999 on the 4V range, in steps of 37 counts
+		 */
+		char line[64];
+
+		for (i = -3999; i <= 3999; i += 37) {
+			snprintf(line, sizeof(line), "volts 1 %04d dc%s", i < 0 ? -i : i, i < 0 ? " neg" : "");
+			add_step(g, line);
+		}
+
+	} else if (lines) {
+		for (i = 0; lines[i]; i++) add_step(g, lines[i]);
+
+	} else {
+		const char **all[] = { modes, ranges, ol, sign, batt, NULL };
+		int j;
+
+		for (j = 0; all[j]; j++) {
+			for (i = 0; all[j][i]; i++) add_step(g, all[j][i]);
+		}
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-124105
+  Function Name	: encode_frame
+  Returns Type	: void
+  ----Parameter List
+  1. const struct step *s,
+  2. uint8_t *f, BK390A_FRAME_SIZE bytes
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void encode_frame( const struct step *s, uint8_t *f ) {
+	f[BYTE_RANGE] = 0x30 | s->range;
+	f[BYTE_DIGIT_3] = '0' + (s->count / 1000) % 10;
+	f[BYTE_DIGIT_2] = '0' + (s->count / 100) % 10;
+	f[BYTE_DIGIT_1] = '0' + (s->count / 10) % 10;
+	f[BYTE_DIGIT_0] = '0' + s->count % 10;
+	f[BYTE_FUNCTION] = s->function;
+	f[BYTE_STATUS] = 0x30 | s->status;
+	f[BYTE_OPTION_1] = 0x30 | s->option1;
+	f[BYTE_OPTION_2] = 0x30 | s->option2;
+	f[BK390A_PAYLOAD_SIZE] = '\r';
+	f[BK390A_PAYLOAD_SIZE +1] = '\n';
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-124118
+  Function Name	: handle_sigint
+  Returns Type	: void
+  ----Parameter List
+  1. int a ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void handle_sigint( int a ) {
+	sigint_pressed = 1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-124130
+  Function Name	: sim_cleanup
+  Returns Type	: void
+  ----Parameter List
+  1. void ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: removes the -L symlinks
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void sim_cleanup( void ) {
+	int i;
+
+	if (glbs == NULL) return;
+
+	for (i = 0; i < glbs->meters; i++) {
+		struct sim_meter *m = &(glbs->m[i]);
+
+		if (m->link[0]) unlink(m->link);
+		if (m->master > 0) close(m->master);
+		if (m->slave > 0) close(m->slave);
+		if (!glbs->quiet && m->path[0]) {
+			fprintf(stderr,"Meter %d (%s): %llu frames sent, %llu dropped (reader too slow)\r\n"
+					, i +1
+					, m->path
+					, (unsigned long long)m->frames
+					, (unsigned long long)m->dropped
+				   );
+		}
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-124145
+  Function Name	: main
+  Returns Type	: int
+  ----Parameter List
+  1. int argc,
+  2.  char **argv ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Frames are paced against an absolute monotonic schedule; if a
+	wakeup is late the missed frames are sent as one batched write
+	so high rates don't cost a syscall per frame per meter.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int main( int argc, char **argv ) {
+	static struct glb g;
+	struct timespec next;
+	uint64_t period_ns, sent = 0;
+	int i, done = 0;
+
+	glbs = NULL;
+	init( &g );
+	parse_parameters( &g, argc, argv );
+	if (load_scenario( &g ) != 0) exit(1);
+
+	sigint_pressed = 0;
+	signal(SIGINT, handle_sigint);
+	signal(SIGTERM, handle_sigint);
+	signal(SIGPIPE, SIG_IGN);
+
+	glbs = &g;
+	atexit(sim_cleanup);
+
+	/*
+	 * Create the pseudo-terminals, the slave side is held open (and
+	 * raw) ourselves so that the master doesn't see a hangup between
+	 * readers and nothing gets echoed back at us.
+	 */
+	for (i = 0; i < g.meters; i++) {
+		struct sim_meter *m = &(g.m[i]);
+		struct termios tio;
+		char *name;
+
+		m->master = posix_openpt(O_RDWR | O_NOCTTY);
+		if ((m->master < 0) || (grantpt(m->master) != 0) || (unlockpt(m->master) != 0) || ((name = ptsname(m->master)) == NULL)) {
+			fprintf(stderr,"Couldn't create pseudo-terminal (%s)\r\n", strerror(errno));
+			exit(1);
+		}
+		snprintf(m->path, sizeof(m->path), "%s", name);
+
+		m->slave = open(m->path, O_RDWR | O_NOCTTY);
+		if ((m->slave >= 0) && (tcgetattr(m->slave, &tio) == 0)) {
+			cfmakeraw(&tio);
+			tcsetattr(m->slave, TCSANOW, &tio);
+		}
+
+		fcntl(m->master, F_SETFL, fcntl(m->master, F_GETFL) | O_NONBLOCK);
+
+		if (g.link_prefix) {
+			snprintf(m->link, sizeof(m->link), "%s%d", g.link_prefix, i +1);
+			unlink(m->link);
+			if (symlink(m->path, m->link) != 0) {
+				fprintf(stderr,"Couldn't link %s to %s (%s)\r\n", m->link, m->path, strerror(errno));
+				m->link[0] = '\0';
+			}
+		}
+
+		m->step = i % g.step_count;
+		m->repeat = 0;
+
+		if (!g.quiet) fprintf(stdout,"%d %s%s%s\n", i +1, m->path, m->link[0] ? " " : "", m->link);
+	}
+	fflush(stdout);
+
+	period_ns = (uint64_t)(1e9 / g.rate);
+	if (period_ns == 0) period_ns = 1;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (!sigint_pressed && !done) {
+		struct timespec now;
+		uint64_t now_ns, next_ns;
+		int batch;
+
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		/*
+		 * Work out how many frame periods are due
+		 */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		now_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+		next_ns = (uint64_t)next.tv_sec * 1000000000ULL + next.tv_nsec;
+		batch = 1;
+		if (now_ns > next_ns) batch += (now_ns - next_ns) / period_ns;
+		if (batch > SIM_BATCH_MAX) batch = SIM_BATCH_MAX;
+		if (g.max_frames && (sent + batch > g.max_frames)) batch = g.max_frames - sent;
+
+		for (i = 0; i < g.meters; i++) {
+			struct sim_meter *m = &(g.m[i]);
+			uint8_t buf[SIM_BATCH_MAX * BK390A_FRAME_SIZE];
+			ssize_t w;
+			int j;
+
+			for (j = 0; j < batch; j++) {
+				encode_frame( &(g.steps[m->step]), buf + j * BK390A_FRAME_SIZE );
+				if (++m->repeat >= g.steps[m->step].repeat) {
+					m->repeat = 0;
+					m->step = (m->step +1) % g.step_count;
+				}
+			}
+
+			/*
+			 * Like a real serial line, if nobody's reading fast
+			 * enough the frames are lost
+			 */
+			w = write(m->master, buf, batch * BK390A_FRAME_SIZE);
+			if (w < 0) w = 0;
+			m->frames += w / BK390A_FRAME_SIZE;
+			m->dropped += batch - w / BK390A_FRAME_SIZE;
+		}
+
+		sent += batch;
+		if (g.max_frames && (sent >= g.max_frames)) done = 1;
+
+		next_ns += (uint64_t)batch * period_ns;
+		if (next_ns + period_ns < now_ns) next_ns = now_ns;
+		next.tv_sec = next_ns / 1000000000ULL;
+		next.tv_nsec = next_ns % 1000000000ULL;
+	}
+
+	/*
+	 * Give readers a moment to drain before the pseudo-terminals go
+	 */
+	if (done) usleep(200000);
+
+	return 0;
+}
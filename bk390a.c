@@ -25,14 +25,39 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <signal.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <wchar.h>
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <sys/epoll.h>
+#endif
+#include "decode.h"
+#include "dispfmt.h"
+#include "framer.h"
+#include "proto.h"
+#include "serial.h"
+#include "timebase.h"
+#include "binlog.h"
+#include "rawcap.h"
+#include "logwr.h"
+#include "metrics.h"
+#include "reconn.h"
+#include "archive.h"
+#include "obsfile.h"
+#include "shmpub.h"
+#ifndef _WIN32
+#include "netsrv.h"
+#include "serprobe.h"
+#endif
+#include "sinkq.h"
+#include "stats.h"
 
 char VERSION[] = "v0.1-Alpha";
-char help[] = " -p <comport#> [-s <serial port config>] [-t] [-o <filename>] [-l <filename>] [-m] [-d] [-q]\r\n"\
+char help[] = " -p <comport#> | -P | -r <filename> [-X <speed>] [-s <serial port config>] [-y <protocol>] [-w <filename>] [-t] [-o <filename>] [-l <filename>] [-R <size>] [-H] [-Y <ms>] [-b <filename>] [-A <filename>] [-F <ms>] [-M <name>] [-N <[host:]port>] [-E <line|bin>] [-Q <drop|block>] [-S <filename>] [-I <filename>] [-W <ms>] [-m] [-d] [-q]\r\n"\
 			   "\n"\
 			   "\t\tBK-Precision 390A Multimeter serial data decoder\r\n"\
 			   "\r\n"\
@@ -41,10 +66,33 @@ char help[] = " -p <comport#> [-s <serial port config>] [-t] [-o <filename>] [-l
 			   "\r\n"\
 			   "\t-h: This help\r\n"\
 			   "\t-p <comport>: Set the com port for the meter, eg: -p 2\r\n"\
-			   "\t-s <[9600|4800|2400|1200]:[7|8][o|e|n][1|2]>, eg: -s 2400:7o1\r\n"\
+			   "\t\t(Linux: a device path, eg: -p /dev/ttyS0, or a number for /dev/ttyUSB<n>)\r\n"\
+			   "\t-P: Find the meter, listening on every serial port at once at each speed and parity, then exit\r\n"\
+			   "\t\t(Linux; without -p the meter is found this way at start up)\r\n"\
+			   "\t-s <[19200|9600|4800|2400|1200]:[7|8][o|e|n][1|2]>, eg: -s 2400:7o1\r\n"\
+			   "\t-y <protocol>: Meter protocol, bk390a (default) or es51922 (19200:7o1, UT61E and the like)\r\n"\
+			   "\t\t(the protocol's own serial config is used unless -s is given)\r\n"\
+			   "\t-w <filename>: Record every byte read from the port, time stamped, to <filename> (replaced)\r\n"\
+			   "\t-r <filename>: Replay a -w recording through the decoder and outputs instead of reading a port\r\n"\
+			   "\t\t(-p <meter id> picks the meter from a bk390ad recording of several)\r\n"\
+			   "\t-X <speed>: -r speed, 1 = as recorded (default), 10 = ten times faster, 0 = as fast as possible\r\n"\
 			   "\t-t: Generate a text file containing current meter data (default to bk390a.txt)\r\n"\
 			   "\t-o <filename>: Set the filename for the meter data ( overrides 'bk390a.txt' )\r\n"\
 			   "\t-l <filename>: Set logging and the filename for the log\r\n"\
+			   "\t-R <size>: Rotate the log when it reaches <size>, eg: -R 100M\r\n"\
+			   "\t-H: Rotate the log every hour\r\n"\
+			   "\t-Y <ms>: fsync the log every <ms> (default never)\r\n"\
+			   "\t-b <filename>: Set binary logging and the filename for the binary log\r\n"\
+			   "\t-F <ms>: Log and binary log flush interval (default 1000ms)\r\n"\
+			   "\t-A <filename>: Set archiving and the filename for the compressed reading archive\r\n"\
+			   "\t-M <name>: Publish the latest reading in shared memory segment <name>, eg: -M /bk390a\r\n"\
+			   "\t-N <[host:]port>: Stream readings to TCP clients connecting to <port>, eg: -N 5390 (Linux)\r\n"\
+			   "\t-E <line|bin>: -N stream as log lines or binary log records (default line)\r\n"\
+			   "\t-Q <drop|block>: When a log can't keep up, drop the oldest readings or hold up capture (default block)\r\n"\
+			   "\t-S <filename>: Keep session and 1s/10s/1m statistics, refreshed in <filename> every second\r\n"\
+			   "\t-I <filename>: Write counters and latency histograms to <filename> every second, Prometheus text format\r\n"\
+			   "\t\t(SIGUSR1 dumps them to stderr at any time)\r\n"\
+			   "\t-W <ms>: Reopen the port when no frame has arrived for <ms> (default 5000, 0 = never)\r\n"\
 			   "\t-d: debug enabled\r\n"\
 			   "\t-m: show multimeter mode\r\n"\
 			   "\t-q: quiet output\r\n"\
@@ -52,57 +100,39 @@ char help[] = " -p <comport#> [-s <serial port config>] [-t] [-o <filename>] [-l
 			   "\n\n\texample: bk390a.exe -p 2 -t -o obsdata.txt\r\n"\
 			   "\r\n";
 
-#define BYTE_RANGE 0
-#define BYTE_DIGIT_3 1
-#define BYTE_DIGIT_2 2
-#define BYTE_DIGIT_1 3
-#define BYTE_DIGIT_0 4
-#define BYTE_FUNCTION 5
-#define BYTE_STATUS 6
-#define BYTE_OPTION_1 7
-#define BYTE_OPTION_2 8
-
-#define FUNCTION_VOLTAGE	0b00111011
-#define FUNCTION_CURRENT_UA			0b00111101 
-#define FUNCTION_CURRENT_MA			0b00111001
-#define FUNCTION_CURRENT_A			0b00111111
-#define FUNCTION_OHMS		0b00110011 
-#define FUNCTION_CONTINUITY	0b00110101
-#define FUNCTION_DIODE		0b00110001
-#define FUNCTION_FQ_RPM		0b00110010
-#define FUNCTION_CAPACITANCE 0b00110110
-#define FUNCTION_TEMPERATURE 0b00110100
-#define FUNCTION_ADP0		0b00111110
-#define FUNCTION_ADP1		0b00111100
-#define FUNCTION_ADP2		0b00111000
-#define FUNCTION_ADP3		0b00111010
-
-#define STATUS_OL			0x01
-#define STATUS_BATT			0x02
-#define STATUS_SIGN			0x04 
-#define STATUS_JUDGE		0x08
-
-#define OPTION1_VAHZ		0x01
-#define OPTION1_PMIN		0x04 
-#define OPTION1_PMAX		0x08
-
-#define OPTION2_APO			0x01
-#define OPTION2_AUTO		0x02
-#define OPTION2_AC			0x04
-#define OPTION2_DC			0x08
-
 char default_output[] = "bk390a.txt";
 uint8_t sigint_pressed;
+uint8_t sigusr1_pressed;
 
 struct glb {
 	uint8_t debug;
 	uint8_t quiet;
 	uint8_t show_mode;
 	uint8_t textfile_output;
+	uint8_t probe;
 	uint16_t flags;
 
 	char *serial_params;
+	const struct proto *protocol;	// -y
+	char *rawcap_filename;	// -w
+	char *replay_filename;	// -r
+	double replay_speed;	// -X, 0 = as fast as possible
+	int replay_meter;		// -p with -r, the recorded meter id replayed
 	char *log_filename;
+	uint64_t log_rotate_bytes;
+	int log_rotate_hourly;
+	uint32_t log_fsync_ms;
+	char *binlog_filename;
+	uint32_t flush_ms;		// -F, text and binary logs
+	char *archive_filename;
+	char *shm_name;
+	char *net_addr;
+	int net_format;			// NETSRV_LINE or NETSRV_BINARY
+	int log_policy;			// SINKQ_BLOCK or SINKQ_DROP_OLDEST
+	char *stats_filename;
+	char *metrics_filename;
+	uint32_t stall_ms;		// -W, 0 = only reopen on a read error
+	struct timebase_anchor t0;	// log 'zero' time, and the wall time then
 	char *output_filename;
 	char *com_address;
 };
@@ -111,8 +141,33 @@ struct glb {
  * We have our file handles as globals only so that
  * we can cleanly close them atexit()
  */
-FILE *fo, *fl;			// Output file handles for OBS output, and log output
+struct logwr lw;		// Text log, batched and written on its own thread
+struct obsfile obs;		// OBS text output, only rewritten on change
+struct shmpub shm;		// Latest reading for other local tools
+struct binlog bl;		// Binary log, buffered
+struct arc arc;			// Compressed reading archive, buffered per block
+struct rawcap raw;		// Raw byte capture, -w
+struct rawcap_reader replay;	// Raw byte capture being replayed, -r
+
+/*
+ * Each output is fed through its own queue and thread so that a slow
+ * disk or terminal never holds up reading the meter
+ */
+struct sinkq q_display, q_obs, q_log, q_binlog, q_archive, q_stats;
+struct stats st;		// Running statistics, -S
+struct framer fr;		// Assembles frames from the serial bytes
+struct metrics_meter mm;	// Counters the framer doesn't keep
+struct metrics_hist publish_latency;	// frame arrival to handed to every output
+struct reconn rc;		// Port up, lost or stalled, and when to reopen it
+struct glb *glbs;
+#ifdef _WIN32
 HANDLE hComm;			// Handle to the serial port
+#else
+int comm_fd = -1;		// Serial port file descriptor
+int comm_vmin;			// Bytes the port's read wakes at, framer_wanted()
+int epoll_fd = -1;		// Event loop the serial port is serviced by
+struct netsrv srv;		// TCP clients, serviced in the same loop
+#endif
 
 
 /*-----------------------------------------------------------------\
@@ -137,11 +192,31 @@ int init( struct glb *g ) {
 	g->show_mode = 0;
 	g->flags = 0;
 	g->textfile_output = 0;
+	g->probe = 0;
 
 	g->output_filename = default_output;
 	g->com_address = NULL;
 	g->log_filename = NULL;
+	g->log_rotate_bytes = 0;
+	g->log_rotate_hourly = 0;
+	g->log_fsync_ms = 0;
+	g->binlog_filename = NULL;
+	g->flush_ms = BINLOG_DEFAULT_FLUSH_MS;
+	g->archive_filename = NULL;
+	g->shm_name = NULL;
+	g->net_addr = NULL;
+	g->net_format = 0;
+	g->log_policy = SINKQ_BLOCK;
+	g->stats_filename = NULL;
+	g->metrics_filename = NULL;
+	g->stall_ms = RECONN_DEFAULT_STALL_MS;
+	memset(&(g->t0), 0, sizeof(g->t0));
 	g->serial_params = NULL;
+	g->protocol = &proto_bk390a;
+	g->rawcap_filename = NULL;
+	g->replay_filename = NULL;
+	g->replay_speed = 1;
+	g->replay_meter = -1;
 
 	return 0;
 }
@@ -189,6 +264,161 @@ int parse_parameters( struct glb *g, int argc, char **argv ) {
 					}
 					break;
 
+				case 'R':
+					/* rotate the log by size */
+					i++;
+					if ((i < argc) && (g->log_rotate_bytes = logwr_parse_size(argv[i]))) break;
+					fprintf(stderr,"Require log rotation size; -R <bytes[k|M|G]>\n");
+					exit(1);
+					break;
+
+				case 'H':
+					/* rotate the log hourly */
+					g->log_rotate_hourly = 1;
+					break;
+
+				case 'Y':
+					/* fsync the log */
+					i++;
+					if (i < argc) g->log_fsync_ms = strtoul(argv[i], NULL, 10);
+					else {
+						fprintf(stderr,"Insufficient parameters; -Y <milliseconds>\n");
+						exit(1);
+					}
+					break;
+
+				case 'b':
+					/* set the binary logging */
+					i++;
+					if (i < argc) g->binlog_filename = argv[i];
+					else {
+						fprintf(stderr,"Require binary log filename; -b <filename>\n");
+						exit(1);
+					}
+					break;
+
+				case 'A':
+					/* set the reading archive */
+					i++;
+					if (i < argc) g->archive_filename = argv[i];
+					else {
+						fprintf(stderr,"Require archive filename; -A <filename>\n");
+						exit(1);
+					}
+					break;
+
+				case 'F':
+					/* log flush interval */
+					i++;
+					if (i < argc) g->flush_ms = strtoul(argv[i], NULL, 10);
+					else {
+						fprintf(stderr,"Insufficient parameters; -F <milliseconds>\n");
+						exit(1);
+					}
+					break;
+
+				case 'N':
+					/* TCP reading stream */
+					i++;
+					if (i < argc) g->net_addr = argv[i];
+					else {
+						fprintf(stderr,"Require port to listen on; -N <[host:]port>\n");
+						exit(1);
+					}
+					break;
+
+				case 'E':
+					/* TCP stream encoding */
+					i++;
+					if ((i < argc) && (strcmp(argv[i], "line") == 0)) g->net_format = 0;
+					else if ((i < argc) && (strcmp(argv[i], "bin") == 0)) g->net_format = 1;
+					else {
+						fprintf(stderr,"Require stream encoding; -E <line|bin>\n");
+						exit(1);
+					}
+					break;
+
+				case 'M':
+					/* shared memory latest reading */
+					i++;
+					if (i < argc) g->shm_name = argv[i];
+					else {
+						fprintf(stderr,"Require shared memory name; -M <name>\n");
+						exit(1);
+					}
+					break;
+
+				case 'I':
+					/* instrumentation */
+					i++;
+					if (i < argc) g->metrics_filename = argv[i];
+					else {
+						fprintf(stderr,"Require metrics filename; -I <filename>\n");
+						exit(1);
+					}
+					break;
+
+				case 'W':
+					/* stall time */
+					i++;
+					if (i < argc) g->stall_ms = strtoul(argv[i], NULL, 10);
+					else {
+						fprintf(stderr,"Require stall time; -W <ms>\n");
+						exit(1);
+					}
+					break;
+
+				case 'S':
+					/* statistics */
+					i++;
+					if (i < argc) g->stats_filename = argv[i];
+					else {
+						fprintf(stderr,"Require statistics filename; -S <filename>\n");
+						exit(1);
+					}
+					break;
+
+				case 'Q':
+					/* log queue overflow policy */
+					i++;
+					if ((i < argc) && (strcmp(argv[i], "drop") == 0)) g->log_policy = SINKQ_DROP_OLDEST;
+					else if ((i < argc) && (strcmp(argv[i], "block") == 0)) g->log_policy = SINKQ_BLOCK;
+					else {
+						fprintf(stderr,"Require queue policy; -Q <drop|block>\n");
+						exit(1);
+					}
+					break;
+
+				case 'w':
+					/* raw capture */
+					i++;
+					if (i < argc) g->rawcap_filename = argv[i];
+					else {
+						fprintf(stderr,"Require raw capture filename; -w <filename>\n");
+						exit(1);
+					}
+					break;
+
+				case 'r':
+					/* replay a raw capture */
+					i++;
+					if (i < argc) g->replay_filename = argv[i];
+					else {
+						fprintf(stderr,"Require raw capture filename; -r <filename>\n");
+						exit(1);
+					}
+					break;
+
+				case 'X':
+					/* replay speed */
+					i++;
+					if (i < argc) g->replay_speed = strtod(argv[i], NULL);
+					else {
+						fprintf(stderr,"Require replay speed; -X <speed>\n");
+						exit(1);
+					}
+					break;
+
 				case 'p':
 					/* set address of B35*/
 					i++;
@@ -199,6 +429,11 @@ int parse_parameters( struct glb *g, int argc, char **argv ) {
 					}
 					break;
 
+				case 'P':
+					/* find the meter */
+					g->probe = 1;
+					break;
+
 				case 'o':
 					/* set output file for text */
 					i++;
@@ -239,6 +474,14 @@ int parse_parameters( struct glb *g, int argc, char **argv ) {
 					}
 					break;
 
+				case 'y':
+					/* meter protocol */
+					i++;
+					if ((i < argc) && (g->protocol = proto_find(argv[i]))) break;
+					fprintf(stderr,"Require a known protocol; -y <bk390a|es51922>\n");
+					exit(1);
+					break;
+
 				default:
 					break;
 			} // switch
@@ -269,6 +512,95 @@ void handle_sigint( int a ) {
 	sigint_pressed = 1;
 }
 
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-175010
+  Function Name	: handle_sigusr1
+  Returns Type	: void
+  ----Parameter List
+  1. int a ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The dump itself is done from the main loop
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void handle_sigusr1( int a ) {
+	sigusr1_pressed = 1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-175022
+  Function Name	: write_metrics
+  Returns Type	: void
+  ----Parameter List
+  1. FILE *f,
+  2. int format, METRICS_TEXT or METRICS_PROMETHEUS
+  3. void *ctx, unused ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Byte stream and reading counters, then per output drops and
+	latency from the frame's arrival to the output being done
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void write_metrics( FILE *f, int format, void *ctx ) {
+	struct sinkq *q[] = { &q_display, &q_obs, &q_log, &q_binlog, &q_archive, &q_stats, NULL };
+	char labels[64];
+	int i;
+
+	if (mm.fr) metrics_meters_write(f, format, &mm, 1);	// not before the port's open
+
+	metrics_header(f, format, "bk390a_publish_latency_seconds", "histogram", "Frame arrival to handed to every output");
+	metrics_hist_write(f, format, "bk390a_publish_latency_seconds", "", &publish_latency);
+
+	metrics_header(f, format, "bk390a_sink_latency_seconds", "histogram", "Frame arrival to the output being done with it");
+	for (i = 0; q[i]; i++) {
+		if (q[i]->name == NULL) continue;
+		snprintf(labels, sizeof(labels), "sink=\"%s\"", q[i]->name);
+		metrics_hist_write(f, format, "bk390a_sink_latency_seconds", labels, &(q[i]->latency));
+	}
+	metrics_header(f, format, "bk390a_sink_dropped_total", "counter", "Readings an output missed, -Q drop");
+	for (i = 0; q[i]; i++) {
+		if (q[i]->name == NULL) continue;
+		snprintf(labels, sizeof(labels), "sink=\"%s\"", q[i]->name);
+		metrics_counter(f, format, "bk390a_sink_dropped_total", labels, __atomic_load_n(&(q[i]->overflows), __ATOMIC_RELAXED));
+	}
+	metrics_header(f, format, "bk390a_sink_waits_total", "counter", "Times capture waited for an output, -Q block");
+	for (i = 0; q[i]; i++) {
+		if (q[i]->name == NULL) continue;
+		snprintf(labels, sizeof(labels), "sink=\"%s\"", q[i]->name);
+		metrics_counter(f, format, "bk390a_sink_waits_total", labels, q[i]->waits);
+	}
+
+	metrics_header(f, format, "bk390a_port_up", "gauge", "1 while frames are arriving, 0 during an outage");
+	metrics_counter(f, format, "bk390a_port_up", "", rc.state == RECONN_UP);
+	metrics_header(f, format, "bk390a_outages_total", "counter", "Times the port was lost or stalled");
+	metrics_counter(f, format, "bk390a_outages_total", "", rc.outages);
+
+	if (lw.fn[0]) {
+		metrics_header(f, format, "bk390a_log_dropped_bytes_total", "counter", "Log bytes dropped, disk full or stalled");
+		metrics_counter(f, format, "bk390a_log_dropped_bytes_total", "", lw.dropped);
+	}
+#ifndef _WIN32
+	if (glbs && glbs->net_addr) {
+		metrics_header(f, format, "bk390a_net_clients", "gauge", "Connected -N clients");
+		metrics_counter(f, format, "bk390a_net_clients", "", srv.clients);
+		metrics_header(f, format, "bk390a_net_dropped_total", "counter", "-N clients disconnected for falling behind");
+		metrics_counter(f, format, "bk390a_net_dropped_total", "", srv.dropped);
+	}
+#endif
+}
+
 
 /*-----------------------------------------------------------------\
   Date Code:	: 20180128-001515
@@ -287,11 +619,40 @@ Changes:
 
 \------------------------------------------------------------------*/
 void set_cursor_visible( uint8_t vis ) {
+#ifdef _WIN32
 	HANDLE consoleHandle = GetStdHandle(STD_OUTPUT_HANDLE);
 	CONSOLE_CURSOR_INFO info;
 	info.dwSize = 100;
 	info.bVisible = vis;
 	SetConsoleCursorInfo(consoleHandle, &info);
+#else
+	if (isatty(STDOUT_FILENO)) {
+		fprintf(stdout, vis ? "\33[?25h" : "\33[?25l");
+		fflush(stdout);
+	}
+#endif
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-220140
+  Function Name	: clock_now
+  Returns Type	: uint64_t
+  ----Parameter List
+  1. void ,
+  ------------------
+  Exit Codes	: now, on the clock the frames are stamped with
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The monotonic clock, or with -r the replay's; a fast replay's
+	stamps run ahead of the monotonic clock.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+uint64_t clock_now( void ) {
+	return replay.f ? rawcap_replay_now(&replay) : timebase_now_ns();
 }
 
 /*-----------------------------------------------------------------\
@@ -311,541 +672,1171 @@ Changes:
 
 \------------------------------------------------------------------*/
 void bk390_cleanup( void ){
-	CloseHandle(hComm);
-	if (fo) fclose(fo);
-	if (fl) fclose(fl);
-	set_cursor_visible(TRUE);
+	struct sinkq *q[] = { &q_display, &q_obs, &q_log, &q_binlog, &q_archive, &q_stats, NULL };
+	int i;
+
+	/*
+	 * Let the outputs finish what's queued before their files go
+	 */
+	for (i = 0; q[i]; i++) {
+		sinkq_stop(q[i]);
+		if (q[i]->overflows || q[i]->waits) {
+			fprintf(stderr,"\r\n%s output: %llu readings dropped, capture held up %llu times\r\n"
+					, q[i]->name
+					, (unsigned long long)q[i]->overflows
+					, (unsigned long long)q[i]->waits
+				   );
+		}
+	}
+
+	/*
+	 * A replay's throughput, capture loop to every output done
+	 */
+	if (replay.f) {
+		double elapsed = (timebase_now_ns() - replay.start_ns) / 1e9;
+
+		fprintf(stderr,"\r\nReplayed %llu records, %llu bytes, %llu frames in %0.3fs, %0.0f frames/s\r\n"
+				, (unsigned long long)replay.records
+				, (unsigned long long)replay.bytes
+				, (unsigned long long)fr.frames_ok
+				, elapsed
+				, elapsed > 0 ? fr.frames_ok / elapsed : 0
+			   );
+	}
+
+	if (rc.outages) {
+		uint64_t total = rc.outage_total_ns;
+
+		if (rc.state != RECONN_UP) total += clock_now() - rc.outage_ns;
+		fprintf(stderr,"\r\nPort: %llu outages, %0.3fs without readings\r\n", (unsigned long long)rc.outages, total / 1e9);
+	}
+
+#ifdef _WIN32
+	if (hComm != INVALID_HANDLE_VALUE) CloseHandle(hComm);
+#else
+	if (comm_fd >= 0) close(comm_fd);
+	if (srv.accepted && glbs && !glbs->quiet) {
+		fprintf(stderr,"\r\nNet: %llu clients, %llu dropped for falling behind, %llu refused\r\n"
+				, (unsigned long long)srv.accepted
+				, (unsigned long long)srv.dropped
+				, (unsigned long long)srv.refused
+			   );
+	}
+	srv.quiet = 1;
+	netsrv_close(&srv);
+	if (epoll_fd >= 0) close(epoll_fd);
+#endif
+	obsfile_close(&obs);
+	shmpub_close(&shm);
+
+	/*
+	 * Session end statistics
+	 */
+	if (glbs && glbs->stats_filename) {
+		struct stats *sp = &st;
+
+		if (stats_write_file(glbs->stats_filename, &sp, 1, clock_now()) != 0) {
+			fprintf(stderr,"Couldn't write statistics to '%s'\r\n", glbs->stats_filename);
+		}
+		if (!glbs->quiet) {
+			fprintf(stderr,"\r\n");
+			stats_write(stderr, &st, clock_now());
+		}
+	}
+	logwr_close(&lw);
+	if (lw.dropped) fprintf(stderr,"\r\nLog: %llu bytes dropped\r\n", (unsigned long long)lw.dropped);
+	if (glbs && glbs->metrics_filename && (metrics_write_file(glbs->metrics_filename, write_metrics, NULL) != 0)) {
+		fprintf(stderr,"Couldn't write metrics to '%s'\r\n", glbs->metrics_filename);
+	}
+	binlog_close(&bl);
+	arc_close(&arc);
+	rawcap_close(&raw);
+	rawcap_replay_close(&replay);
+	set_cursor_visible(1);
 }
 
 
+#ifndef _WIN32
 /*-----------------------------------------------------------------\
-  Date Code:	: 20180127-220307
-  Function Name	: main
-  Returns Type	: int
+  Date Code:	: 20261016-182540
+  Function Name	: probe_ports
+  Returns Type	: void
   ----Parameter List
-  1. int argc, 
-  2.  char **argv , 
+  1. struct glb *g,
+  2. char *com_port, the -p port if any, the meter's port on return
+  3. int len,
+  4. struct serial_params *sp, tried first, the meter's on return ,
   ------------------
-  Exit Codes	: 
-  Side Effects	: 
+  Exit Codes	:
+  Side Effects	: exits for -P, or if there's no meter to be found
   --------------------------------------------------------------------
 Comments:
+	Every /dev/ttyUSB*, ttyACM* and ttyS* (and the -p port) is
+	probed in parallel, see serprobe.c.  -P reports every port with
+	a meter on it; otherwise the first one found is used.
 
 --------------------------------------------------------------------
 Changes:
 
 \------------------------------------------------------------------*/
-int main( int argc, char **argv ) {
-	char cmd[1024];
-	char mmode[128];		// String describing multimeter mode (volts, amps etc)
-	char mode_separator[] = "\r\n  ";
-	char prefix[128];		// Units prefix u, m, k, M etc 
-	char units[128];		// Measurement units F, V, A, R
-	uint8_t d[256];			// Serial data packet
-	uint8_t dps = 0;		// Number of decimal places
-	uint32_t logscale = 1;	// What scale do we multiple the screen values for in the log
-	struct timeval t0, t1;	// Time values for the log files
-	uint64_t t0i, t1i;
-	struct timezone tz;
-	struct glb g;			// Global structure for passing variables around
-	int i = 0;				// Generic counter
-	char hbc = ' ';			// Heart-beat character
+void probe_ports( struct glb *g, char *com_port, int len, struct serial_params *sp ) {
+	static struct serprobe probe;
+	char params[32];
+	int i, n, found = 0;
+
+	serprobe_init(&probe, sp);
+	probe.proto = g->protocol;
+	if (com_port[0]) serprobe_add(&probe, com_port);
+	serprobe_add_candidates(&probe);
+
+	if (!g->quiet) fprintf(stderr,"Looking for the meter on %d serial ports ...\r\n", probe.count);
+	n = serprobe_run(&probe, SERPROBE_DEFAULT_WINDOW_MS, !g->probe);
+	if (n < 0) {
+		fprintf(stderr,"Couldn't probe the serial ports (%s)\r\n", strerror(errno));
+		exit(1);
+	}
 
-	char  com_port[256];	// com port path / ie, \\.COM4
-	BOOL  com_read_status;  // return status of various com port functions
-	DWORD dwEventMask;      // Event mask to trigger
-	char  temp_char;        // Temporary character 
-	DWORD bytes_read;       // Number of bytes read by ReadFile()
+	for (i = 0; i < probe.count; i++) {
+		struct serprobe_port *p = &(probe.p[i]);
 
-	t0i = t1i = 0;
-	fo = fl = NULL;
+		if (p->state == SERPROBE_MATCH) {
+			fprintf(g->probe ? stdout : stderr,"Meter found on %s at %s\r\n", p->device, serial_params_str(&(p->sp), params, sizeof(params)));
+			if (!g->probe && !found) {
+				snprintf(com_port, len, "%s", p->device);
+				*sp = p->sp;
+				found = 1;
+			}
+		} else if (g->debug && (p->state == SERPROBE_OPEN_FAILED)) {
+			fprintf(stderr,"%s: %s\r\n", p->device, strerror(p->err));
+		}
+	}
 
-	if (argc == 1) {
-		fprintf(stdout,"Usage: %s %s", argv[0], help);
+	if (g->probe) exit(n ? 0 : 1);
+	if (n == 0) {
+		fprintf(stderr,"No meter found on any serial port, try -p <port> -s <settings>\r\n");
 		exit(1);
 	}
+}
+#endif
 
-	/*
-	 * Setup the cleanup crew on exit
-	 */
-	atexit(bk390_cleanup);
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-142010
+  Function Name	: format_reading
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g,
+  2. const struct bk390a_reading *r,
+  3. char *cmd, display string
+  4. size_t len ,
+  ------------------
+  Exit Codes	: characters written
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The display / OBS string, with the meter mode on a second
+	line if -m; see dispfmt.c
 
-	/*
-	 * Set up the signal handler for when someone presses ctrl-c
-	 */
-	sigint_pressed = 0;
-	signal(SIGINT, handle_sigint); 
+--------------------------------------------------------------------
+Changes:
 
-	/* 
-	 * Initialise the global structure
-	 */
-	init( &g );
+\------------------------------------------------------------------*/
+int format_reading( struct glb *g, const struct bk390a_reading *r, char *cmd, size_t len ) {
+	int n;
 
-	/*
-	 * Parse our command line parameters
-	 */
-	parse_parameters( &g, argc, argv );
+	/** range checks **/
+	n = dispfmt_reading( r, 0, cmd, len );
+	if ((r->status & STATUS_OL) || (g->show_mode == 0)) return n;
 
+	n = dispfmt_append( cmd, n, len, "\r\n  " );
 
-	/*
-	 * Sanity check our parameters
-	 */
-	if (g.com_address == NULL) {
-		fprintf(stderr, "Require com port address for BK-390A meter, ie, -p 2\r\n");
-		exit(1);
-	} else {
-		snprintf( com_port, sizeof(com_port), "\\\\.\\COM%s", g.com_address );
-	} 
+	return dispfmt_append( cmd, n, len, bk390a_mode_str[r->mode] );
+}
 
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-142025
+  Function Name	: sink_display
+  Returns Type	: void
+  ----Parameter List
+  1. void *ctx, struct glb
+  2. const struct sinkq_event *e ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Runs on the display queue's thread, as do the other sink_*()
 
-	if (g.quiet == 0) fprintf(stdout,"BK-Precision 390A Multimeter serial data decoder\n"\
-			"\n"\
-			"  By Paul L Daniels / pldaniels@gmail.com\n"\
-			"  v0.1Alpha / January 27, 2018\n"\
-			"\n"\
-		   );
-	/*
-	 * Open the serial port 
-	 */
-	hComm = CreateFile( com_port,                  // Name of port 
-			GENERIC_READ,			// Read Access
-			0,                      // No Sharing
-			NULL,                   // No Security
-			OPEN_EXISTING,          // Open existing port only
-			0,                      // Non overlapped I/O
-			NULL);                  // Null for comm devices
+--------------------------------------------------------------------
+Changes:
 
-	/*
-	 * Check the outcome of the attempt to create the handle for the com port
-	 */
-	if (hComm == INVALID_HANDLE_VALUE) {
-		fprintf(stderr,"Error! - Port %s can't be opened\r\n", com_port);
-		exit(1);
-	} else {
-		if (!g.quiet) printf("Port %s Opened\r\n", com_port);
-	}
+\------------------------------------------------------------------*/
+void sink_display( void *ctx, const struct sinkq_event *e ) {
+	static char hbc = ' ';	// Heart-beat character
+	char cmd[1024];
 
-	/*
-	 * Set serial port parameters
-	 */
-	DCB dcbSerialParams = { 0 };                         // Init DCB structure
-	dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
+	if (e->type == SINKQ_COMMS_BACK) return;
+	if (e->type == SINKQ_NO_COMMS) snprintf(cmd, sizeof(cmd), "N/C       ");
+	else format_reading( (struct glb *)ctx, &(e->r), cmd, sizeof(cmd) );
 
-	com_read_status = GetCommState(hComm, &dcbSerialParams);      // Retrieve current settings
-	if (com_read_status == FALSE) { fprintf(stderr,"Error in getting GetCommState()\r\n"); }
+	//			fprintf(stdout, "\33[2K\r"); // line erase
+	//			fprintf(stdout, "\x1B[2A"); // line up
+	//			fprintf(stdout, "\33[2K\r"); // line erase
+	fprintf(stdout,"\r%c %s", hbc, cmd );
+	fflush(stdout);
+	if (hbc == ' ') hbc = '.'; else hbc = ' ';
+}
 
-	dcbSerialParams.BaudRate = CBR_2400;   
-	dcbSerialParams.ByteSize = 7;         
-	dcbSerialParams.StopBits = ONESTOPBIT; 
-	dcbSerialParams.Parity = ODDPARITY;       
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-142040
+  Function Name	: sink_obs
+  Returns Type	: void
+  ----Parameter List
+  1. void *ctx, struct glb
+  2. const struct sinkq_event *e ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Replace the OBS file, atomically, but only when the string
+	has changed.
 
-	if (g.serial_params) {
+--------------------------------------------------------------------
+Changes:
 
-		char *p = g.serial_params;
+\------------------------------------------------------------------*/
+void sink_obs( void *ctx, const struct sinkq_event *e ) {
+	struct glb *g = (struct glb *)ctx;
+	char cmd[1024];
 
-		if (strncmp(p, "9600:", 5)==0) dcbSerialParams.BaudRate = CBR_9600;      // BaudRate = 9600
-		else if (strncmp(p, "4800:", 5)==0) dcbSerialParams.BaudRate = CBR_4800;      // BaudRate = 4800
-		else if (strncmp(p, "2400:", 5)==0) dcbSerialParams.BaudRate = CBR_2400;      // BaudRate = 2400
-		else if (strncmp(p, "1200:", 5)==0) dcbSerialParams.BaudRate = CBR_1200;      // BaudRate = 1200
-		else {
-			fprintf(stderr,"Invalid serial speed\r\n");
-			set_cursor_visible(TRUE);
-			exit(1);
-		}
+	if (e->type == SINKQ_COMMS_BACK) return;
+	if (e->type == SINKQ_NO_COMMS) snprintf(cmd, sizeof(cmd), "N/C");
+	else format_reading( g, &(e->r), cmd, sizeof(cmd) );
+	if (obsfile_update(&obs, cmd) < 0 && g->debug) {
+		fprintf(stderr,"Couldn't update '%s' (%s)\r\n", g->output_filename, strerror(errno));
+	}
+}
 
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-142055
+  Function Name	: sink_log
+  Returns Type	: void
+  ----Parameter List
+  1. void *ctx, struct glb
+  2. const struct sinkq_event *e ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Log lines are the seconds since the session started, from the
+	frame's arrival time stamp, value in SI base units (12.34mV is
+	logged as 0.01234 V) and units.  O.L. is logged as such.
+	Lines are handed to the log writer, which batches the disk
+	writes on its own thread.
 
+	An outage is logged as a pair of comment lines, its start and
+	cause then its end and length, rather than as readings:
 
-		p = &(g.serial_params[5]);
-		if (*p == '7') dcbSerialParams.ByteSize = 7;         
-		else if (*p == '8') dcbSerialParams.ByteSize = 8;        
-		else {
-			fprintf(stderr,"Invalid serial byte size '%c'\r\n", *p);
-			set_cursor_visible(TRUE);
-			exit(1);
-		}
+		# outage 12.345 lost
+		# resumed 19.870 after 7.525s
 
-		p++;
-		if (*p == 'o') dcbSerialParams.Parity = ODDPARITY;       
-		else if (*p == 'e') dcbSerialParams.Parity = EVENPARITY;     
-		else if (*p == 'n') dcbSerialParams.Parity = NOPARITY;      
-		else {
-			fprintf(stderr,"Invalid serial parity type '%c'\r\n", *p);
-			set_cursor_visible(TRUE);
-			exit(1);
-		}
+--------------------------------------------------------------------
+Changes:
 
-		p++;
-		if (*p == '1') dcbSerialParams.StopBits = ONESTOPBIT; 
-		else if (*p == '2') dcbSerialParams.StopBits = TWOSTOPBITS;
-		else {
-			fprintf(stderr,"Invalid serial stop bits '%c'\r\n", *p);
-			set_cursor_visible(TRUE);
-			exit(1);
+\------------------------------------------------------------------*/
+void sink_log( void *ctx, const struct sinkq_event *e ) {
+	struct glb *g = (struct glb *)ctx;
+	char value[32];
+	char line[128];
+	int n;
+
+	if (e->type == SINKQ_NO_COMMS) {
+		n = snprintf(line, sizeof(line), "# outage %0.3f %s\n"
+				, (int64_t)(e->t_ns - g->t0.t_ns) / 1e9
+				, reconn_cause_str[e->cause]
+				);
+		if (n > 0) logwr_write(&lw, line, n);
+		return;
+	}
+	if (e->type == SINKQ_COMMS_BACK) {
+		n = snprintf(line, sizeof(line), "# resumed %0.3f after %0.3fs\n"
+				, (int64_t)(e->t_ns - g->t0.t_ns) / 1e9
+				, (e->t_ns - e->since_ns) / 1e9
+				);
+		if (n > 0) logwr_write(&lw, line, n);
+		return;
+	}
+
+	if (e->r.status & STATUS_OL) snprintf(value, sizeof(value), "O.L.");
+	else bk390a_value_str(&(e->r), value, sizeof(value));
+
+	n = snprintf(line, sizeof(line), "%0.3f %s %s\n"
+			, (int64_t)(e->t_ns - g->t0.t_ns) / 1e9
+			, value
+			, bk390a_unit_str[e->r.unit]
+			);
+	if (n > 0) logwr_write(&lw, line, n);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-142110
+  Function Name	: sink_binlog
+  Returns Type	: void
+  ----Parameter List
+  1. void *ctx,
+  2. const struct sinkq_event *e ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Asks for a tick when the buffered records are due out, so -F
+	holds with the meter gone quiet too
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void sink_binlog( void *ctx, const struct sinkq_event *e ) {
+	if (e->type == SINKQ_TICK) binlog_tick(&bl, e->t_ns);
+	else if (e->type == SINKQ_NO_COMMS) binlog_append_outage(&bl, BINLOG_OUTAGE, e->meter, e->t_ns, e->cause, 0);
+	else if (e->type == SINKQ_COMMS_BACK) binlog_append_outage(&bl, BINLOG_RESUME, e->meter, e->t_ns, 0, (e->t_ns - e->since_ns) / 1e9);
+	else binlog_append(&bl, e->meter, e->t_ns, e->raw, &(e->r));
+
+	q_binlog.tick_ns = binlog_due(&bl);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-161040
+  Function Name	: sink_archive
+  Returns Type	: void
+  ----Parameter List
+  1. void *ctx, struct glb
+  2. const struct sinkq_event *e ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Times go in as ticks since the session anchor, rounded to the
+	nearest, and the value as the meter's own count and exponent
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void sink_archive( void *ctx, const struct sinkq_event *e ) {
+	struct glb *g = (struct glb *)ctx;
+	struct arc_sample s;
+
+	if (e->type != SINKQ_READING) return;
+	s.t = (int64_t)(e->t_ns - g->t0.t_ns + ARC_TICK_NS / 2) / (int64_t)ARC_TICK_NS;
+	s.mantissa = e->r.count;
+	s.exp10 = e->r.exp10;
+	s.unit = e->r.unit;
+	s.flags = e->r.status & (STATUS_OL | STATUS_BATT);
+	arc_append(&arc, &s);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-144310
+  Function Name	: sink_stats
+  Returns Type	: void
+  ----Parameter List
+  1. void *ctx, struct glb
+  2. const struct sinkq_event *e ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: refreshes the -S file every STATS_WRITE_INTERVAL_NS
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void sink_stats( void *ctx, const struct sinkq_event *e ) {
+	static uint64_t last_write = 0;
+	struct glb *g = (struct glb *)ctx;
+	struct stats *sp = &st;
+
+	if (e->type != SINKQ_READING) return;
+	stats_add(&st, e->t_ns, &(e->r));
+
+	if (e->t_ns - last_write >= STATS_WRITE_INTERVAL_NS) {
+		stats_write_file(g->stats_filename, &sp, 1, e->t_ns);
+		last_write = e->t_ns;
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-142125
+  Function Name	: sink_start
+  Returns Type	: void
+  ----Parameter List
+  1. struct sinkq *q,
+  2. const char *name,
+  3. int policy,
+  4. sinkq_fn fn,
+  5. struct glb *g ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: exits if the queue/thread can't be set up
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void sink_start( struct sinkq *q, const char *name, int policy, sinkq_fn fn, struct glb *g ) {
+	if (sinkq_init(q, name, SINKQ_DEFAULT_SIZE, policy) == 0) {
+		q->untimed = !rawcap_replay_timed(&replay);
+		if (sinkq_start(q, fn, g) == 0) return;
+	}
+
+	fprintf(stderr,"Couldn't start the %s output thread\r\n", name);
+	exit(1);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-192040
+  Function Name	: publish
+  Returns Type	: void
+  ----Parameter List
+  1. struct glb *g,
+  2. const struct sinkq_event *e ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Hands a reading, or an outage starting or ending, to every
+	output's queue
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void publish( struct glb *g, const struct sinkq_event *e ) {
+	if (!g->quiet) sinkq_push(&q_display, e);
+	if (g->textfile_output) sinkq_push(&q_obs, e);
+	if (lw.running) sinkq_push(&q_log, e);
+	if (bl.f) sinkq_push(&q_binlog, e);
+	if (arc.f) sinkq_push(&q_archive, e);
+	if (g->stats_filename) sinkq_push(&q_stats, e);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-192055
+  Function Name	: comms_down
+  Returns Type	: void
+  ----Parameter List
+  1. struct glb *g,
+  2. const char *com_port,
+  3. int cause, RECONN_LOST or RECONN_STALLED
+  4. uint64_t now ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: closes the port
+  --------------------------------------------------------------------
+Comments:
+	The first time round for an outage the outputs are told, so the
+	logs show the gap as an outage rather than just missing lines.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void comms_down( struct glb *g, const char *com_port, int cause, uint64_t now ) {
+	struct sinkq_event se;
+
+#ifdef _WIN32
+	if (hComm != INVALID_HANDLE_VALUE) CloseHandle(hComm);
+	hComm = INVALID_HANDLE_VALUE;
+#else
+	if (comm_fd >= 0) close(comm_fd);	// also takes it out of epoll
+	comm_fd = -1;
+#endif
+	framer_discard(&fr);
+	if (raw.f) rawcap_down(&raw, 0, now, cause);
+
+	if (reconn_down(&rc, cause, now) == 0) return;
+
+	fprintf(stderr,"\r\nPort %s %s, reopening\r\n", com_port, reconn_cause_str[cause]);
+
+	memset(&se, 0, sizeof(se));
+	se.type = SINKQ_NO_COMMS;
+	se.cause = cause;
+	se.t_ns = rc.outage_ns;
+	publish(g, &se);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-192110
+  Function Name	: comms_reopen
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g,
+  2. const char *com_port,
+  3. const struct serial_params *sp, as it was first opened with
+  4. uint64_t now ,
+  ------------------
+  Exit Codes	: 0 = reopened, -1 = not yet, backing off
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The outage isn't over until a frame arrives, see comms_back()
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int comms_reopen( struct glb *g, const char *com_port, const struct serial_params *sp, uint64_t now ) {
+#ifdef _WIN32
+	hComm = (HANDLE)serial_open_win( com_port, sp );
+	if (hComm == INVALID_HANDLE_VALUE) {
+#else
+	struct epoll_event ev;
+
+	comm_fd = serial_open( com_port, sp, g->protocol->frame_size );
+	comm_vmin = g->protocol->frame_size;
+	if (comm_fd >= 0) {
+		ev.events = EPOLLIN;
+		ev.data.ptr = &comm_fd;
+		if (epoll_ctl( epoll_fd, EPOLL_CTL_ADD, comm_fd, &ev ) != 0) {
+			close(comm_fd);
+			comm_fd = -1;
 		}
+	}
+	if (comm_fd < 0) {
+#endif
+		reconn_failed(&rc, now);
+		if (g->debug) fprintf(stderr,"Port %s reopen %u failed, next in %dms\r\n", com_port, rc.attempts, reconn_timeout_ms(&rc, now));
+		return -1;
+	}
 
+	reconn_reopened(&rc, now);
+	if (g->debug) fprintf(stderr,"Port %s reopened\r\n", com_port);
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-192125
+  Function Name	: comms_back
+  Returns Type	: void
+  ----Parameter List
+  1. struct glb *g,
+  2. const char *com_port,
+  3. uint64_t t_ns, the first frame's arrival ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Called for every frame, does nothing unless the frame ends an
+	outage
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void comms_back( struct glb *g, const char *com_port, uint64_t t_ns ) {
+	struct sinkq_event se;
+
+	if (reconn_frame(&rc, t_ns) == 0) return;
+
+	fprintf(stderr,"\r\nPort %s back after %0.3fs\r\n", com_port, (t_ns - rc.outage_ns) / 1e9);
+
+	memset(&se, 0, sizeof(se));
+	se.type = SINKQ_COMMS_BACK;
+	se.t_ns = t_ns;
+	se.since_ns = rc.outage_ns;
+	publish(g, &se);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200510
+  Function Name	: replay_read
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g,
+  2. uint8_t *buf, the framer's write pointer
+  3. size_t len,
+  4. uint64_t *t_ns, receives the chunk's time stamp
+  5. int *wait_ms, receives how long until the next is due ,
+  ------------------
+  Exit Codes	: bytes put in buf, 0 if none (wait *wait_ms)
+  Side Effects	: exits at the end of the recording
+  --------------------------------------------------------------------
+Comments:
+	-r; stands in for the read from the port.  Where the capture
+	closed the port the replay does too, so the same outage is
+	reported.  Other meters' records in a bk390ad recording are
+	passed over.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int replay_read( struct glb *g, uint8_t *buf, size_t len, uint64_t *t_ns, int *wait_ms ) {
+	struct rawcap_record rec;
+
+	*wait_ms = 0;
+	switch (rawcap_replay_next(&replay, &rec, buf, len)) {
+		case 1: break;
+		case 0: *wait_ms = rawcap_replay_wait_ms(&replay); return 0;
+		case -2: fprintf(stderr,"\r\nDamaged record in '%s' after %llu records, stopping\r\n", g->replay_filename, (unsigned long long)replay.records); exit(1);
+		default: exit(0);
+	}
+
+	if (rec.meter != g->replay_meter) return 0;
+
+	*t_ns = rec.t_ns;
+	if (rec.type == RAWCAP_DOWN) {
+		comms_down( g, g->replay_filename, rec.cause, rec.t_ns );
+		return 0;
 	}
 
-	com_read_status = SetCommState(hComm, &dcbSerialParams); 
-	if (com_read_status == FALSE) {
-		fprintf(stderr,"Error setting com port configuration (2400/7/1/O etc)\r\n");
+	/*
+	 * The meter's protocol as recorded, whatever -y says
+	 */
+	if ((rec.protocol < BK390A_PROTOCOL_COUNT) && (proto_list[rec.protocol] != g->protocol)) {
+		g->protocol = proto_list[rec.protocol];
+		framer_protocol( &fr, g->protocol );
+	}
+
+	return rec.len;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20180127-220307
+  Function Name	: main
+  Returns Type	: int
+  ----Parameter List
+  1. int argc, 
+  2.  char **argv , 
+  ------------------
+  Exit Codes	: 
+  Side Effects	: 
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int main( int argc, char **argv ) {
+	uint8_t d[BK390A_PAYLOAD_MAX];	// Serial data packet
+	struct sinkq_event se;	// Decoded frame, as handed to the outputs
+	struct glb g;			// Global structure for passing variables around
+	int i = 0;				// Generic counter
+
+	char  com_port[256];	// com port path / ie, \\.COM4 or /dev/ttyUSB0
+	struct serial_params sp;	// Speed, bits, parity, stop bits
+	uint64_t t_rx;			// When the last read completed
+	uint64_t metrics_written = 0;	// Last -I refresh
+	uint64_t now;
+	int timeout_ms;			// Until the next reopen or stall check
+#ifdef _WIN32
+	BOOL  com_read_status;  // return status of various com port functions
+	DWORD bytes_read;       // Number of bytes read by ReadFile()
+#else
+	struct epoll_event ev;
+	ssize_t bytes_read;
+#endif
+
+	lw.fd = -1;
+#ifdef _WIN32
+	hComm = INVALID_HANDLE_VALUE;
+#endif
+#ifndef _WIN32
+	srv.listen_fd = -1;
+#endif
+
+	if (argc == 1) {
+		fprintf(stdout,"Usage: %s %s", argv[0], help);
 		exit(1);
+	}
+
+	/*
+	 * Setup the cleanup crew on exit
+	 */
+	atexit(bk390_cleanup);
 
+	/*
+	 * Set up the signal handler for when someone presses ctrl-c
+	 */
+	sigint_pressed = 0;
+	signal(SIGINT, handle_sigint); 
+#ifdef SIGUSR1
+	signal(SIGUSR1, handle_sigusr1);
+#endif
+
+	/* 
+	 * Initialise the global structure
+	 */
+	init( &g );
+	glbs = &g;
+
+	/*
+	 * Parse our command line parameters
+	 */
+	parse_parameters( &g, argc, argv );
+
+
+	/*
+	 * Sanity check our parameters
+	 */
+	if (g.replay_filename) {
+		snprintf( com_port, sizeof(com_port), "%s", g.replay_filename );
+		if (g.com_address) g.replay_meter = atoi(g.com_address);
+	} else if (g.com_address == NULL) {
+#ifdef _WIN32
+		fprintf(stderr, "Require com port address for BK-390A meter, ie, -p 2\r\n");
+		exit(1);
+#else
+		com_port[0] = '\0';	// probed for below
+#endif
 	} else {
-		if (!g.quiet) {
-		printf("Set DCB structure success\r\n");
-		printf("\tBaudrate = %d\r\n", dcbSerialParams.BaudRate);
-		printf("\tByteSize = %d\r\n", dcbSerialParams.ByteSize);
-		printf("\tStopBits = %d\r\n", dcbSerialParams.StopBits);
-		printf("\tParity   = %d\r\n", dcbSerialParams.Parity);
+#ifdef _WIN32
+		snprintf( com_port, sizeof(com_port), "\\\\.\\COM%s", g.com_address );
+#else
+		serial_device_path( g.com_address, com_port, sizeof(com_port) );
+#endif
+	} 
+
+	serial_default_params( &sp );
+	serial_parse_params( g.protocol->serial_params, &sp );
+	if (g.serial_params) {
+		switch (serial_parse_params( g.serial_params, &sp )) {
+			case SERIAL_PARAM_OK: break;
+			case SERIAL_PARAM_SPEED: fprintf(stderr,"Invalid serial speed\r\n"); exit(1);
+			case SERIAL_PARAM_BITS: fprintf(stderr,"Invalid serial byte size in '%s'\r\n", g.serial_params); exit(1);
+			case SERIAL_PARAM_PARITY: fprintf(stderr,"Invalid serial parity type in '%s'\r\n", g.serial_params); exit(1);
+			default: fprintf(stderr,"Invalid serial stop bits in '%s'\r\n", g.serial_params); exit(1);
 		}
 	}
 
-	COMMTIMEOUTS timeouts = { 0 };
-	timeouts.ReadIntervalTimeout         = 50;
-	timeouts.ReadTotalTimeoutConstant    = 50;
-	timeouts.ReadTotalTimeoutMultiplier  = 10;
-	timeouts.WriteTotalTimeoutConstant   = 50;
-	timeouts.WriteTotalTimeoutMultiplier = 10;
-	if (SetCommTimeouts(hComm, &timeouts) == FALSE) {
-		fprintf(stderr,"\tError in setting time-outs\r\n");
-		exit(1);
 
-	} else { 
-		if (!g.quiet) printf("\tSetting time-outs successful\r\n");
+#ifndef _WIN32
+	/*
+	 * -P, or no -p; listen for the meter on every port at once
+	 */
+	if (!g.replay_filename && (g.probe || (com_port[0] == '\0'))) {
+		probe_ports( &g, com_port, sizeof(com_port), &sp );
 	}
+#endif
 
+	if (g.quiet == 0) fprintf(stdout,"BK-Precision 390A Multimeter serial data decoder\n"\
+			"\n"\
+			"  By Paul L Daniels / pldaniels@gmail.com\n"\
+			"  v0.1Alpha / January 27, 2018\n"\
+			"\n"\
+		   );
 
-	com_read_status = SetCommMask(hComm, EV_RXCHAR); //Configure Windows to Monitor the serial device for Character Reception
-	if (com_read_status == FALSE) {
-		fprintf(stderr,"\tError in setting CommMask\r\n");
+#ifndef _WIN32
+	epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+	if (epoll_fd < 0) {
+		fprintf(stderr,"Error creating epoll instance (%s)\r\n", strerror(errno));
 		exit(1);
+	}
+#endif
+
+	if (g.replay_filename) {
+		char params[16];
+
+		/*
+		 * -r; the recording stands in for the port, its chunks are
+		 * handed to the framer in place of reads
+		 */
+		switch (rawcap_replay_open( &replay, g.replay_filename, g.replay_speed )) {
+			case 0: break;
+			case -2: fprintf(stderr,"'%s' isn't a compatible raw capture\r\n", g.replay_filename); exit(1);
+			default: fprintf(stderr,"Couldn't open '%s' (%s)\r\n", g.replay_filename, strerror(errno)); exit(1);
+		}
+
+		/*
+		 * A bk390ad recording's meters are 1..meters, bk390a's is
+		 * meter 0; only one of them goes through the framer
+		 */
+		if (g.replay_meter < 0) {
+			if (replay.h.meters > 1) {
+				fprintf(stderr,"'%s' holds %u meters, pick the one to replay with -p <meter id>\r\n", g.replay_filename, replay.h.meters);
+				exit(1);
+			}
+			g.replay_meter = replay.h.meters;
+		} else if ((g.replay_meter > replay.h.meters) || ((g.replay_meter == 0) && (replay.h.meters > 0))) {
+			fprintf(stderr,"'%s' has no meter %d\r\n", g.replay_filename, g.replay_meter);
+			exit(1);
+		}
+
+		serial_parse_params( replay.h.serial_params, &sp );
+		serial_params_str( &sp, params, sizeof(params) );
+		if (!g.quiet) {
+			if (replay.speed > 0) printf("Replaying %s, recorded at %s, at %gx\r\n", g.replay_filename, params, replay.speed);
+			else printf("Replaying %s, recorded at %s, as fast as possible\r\n", g.replay_filename, params);
+		}
 
 	} else {
-		if (!g.quiet) printf("\tCommMask successful\r\n");
+#ifdef _WIN32
+		/*
+		 * Open the serial port, serial-win.c sets the DCB and time-outs,
+		 * the same way again if it has to be reopened
+		 */
+		hComm = (HANDLE)serial_open_win( com_port, &sp );
+		if (hComm == INVALID_HANDLE_VALUE) {
+			fprintf(stderr,"Error! - Port %s can't be opened or configured (%lu)\r\n", com_port, (unsigned long)GetLastError());
+			exit(1);
+		} else {
+			if (!g.quiet) {
+				printf("Port %s Opened\r\n", com_port);
+				printf("\tBaudrate = %d\r\n", sp.baud);
+				printf("\tByteSize = %d\r\n", sp.bits);
+				printf("\tStopBits = %d\r\n", sp.stop);
+				printf("\tParity   = %c\r\n", sp.parity);
+				printf("\tProtocol = %s\r\n", g.protocol->name);
+			}
+		}
+
+#else
+		/*
+		 * Open the serial port, non-blocking, and hand it to epoll.  The
+		 * termios VMIN is the protocol's frame size so we're only woken
+		 * per frame.
+		 */
+		comm_fd = serial_open( com_port, &sp, g.protocol->frame_size );
+		comm_vmin = g.protocol->frame_size;
+		if (comm_fd < 0) {
+			fprintf(stderr,"Error! - Port %s can't be opened (%s)\r\n", com_port, strerror(errno));
+			exit(1);
+		} else {
+			if (!g.quiet) {
+				printf("Port %s Opened\r\n", com_port);
+				printf("\tBaudrate = %d\r\n", sp.baud);
+				printf("\tByteSize = %d\r\n", sp.bits);
+				printf("\tStopBits = %d\r\n", sp.stop);
+				printf("\tParity   = %c\r\n", sp.parity);
+				printf("\tProtocol = %s\r\n", g.protocol->name);
+			}
+		}
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = &comm_fd;
+		if (epoll_ctl( epoll_fd, EPOLL_CTL_ADD, comm_fd, &ev ) != 0) {
+			fprintf(stderr,"Error adding %s to epoll (%s)\r\n", com_port, strerror(errno));
+			exit(1);
+		}
+#endif
 	}
 
+	/*
+	 * set "now" to be the log 'zero' time, and note the wall
+	 * clock time it corresponds to for this session
+	 */
+	if (replay.f) rawcap_replay_anchor(&replay, &(g.t0));
+	else timebase_anchor(&(g.t0));
 
+	/*
+	 * If required, record every byte read, from here on
+	 *
+	 */
+	if (g.rawcap_filename) {
+		char params[16];
+
+		serial_params_str( &sp, params, sizeof(params) );
+		if (rawcap_open(&raw, g.rawcap_filename, &(g.t0), params, 0, g.flush_ms) != 0) {
+			fprintf(stderr,"Couldn't create '%s' (%s), NOT RECORDING\r\n", g.rawcap_filename, strerror(errno));
+		}
+	}
 
 	/*
-	 * If required, open the log file, in append mode
+	 * If required, open the log file, in append mode, the session
+	 * line heads it and every file it's rotated in to
 	 *
 	 */
 	if (g.log_filename) {
 
-		fl = fopen(g.log_filename, "a");
-		if (fl == NULL) {
+		if (logwr_open(&lw, g.log_filename, g.flush_ms, g.log_rotate_bytes, g.log_rotate_hourly, g.log_fsync_ms) != 0) {
 			fprintf(stderr,"Couldn't open '%s' file to write/append, NO LOGGING\r\n", g.log_filename);
+
+		} else {
+			char wall[64];
+			char header[LOGWR_HEADER_MAX];
+
+			timebase_wall_str(g.t0.wall_ns, wall, sizeof(wall));
+			snprintf(header, sizeof(header), "# session %s wall_ns %lld\n", wall, (long long)g.t0.wall_ns);
+			logwr_header(&lw, header);
+		}
+	}
+
+	/*
+	 * If required, open the binary log, records are buffered and
+	 * written out every -F milliseconds rather than per frame
+	 *
+	 */
+	if (g.binlog_filename) {
+		switch (binlog_open(&bl, g.binlog_filename, g.flush_ms, &(g.t0))) {
+			case 0: break;
+			case -2: fprintf(stderr,"'%s' isn't a compatible binary log, NO BINARY LOGGING\r\n", g.binlog_filename); break;
+			default: fprintf(stderr,"Couldn't open '%s' file to write/append, NO BINARY LOGGING\r\n", g.binlog_filename); break;
+		}
+	}
+
+	/*
+	 * If required, open the reading archive, a block is written out
+	 * when it fills or spans a minute, whichever comes first
+	 *
+	 */
+	if (g.archive_filename) {
+		switch (arc_open(&arc, g.archive_filename, ARC_DEFAULT_FLUSH_MS)) {
+			case 0: arc_session(&arc, g.t0.wall_ns); break;
+			case -2: fprintf(stderr,"'%s' isn't a compatible reading archive, NOT ARCHIVING\r\n", g.archive_filename); break;
+			default: fprintf(stderr,"Couldn't open '%s' file to write/append, NOT ARCHIVING\r\n", g.archive_filename); break;
+		}
+	}
+
+	/*
+	 * If required, publish the latest reading in shared memory
+	 *
+	 */
+	if (g.shm_name) {
+		if (shmpub_open(&shm, g.shm_name, 1) != 0) {
+			fprintf(stderr,"Couldn't create shared memory segment '%s' (%s), NOT PUBLISHING\r\n", g.shm_name, strerror(errno));
 		}
+	}
 
-		/* set "now" to be the log 'zero' time */
-		gettimeofday( &t0, &tz );
-		t0i = t0.tv_sec *10 +(t0.tv_usec /100000);
+#ifndef _WIN32
+	/*
+	 * If required, listen for TCP clients to stream readings to, on
+	 * the same epoll loop as the serial port
+	 *
+	 */
+	if (g.net_addr) {
+		switch (netsrv_open(&srv, g.net_addr, g.net_format, epoll_fd, &(g.t0))) {
+			case 0: srv.quiet = g.quiet; break;
+			case -1: fprintf(stderr,"Couldn't understand '%s' as [host:]port, NOT STREAMING\r\n", g.net_addr); break;
+			default: fprintf(stderr,"Couldn't listen on '%s' (%s), NOT STREAMING\r\n", g.net_addr, strerror(errno)); break;
+		}
 	}
+#endif
 
 	/*
-	 * If required, open the text file we're going to generate the multimeter
+	 * If required, set up the text file we're going to generate the multimeter
 	 * data in to, this is a single frame only data file it is NOT a log file
 	 *
 	 */
 	if (g.textfile_output) {
-		fo = fopen("bk390a.txt","w");
-		if (fo == NULL) {
-			fprintf(stderr,"Couldn't open bk390a.data file to write, not saving to file\r\n");
+		if (obsfile_open(&obs, g.output_filename) != 0) {
+			fprintf(stderr,"Couldn't use '%s' as the output file, not saving to file\r\n", g.output_filename);
 			g.textfile_output = 0;
 		}
 	}
 
 	if (!g.quiet) fprintf(stdout,"\r\nPress Ctrl-C to exit\r\n---------------\r\n");
 
-	set_cursor_visible(FALSE);
+	set_cursor_visible(0);
+
+	/*
+	 * The display and OBS file only ever want the latest reading, the
+	 * logs want all of them unless -Q drop
+	 *
+	 */
+	if (!g.quiet) sink_start(&q_display, "Display", SINKQ_DROP_OLDEST, sink_display, &g);
+	if (g.textfile_output) sink_start(&q_obs, "OBS file", SINKQ_DROP_OLDEST, sink_obs, &g);
+	if (lw.running) sink_start(&q_log, "Log", g.log_policy, sink_log, &g);
+	if (bl.f) sink_start(&q_binlog, "Binary log", g.log_policy, sink_binlog, &g);
+	if (arc.f) sink_start(&q_archive, "Archive", g.log_policy, sink_archive, &g);
+	if (g.stats_filename) {
+		stats_init(&st, 0);
+		sink_start(&q_stats, "Statistics", g.log_policy, sink_stats, &g);
+	}
+
+	framer_init(&fr);
+	framer_protocol(&fr, g.protocol);
+	metrics_meter_init(&mm, 0, &fr);
+	reconn_init(&rc, replay.f ? 0 : g.stall_ms, timebase_now_ns());
 
 	/*
 	 * Keep reading, interpreting and converting data until someone
 	 * presses ctrl-c or there's an error
 	 */
 	while (1) {
-		char *p, *q;
-		double v = 0.0;
-		int end_of_frame_received = 0;
-
-		units[0] = '\0';
-		prefix[0] = '\0';
-		mmode[0] = '\0';
-		logscale = 1;
 
+		/*
+		 * Counters and histograms, on request and every second
+		 * for -I
+		 */
+		if (sigusr1_pressed) {
+			sigusr1_pressed = 0;
+			fprintf(stderr,"\r\n");
+			write_metrics(stderr, METRICS_TEXT, NULL);
+		}
+		if (g.metrics_filename && (timebase_now_ns() - metrics_written >= STATS_WRITE_INTERVAL_NS)) {
+			metrics_write_file(g.metrics_filename, write_metrics, NULL);
+			metrics_written = timebase_now_ns();
+		}
 
 		/*
-		 * If the ctrl-c was pressed, then clean up things
-		 * and exit 
+		 * Port lost, or no frames for -W; close it and reopen it,
+		 * with the same parameters, as the backoff allows
 		 */
-		if (sigint_pressed) {
-			exit(1);
+		now = timebase_now_ns();
+		switch (replay.f ? RECONN_NONE : reconn_due(&rc, now)) {
+			case RECONN_CLOSE: comms_down( &g, com_port, RECONN_STALLED, now ); break;
+			case RECONN_REOPEN: comms_reopen( &g, com_port, &sp, now ); break;
+			default: break;
 		}
+		rawcap_tick(&raw, now);	// -F, with the port quiet too
 
 
 		/*
 		 * Time to start receiving the serial block data 
 		 *
-		 * We initially "stage" here waiting for there to 
-		 * be something happening on the com port.  Soon as
-		 * something happens, then we move forward to trying
-		 * to read the data.
+		 * Whatever the port has available is read in one go straight
+		 * in to the framer's ring buffer.  The comm time-outs end the
+		 * ReadFile() at the gap between frames (on Linux epoll wakes us
+		 * at VMIN bytes, kept at what the framer needs to finish the
+		 * frame it's on) so this is normally a single call per frame.
+		 * Once the framer has a complete and well formed frame we move
+		 * on to decoding it.
+		 *
+		 * Each read is time stamped the moment it returns, and each
+		 * frame carries the stamp of the read holding its final \n.
+		 * With -w the read is recorded as is, and with -r the
+		 * recording's chunks take the place of reads.
+		 *
+		 * A failed read, or on Linux end of file or a hang up, means
+		 * the port's gone (USB adaptor unplugged or bumped); it's
+		 * closed and left to the reopen above.
 		 *
 		 */
-		com_read_status = WaitCommEvent(hComm, &dwEventMask, NULL); //Wait for the character to be received
-
+		if (framer_next(&fr, d, &(se.t_ns)) == 0) {
+			uint8_t *wp;
+			size_t wlen;
 
-		if (com_read_status == FALSE) {
-			fprintf(stderr,"Error in WaitCommEvent()\r\n");
-
-		} else {
 			/*
-			 * If we're not in debug mode, then read the data from the
-			 * com port until we get a \n character, which is the 
-			 * end-of-frame marker.
-			 *
-			 * This is the section where we're capturing the data bytes
-			 * from the multimeter.
-			 *
+			 * If the ctrl-c was pressed, then clean up things
+			 * and exit; checked only once everything read has
+			 * been framed, so -w never holds a frame the outputs
+			 * didn't get
 			 */
+			if (sigint_pressed) {
+				exit(1);
+			}
 
-			if (g.debug) fprintf(stdout,"DATA START: ");
-			end_of_frame_received = 0;
-			i = 0;
-			do {
-				com_read_status = ReadFile(hComm, &temp_char, sizeof(temp_char), &bytes_read, NULL);
-				d[i] = temp_char;
-				if (g.debug) fprintf(stdout,"%x ", d[i]);
-				if (temp_char == '\n') { end_of_frame_received = 1; break; }
-				i++;
-			} while ((bytes_read > 0) && (i < sizeof(d)));
-			if (g.debug) fprintf(stdout,":END\r\n");
-		}	
-
-
-		/*
-		 * Decode our data.  
-		 *
-		 * While the data sheet gives a very nice matrix for the RANGE and FUNCTION values
-		 * it's probably more human-readable to break it down in to longer code on a per
-		 * function selection.
-		 *
-		 */
-		switch (d[BYTE_FUNCTION]) {
-
-			case FUNCTION_VOLTAGE: 
-				snprintf(units,sizeof(units),"V");
-				snprintf(mmode,sizeof(mmode),"Volts");
-
-				switch (d[BYTE_RANGE] & 0x0F) {
-					case 0: dps = 1; snprintf(prefix, sizeof(prefix), "m"); break;
-					case 1: dps = 3; break;
-					case 2: dps = 2; break;
-					case 3: dps = 1; break;
-					case 4: dps = 0; break;
-				} // test the range byte for voltages
-				break; // FUNCTION_VOLTAGE
-
-
-			case FUNCTION_CURRENT_UA:
-				snprintf(units,sizeof(units),"A");
-				snprintf(prefix,sizeof(prefix),"m");
-				snprintf(mmode,sizeof(mmode),"Amps");
-
-				switch (d[BYTE_RANGE] & 0x0F) {
-					case 0: dps = 2; break;
-					case 1: dps = 1; break;
+			wp = framer_write_ptr(&fr, &wlen);
+#ifdef _WIN32
+			if (replay.f) {
+				bytes_read = replay_read( &g, wp, wlen, &t_rx, &timeout_ms );
+				if (bytes_read == 0) {
+					if (timeout_ms > 0) Sleep(timeout_ms);
+					continue;
 				}
-				break; // FUNCTION_CURRENT_UA
-
-
-
-			case FUNCTION_CURRENT_MA:
-				snprintf(units,sizeof(units),"A");
-				snprintf(prefix,sizeof(prefix),"μ");
-				snprintf(mmode,sizeof(mmode),"Amps");
-
-				switch (d[BYTE_RANGE] & 0x0F) {
-					case 0: dps = 1; break;
-					case 1: dps = 0; break;
+			} else if (hComm == INVALID_HANDLE_VALUE) {
+				timeout_ms = reconn_timeout_ms(&rc, timebase_now_ns());
+				Sleep(((timeout_ms < 0) || (timeout_ms > 100)) ? 100 : timeout_ms);	// stay responsive to ctrl-c
+				continue;
+			} else {
+				com_read_status = ReadFile(hComm, wp, wlen, &bytes_read, NULL);
+				t_rx = timebase_now_ns();
+				if (com_read_status == FALSE) {
+					fprintf(stderr,"Error in ReadFile() (%lu)\r\n", (unsigned long)GetLastError());
+					comms_down( &g, com_port, RECONN_LOST, t_rx );
+					continue;
 				}
-				break; // FUNCTION_CURRENT_MA
-
-
-			case FUNCTION_CURRENT_A:
-				snprintf(units,sizeof(units),"A");
-				snprintf(mmode,sizeof(mmode),"Amps");
-				break; // FUNCTION_CURRENT_A
-
-
-
-			case FUNCTION_OHMS:
-				snprintf(mmode,sizeof(mmode),"Resistance");
-				snprintf(units,sizeof(units),"Ω");
-
-				switch (d[BYTE_RANGE] & 0x0F) {
-					case 0: dps = 1; break;
-					case 1: dps = 3; snprintf(prefix,sizeof(prefix),"k"); break;
-					case 2: dps = 2; snprintf(prefix,sizeof(prefix),"k"); break;
-					case 3: dps = 1; snprintf(prefix,sizeof(prefix),"k"); break;
-					case 4: dps = 3; snprintf(prefix,sizeof(prefix),"M"); break;
-					case 5: dps = 2; snprintf(prefix,sizeof(prefix),"M"); break;
+				if (raw.f) rawcap_append(&raw, 0, g.protocol->id, t_rx, wp, bytes_read);
+			}
+#else
+			if (replay.f) {
+				/*
+				 * TCP clients are still serviced, between chunks
+				 */
+				if ((srv.listen_fd >= 0) && (epoll_wait(epoll_fd, &ev, 1, 0) > 0)) {
+					netsrv_event(&srv, ev.data.ptr, ev.events);
+					continue;
+				}
+				bytes_read = replay_read( &g, wp, wlen, &t_rx, &timeout_ms );
+				if (bytes_read == 0) {
+					if ((timeout_ms > 0) && (epoll_wait(epoll_fd, &ev, 1, timeout_ms) > 0)) netsrv_event(&srv, ev.data.ptr, ev.events);
+					continue;
+				}
+			} else {
+				timeout_ms = reconn_timeout_ms(&rc, timebase_now_ns());
+				if (g.metrics_filename && ((timeout_ms < 0) || (timeout_ms > 1000))) timeout_ms = 1000;
+				if (rawcap_due(&raw) && ((timeout_ms < 0) || (rawcap_due(&raw) - now < (uint64_t)timeout_ms * 1000000ULL))) {
+					timeout_ms = (rawcap_due(&raw) - now + 999999) / 1000000;
 				}
-				break; // FUNCTION_OHMS
-
-
-
-			case FUNCTION_CONTINUITY:
-				snprintf(mmode,sizeof(mmode),"Continuity");
-				snprintf(units,sizeof(units),"Ω");
-				dps = 1;
-				break; // FUNCTION_CONTINUITY
-
-
-			case FUNCTION_DIODE:
-				snprintf(mmode,sizeof(mmode),"Diode");
-				snprintf(units,sizeof(units),"V");
-				dps = 1;
-				break; // FUNCTION_DIODE
-
-
-			case FUNCTION_FQ_RPM:
-				if (d[BYTE_STATUS] & STATUS_JUDGE) {
-					snprintf(mmode,sizeof(mmode),"Frequency");
-					snprintf(units,sizeof(units),"Hz");
-					switch (d[BYTE_RANGE] & 0x0F) {
-						case 0: dps = 3; snprintf(prefix, sizeof(prefix),"k"); break;
-						case 1: dps = 2; snprintf(prefix, sizeof(prefix),"k"); break;
-						case 2: dps = 1; snprintf(prefix, sizeof(prefix),"k"); break;
-						case 3: dps = 3; snprintf(prefix, sizeof(prefix),"M"); break;
-						case 4: dps = 2; snprintf(prefix, sizeof(prefix),"M"); break;
-						case 5: dps = 1; snprintf(prefix, sizeof(prefix),"M"); break;
-					} // switch
-
-				} else {
-					snprintf(mmode,sizeof(mmode),"RPM");
-					snprintf(units,sizeof(units),"rpm");
-					switch (d[BYTE_RANGE] & 0x0F) {
-						case 0: dps = 2; snprintf(prefix, sizeof(prefix),"k"); break;
-						case 1: dps = 1; snprintf(prefix, sizeof(prefix),"k"); break;
-						case 2: dps = 3; snprintf(prefix, sizeof(prefix),"M"); break;
-						case 3: dps = 2; snprintf(prefix, sizeof(prefix),"M"); break;
-						case 4: dps = 1; snprintf(prefix, sizeof(prefix),"M"); break;
-						case 5: dps = 0; snprintf(prefix, sizeof(prefix),"M"); break;
-					} // switch
+				if ((comm_fd >= 0) && (framer_wanted(&fr) != (uint32_t)comm_vmin)) {
+					comm_vmin = framer_wanted(&fr);
+					serial_set_vmin(comm_fd, comm_vmin);
 				}
-				break; // FUNCTION_FQ_RPM
-
-
-
-			case FUNCTION_CAPACITANCE:
-				snprintf(mmode,sizeof(mmode),"Capacitance");
-				snprintf(units,sizeof(units),"F");
-				switch (d[BYTE_RANGE] & 0x0F) {
-					case 0: dps = 3; snprintf(prefix, sizeof(prefix),"n"); break;
-					case 1: dps = 2; snprintf(prefix, sizeof(prefix),"n"); break;
-					case 2: dps = 1; snprintf(prefix, sizeof(prefix),"n"); break;
-					case 3: dps = 3; snprintf(prefix, sizeof(prefix),"μ"); break;
-					case 4: dps = 2; snprintf(prefix, sizeof(prefix),"μ"); break;
-					case 5: dps = 1; snprintf(prefix, sizeof(prefix),"μ"); break;
-					case 6: dps = 3; snprintf(prefix, sizeof(prefix),"m"); break;
-					case 7: dps = 2; snprintf(prefix, sizeof(prefix),"m"); break;
+				if (epoll_wait(epoll_fd, &ev, 1, timeout_ms) < 1) continue; // EINTR, ctrl-c, -I refresh, reopen due
+				if (ev.data.ptr != &comm_fd) {
+					netsrv_event(&srv, ev.data.ptr, ev.events);
+					continue;
 				}
-				break; // FUNCTION_CAPACITANCE
-
-			case FUNCTION_TEMPERATURE:
-				snprintf(mmode,sizeof(mmode),"Temperature");
-				if (d[BYTE_STATUS] & STATUS_JUDGE) {
-					snprintf(units,sizeof(units),"'C");
-				} else {
-					snprintf(units,sizeof(units),"'F");
+				bytes_read = read(comm_fd, wp, wlen);
+				t_rx = timebase_now_ns();
+				if (bytes_read <= 0) {
+					if ((bytes_read < 0) && (errno == EAGAIN) && !(ev.events & (EPOLLHUP | EPOLLERR))) continue;
+					if (bytes_read < 0) fprintf(stderr,"\r\nError in read() (%s)\r\n", strerror(errno));
+					comms_down( &g, com_port, RECONN_LOST, t_rx );
+					continue;
 				}
-				break; // FUNCTION_TEMPERATURE
+				if (raw.f) rawcap_append(&raw, 0, g.protocol->id, t_rx, wp, bytes_read);
+			}
+#endif
 
-		}
+			if (g.debug) {
+				fprintf(stdout,"DATA START: ");
+				for (i = 0; i < bytes_read; i++) fprintf(stdout,"%x ", wp[i]);
+				fprintf(stdout,":END\r\n");
+			}
+
+			framer_commit(&fr, bytes_read, t_rx);
+			continue;
+		}	
 
 
 		/*
-		 * Decode the digit data in to human-readable 
+		 * Decode our data.
 		 *
-		 * first byte is the sign +/-
-		 * bytes 1..4 are ASCII char codes for 0000-9999
+		 * The function/range matrix from the data sheet lives in decode.c
+		 * and is shared with win-bk390a; frames with an unknown function
+		 * or range are dropped rather than shown with stale units.
 		 *
-		 */
-		v = ((d[1] & 0x0F ) *1000) 
-			+((d[2] & 0x0F ) *100)
-			+((d[3] & 0x0F ) *10)
-			+((d[4] & 0x0F ) *1);
-
-		/*
-		 * If we're not showing the meter mode, then just
-		 * zero the string we generated previously
-		 */
-		if (g.show_mode == 0) {
-			mmode[0] = 0;
-			mode_separator[0] = 0;
-		} 
-
-		/** range checks **/
-		if ( (d[BYTE_STATUS] & STATUS_OL) == 1 ) {
-			snprintf(cmd, sizeof(cmd), "O.L." );
-
-		} else {
-			if (dps < 0) dps = 0;
-			if (dps > 3) dps = 3;
-
-			switch (dps) {
-				case 0: snprintf(cmd, sizeof(cmd), "% 05.0f%s%s%s%s",v, prefix, units, mode_separator, mmode ); break;
-				case 1: snprintf(cmd, sizeof(cmd), "% 06.1f%s%s%s%s",v/10, prefix, units, mode_separator, mmode ); break;
-				case 2: snprintf(cmd, sizeof(cmd), "% 06.2f%s%s%s%s",v/100, prefix, units, mode_separator, mmode ); break;
-				case 3: snprintf(cmd, sizeof(cmd), "% 06.3f%s%s%s%s",v/1000, prefix, units, mode_separator, mmode ); break;
-			}
-		}
-
-		/*
-		 * If we're generating the output file for OBS
-		 * then rewind and rewrite the file each time.
+		 * Any well formed frame shows the meter's talking, and ends
+		 * an outage.
 		 *
 		 */
-		if (g.textfile_output) {
-			rewind(fo);
-			fprintf(fo, "%s%c", cmd, 0);
-			fflush(fo);
+		comms_back( &g, com_port, se.t_ns );
+		if (g.protocol->decode(d, &(se.r)) != 0) {
+			mm.decode_errors++;
+			continue;
 		}
+		metrics_meter_reading(&mm, &(se.r));
+
+		se.type = SINKQ_READING;
+		se.meter = 0;
+		memcpy(se.raw, d, BK390A_PAYLOAD_MAX);
 
 		/*
-		 * If we're generating the lof file, make sure we
-		 * put down the time-delta 
-		 *
-		 * FIXME: we don't yet set the appropriate logscale in the
-		 *			range/function switch statement sequence
+		 * The shared memory slot is a seqlock and the TCP clients are
+		 * non-blocking, publishing never waits, everything else is
+		 * handed to its output thread
 		 *
 		 */
-		if (g.log_filename && fl) {
-			gettimeofday( &t1, &tz );
-			t1i = t1.tv_sec *10 +(t1.tv_usec /100000);
-			fprintf(fl, "%0.1f %0.6f %s\n"
-					, (t1i -t0i)/10.0
-					, v /logscale
-					, units 
-				   );
-			fflush(fl);
-		}
-
-		if (!g.quiet) {
-			//			fprintf(stdout, "\33[2K\r"); // line erase
-			//			fprintf(stdout, "\x1B[2A"); // line up
-			//			fprintf(stdout, "\33[2K\r"); // line erase
-			//		if (g.debug) fprintf(stdout,"[ %03d %03d %03d %03d %03d %03d ]", d[6], d[7], d[8], d[9], d[10], d[11]);
-			fprintf(stdout,"\r%c %s", hbc, cmd );
-			fflush(stdout);
-			if (hbc == ' ') hbc = '.'; else hbc = ' ';
-
-		}
+		if (g.shm_name) shmpub_update(&shm, 0, 0, se.t_ns, &(se.r));
+#ifndef _WIN32
+		if (srv.listen_fd >= 0) netsrv_publish(&srv, 0, se.t_ns, se.raw, &(se.r));
+#endif
 
+		publish( &g, &se );
+		if (rawcap_replay_timed(&replay)) metrics_hist_record(&publish_latency, timebase_now_ns() - se.t_ns);
 	}
 
-	CloseHandle(hComm);//Closing the Serial Port
-
 	return 0;
 }
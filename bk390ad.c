@@ -0,0 +1,1371 @@
+/*
+ * BK Precision Model 390A multi-meter capture daemon
+ *
+ * Captures any number of 390A meters from a single process and a
+ * single epoll event loop, tagging every reading with the meter id
+ * and stamping all of them from one shared monotonic time base.
+ *
+ * Build on Linux;
+ *		make bk390ad
+ *
+ * Run;
+ *		./bk390ad -p /dev/ttyUSB0 -p /dev/ttyUSB1 -l rack.log
+ *		./bk390ad -c rack.conf -l rack.log
+ *
+ * The config file has one meter per line, the device and optionally
+ * its serial parameters and protocol, '#' starts a comment;
+ *
+ *		/dev/ttyUSB0
+ *		/dev/ttyUSB1 9600:8n1
+ *		/dev/ttyUSB2 es51922
+ *
+ * Each meter is decoded with its own protocol (see proto.h), or the -y
+ * one, so a rack of mixed meters is captured by the one daemon.
+ *
+ * Meter ids are assigned in the order the ports are given, from 1.
+ *
+ * Without -p or -c every serial port is probed, and each one with a
+ * meter on it is captured at the settings it was found at.
+ *
+ * A meter whose port is lost (adaptor unplugged) or goes quiet for -W
+ * is closed and reopened, with backoff, while the others carry on.
+ *
+ * -w records every read, tagged with its meter id, and -r plays such a
+ * recording back in place of the ports; see rawcap.h.
+ *
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include "decode.h"
+#include "framer.h"
+#include "proto.h"
+#include "serial.h"
+#include "serprobe.h"
+#include "timebase.h"
+#include "binlog.h"
+#include "rawcap.h"
+#include "logwr.h"
+#include "shmpub.h"
+#include "netsrv.h"
+#include "stats.h"
+#include "metrics.h"
+#include "reconn.h"
+
+#define METERS_MAX 64
+#define EVENTS_MAX 16
+
+char VERSION[] = "v0.1-Alpha";
+char help[] = " -p <port> [-p <port> ...] | -c <config file> | -P | -r <filename> [-X <speed>] [-s <serial port config>] [-y <protocol>] [-w <filename>] [-l <filename>] [-R <size>] [-H] [-Y <ms>] [-b <filename>] [-F <ms>] [-M <name>] [-N <[host:]port>] [-E <line|bin>] [-S <filename>] [-I <filename>] [-W <ms>] [-m] [-d] [-q]\r\n"\
+			   "\n"\
+			   "\t\tBK-Precision 390A Multi-meter capture daemon\r\n"\
+			   "\r\n"\
+			   "\t-h: This help\r\n"\
+			   "\t-p <port>: Add a meter, device path or number for /dev/ttyUSB<n>, repeat for more meters\r\n"\
+			   "\t-c <filename>: Read meters from a config file, one '<port> [serial config] [protocol]' per line\r\n"\
+			   "\t-P: Find meters, listening on every serial port (or just the -p/-c ones) at once at each speed and parity, then exit\r\n"\
+			   "\t\t(without -p or -c, every meter found this way is captured)\r\n"\
+			   "\t-r <filename>: Replay a raw capture made with -w in place of the ports, its meters and times as recorded\r\n"\
+			   "\t-X <speed>: -r replay speed, 1 = as recorded (default), 0 = as fast as possible\r\n"\
+			   "\t-s <[19200|9600|4800|2400|1200]:[7|8][o|e|n][1|2]>, default for meters without their own, eg: -s 2400:7o1\r\n"\
+			   "\t-y <protocol>: Protocol for meters without their own, bk390a (default) or es51922 (19200:7o1, UT61E and the like)\r\n"\
+			   "\t\t(without -s or their own, meters use their protocol's serial config)\r\n"\
+			   "\t-w <filename>: Record every byte read from every meter, and when, to <filename> (replaced)\r\n"\
+			   "\t-l <filename>: Set logging and the filename for the log\r\n"\
+			   "\t-R <size>: Rotate the log when it reaches <size>, eg: -R 100M\r\n"\
+			   "\t-H: Rotate the log every hour\r\n"\
+			   "\t-Y <ms>: fsync the log every <ms> (default never)\r\n"\
+			   "\t-b <filename>: Set binary logging and the filename for the binary log\r\n"\
+			   "\t-F <ms>: Log and binary log flush interval (default 1000ms)\r\n"\
+			   "\t-M <name>: Publish the latest readings in shared memory segment <name>, eg: -M /bk390a\r\n"\
+			   "\t-N <[host:]port>: Stream readings to TCP clients connecting to <port>, eg: -N 5390\r\n"\
+			   "\t-E <line|bin>: -N stream as log lines or binary log records (default line)\r\n"\
+			   "\t-S <filename>: Keep per meter session and 1s/10s/1m statistics, refreshed in <filename> every second\r\n"\
+			   "\t-I <filename>: Write counters and latency histograms to <filename> every second, Prometheus text format\r\n"\
+			   "\t\t(SIGUSR1 dumps them to stderr at any time)\r\n"\
+			   "\t-W <ms>: Reopen a meter's port when no frame has arrived for <ms> (default 5000, 0 = never)\r\n"\
+			   "\t-d: debug enabled\r\n"\
+			   "\t-m: show multimeter mode\r\n"\
+			   "\t-q: quiet output\r\n"\
+			   "\t-v: show version\r\n"\
+			   "\n\n\texample: bk390ad -p 0 -p 1 -p /dev/ttyS0 -l rack.log\r\n"\
+			   "\r\n";
+
+uint8_t sigint_pressed;
+uint8_t sigusr1_pressed;
+
+struct meter {
+	int id;
+	int fd;
+	char port[256];
+	char serial_params[32];
+	const struct proto *proto;	// NULL for the -y protocol
+	char device[256];			// port, as opened
+	struct serial_params sp;	// as opened, and reopened
+	struct reconn rc;
+	struct framer fr;
+	int vmin;					// bytes the port's read wakes at, framer_wanted()
+	uint64_t readings;
+	struct stats st;
+};
+
+struct glb {
+	uint8_t debug;
+	uint8_t quiet;
+	uint8_t show_mode;
+	uint8_t probe;
+
+	char *serial_params;
+	const struct proto *protocol;	// -y, meters without their own
+	char *log_filename;
+	uint64_t log_rotate_bytes;
+	int log_rotate_hourly;
+	uint32_t log_fsync_ms;
+	char *binlog_filename;
+	uint32_t flush_ms;		// -F, text and binary logs
+	char *shm_name;
+	char *net_addr;
+	int net_format;			// NETSRV_LINE or NETSRV_BINARY
+	char *stats_filename;
+	char *metrics_filename;
+	char *config_filename;
+	uint32_t stall_ms;		// -W, 0 = only reopen on a read error
+	char *rawcap_filename;	// -w
+	char *replay_filename;	// -r
+	double replay_speed;	// -X, 0 = as fast as possible
+
+	struct timebase_anchor t0;	// shared time base zero, and the wall time then
+
+	int meter_count;
+	struct meter meters[METERS_MAX];
+	struct metrics_meter mm[METERS_MAX];	// meters[<n>]'s counters, one array for metrics_meters_write()
+};
+
+/*
+ * Globals only so that we can cleanly close them atexit()
+ */
+struct logwr lw;
+struct binlog bl;
+struct shmpub shm;
+struct netsrv srv;
+struct metrics_hist publish_latency;	// frame arrival to every output done
+struct rawcap raw;		// Raw byte capture, -w
+struct rawcap_reader replay;	// Raw byte capture being replayed, -r
+int epoll_fd = -1;
+struct glb *glbs;
+
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-111020
+  Function Name	: init
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int init( struct glb *g ) {
+	g->debug = 0;
+	g->quiet = 0;
+	g->show_mode = 0;
+	g->probe = 0;
+
+	g->serial_params = NULL;
+	g->protocol = &proto_bk390a;
+	g->log_filename = NULL;
+	g->log_rotate_bytes = 0;
+	g->log_rotate_hourly = 0;
+	g->log_fsync_ms = 0;
+	g->binlog_filename = NULL;
+	g->flush_ms = BINLOG_DEFAULT_FLUSH_MS;
+	g->shm_name = NULL;
+	g->net_addr = NULL;
+	g->net_format = NETSRV_LINE;
+	g->stats_filename = NULL;
+	g->metrics_filename = NULL;
+	g->config_filename = NULL;
+	g->stall_ms = RECONN_DEFAULT_STALL_MS;
+	g->rawcap_filename = NULL;
+	g->replay_filename = NULL;
+	g->replay_speed = 1;
+
+	g->meter_count = 0;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-111034
+  Function Name	: add_meter
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g,
+  2. const char *port,
+  3. const char *serial_params, NULL for the -s default
+  4. const struct proto *proto, NULL for the -y protocol
+  ------------------
+  Exit Codes	: 0 = ok, -1 = too many meters
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int add_meter( struct glb *g, const char *port, const char *serial_params, const struct proto *proto ) {
+	struct meter *m;
+
+	if (g->meter_count >= METERS_MAX) {
+		fprintf(stderr,"Too many meters, maximum is %d\r\n", METERS_MAX);
+		return -1;
+	}
+
+	m = &(g->meters[g->meter_count]);
+	memset(m, 0, sizeof(struct meter));
+	m->id = g->meter_count +1;
+	m->fd = -1;
+	snprintf(m->port, sizeof(m->port), "%s", port);
+	if (serial_params) snprintf(m->serial_params, sizeof(m->serial_params), "%s", serial_params);
+	m->proto = proto;
+	framer_init(&(m->fr));
+	stats_init(&(m->st), m->id);
+	metrics_meter_init(&(g->mm[g->meter_count]), m->id, &(m->fr));
+
+	g->meter_count++;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-111047
+  Function Name	: load_config
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g,
+  2. const char *fn ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = couldn't read the file
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int load_config( struct glb *g, const char *fn ) {
+	FILE *f;
+	char line[1024];
+
+	f = fopen(fn, "r");
+	if (f == NULL) {
+		fprintf(stderr,"Couldn't open config file '%s' (%s)\r\n", fn, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		const struct proto *proto = NULL;
+		char *port, *params, *name, *p;
+
+		p = strchr(line, '#');
+		if (p) *p = '\0';
+
+		port = strtok(line, " \t\r\n");
+		if (port == NULL) continue;
+		params = strtok(NULL, " \t\r\n");
+
+		/*
+		 * '<port> <protocol>' as well as '<port> <params> <protocol>'
+		 */
+		if (params && (proto = proto_find(params))) params = NULL;
+		else if ((name = strtok(NULL, " \t\r\n")) && ((proto = proto_find(name)) == NULL)) {
+			fprintf(stderr,"%s: unknown protocol '%s' for %s\r\n", fn, name, port);
+			fclose(f);
+			return -1;
+		}
+
+		if (add_meter(g, port, params, proto) != 0) break;
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-183305
+  Function Name	: probe_meters
+  Returns Type	: void
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: exits for -P, or if there are no meters to be found
+  --------------------------------------------------------------------
+Comments:
+	The given meters' ports, or every serial port if none were,
+	are probed in parallel, see serprobe.c.  Without -P the meters
+	found are added, in port order, with the settings they were
+	found at.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void probe_meters( struct glb *g ) {
+	static struct serprobe probe;
+	struct serial_params sp;
+	char device[256], params[32];
+	int i, n;
+
+	serial_default_params( &sp );
+	serial_parse_params( g->protocol->serial_params, &sp );
+	if (g->serial_params && serial_parse_params( g->serial_params, &sp ) != SERIAL_PARAM_OK) {
+		fprintf(stderr,"Invalid serial parameters '%s'\r\n", g->serial_params);
+		exit(1);
+	}
+
+	serprobe_init(&probe, &sp);
+	probe.proto = g->protocol;
+	for (i = 0; i < g->meter_count; i++) {
+		serprobe_add(&probe, serial_device_path( g->meters[i].port, device, sizeof(device) ));
+	}
+	if (g->meter_count == 0) serprobe_add_candidates(&probe);
+
+	if (!g->quiet) fprintf(stderr,"Looking for meters on %d serial ports ...\r\n", probe.count);
+	n = serprobe_run(&probe, SERPROBE_DEFAULT_WINDOW_MS, 0);
+	if (n < 0) {
+		fprintf(stderr,"Couldn't probe the serial ports (%s)\r\n", strerror(errno));
+		exit(1);
+	}
+
+	for (i = 0; i < probe.count; i++) {
+		struct serprobe_port *p = &(probe.p[i]);
+
+		if (p->state == SERPROBE_MATCH) {
+			serial_params_str(&(p->sp), params, sizeof(params));
+			fprintf(g->probe ? stdout : stderr,"Meter found on %s at %s\r\n", p->device, params);
+			if (!g->probe && (add_meter(g, p->device, params, NULL) != 0)) break;
+
+		} else if (g->debug && (p->state == SERPROBE_OPEN_FAILED)) {
+			fprintf(stderr,"%s: %s\r\n", p->device, strerror(p->err));
+		}
+	}
+
+	if (g->probe) exit(n ? 0 : 1);
+	if (n == 0) {
+		fprintf(stderr,"No meters found on any serial port, try -p <port> or -c <config file>\r\n");
+		exit(1);
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-111058
+  Function Name	: parse_parameters
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g,
+  2.  int argc,
+  3.  char **argv ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int parse_parameters( struct glb *g, int argc, char **argv ) {
+
+	int i;
+
+	for (i = 0; i < argc; i++) {
+
+		if (argv[i][0] == '-') {
+
+			/* parameter */
+			switch (argv[i][1]) {
+				case 'h':
+					fprintf(stdout,"Usage: %s %s", argv[0], help);
+					exit(1);
+					break;
+
+				case 'p':
+					i++;
+					if (i < argc) {
+						if (add_meter(g, argv[i], NULL, NULL) != 0) exit(1);
+					} else {
+						fprintf(stderr,"Insufficient parameters; -p <port>\n");
+						exit(1);
+					}
+					break;
+
+				case 'P':
+					g->probe = 1;
+					break;
+
+				case 'c':
+					i++;
+					if (i < argc) g->config_filename = argv[i];
+					else {
+						fprintf(stderr,"Insufficient parameters; -c <config file>\n");
+						exit(1);
+					}
+					break;
+
+				case 'l':
+					i++;
+					if (i < argc) g->log_filename = argv[i];
+					else {
+						fprintf(stderr,"Require log filename; -l <filename>\n");
+						exit(1);
+					}
+					break;
+
+				case 'R':
+					i++;
+					if ((i < argc) && (g->log_rotate_bytes = logwr_parse_size(argv[i]))) break;
+					fprintf(stderr,"Require log rotation size; -R <bytes[k|M|G]>\n");
+					exit(1);
+					break;
+
+				case 'H':
+					g->log_rotate_hourly = 1;
+					break;
+
+				case 'Y':
+					i++;
+					if (i < argc) g->log_fsync_ms = strtoul(argv[i], NULL, 10);
+					else {
+						fprintf(stderr,"Insufficient parameters; -Y <milliseconds>\n");
+						exit(1);
+					}
+					break;
+
+				case 'W':
+					i++;
+					if (i < argc) g->stall_ms = strtoul(argv[i], NULL, 10);
+					else {
+						fprintf(stderr,"Require stall time; -W <ms>\n");
+						exit(1);
+					}
+					break;
+
+				case 'w':
+					i++;
+					if (i < argc) g->rawcap_filename = argv[i];
+					else {
+						fprintf(stderr,"Require raw capture filename; -w <filename>\n");
+						exit(1);
+					}
+					break;
+
+				case 'r':
+					i++;
+					if (i < argc) g->replay_filename = argv[i];
+					else {
+						fprintf(stderr,"Require raw capture filename; -r <filename>\n");
+						exit(1);
+					}
+					break;
+
+				case 'X':
+					i++;
+					if (i < argc) g->replay_speed = strtod(argv[i], NULL);
+					else {
+						fprintf(stderr,"Require replay speed; -X <speed>\n");
+						exit(1);
+					}
+					break;
+
+				case 'b':
+					i++;
+					if (i < argc) g->binlog_filename = argv[i];
+					else {
+						fprintf(stderr,"Require binary log filename; -b <filename>\n");
+						exit(1);
+					}
+					break;
+
+				case 'F':
+					i++;
+					if (i < argc) g->flush_ms = strtoul(argv[i], NULL, 10);
+					else {
+						fprintf(stderr,"Insufficient parameters; -F <milliseconds>\n");
+						exit(1);
+					}
+					break;
+
+				case 'S':
+					i++;
+					if (i < argc) g->stats_filename = argv[i];
+					else {
+						fprintf(stderr,"Require statistics filename; -S <filename>\n");
+						exit(1);
+					}
+					break;
+
+				case 'I':
+					i++;
+					if (i < argc) g->metrics_filename = argv[i];
+					else {
+						fprintf(stderr,"Require metrics filename; -I <filename>\n");
+						exit(1);
+					}
+					break;
+
+				case 'N':
+					i++;
+					if (i < argc) g->net_addr = argv[i];
+					else {
+						fprintf(stderr,"Require port to listen on; -N <[host:]port>\n");
+						exit(1);
+					}
+					break;
+
+				case 'E':
+					i++;
+					if ((i < argc) && (strcmp(argv[i], "line") == 0)) g->net_format = NETSRV_LINE;
+					else if ((i < argc) && (strcmp(argv[i], "bin") == 0)) g->net_format = NETSRV_BINARY;
+					else {
+						fprintf(stderr,"Require stream encoding; -E <line|bin>\n");
+						exit(1);
+					}
+					break;
+
+				case 'M':
+					i++;
+					if (i < argc) g->shm_name = argv[i];
+					else {
+						fprintf(stderr,"Require shared memory name; -M <name>\n");
+						exit(1);
+					}
+					break;
+
+				case 's':
+					i++;
+					if (i < argc) g->serial_params = argv[i];
+					else {
+						fprintf(stderr,"Insufficient parameters; -s <parameters> [eg 2400:7o1] = 2400, 7-bit, odd, 1-stop\n");
+						exit(1);
+					}
+					break;
+
+				case 'y':
+					/* protocol for meters without their own */
+					i++;
+					if ((i < argc) && (g->protocol = proto_find(argv[i]))) break;
+					fprintf(stderr,"Require a known protocol; -y <bk390a|es51922>\n");
+					exit(1);
+					break;
+
+				case 'd':
+					g->debug = 1;
+					break;
+
+				case 'q':
+					g->quiet = 1;
+					break;
+
+				case 'm':
+					g->show_mode = 1;
+					break;
+
+				case 'v':
+					fprintf(stdout,"%s\r\n", VERSION);
+					exit(0);
+					break;
+
+				default:
+					break;
+			} // switch
+		}
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-111110
+  Function Name	: handle_sigint
+  Returns Type	: void
+  ----Parameter List
+  1. int a ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void handle_sigint( int a ) {
+	sigint_pressed = 1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-175540
+  Function Name	: handle_sigusr1
+  Returns Type	: void
+  ----Parameter List
+  1. int a ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void handle_sigusr1( int a ) {
+	sigusr1_pressed = 1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-175552
+  Function Name	: write_metrics
+  Returns Type	: void
+  ----Parameter List
+  1. FILE *f,
+  2. int format, METRICS_TEXT or METRICS_PROMETHEUS
+  3. void *ctx, struct glb ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Every output is written inline from the loop, so the one
+	latency is frame arrival to the last of them
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void write_metrics( FILE *f, int format, void *ctx ) {
+	struct glb *g = ctx;
+	char labels[32];
+	int i;
+
+	metrics_meters_write(f, format, g->mm, g->meter_count);
+
+	metrics_header(f, format, "bk390a_publish_latency_seconds", "histogram", "Frame arrival to every output done");
+	metrics_hist_write(f, format, "bk390a_publish_latency_seconds", "", &publish_latency);
+
+	metrics_header(f, format, "bk390a_port_up", "gauge", "1 while frames are arriving, 0 during an outage");
+	for (i = 0; i < g->meter_count; i++) {
+		snprintf(labels, sizeof(labels), "meter=\"%d\"", g->meters[i].id);
+		metrics_counter(f, format, "bk390a_port_up", labels, g->meters[i].rc.state == RECONN_UP);
+	}
+	metrics_header(f, format, "bk390a_outages_total", "counter", "Times the port was lost or stalled");
+	for (i = 0; i < g->meter_count; i++) {
+		snprintf(labels, sizeof(labels), "meter=\"%d\"", g->meters[i].id);
+		metrics_counter(f, format, "bk390a_outages_total", labels, g->meters[i].rc.outages);
+	}
+
+	if (g->log_filename) {
+		metrics_header(f, format, "bk390a_log_dropped_bytes_total", "counter", "Log bytes dropped, disk full or stalled");
+		metrics_counter(f, format, "bk390a_log_dropped_bytes_total", "", lw.dropped);
+	}
+	if (g->net_addr) {
+		metrics_header(f, format, "bk390a_net_clients", "gauge", "Connected -N clients");
+		metrics_counter(f, format, "bk390a_net_clients", "", srv.clients);
+		metrics_header(f, format, "bk390a_net_dropped_total", "counter", "-N clients disconnected for falling behind");
+		metrics_counter(f, format, "bk390a_net_dropped_total", "", srv.dropped);
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-220140
+  Function Name	: clock_now
+  Returns Type	: uint64_t
+  ----Parameter List
+  1. void ,
+  ------------------
+  Exit Codes	: now, on the clock the frames are stamped with
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The monotonic clock, or with -r the replay's; a fast replay's
+	stamps run ahead of the monotonic clock.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+uint64_t clock_now( void ) {
+	return replay.f ? rawcap_replay_now(&replay) : timebase_now_ns();
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-144420
+  Function Name	: write_stats
+  Returns Type	: void
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: replaces the -S file
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void write_stats( struct glb *g ) {
+	struct stats *sp[METERS_MAX];
+	int i;
+
+	for (i = 0; i < g->meter_count; i++) sp[i] = &(g->meters[i].st);
+	if (stats_write_file(g->stats_filename, sp, g->meter_count, clock_now()) != 0) {
+		fprintf(stderr,"Couldn't write statistics to '%s'\r\n", g->stats_filename);
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-111121
+  Function Name	: bk390d_cleanup
+  Returns Type	: void
+  ----Parameter List
+  1. void ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void bk390d_cleanup( void ) {
+	int i;
+
+	/*
+	 * A replay's throughput, reading the capture to every output done
+	 */
+	if (replay.f && glbs) {
+		double elapsed = (timebase_now_ns() - replay.start_ns) / 1e9;
+		uint64_t frames = 0;
+
+		for (i = 0; i < glbs->meter_count; i++) frames += glbs->meters[i].fr.frames_ok;
+		fprintf(stderr,"Replayed %llu records, %llu bytes, %llu frames in %0.3fs, %0.0f frames/s\r\n"
+				, (unsigned long long)replay.records
+				, (unsigned long long)replay.bytes
+				, (unsigned long long)frames
+				, elapsed
+				, elapsed > 0 ? frames / elapsed : 0
+			   );
+	}
+
+	if (glbs) {
+		for (i = 0; i < glbs->meter_count; i++) {
+			struct meter *m = &(glbs->meters[i]);
+
+			if (m->fd >= 0) close(m->fd);
+			m->fd = -1;
+			if (!glbs->quiet && !glbs->probe) {
+				fprintf(stderr,"Meter %d (%s): %llu readings, %llu malformed, %llu resyncs, %llu outages\r\n"
+						, m->id
+						, m->port
+						, (unsigned long long)m->readings
+						, (unsigned long long)m->fr.frames_malformed
+						, (unsigned long long)m->fr.resyncs
+						, (unsigned long long)m->rc.outages
+						);
+			}
+		}
+	}
+	if (glbs && glbs->stats_filename) {
+		write_stats(glbs);
+		if (!glbs->quiet) {
+			for (i = 0; i < glbs->meter_count; i++) stats_write(stderr, &(glbs->meters[i].st), clock_now());
+		}
+	}
+	if (srv.accepted && glbs && !glbs->quiet) {
+		fprintf(stderr,"Net: %llu clients, %llu dropped for falling behind, %llu refused\r\n"
+				, (unsigned long long)srv.accepted
+				, (unsigned long long)srv.dropped
+				, (unsigned long long)srv.refused
+			   );
+	}
+	srv.quiet = 1;
+	netsrv_close(&srv);
+	if (epoll_fd >= 0) close(epoll_fd);
+	logwr_close(&lw);
+	if (lw.dropped) fprintf(stderr,"Log: %llu bytes dropped\r\n", (unsigned long long)lw.dropped);
+	if (glbs && glbs->metrics_filename && (metrics_write_file(glbs->metrics_filename, write_metrics, glbs) != 0)) {
+		fprintf(stderr,"Couldn't write metrics to '%s'\r\n", glbs->metrics_filename);
+	}
+	binlog_close(&bl);
+	rawcap_close(&raw);
+	rawcap_replay_close(&replay);
+	shmpub_close(&shm);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-192210
+  Function Name	: meter_outage
+  Returns Type	: void
+  ----Parameter List
+  1. struct glb *g,
+  2. struct meter *m,
+  3. int type, BINLOG_OUTAGE or BINLOG_RESUME
+  4. uint64_t t_ns, start or end of the outage ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The gap goes in to the logs as an outage, not as missing lines;
+
+		# meter 2 outage 12.345 lost
+		# meter 2 resumed 19.870 after 7.525s
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void meter_outage( struct glb *g, struct meter *m, int type, uint64_t t_ns ) {
+	char line[128];
+	double t = (int64_t)(t_ns - g->t0.t_ns) / 1e9;
+	double seconds = 0;
+	int n;
+
+	if (type == BINLOG_OUTAGE) {
+		fprintf(stderr,"Meter %d: %s %s, reopening\r\n", m->id, m->device, reconn_cause_str[m->rc.cause]);
+		n = snprintf(line, sizeof(line), "# meter %d outage %0.3f %s\n", m->id, t, reconn_cause_str[m->rc.cause]);
+	} else {
+		seconds = (t_ns - m->rc.outage_ns) / 1e9;
+		fprintf(stderr,"Meter %d: %s back after %0.3fs\r\n", m->id, m->device, seconds);
+		n = snprintf(line, sizeof(line), "# meter %d resumed %0.3f after %0.3fs\n", m->id, t, seconds);
+	}
+
+	if (lw.running && (n > 0)) logwr_write(&lw, line, n);
+	if (g->binlog_filename) binlog_append_outage(&bl, type, m->id, t_ns, m->rc.cause, seconds);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-192224
+  Function Name	: meter_down
+  Returns Type	: void
+  ----Parameter List
+  1. struct glb *g,
+  2. struct meter *m,
+  3. int cause, RECONN_LOST or RECONN_STALLED
+  4. uint64_t now ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: closes the meter's port, which takes it out of epoll
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void meter_down( struct glb *g, struct meter *m, int cause, uint64_t now ) {
+	if (m->fd >= 0) close(m->fd);
+	m->fd = -1;
+	framer_discard(&(m->fr));
+	if (raw.f) rawcap_down(&raw, m->id, now, cause);
+
+	if (reconn_down(&(m->rc), cause, now)) meter_outage( g, m, BINLOG_OUTAGE, m->rc.outage_ns );
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-192238
+  Function Name	: meter_reopen
+  Returns Type	: void
+  ----Parameter List
+  1. struct glb *g,
+  2. struct meter *m,
+  3. uint64_t now ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Same device and serial parameters as the first open
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void meter_reopen( struct glb *g, struct meter *m, uint64_t now ) {
+	struct epoll_event ev;
+
+	m->fd = serial_open( m->device, &(m->sp), m->proto->frame_size );
+	m->vmin = m->proto->frame_size;
+	if (m->fd >= 0) {
+		ev.events = EPOLLIN;
+		ev.data.ptr = m;
+		if (epoll_ctl( epoll_fd, EPOLL_CTL_ADD, m->fd, &ev ) != 0) {
+			close(m->fd);
+			m->fd = -1;
+		}
+	}
+
+	if (m->fd < 0) {
+		reconn_failed(&(m->rc), now);
+		if (g->debug) fprintf(stderr,"Meter %d: reopen %u failed (%s), next in %dms\r\n", m->id, m->rc.attempts, strerror(errno), reconn_timeout_ms(&(m->rc), now));
+		return;
+	}
+
+	reconn_reopened(&(m->rc), now);
+	if (g->debug) fprintf(stderr,"Meter %d: %s reopened\r\n", m->id, m->device);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-111133
+  Function Name	: meter_frame
+  Returns Type	: void
+  ----Parameter List
+  1. struct glb *g,
+  2. struct meter *m,
+  3. const uint8_t *d, frame payload
+  4. uint64_t t_ns, monotonic time stamp
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Output lines are '<meter id> <seconds> <value> <unit> [mode]', the
+	value in SI base units as bk390a and the -N stream write it.
+
+	Any well formed frame shows the meter's talking, and ends an
+	outage.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void meter_frame( struct glb *g, struct meter *m, const uint8_t *d, uint64_t t_ns ) {
+	struct metrics_meter *mm = &(g->mm[m->id -1]);
+	struct bk390a_reading r;
+	char value[32];
+	double t;
+
+	if (reconn_frame(&(m->rc), t_ns)) meter_outage( g, m, BINLOG_RESUME, t_ns );
+
+	if (m->proto->decode(d, &r) != 0) {
+		mm->decode_errors++;
+		return;
+	}
+	m->readings++;
+	metrics_meter_reading(mm, &r);
+
+	if (g->binlog_filename) binlog_append(&bl, m->id, t_ns, d, &r);
+	if (g->shm_name) shmpub_update(&shm, m->id -1, m->id, t_ns, &r);
+	if (srv.listen_fd >= 0) netsrv_publish(&srv, m->id, t_ns, d, &r);
+	if (g->stats_filename) stats_add(&(m->st), t_ns, &r);
+
+	t = (int64_t)(t_ns - g->t0.t_ns) / 1e9;
+
+	if (r.status & STATUS_OL) snprintf(value, sizeof(value), "O.L.");
+	else bk390a_value_str(&r, value, sizeof(value));
+
+	if (!g->quiet) {
+		fprintf(stdout,"%d %0.3f %s %s%s%s\n"
+				, m->id
+				, t
+				, value
+				, bk390a_unit_str[r.unit]
+				, g->show_mode ? " " : ""
+				, g->show_mode ? bk390a_mode_str[r.mode] : ""
+			   );
+	}
+
+	if (lw.running) {
+		char line[128];
+		int n;
+
+		n = snprintf(line, sizeof(line), "%d %0.3f %s %s\n"
+				, m->id
+				, t
+				, value
+				, bk390a_unit_str[r.unit]
+				);
+		if (n > 0) logwr_write(&lw, line, n);
+	}
+
+	if (rawcap_replay_timed(&replay)) metrics_hist_record(&publish_latency, timebase_now_ns() - t_ns);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-201010
+  Function Name	: replay_next
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	: ms until the next record is due, 0 after handling one
+  Side Effects	: exits at the end of the recording
+  --------------------------------------------------------------------
+Comments:
+	-r; stands in for the reads from the meters' ports.  Each chunk
+	goes to its meter's framer as the read did, and where the
+	capture closed a port the replay does too, so the same outage
+	is reported.  One record a call, the TCP clients are serviced
+	in between.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int replay_next( struct glb *g ) {
+	static uint8_t buf[RAWCAP_CHUNK_MAX];
+	struct rawcap_record rec;
+	struct meter *m;
+	uint8_t d[BK390A_PAYLOAD_MAX];
+	uint64_t t_ns;
+	size_t done, n;
+
+	switch (rawcap_replay_next(&replay, &rec, buf, sizeof(buf))) {
+		case 1: break;
+		case 0: return rawcap_replay_wait_ms(&replay);
+		case -2: fprintf(stderr,"Damaged record in '%s' after %llu records, stopping\r\n", g->replay_filename, (unsigned long long)replay.records); exit(1);
+		default: exit(0);
+	}
+
+	m = &(g->meters[((rec.meter > 0) && (rec.meter <= g->meter_count)) ? rec.meter -1 : 0]);
+	if (rec.type == RAWCAP_DOWN) {
+		meter_down( g, m, rec.cause, rec.t_ns );
+		return 0;
+	}
+
+	/*
+	 * Each meter's protocol as recorded, whatever -y says
+	 */
+	if ((rec.protocol < BK390A_PROTOCOL_COUNT) && (proto_list[rec.protocol] != m->proto)) {
+		m->proto = proto_list[rec.protocol];
+		framer_protocol( &(m->fr), m->proto );
+	}
+
+	for (done = 0; done < rec.len; done += n) {
+		n = framer_push( &(m->fr), buf + done, rec.len - done, rec.t_ns );
+		while (framer_next( &(m->fr), d, &t_ns )) {
+			meter_frame( g, m, d, t_ns );
+		}
+		if (n == 0) framer_discard( &(m->fr) );	// full of noise, as a live read would have found it
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-111145
+  Function Name	: main
+  Returns Type	: int
+  ----Parameter List
+  1. int argc,
+  2.  char **argv ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int main( int argc, char **argv ) {
+	static struct glb g;	// static, bk390d_cleanup() still uses it after main() returns
+	struct epoll_event ev, events[EVENTS_MAX];
+	uint8_t d[BK390A_PAYLOAD_MAX];
+	uint64_t stats_written = 0;
+	uint64_t metrics_written = 0;
+	int i;
+
+	if (argc == 1) {
+		fprintf(stdout,"Usage: %s %s", argv[0], help);
+		exit(1);
+	}
+
+	glbs = &g;
+	lw.fd = -1;
+	srv.listen_fd = -1;
+	atexit(bk390d_cleanup);
+
+	sigint_pressed = 0;
+	signal(SIGINT, handle_sigint);
+	signal(SIGTERM, handle_sigint);
+	signal(SIGUSR1, handle_sigusr1);
+
+	init( &g );
+	parse_parameters( &g, argc, argv );
+
+	if (g.replay_filename) {
+		/*
+		 * -r; the recording's meters replace any given, every one
+		 * of them reads from the recording
+		 */
+		switch (rawcap_replay_open( &replay, g.replay_filename, g.replay_speed )) {
+			case 0: break;
+			case -2: fprintf(stderr,"'%s' isn't a compatible raw capture\r\n", g.replay_filename); exit(1);
+			default: fprintf(stderr,"Couldn't open '%s' (%s)\r\n", g.replay_filename, strerror(errno)); exit(1);
+		}
+		g.meter_count = 0;
+		g.serial_params = replay.h.serial_params;
+		for (i = 0; (i < replay.h.meters) || (i == 0); i++) {
+			if (add_meter(&g, g.replay_filename, NULL, NULL) != 0) exit(1);
+		}
+		if (!g.quiet) {
+			if (replay.speed > 0) fprintf(stderr,"Replaying %s, %d meters recorded at %s, at %gx\r\n", g.replay_filename, g.meter_count, replay.h.serial_params, replay.speed);
+			else fprintf(stderr,"Replaying %s, %d meters recorded at %s, as fast as possible\r\n", g.replay_filename, g.meter_count, replay.h.serial_params);
+		}
+
+	} else {
+		if (g.config_filename && load_config( &g, g.config_filename ) != 0) exit(1);
+
+		/*
+		 * -P, or no meters given; listen for them on every port at once
+		 */
+		if (g.probe || (g.meter_count == 0)) probe_meters( &g );
+	}
+
+	if (g.log_filename) {
+		if (logwr_open(&lw, g.log_filename, g.flush_ms, g.log_rotate_bytes, g.log_rotate_hourly, g.log_fsync_ms) != 0) {
+			fprintf(stderr,"Couldn't open '%s' file to write/append, NO LOGGING\r\n", g.log_filename);
+		}
+	}
+
+	epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+	if (epoll_fd < 0) {
+		fprintf(stderr,"Error creating epoll instance (%s)\r\n", strerror(errno));
+		exit(1);
+	}
+
+	/*
+	 * Open every meter and add it to the one event loop
+	 */
+	for (i = 0; i < g.meter_count; i++) {
+		struct meter *m = &(g.meters[i]);
+		struct serial_params sp;
+		const char *params;
+
+		if (m->proto == NULL) m->proto = g.protocol;
+		framer_protocol( &(m->fr), m->proto );
+
+		serial_default_params( &sp );
+		params = m->serial_params[0] ? m->serial_params : (g.serial_params ? g.serial_params : m->proto->serial_params);
+		if (params && serial_parse_params( params, &sp ) != SERIAL_PARAM_OK) {
+			fprintf(stderr,"Meter %d: invalid serial parameters '%s'\r\n", m->id, params);
+			exit(1);
+		}
+
+		serial_device_path( m->port, m->device, sizeof(m->device) );
+		m->sp = sp;
+		if (replay.f) {
+			snprintf(m->device, sizeof(m->device), "%s", m->port);
+			reconn_init( &(m->rc), 0, timebase_now_ns() );
+			continue;
+		}
+
+		m->fd = serial_open( m->device, &sp, m->proto->frame_size );
+		m->vmin = m->proto->frame_size;
+		if (m->fd < 0) {
+			fprintf(stderr,"Meter %d: port %s can't be opened (%s)\r\n", m->id, m->device, strerror(errno));
+			exit(1);
+		}
+		reconn_init( &(m->rc), g.stall_ms, timebase_now_ns() );
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = m;
+		if (epoll_ctl( epoll_fd, EPOLL_CTL_ADD, m->fd, &ev ) != 0) {
+			fprintf(stderr,"Meter %d: error adding to epoll (%s)\r\n", m->id, strerror(errno));
+			exit(1);
+		}
+
+		if (!g.quiet) fprintf(stderr,"Meter %d: %s opened at %d:%d%c%d, %s\r\n", m->id, m->device, sp.baud, sp.bits, sp.parity, sp.stop, m->proto->name);
+	}
+
+	/*
+	 * Slot <n> of the segment is meter id <n>+1
+	 */
+	if (g.shm_name) {
+		if (shmpub_open(&shm, g.shm_name, g.meter_count) != 0) {
+			fprintf(stderr,"Couldn't create shared memory segment '%s' (%s), NOT PUBLISHING\r\n", g.shm_name, strerror(errno));
+		}
+	}
+
+	/*
+	 * All meters share the one time base, a replay's is the
+	 * recording's
+	 */
+	if (replay.f) rawcap_replay_anchor(&replay, &(g.t0));
+	else timebase_anchor(&(g.t0));
+
+	/*
+	 * -w; every read from here on, the header holds the -s default
+	 */
+	if (g.rawcap_filename) {
+		struct serial_params sp;
+		char params[16];
+
+		serial_default_params( &sp );
+		serial_parse_params( g.protocol->serial_params, &sp );
+		if (g.serial_params) serial_parse_params( g.serial_params, &sp );
+		serial_params_str( &sp, params, sizeof(params) );
+		if (rawcap_open(&raw, g.rawcap_filename, &(g.t0), params, g.meter_count, g.flush_ms) != 0) {
+			fprintf(stderr,"Couldn't create '%s' (%s), NOT RECORDING\r\n", g.rawcap_filename, strerror(errno));
+		}
+	}
+
+	if (g.binlog_filename) {
+		switch (binlog_open(&bl, g.binlog_filename, g.flush_ms, &(g.t0))) {
+			case 0: break;
+			case -2: fprintf(stderr,"'%s' isn't a compatible binary log, NO BINARY LOGGING\r\n", g.binlog_filename); break;
+			default: fprintf(stderr,"Couldn't open '%s' file to write/append, NO BINARY LOGGING\r\n", g.binlog_filename); break;
+		}
+	}
+
+	if (lw.running) {
+		char wall[64];
+		char header[LOGWR_HEADER_MAX];
+
+		timebase_wall_str(g.t0.wall_ns, wall, sizeof(wall));
+		snprintf(header, sizeof(header), "# session %s wall_ns %lld\n", wall, (long long)g.t0.wall_ns);
+		logwr_header(&lw, header);
+	}
+
+	/*
+	 * TCP clients share the meters' epoll loop
+	 */
+	if (g.net_addr) {
+		switch (netsrv_open(&srv, g.net_addr, g.net_format, epoll_fd, &(g.t0))) {
+			case 0: srv.quiet = g.quiet; break;
+			case -1: fprintf(stderr,"Couldn't understand '%s' as [host:]port, NOT STREAMING\r\n", g.net_addr); break;
+			default: fprintf(stderr,"Couldn't listen on '%s' (%s), NOT STREAMING\r\n", g.net_addr, strerror(errno)); break;
+		}
+	}
+
+	while (!sigint_pressed) {
+		uint64_t now;
+		int n, timeout_ms, t;
+
+		if (sigusr1_pressed) {
+			sigusr1_pressed = 0;
+			write_metrics(stderr, METRICS_TEXT, &g);
+		}
+		if (g.metrics_filename && (timebase_now_ns() - metrics_written >= STATS_WRITE_INTERVAL_NS)) {
+			metrics_write_file(g.metrics_filename, write_metrics, &g);
+			metrics_written = timebase_now_ns();
+		}
+
+		/*
+		 * Meters whose port was lost, or that have gone quiet for
+		 * -W; closed, then reopened as their backoff allows.  epoll
+		 * waits no longer than the next of those is due.
+		 *
+		 * A replay has no ports to reopen; instead epoll waits no
+		 * longer than the next record is due.
+		 *
+		 * Nor longer than the binary log's or -w capture's -F, so the
+		 * readings before every meter goes quiet are written out on
+		 * time.
+		 */
+		now = timebase_now_ns();
+		timeout_ms = (g.stats_filename || g.metrics_filename) ? 1000 : -1;
+		binlog_tick( &bl, now );
+		if (binlog_due( &bl )) {
+			t = (binlog_due( &bl ) - now + 999999) / 1000000;
+			if ((timeout_ms < 0) || (t < timeout_ms)) timeout_ms = t;
+		}
+		rawcap_tick( &raw, now );
+		if (rawcap_due( &raw )) {
+			t = (rawcap_due( &raw ) - now + 999999) / 1000000;
+			if ((timeout_ms < 0) || (t < timeout_ms)) timeout_ms = t;
+		}
+		if (replay.f) {
+			t = replay_next( &g );
+			if ((timeout_ms < 0) || (t < timeout_ms)) timeout_ms = t;
+		}
+		for (i = 0; (i < g.meter_count) && !replay.f; i++) {
+			struct meter *m = &(g.meters[i]);
+
+			switch (reconn_due( &(m->rc), now )) {
+				case RECONN_CLOSE: meter_down( &g, m, RECONN_STALLED, now ); break;
+				case RECONN_REOPEN: meter_reopen( &g, m, now ); break;
+				default: break;
+			}
+			t = reconn_timeout_ms( &(m->rc), now );
+			if ((t >= 0) && ((timeout_ms < 0) || (t < timeout_ms))) timeout_ms = t;
+		}
+
+		n = epoll_wait( epoll_fd, events, EVENTS_MAX, timeout_ms );
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			fprintf(stderr,"Error in epoll_wait() (%s)\r\n", strerror(errno));
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			struct meter *m = events[i].data.ptr;
+			uint8_t *wp;
+			size_t wlen;
+			ssize_t bytes_read;
+			uint64_t t_ns;
+
+			if (netsrv_event(&srv, events[i].data.ptr, events[i].events)) continue;
+
+			wp = framer_write_ptr( &(m->fr), &wlen );
+			bytes_read = read( m->fd, wp, wlen );
+			t_ns = timebase_now_ns();
+			if (bytes_read <= 0) {
+				if ((bytes_read < 0) && (errno == EAGAIN) && !(events[i].events & (EPOLLHUP | EPOLLERR))) continue;
+				if (g.debug) fprintf(stderr,"Meter %d: read error on %s (%s)\r\n", m->id, m->device, bytes_read ? strerror(errno) : "EOF");
+				meter_down( &g, m, RECONN_LOST, t_ns );
+				continue;
+			}
+
+			if (g.debug) {
+				int j;
+				fprintf(stderr,"%d DATA START: ", m->id);
+				for (j = 0; j < bytes_read; j++) fprintf(stderr,"%x ", wp[j]);
+				fprintf(stderr,":END\r\n");
+			}
+
+			if (raw.f) rawcap_append( &raw, m->id, m->proto->id, t_ns, wp, bytes_read );
+			framer_commit( &(m->fr), bytes_read, t_ns );
+
+			while (framer_next( &(m->fr), d, &t_ns )) {
+				meter_frame( &g, m, d, t_ns );
+			}
+			if ((m->fd >= 0) && (framer_wanted( &(m->fr) ) != (uint32_t)m->vmin)) {
+				m->vmin = framer_wanted( &(m->fr) );
+				serial_set_vmin( m->fd, m->vmin );
+			}
+		}
+
+		if (!g.quiet) fflush(stdout);
+
+		if (g.stats_filename && (timebase_now_ns() - stats_written >= STATS_WRITE_INTERVAL_NS)) {
+			write_stats( &g );
+			stats_written = timebase_now_ns();
+		}
+	}
+
+	return 0;
+}
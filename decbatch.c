@@ -0,0 +1,515 @@
+/*
+ * BK Precision Model 390A batch frame decoder
+ *
+ * A block of 16 (SSE2) or 32 (AVX2) frames is loaded a frame per
+ * lane and transposed, so that register <j> holds byte <j> of every
+ * frame.  The 0x3? checks, digit checks, BCD to count, sign, and the
+ * status and option nibbles are then each one instruction for the
+ * whole block.  Only the function/range table lookup is done a frame
+ * at a time, from a byte index the vectors build.
+ *
+ * The vector code is only built for x86 with gcc/clang (target
+ * attributes, so no special CFLAGS are needed) and not for 32 bit
+ * Windows, whose stack isn't realigned for vector spills.  The block
+ * loops are unrolled by pragma; at the default -O they otherwise run
+ * through memory and lose most of the gain.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "decode.h"
+#include "decbatch.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && !defined(_WIN32)))
+#define DECBATCH_X86
+#include <immintrin.h>
+#endif
+
+const char *bk390a_batch_str[BK390A_BATCH_BEST] = { "scalar", "sse2", "avx2" };
+
+static size_t (*decbatch_fn)(const uint8_t *frames, size_t stride, size_t n, struct bk390a_batch *b) = NULL;
+
+#ifdef DECBATCH_X86
+/*
+ * bk390a_range_table[] flat, [FUNCTION & 0x0F][JUDGE][RANGE], each
+ * entry exp10 | unit << 8 | mode << 16, 0 for an unknown mode
+ */
+static uint32_t decbatch_table[256];
+#endif
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-203010
+  Function Name	: decbatch_scalar
+  Returns Type	: size_t
+  ----Parameter List
+  1. const uint8_t *frames, first frame payload
+  2. size_t stride, bytes from one payload to the next
+  3. size_t n, frames
+  4. struct bk390a_batch *b ,
+  ------------------
+  Exit Codes	: frames accepted
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The fallback, and the vector versions' tail
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static size_t decbatch_scalar(const uint8_t *frames, size_t stride, size_t n, struct bk390a_batch *b) {
+	struct bk390a_reading r;
+	size_t i, accepted = 0;
+
+	for (i = 0; i < n; i++) {
+		if (bk390a_decode(frames + i * stride, &r) == 0) {
+			b->exp10[i] = r.exp10;
+			b->unit[i] = r.unit;
+			b->mode[i] = r.mode;
+			accepted++;
+		} else {
+			b->exp10[i] = 0;
+			b->unit[i] = BK390A_UNIT_NONE;
+			b->mode[i] = BK390A_MODE_UNKNOWN;
+		}
+		b->count[i] = r.count;
+		b->flags[i] = r.status | (r.option2 << 4);
+	}
+
+	return accepted;
+}
+
+#ifdef DECBATCH_X86
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-203024
+  Function Name	: decbatch_lookup
+  Returns Type	: size_t
+  ----Parameter List
+  1. const uint8_t *idx, per frame FUNCTION << 4 | JUDGE | RANGE
+  2. uint32_t ok, per frame bit, bytes passed the checks
+  3. size_t n, frames in the block
+  4. struct bk390a_batch *b, already offset to the block ,
+  ------------------
+  Exit Codes	: frames accepted
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	FUNCTION is only ever outside the 0x3? block in a frame that has
+	already failed the checks, so the low nibble alone indexes the
+	table.  No branches; a failed frame's entry is masked to 0.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static size_t decbatch_lookup(const uint8_t *idx, uint32_t ok, size_t n, struct bk390a_batch *b) {
+	size_t k, accepted = 0;
+	uint32_t e;
+
+	for (k = 0; k < n; k++) {
+		e = decbatch_table[idx[k]] & -((ok >> k) & 1);
+		b->exp10[k] = (int8_t)(e & 0xFF);
+		b->unit[k] = (e >> 8) & 0xFF;
+		b->mode[k] = e >> 16;
+		accepted += (e != 0);
+	}
+
+	return accepted;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-203038
+  Function Name	: decbatch_offset
+  Returns Type	: void
+  ----Parameter List
+  1. struct bk390a_batch *t, receives b from frame i on
+  2. const struct bk390a_batch *b,
+  3. size_t i ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void decbatch_offset(struct bk390a_batch *t, const struct bk390a_batch *b, size_t i) {
+	t->count = b->count + i;
+	t->exp10 = b->exp10 + i;
+	t->unit = b->unit + i;
+	t->mode = b->mode + i;
+	t->flags = b->flags + i;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-203052
+  Function Name	: decbatch_blocks
+  Returns Type	: size_t
+  ----Parameter List
+  1. size_t stride,
+  2. size_t n ,
+  3. size_t block, frames per vector block
+  ------------------
+  Exit Codes	: frames that can be done in whole vector blocks
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Each frame is loaded 16 bytes at a time, 7 past its payload;
+	with any stride of at least a payload that stays inside the
+	array for every frame but the last, which is always left to
+	decbatch_scalar() along with any part block
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static size_t decbatch_blocks(size_t stride, size_t n, size_t block) {
+	if ((n == 0) || (stride < BK390A_PAYLOAD_SIZE)) return 0;
+
+	return ((n - 1) / block) * block;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-203106
+  Function Name	: decbatch_count_sse2
+  Returns Type	: __m128i
+  ----Parameter List
+  1. __m128i d3, thousands, one frame per 16 bit lane
+  2. __m128i d2,
+  3. __m128i d1,
+  4. __m128i d0,
+  5. __m128i neg, 0xFFFF per negative frame ,
+  ------------------
+  Exit Codes	: 8 signed counts
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+__attribute__((target("sse2")))
+static __m128i decbatch_count_sse2(__m128i d3, __m128i d2, __m128i d1, __m128i d0, __m128i neg) {
+	__m128i c;
+
+	c = _mm_add_epi16(_mm_mullo_epi16(d3, _mm_set1_epi16(1000)), _mm_mullo_epi16(d2, _mm_set1_epi16(100)));
+	c = _mm_add_epi16(c, _mm_add_epi16(_mm_mullo_epi16(d1, _mm_set1_epi16(10)), d0));
+
+	return _mm_sub_epi16(_mm_xor_si128(c, neg), neg);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-203120
+  Function Name	: decbatch_sse2
+  Returns Type	: size_t
+  ----Parameter List
+  1. const uint8_t *frames,
+  2. size_t stride,
+  3. size_t n,
+  4. struct bk390a_batch *b ,
+  ------------------
+  Exit Codes	: frames accepted
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Four rounds of interleaving rows k and k+8 transpose the 16x16
+	bytes; afterwards p[j] lane i is byte j of frame i.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+__attribute__((target("sse2")))
+static size_t decbatch_sse2(const uint8_t *frames, size_t stride, size_t n, struct bk390a_batch *b) {
+	const __m128i lo = _mm_set1_epi8(0x0F);
+	const __m128i zero = _mm_setzero_si128();
+	struct bk390a_batch t;
+	uint8_t idx[16];
+	size_t i, end, accepted = 0;
+	int j, k, round;
+
+	end = decbatch_blocks(stride, n, 16);
+	for (i = 0; i < end; i += 16) {
+		__m128i p[16], q[16], d[5], ok, neg;
+
+#pragma GCC unroll 16
+		for (k = 0; k < 16; k++) p[k] = _mm_loadu_si128((const __m128i *)(frames + (i + k) * stride));
+#pragma GCC unroll 4
+		for (round = 0; round < 4; round++) {
+#pragma GCC unroll 8
+			for (k = 0; k < 8; k++) {
+				q[2 * k] = _mm_unpacklo_epi8(p[k], p[k + 8]);
+				q[2 * k + 1] = _mm_unpackhi_epi8(p[k], p[k + 8]);
+			}
+			memcpy(p, q, sizeof(p));
+		}
+
+		/*
+		 * Every byte 0x30..0x3F, digits 0..9, range 0..7
+		 */
+		ok = _mm_set1_epi8(-1);
+#pragma GCC unroll 9
+		for (j = 0; j < BK390A_PAYLOAD_SIZE; j++) {
+			ok = _mm_and_si128(ok, _mm_cmpeq_epi8(_mm_andnot_si128(lo, p[j]), _mm_set1_epi8(0x30)));
+		}
+#pragma GCC unroll 4
+		for (j = BYTE_DIGIT_3; j <= BYTE_DIGIT_0; j++) {
+			d[j] = _mm_and_si128(p[j], lo);
+			ok = _mm_and_si128(ok, _mm_cmpgt_epi8(_mm_set1_epi8(10), d[j]));
+		}
+		ok = _mm_and_si128(ok, _mm_cmpeq_epi8(_mm_and_si128(p[BYTE_RANGE], _mm_set1_epi8(0x08)), zero));
+
+		neg = _mm_cmpeq_epi8(_mm_and_si128(p[BYTE_STATUS], _mm_set1_epi8(STATUS_SIGN)), _mm_set1_epi8(STATUS_SIGN));
+		_mm_storeu_si128((__m128i *)(b->count + i), decbatch_count_sse2(
+					_mm_unpacklo_epi8(d[BYTE_DIGIT_3], zero), _mm_unpacklo_epi8(d[BYTE_DIGIT_2], zero),
+					_mm_unpacklo_epi8(d[BYTE_DIGIT_1], zero), _mm_unpacklo_epi8(d[BYTE_DIGIT_0], zero),
+					_mm_unpacklo_epi8(neg, neg)));
+		_mm_storeu_si128((__m128i *)(b->count + i + 8), decbatch_count_sse2(
+					_mm_unpackhi_epi8(d[BYTE_DIGIT_3], zero), _mm_unpackhi_epi8(d[BYTE_DIGIT_2], zero),
+					_mm_unpackhi_epi8(d[BYTE_DIGIT_1], zero), _mm_unpackhi_epi8(d[BYTE_DIGIT_0], zero),
+					_mm_unpackhi_epi8(neg, neg)));
+
+		_mm_storeu_si128((__m128i *)(b->flags + i), _mm_or_si128(_mm_and_si128(p[BYTE_STATUS], lo),
+					_mm_slli_epi16(_mm_and_si128(p[BYTE_OPTION_2], lo), 4)));
+
+		_mm_storeu_si128((__m128i *)idx, _mm_or_si128(_mm_slli_epi16(_mm_and_si128(p[BYTE_FUNCTION], lo), 4),
+					_mm_or_si128(_mm_and_si128(p[BYTE_STATUS], _mm_set1_epi8(STATUS_JUDGE)), _mm_and_si128(p[BYTE_RANGE], _mm_set1_epi8(0x07)))));
+
+		decbatch_offset(&t, b, i);
+		accepted += decbatch_lookup(idx, (uint32_t)_mm_movemask_epi8(ok), 16, &t);
+	}
+
+	decbatch_offset(&t, b, end);
+
+	return accepted + decbatch_scalar(frames + end * stride, stride, n - end, &t);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-203134
+  Function Name	: decbatch_count_avx2
+  Returns Type	: __m256i
+  ----Parameter List
+  1. __m256i d3, thousands, one frame per 16 bit lane
+  2. __m256i d2,
+  3. __m256i d1,
+  4. __m256i d0,
+  5. __m256i neg, 0xFFFF per negative frame ,
+  ------------------
+  Exit Codes	: 16 signed counts
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static __m256i decbatch_count_avx2(__m256i d3, __m256i d2, __m256i d1, __m256i d0, __m256i neg) {
+	__m256i c;
+
+	c = _mm256_add_epi16(_mm256_mullo_epi16(d3, _mm256_set1_epi16(1000)), _mm256_mullo_epi16(d2, _mm256_set1_epi16(100)));
+	c = _mm256_add_epi16(c, _mm256_add_epi16(_mm256_mullo_epi16(d1, _mm256_set1_epi16(10)), d0));
+
+	return _mm256_sub_epi16(_mm256_xor_si256(c, neg), neg);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-203148
+  Function Name	: decbatch_avx2
+  Returns Type	: size_t
+  ----Parameter List
+  1. const uint8_t *frames,
+  2. size_t stride,
+  3. size_t n,
+  4. struct bk390a_batch *b ,
+  ------------------
+  Exit Codes	: frames accepted
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	As decbatch_sse2() with frames i..i+15 in the low 128 bit lane
+	and i+16..i+31 in the high one; the byte wide results come out
+	in frame order, the 16 bit counts are put back in order with a
+	lane permute.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static size_t decbatch_avx2(const uint8_t *frames, size_t stride, size_t n, struct bk390a_batch *b) {
+	const __m256i lo = _mm256_set1_epi8(0x0F);
+	const __m256i zero = _mm256_setzero_si256();
+	struct bk390a_batch t;
+	uint8_t idx[32];
+	size_t i, end, accepted = 0;
+	int j, k, round;
+
+	end = decbatch_blocks(stride, n, 32);
+	for (i = 0; i < end; i += 32) {
+		__m256i p[16], q[16], d[5], ok, neg, clo, chi;
+
+#pragma GCC unroll 16
+		for (k = 0; k < 16; k++) {
+			p[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(frames + (i + k) * stride))),
+					_mm_loadu_si128((const __m128i *)(frames + (i + k + 16) * stride)), 1);
+		}
+#pragma GCC unroll 4
+		for (round = 0; round < 4; round++) {
+#pragma GCC unroll 8
+			for (k = 0; k < 8; k++) {
+				q[2 * k] = _mm256_unpacklo_epi8(p[k], p[k + 8]);
+				q[2 * k + 1] = _mm256_unpackhi_epi8(p[k], p[k + 8]);
+			}
+			memcpy(p, q, sizeof(p));
+		}
+
+		ok = _mm256_set1_epi8(-1);
+#pragma GCC unroll 9
+		for (j = 0; j < BK390A_PAYLOAD_SIZE; j++) {
+			ok = _mm256_and_si256(ok, _mm256_cmpeq_epi8(_mm256_andnot_si256(lo, p[j]), _mm256_set1_epi8(0x30)));
+		}
+#pragma GCC unroll 4
+		for (j = BYTE_DIGIT_3; j <= BYTE_DIGIT_0; j++) {
+			d[j] = _mm256_and_si256(p[j], lo);
+			ok = _mm256_and_si256(ok, _mm256_cmpgt_epi8(_mm256_set1_epi8(10), d[j]));
+		}
+		ok = _mm256_and_si256(ok, _mm256_cmpeq_epi8(_mm256_and_si256(p[BYTE_RANGE], _mm256_set1_epi8(0x08)), zero));
+
+		neg = _mm256_cmpeq_epi8(_mm256_and_si256(p[BYTE_STATUS], _mm256_set1_epi8(STATUS_SIGN)), _mm256_set1_epi8(STATUS_SIGN));
+		clo = decbatch_count_avx2(
+				_mm256_unpacklo_epi8(d[BYTE_DIGIT_3], zero), _mm256_unpacklo_epi8(d[BYTE_DIGIT_2], zero),
+				_mm256_unpacklo_epi8(d[BYTE_DIGIT_1], zero), _mm256_unpacklo_epi8(d[BYTE_DIGIT_0], zero),
+				_mm256_unpacklo_epi8(neg, neg));
+		chi = decbatch_count_avx2(
+				_mm256_unpackhi_epi8(d[BYTE_DIGIT_3], zero), _mm256_unpackhi_epi8(d[BYTE_DIGIT_2], zero),
+				_mm256_unpackhi_epi8(d[BYTE_DIGIT_1], zero), _mm256_unpackhi_epi8(d[BYTE_DIGIT_0], zero),
+				_mm256_unpackhi_epi8(neg, neg));
+		_mm256_storeu_si256((__m256i *)(b->count + i), _mm256_permute2x128_si256(clo, chi, 0x20));
+		_mm256_storeu_si256((__m256i *)(b->count + i + 16), _mm256_permute2x128_si256(clo, chi, 0x31));
+
+		_mm256_storeu_si256((__m256i *)(b->flags + i), _mm256_or_si256(_mm256_and_si256(p[BYTE_STATUS], lo),
+					_mm256_slli_epi16(_mm256_and_si256(p[BYTE_OPTION_2], lo), 4)));
+
+		_mm256_storeu_si256((__m256i *)idx, _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(p[BYTE_FUNCTION], lo), 4),
+					_mm256_or_si256(_mm256_and_si256(p[BYTE_STATUS], _mm256_set1_epi8(STATUS_JUDGE)), _mm256_and_si256(p[BYTE_RANGE], _mm256_set1_epi8(0x07)))));
+
+		decbatch_offset(&t, b, i);
+		accepted += decbatch_lookup(idx, (uint32_t)_mm256_movemask_epi8(ok), 32, &t);
+	}
+
+	decbatch_offset(&t, b, end);
+
+	return accepted + decbatch_scalar(frames + end * stride, stride, n - end, &t);
+}
+
+#endif
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-203202
+  Function Name	: bk390a_decode_batch_use
+  Returns Type	: int
+  ----Parameter List
+  1. int impl, BK390A_BATCH_* ,
+  ------------------
+  Exit Codes	: the implementation now in use
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Asking for one the CPU (or the build) doesn't have gets the
+	best one below it.  Only needed to compare them, the first
+	bk390a_decode_batch() picks BK390A_BATCH_BEST itself.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int bk390a_decode_batch_use(int impl) {
+	int best = BK390A_BATCH_SCALAR;
+
+#ifdef DECBATCH_X86
+	const struct bk390a_range *e = &bk390a_range_table[0][0][0];
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		if (e[i].mode == BK390A_MODE_UNKNOWN) decbatch_table[i] = 0;
+		else decbatch_table[i] = (uint8_t)(e[i].si_exp - e[i].dps) | (e[i].unit << 8) | (e[i].mode << 16);
+	}
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) best = BK390A_BATCH_SSE2;
+	if (__builtin_cpu_supports("avx2")) best = BK390A_BATCH_AVX2;
+#endif
+
+	if ((impl < BK390A_BATCH_SCALAR) || (impl > best)) impl = best;
+
+	switch (impl) {
+#ifdef DECBATCH_X86
+		case BK390A_BATCH_AVX2: decbatch_fn = decbatch_avx2; break;
+		case BK390A_BATCH_SSE2: decbatch_fn = decbatch_sse2; break;
+#endif
+		default: decbatch_fn = decbatch_scalar; break;
+	}
+
+	return impl;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-203216
+  Function Name	: bk390a_decode_batch
+  Returns Type	: size_t
+  ----Parameter List
+  1. const uint8_t *frames, first frame payload
+  2. size_t stride, bytes from one payload to the next, BK390A_PAYLOAD_SIZE when packed
+  3. size_t n, frames
+  4. struct bk390a_batch *b, n entries of results ,
+  ------------------
+  Exit Codes	: frames accepted, the rest have mode BK390A_MODE_UNKNOWN
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The stride lets the payloads be decoded where they lie, eg in
+	an mmap()ed binary log's records.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+size_t bk390a_decode_batch(const uint8_t *frames, size_t stride, size_t n, struct bk390a_batch *b) {
+	if (decbatch_fn == NULL) bk390a_decode_batch_use(BK390A_BATCH_BEST);
+
+	return decbatch_fn(frames, stride, n, b);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-203230
+  Function Name	: bk390a_batch_value
+  Returns Type	: double
+  ----Parameter List
+  1. const struct bk390a_batch *b,
+  2. size_t i ,
+  ------------------
+  Exit Codes	: frame i's reading in SI base units
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Same rounding as bk390a_value()
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+double bk390a_batch_value(const struct bk390a_batch *b, size_t i) {
+	struct bk390a_reading r;
+
+	r.count = b->count[i];
+	r.exp10 = b->exp10[i];
+
+	return bk390a_value(&r);
+}
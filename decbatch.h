@@ -0,0 +1,63 @@
+/*
+ * BK Precision Model 390A batch frame decoder
+ *
+ * Decodes an array of frame payloads in one call in to a structure of
+ * arrays, for re-decoding recorded frames offline (bk390a-query -D, a
+ * month of binary logs) rather than one frame at a time as they
+ * arrive.  Every frame decodes exactly as bk390a_decode() decodes it.
+ *
+ * The byte checks, digit combining and status/option extraction are
+ * done 16 (SSE2) or 32 (AVX2) frames at a time on x86, picked at run
+ * time from what the CPU supports, with a plain C fallback elsewhere.
+ *
+ */
+#ifndef __BK390A_DECBATCH_H__
+#define __BK390A_DECBATCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Implementations, bk390a_decode_batch_use()
+ */
+#define BK390A_BATCH_SCALAR 0
+#define BK390A_BATCH_SSE2 1
+#define BK390A_BATCH_AVX2 2
+#define BK390A_BATCH_BEST 3	// the best the CPU supports, the default
+
+/*
+ * flags[] holds the STATUS_* bits low and the OPTION2_* bits high
+ */
+#define BK390A_BATCH_STATUS(f) ((f) & 0x0F)
+#define BK390A_BATCH_OPTION2(f) ((f) >> 4)
+
+/*
+ * Caller allocated, each array at least n entries.  Frame <i> reads
+ * count[i] x 10^exp10[i] SI base units; a frame bk390a_decode() would
+ * reject has mode[i] BK390A_MODE_UNKNOWN, unit[i] BK390A_UNIT_NONE
+ * and exp10[i] 0.
+ */
+struct bk390a_batch {
+	int16_t *count;		// signed display count
+	int8_t *exp10;		// si_exp - dps
+	uint8_t *unit;		// enum bk390a_unit
+	uint8_t *mode;		// enum bk390a_mode
+	uint8_t *flags;		// STATUS_* | OPTION2_* << 4
+};
+
+extern const char *bk390a_batch_str[BK390A_BATCH_BEST];
+
+size_t bk390a_decode_batch(const uint8_t *frames, size_t stride, size_t n, struct bk390a_batch *b);
+int bk390a_decode_batch_use(int impl);
+double bk390a_batch_value(const struct bk390a_batch *b, size_t i);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,230 @@
+/*
+ * BK Precision Model 390A multimeter frame decoder
+ *
+ * The FUNCTION/RANGE matrix from the data sheet is built at compile
+ * time in to bk390a_range_table[] so that decoding a frame is a single
+ * table lookup rather than a nested switch per function.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include "decode.h"
+
+#define R(dps, exp, unit, mode) { dps, exp, BK390A_UNIT_##unit, BK390A_MODE_##mode }
+#define ALL8(x) { x, x, x, x, x, x, x, x }
+#define FN(f) [(f) & 0x0F]
+
+/*
+ * Indexed by [FUNCTION & 0x0F][STATUS_JUDGE][RANGE & 0x07].  Row 16 is
+ * all zeros (BK390A_MODE_UNKNOWN) and is used for function bytes that
+ * are outside of the 0x3? block, as are any unlisted ranges.
+ *
+ * Note that the FUNCTION_CURRENT_UA/MA codes show mA/uA scaled values
+ * respectively on the 390A.
+ */
+const struct bk390a_range bk390a_range_table[17][2][8] = {
+	FN(FUNCTION_VOLTAGE) = {
+		{ R(1, -3, VOLT, VOLTS), R(3, 0, VOLT, VOLTS), R(2, 0, VOLT, VOLTS), R(1, 0, VOLT, VOLTS), R(0, 0, VOLT, VOLTS) },
+		{ R(1, -3, VOLT, VOLTS), R(3, 0, VOLT, VOLTS), R(2, 0, VOLT, VOLTS), R(1, 0, VOLT, VOLTS), R(0, 0, VOLT, VOLTS) }
+	},
+
+	FN(FUNCTION_CURRENT_UA) = {
+		{ R(2, -3, AMP, AMPS), R(1, -3, AMP, AMPS) },
+		{ R(2, -3, AMP, AMPS), R(1, -3, AMP, AMPS) }
+	},
+
+	FN(FUNCTION_CURRENT_MA) = {
+		{ R(1, -6, AMP, AMPS), R(0, -6, AMP, AMPS) },
+		{ R(1, -6, AMP, AMPS), R(0, -6, AMP, AMPS) }
+	},
+
+	FN(FUNCTION_CURRENT_A) = {
+		ALL8(R(2, 0, AMP, AMPS)),
+		ALL8(R(2, 0, AMP, AMPS))
+	},
+
+	FN(FUNCTION_OHMS) = {
+		{ R(1, 0, OHM, RESISTANCE), R(3, 3, OHM, RESISTANCE), R(2, 3, OHM, RESISTANCE), R(1, 3, OHM, RESISTANCE), R(3, 6, OHM, RESISTANCE), R(2, 6, OHM, RESISTANCE) },
+		{ R(1, 0, OHM, RESISTANCE), R(3, 3, OHM, RESISTANCE), R(2, 3, OHM, RESISTANCE), R(1, 3, OHM, RESISTANCE), R(3, 6, OHM, RESISTANCE), R(2, 6, OHM, RESISTANCE) }
+	},
+
+	FN(FUNCTION_CONTINUITY) = {
+		ALL8(R(1, 0, OHM, CONTINUITY)),
+		ALL8(R(1, 0, OHM, CONTINUITY))
+	},
+
+	FN(FUNCTION_DIODE) = {
+		ALL8(R(3, 0, VOLT, DIODE)),
+		ALL8(R(3, 0, VOLT, DIODE))
+	},
+
+	FN(FUNCTION_FQ_RPM) = {
+		/* JUDGE clear: RPM */
+		{ R(2, 3, RPM, RPM), R(1, 3, RPM, RPM), R(3, 6, RPM, RPM), R(2, 6, RPM, RPM), R(1, 6, RPM, RPM), R(0, 6, RPM, RPM) },
+		/* JUDGE set: Frequency */
+		{ R(3, 3, HZ, FREQUENCY), R(2, 3, HZ, FREQUENCY), R(1, 3, HZ, FREQUENCY), R(3, 6, HZ, FREQUENCY), R(2, 6, HZ, FREQUENCY), R(1, 6, HZ, FREQUENCY) }
+	},
+
+	FN(FUNCTION_CAPACITANCE) = {
+		{ R(3, -9, FARAD, CAPACITANCE), R(2, -9, FARAD, CAPACITANCE), R(1, -9, FARAD, CAPACITANCE), R(3, -6, FARAD, CAPACITANCE),
+			R(2, -6, FARAD, CAPACITANCE), R(1, -6, FARAD, CAPACITANCE), R(3, -3, FARAD, CAPACITANCE), R(2, -3, FARAD, CAPACITANCE) },
+		{ R(3, -9, FARAD, CAPACITANCE), R(2, -9, FARAD, CAPACITANCE), R(1, -9, FARAD, CAPACITANCE), R(3, -6, FARAD, CAPACITANCE),
+			R(2, -6, FARAD, CAPACITANCE), R(1, -6, FARAD, CAPACITANCE), R(3, -3, FARAD, CAPACITANCE), R(2, -3, FARAD, CAPACITANCE) }
+	},
+
+	FN(FUNCTION_TEMPERATURE) = {
+		/* JUDGE clear: Fahrenheit, set: Celsius */
+		ALL8(R(0, 0, DEGF, TEMPERATURE)),
+		ALL8(R(0, 0, DEGC, TEMPERATURE))
+	},
+
+	FN(FUNCTION_ADP0) = { ALL8(R(0, 0, NONE, ADP)), ALL8(R(0, 0, NONE, ADP)) },
+	FN(FUNCTION_ADP1) = { ALL8(R(0, 0, NONE, ADP)), ALL8(R(0, 0, NONE, ADP)) },
+	FN(FUNCTION_ADP2) = { ALL8(R(0, 0, NONE, ADP)), ALL8(R(0, 0, NONE, ADP)) },
+	FN(FUNCTION_ADP3) = { ALL8(R(0, 0, NONE, ADP)), ALL8(R(0, 0, NONE, ADP)) },
+};
+
+const char *bk390a_unit_str[BK390A_UNIT_COUNT] = { "", "V", "A", "Ω", "Hz", "rpm", "F", "'C", "'F" };
+const wchar_t *bk390a_unit_wstr[BK390A_UNIT_COUNT] = { L"", L"V", L"A", L"\u2126", L"Hz", L"rpm", L"F", L"\u00B0C", L"\u00B0F" };
+
+const char *bk390a_mode_str[BK390A_MODE_COUNT] = {
+	"", "Volts", "Amps", "Resistance", "Continuity", "Diode",
+	"Frequency", "RPM", "Capacitance", "Temperature", "Adapter"
+};
+const wchar_t *bk390a_mode_wstr[BK390A_MODE_COUNT] = {
+	L"", L"Volts", L"Amps", L"Resistance", L"Continuity", L"Diode",
+	L"Frequency", L"RPM", L"Capacitance", L"Temperature", L"Adapter"
+};
+
+const char *bk390a_prefix_str[BK390A_PREFIX_COUNT] = { "n", "μ", "m", "", "k", "M" };
+const wchar_t *bk390a_prefix_wstr[BK390A_PREFIX_COUNT] = { L"n", L"\u00B5", L"m", L"", L"k", L"M" };
+
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-091204
+  Function Name	: bk390a_decode
+  Returns Type	: int
+  ----Parameter List
+  1. const uint8_t *d, 9 byte frame payload
+  2. struct bk390a_reading *r, decoded result
+  ------------------
+  Exit Codes	: 0 = success, -1 = unknown function/range or malformed
+  Side Effects	: r is always fully written, from this frame only
+  --------------------------------------------------------------------
+Comments:
+	No branches on the frame contents; the function/range lookup,
+	the sign and the validity checks are resolved arithmetically.
+
+	The payload is checked as framer.c checks it, every byte in the
+	0x30..0x3F block and digits 0..9, so a frame that didn't come
+	through the framer can't be accepted with a count outside of
+	-9999..9999, or a range nibble over 7 read as one of ranges 0..7.
+	An accepted frame always has a known mode, a unit,
+	prefix and exp10 within the tables, and a finite value.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int bk390a_decode(const uint8_t *d, struct bk390a_reading *r) {
+	const struct bk390a_range *e;
+	static const uint8_t digits[8] = { 0, 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0 };
+	uint64_t w, dm, bad;
+	unsigned int fn, neg;
+	int count;
+
+	fn = d[BYTE_FUNCTION];
+	fn = ((fn & 0xF0) == 0x30) ? (fn & 0x0F) : 16;
+	e = &bk390a_range_table[fn][(d[BYTE_STATUS] & STATUS_JUDGE) >> 3][d[BYTE_RANGE] & 0x07];
+
+	/*
+	 * Any byte outside of 0x30..0x3F, or a digit nibble over 9 (adding
+	 * 6 carries in to bit 4); bytes 0..7 a word at a time, byte order
+	 * doesn't matter as the digit mask is loaded the same way
+	 */
+	memcpy(&w, d, sizeof(w));
+	memcpy(&dm, digits, sizeof(dm));
+	bad = (w & 0xF0F0F0F0F0F0F0F0ULL) ^ 0x3030303030303030ULL;
+	bad |= (((w & 0x0F0F0F0F0F0F0F0FULL) + 0x0606060606060606ULL) & 0x1010101010101010ULL) & dm;
+	bad |= (d[BYTE_OPTION_2] & 0xF0) ^ 0x30;
+	bad |= d[BYTE_RANGE] & 0x08;
+
+	/*
+	 * bytes 1..4 are ASCII char codes for 0000-9999
+	 */
+	count = ((d[BYTE_DIGIT_3] & 0x0F) * 1000)
+		+ ((d[BYTE_DIGIT_2] & 0x0F) * 100)
+		+ ((d[BYTE_DIGIT_1] & 0x0F) * 10)
+		+ ((d[BYTE_DIGIT_0] & 0x0F) * 1);
+
+	neg = (d[BYTE_STATUS] & STATUS_SIGN) >> 2;
+	r->count = (int16_t)((count ^ -(int)neg) + (int)neg);
+
+	r->dps = e->dps;
+	r->si_exp = e->si_exp;
+	r->exp10 = e->si_exp - e->dps;
+	r->unit = e->unit;
+	r->mode = e->mode;
+	r->status = d[BYTE_STATUS] & 0x0F;
+	r->option1 = d[BYTE_OPTION_1] & 0x0F;
+	r->option2 = d[BYTE_OPTION_2] & 0x0F;
+	r->protocol = BK390A_PROTOCOL_BK390A;
+
+	return ((e->mode == BK390A_MODE_UNKNOWN) || bad) ? -1 : 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-113015
+  Function Name	: bk390a_value
+  Returns Type	: double
+  ----Parameter List
+  1. const struct bk390a_reading *r ,
+  ------------------
+  Exit Codes	: reading in SI base units, ie 12.34mV = 0.01234
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Powers of ten up to 10^22 are exact doubles, so scaling the count
+	by one (rather than by an inexact 1e-N) gives the nearest double
+	to the true decimal value.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+double bk390a_value(const struct bk390a_reading *r) {
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12
+	};
+
+	if (r->exp10 < 0) return r->count / pow10[-r->exp10];
+
+	return r->count * pow10[r->exp10];
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-152010
+  Function Name	: bk390a_value_str
+  Returns Type	: int
+  ----Parameter List
+  1. const struct bk390a_reading *r,
+  2. char *buf,
+  3. size_t len ,
+  ------------------
+  Exit Codes	: characters written
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The value in SI base units with as many decimal places as the
+	meter resolves, ie 12.34mV = "0.01234", 1.234MOhm = "1234000"
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int bk390a_value_str(const struct bk390a_reading *r, char *buf, size_t len) {
+	return snprintf(buf, len, "%0.*f", (r->exp10 < 0) ? -r->exp10 : 0, bk390a_value(r));
+}
@@ -0,0 +1,162 @@
+/*
+ * BK Precision Model 390A multimeter frame decoder
+ *
+ * Shared between bk390a.c and win-bk390a.cpp so that both front
+ * ends interpret the meter data identically.
+ *
+ * The meter sends an 11 byte frame; 9 bytes of payload followed
+ * by \r\n.  The FUNCTION byte and the RANGE nibble (plus the JUDGE
+ * status bit for Frequency/RPM and C/F temperature) select the
+ * decimal places, SI prefix, unit and mode for the 4 BCD digits.
+ *
+ */
+#ifndef __BK390A_DECODE_H__
+#define __BK390A_DECODE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BYTE_RANGE 0
+#define BYTE_DIGIT_3 1
+#define BYTE_DIGIT_2 2
+#define BYTE_DIGIT_1 3
+#define BYTE_DIGIT_0 4
+#define BYTE_FUNCTION 5
+#define BYTE_STATUS 6
+#define BYTE_OPTION_1 7
+#define BYTE_OPTION_2 8
+
+#define BK390A_PAYLOAD_SIZE 9
+#define BK390A_FRAME_SIZE 11	// payload + \r\n
+
+/*
+ * Longest payload and frame, and most display digits, of any protocol,
+ * proto.h
+ */
+#define BK390A_PAYLOAD_MAX 12
+#define BK390A_FRAME_MAX 14
+#define BK390A_DIGITS_MAX 5
+
+#define FUNCTION_VOLTAGE 0b00111011
+#define FUNCTION_CURRENT_UA 0b00111101
+#define FUNCTION_CURRENT_MA 0b00111001
+#define FUNCTION_CURRENT_A 0b00111111
+#define FUNCTION_OHMS 0b00110011
+#define FUNCTION_CONTINUITY 0b00110101
+#define FUNCTION_DIODE 0b00110001
+#define FUNCTION_FQ_RPM 0b00110010
+#define FUNCTION_CAPACITANCE 0b00110110
+#define FUNCTION_TEMPERATURE 0b00110100
+#define FUNCTION_ADP0 0b00111110
+#define FUNCTION_ADP1 0b00111100
+#define FUNCTION_ADP2 0b00111000
+#define FUNCTION_ADP3 0b00111010
+
+#define STATUS_OL 0x01
+#define STATUS_BATT 0x02
+#define STATUS_SIGN 0x04
+#define STATUS_JUDGE 0x08
+
+#define OPTION1_VAHZ 0x01
+#define OPTION1_PMIN 0x04
+#define OPTION1_PMAX 0x08
+
+#define OPTION2_APO 0x01
+#define OPTION2_AUTO 0x02
+#define OPTION2_AC 0x04
+#define OPTION2_DC 0x08
+
+enum bk390a_unit {
+	BK390A_UNIT_NONE = 0,
+	BK390A_UNIT_VOLT,
+	BK390A_UNIT_AMP,
+	BK390A_UNIT_OHM,
+	BK390A_UNIT_HZ,
+	BK390A_UNIT_RPM,
+	BK390A_UNIT_FARAD,
+	BK390A_UNIT_DEGC,
+	BK390A_UNIT_DEGF,
+	BK390A_UNIT_COUNT
+};
+
+enum bk390a_protocol {
+	BK390A_PROTOCOL_BK390A = 0,
+	BK390A_PROTOCOL_ES51922,
+	BK390A_PROTOCOL_COUNT
+};
+
+enum bk390a_mode {
+	BK390A_MODE_UNKNOWN = 0,
+	BK390A_MODE_VOLTS,
+	BK390A_MODE_AMPS,
+	BK390A_MODE_RESISTANCE,
+	BK390A_MODE_CONTINUITY,
+	BK390A_MODE_DIODE,
+	BK390A_MODE_FREQUENCY,
+	BK390A_MODE_RPM,
+	BK390A_MODE_CAPACITANCE,
+	BK390A_MODE_TEMPERATURE,
+	BK390A_MODE_ADP,
+	BK390A_MODE_COUNT
+};
+
+/*
+ * SI prefixes run from n (1e-9) to M (1e6) in steps of 10^3,
+ * BK390A_PREFIX_INDEX() maps the exponent on to the string tables
+ */
+#define BK390A_PREFIX_COUNT 6
+#define BK390A_PREFIX_INDEX(e) (((e) + 9) / 3)
+
+/*
+ * One entry of the FUNCTION x JUDGE x RANGE table
+ */
+struct bk390a_range {
+	int8_t dps;		// Number of decimal places shown
+	int8_t si_exp;	// Power of ten of the SI prefix
+	uint8_t unit;	// enum bk390a_unit
+	uint8_t mode;	// enum bk390a_mode
+};
+
+/*
+ * Decoded frame
+ *
+ * The reading is exactly count x 10^exp10 SI base units (12.34mV is
+ * 1234 x 10^-5 V); it only becomes a double at the outputs that
+ * need one, bk390a_value()
+ */
+struct bk390a_reading {
+	int16_t count;	// Signed display count, -9999..9999 (-22000..22000 ES51922)
+	int8_t dps;
+	int8_t si_exp;
+	int8_t exp10;	// si_exp - dps
+	uint8_t unit;
+	uint8_t mode;
+	uint8_t status;	// STATUS_* bits
+	uint8_t option1;	// OPTION1_* bits
+	uint8_t option2;	// OPTION2_* bits
+	uint8_t protocol;	// enum bk390a_protocol, of the decoder
+};
+
+extern const struct bk390a_range bk390a_range_table[17][2][8];
+
+extern const char *bk390a_unit_str[BK390A_UNIT_COUNT];
+extern const char *bk390a_mode_str[BK390A_MODE_COUNT];
+extern const char *bk390a_prefix_str[BK390A_PREFIX_COUNT];
+extern const wchar_t *bk390a_unit_wstr[BK390A_UNIT_COUNT];
+extern const wchar_t *bk390a_mode_wstr[BK390A_MODE_COUNT];
+extern const wchar_t *bk390a_prefix_wstr[BK390A_PREFIX_COUNT];
+
+int bk390a_decode(const uint8_t *d, struct bk390a_reading *r);
+double bk390a_value(const struct bk390a_reading *r);
+int bk390a_value_str(const struct bk390a_reading *r, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,228 @@
+/*
+ * Display string formatting
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+#include "dispfmt.h"
+#include "proto.h"
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-153010
+  Function Name	: dispfmt_digits
+  Returns Type	: static int
+  ----Parameter List
+  1. const struct bk390a_reading *r,
+  2. char *d, receives up to BK390A_DIGITS_MAX + 2 characters, not terminated
+  ------------------
+  Exit Codes	: characters written
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Sign (or a space), then the meter's digits (four from a 390A,
+	five from an ES51922), zero filled, with the decimal point dps
+	digits from the right; the same characters the old "% 06.*f"
+	of count / 10^dps gave for the 390A.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int dispfmt_digits(const struct bk390a_reading *r, char *d) {
+	static const int full[BK390A_DIGITS_MAX + 1] = { 0, 9, 99, 999, 9999, 99999 };
+	char digits[BK390A_DIGITS_MAX];
+	int c = r->count;
+	int dps = r->dps;
+	int places = 4;
+	int i, n = 0;
+
+	if (r->protocol < BK390A_PROTOCOL_COUNT) places = proto_list[r->protocol]->layout->digits;
+
+	if (dps < 0) dps = 0;
+	if (dps > places - 1) dps = places - 1;
+
+	d[n++] = (c < 0) ? '-' : ' ';
+	if (c < 0) c = -c;
+	if (c > full[places]) c = full[places];
+
+	for (i = places - 1; i >= 0; i--) {
+		digits[i] = '0' + (c % 10);
+		c /= 10;
+	}
+
+	for (i = 0; i < places; i++) {
+		if (dps && (i == places - dps)) d[n++] = '.';
+		d[n++] = digits[i];
+	}
+
+	return n;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-153022
+  Function Name	: dispfmt_append
+  Returns Type	: int
+  ----Parameter List
+  1. char *buf,
+  2. int pos, current length of buf
+  3. size_t len, size of buf
+  4. const char *s ,
+  ------------------
+  Exit Codes	: new length of buf
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int dispfmt_append(char *buf, int pos, size_t len, const char *s) {
+	if (len == 0) return 0;
+
+	while (*s && ((size_t)pos < len -1)) buf[pos++] = *s++;
+	buf[pos] = '\0';
+
+	return pos;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-153035
+  Function Name	: dispfmt_wappend
+  Returns Type	: int
+  ----Parameter List
+  1. wchar_t *buf,
+  2. int pos, current length of buf
+  3. size_t len, size of buf in characters
+  4. const wchar_t *s ,
+  ------------------
+  Exit Codes	: new length of buf
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int dispfmt_wappend(wchar_t *buf, int pos, size_t len, const wchar_t *s) {
+	if (len == 0) return 0;
+
+	while (*s && ((size_t)pos < len -1)) buf[pos++] = *s++;
+	buf[pos] = L'\0';
+
+	return pos;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-153048
+  Function Name	: dispfmt_wpad
+  Returns Type	: int
+  ----Parameter List
+  1. wchar_t *buf,
+  2. int pos, current length of buf
+  3. size_t len, size of buf in characters
+  4. int width ,
+  ------------------
+  Exit Codes	: new length of buf
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Space fill to width, as "%-<width>s" would
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int dispfmt_wpad(wchar_t *buf, int pos, size_t len, int width) {
+	if (len == 0) return 0;
+
+	while ((pos < width) && ((size_t)pos < len -1)) buf[pos++] = L' ';
+	buf[pos] = L'\0';
+
+	return pos;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-153100
+  Function Name	: dispfmt_reading
+  Returns Type	: int
+  ----Parameter List
+  1. const struct bk390a_reading *r,
+  2. int flags, DISPFMT_*
+  3. char *buf,
+  4. size_t len ,
+  ------------------
+  Exit Codes	: characters written
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	UTF-8, ie " 012.3mV", "-1.234kΩ" or "O.L."
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int dispfmt_reading(const struct bk390a_reading *r, int flags, char *buf, size_t len) {
+	char d[BK390A_DIGITS_MAX + 3];
+	const char *prefix;
+	int n;
+
+	if (len == 0) return 0;
+	buf[0] = '\0';
+
+	if (r->status & STATUS_OL) return dispfmt_append(buf, 0, len, "O.L.");
+
+	d[dispfmt_digits(r, d)] = '\0';
+	prefix = bk390a_prefix_str[BK390A_PREFIX_INDEX(r->si_exp)];
+	if ((flags & DISPFMT_PREFIX_SPACE) && (prefix[0] == '\0')) prefix = " ";
+
+	n = dispfmt_append(buf, 0, len, d);
+	n = dispfmt_append(buf, n, len, prefix);
+
+	return dispfmt_append(buf, n, len, bk390a_unit_str[r->unit]);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-153112
+  Function Name	: dispfmt_wreading
+  Returns Type	: int
+  ----Parameter List
+  1. const struct bk390a_reading *r,
+  2. int flags, DISPFMT_*
+  3. wchar_t *buf,
+  4. size_t len, in characters
+  ------------------
+  Exit Codes	: characters written
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int dispfmt_wreading(const struct bk390a_reading *r, int flags, wchar_t *buf, size_t len) {
+	char d[BK390A_DIGITS_MAX + 3];
+	wchar_t wd[BK390A_DIGITS_MAX + 3];
+	const wchar_t *prefix;
+	int i, n;
+
+	if (len == 0) return 0;
+	buf[0] = L'\0';
+
+	if (r->status & STATUS_OL) return dispfmt_wappend(buf, 0, len, L"O.L.");
+
+	n = dispfmt_digits(r, d);
+	for (i = 0; i < n; i++) wd[i] = (wchar_t)d[i];
+	wd[n] = L'\0';
+	prefix = bk390a_prefix_wstr[BK390A_PREFIX_INDEX(r->si_exp)];
+	if ((flags & DISPFMT_PREFIX_SPACE) && (prefix[0] == L'\0')) prefix = L" ";
+
+	n = dispfmt_wappend(buf, 0, len, wd);
+	n = dispfmt_wappend(buf, n, len, prefix);
+
+	return dispfmt_wappend(buf, n, len, bk390a_unit_wstr[r->unit]);
+}
@@ -0,0 +1,39 @@
+/*
+ * Display string formatting
+ *
+ * Renders a decoded reading as the meter shows it, sign, its four (or
+ * with an ES51922 five) digits with the decimal point in place, prefix
+ * and unit ("-012.3mV", " 1.2345V"),
+ * straight from the integer fields of the reading.  No floating
+ * point, printf or locale work; the console, OBS file and GUI all
+ * format every frame through here.
+ *
+ * dispfmt_reading() writes UTF-8, dispfmt_wreading() wchar_t (UTF-16
+ * on Windows, as the GUI's TextOutW() wants).  Both always terminate
+ * the buffer and truncate rather than overrun it.
+ *
+ */
+#ifndef __BK390A_DISPFMT_H__
+#define __BK390A_DISPFMT_H__
+
+#include <stddef.h>
+#include <wchar.h>
+#include "decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DISPFMT_PREFIX_SPACE 0x01	// a space when there's no prefix, keeps the units still
+
+int dispfmt_reading(const struct bk390a_reading *r, int flags, char *buf, size_t len);
+int dispfmt_wreading(const struct bk390a_reading *r, int flags, wchar_t *buf, size_t len);
+int dispfmt_append(char *buf, int pos, size_t len, const char *s);
+int dispfmt_wappend(wchar_t *buf, int pos, size_t len, const wchar_t *s);
+int dispfmt_wpad(wchar_t *buf, int pos, size_t len, int width);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,363 @@
+/*
+ * BK Precision Model 390A serial framer
+ *
+ * The port is read in whatever sized chunks are available, directly
+ * in to the ring via framer_write_ptr()/framer_commit(), and frames
+ * are then extracted with framer_next().  Stamp the read as soon as
+ * it returns, before doing anything else with the bytes.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "framer.h"
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-094410
+  Function Name	: framer_init
+  Returns Type	: void
+  ----Parameter List
+  1. struct framer *f ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void framer_init(struct framer *f) {
+	memset(f, 0, sizeof(struct framer));
+	f->proto = &proto_bk390a;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-201815
+  Function Name	: framer_protocol
+  Returns Type	: void
+  ----Parameter List
+  1. struct framer *f,
+  2. const struct proto *p, the meter's protocol ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: forgets any partial frame
+  --------------------------------------------------------------------
+Comments:
+	Set before the first bytes are committed.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void framer_protocol(struct framer *f, const struct proto *p) {
+	f->proto = p;
+	framer_discard(f);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-192010
+  Function Name	: framer_discard
+  Returns Type	: void
+  ----Parameter List
+  1. struct framer *f ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Forget any partial frame, keeping the counters; after the port
+	has been reopened the next bytes don't continue it.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void framer_discard(struct framer *f) {
+	f->bytes_dropped += f->head - f->tail;
+	f->tail = f->head;
+	f->scan = f->head;
+	f->stamp_tail = f->stamp_head;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-094422
+  Function Name	: framer_write_ptr
+  Returns Type	: uint8_t *
+  ----Parameter List
+  1. struct framer *f ,
+  2. size_t *len, set to the contiguous space available
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Lets the caller ReadFile()/read() straight in to the ring, the
+	space offered never wraps so a single read call will do.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+uint8_t *framer_write_ptr(struct framer *f, size_t *len) {
+	uint32_t used = f->head - f->tail;
+	uint32_t offset = f->head & FRAMER_MASK;
+	uint32_t space = FRAMER_BUFFER_SIZE - used;
+
+	if (space > FRAMER_BUFFER_SIZE - offset) space = FRAMER_BUFFER_SIZE - offset;
+	*len = space;
+
+	return &(f->buf[offset]);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-094431
+  Function Name	: framer_commit
+  Returns Type	: void
+  ----Parameter List
+  1. struct framer *f ,
+  2. size_t n, bytes placed at framer_write_ptr()
+  3. uint64_t t_ns, monotonic time the read completed
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	If more than FRAMER_STAMPS reads are waiting to be framed the
+	oldest stamp is forgotten, its bytes take the next read's
+	(later) time.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void framer_commit(struct framer *f, size_t n, uint64_t t_ns) {
+	uint32_t i;
+
+	if (n == 0) return;
+
+	f->head += (uint32_t)n;
+	f->bytes += n;
+
+	if (f->stamp_head - f->stamp_tail >= FRAMER_STAMPS) f->stamp_tail++;
+	i = f->stamp_head & FRAMER_STAMP_MASK;
+	f->stamp_end[i] = f->head;
+	f->stamp_ns[i] = t_ns;
+	f->stamp_head++;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-094440
+  Function Name	: framer_push
+  Returns Type	: size_t
+  ----Parameter List
+  1. struct framer *f ,
+  2. const uint8_t *data,
+  3. size_t n ,
+  4. uint64_t t_ns, monotonic time the data arrived
+  ------------------
+  Exit Codes	: number of bytes accepted
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Copying variant for when the data is already in a buffer,
+	call framer_next() until it returns 0 and push the remainder.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+size_t framer_push(struct framer *f, const uint8_t *data, size_t n, uint64_t t_ns) {
+	size_t done = 0;
+
+	while (done < n) {
+		size_t len;
+		uint8_t *p = framer_write_ptr(f, &len);
+
+		if (len == 0) break;
+		if (len > n - done) len = n - done;
+		memcpy(p, data + done, len);
+		framer_commit(f, len, t_ns);
+		done += len;
+	}
+
+	return done;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-094452
+  Function Name	: frame_valid
+  Returns Type	: int
+  ----Parameter List
+  1. const struct proto *p, the frame's protocol
+  2. const uint8_t *d, p->frame_size byte candidate frame
+  ------------------
+  Exit Codes	: 1 if the frame has the protocol's shape
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Every payload byte of the 390A, and of its relatives, lives in
+	the 0x30..0x3F block.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int frame_valid(const struct proto *p, const uint8_t *d) {
+	const struct proto_layout *l = p->layout;
+	int i;
+
+	if (d[l->payload_size] != p->terminator[0]) return 0;
+	for (i = 0; i < l->payload_size; i++) {
+		if ((d[i] & 0xF0) != 0x30) return 0;
+	}
+	for (i = l->byte_digits; i < l->byte_digits + l->digits; i++) {
+		if ((d[i] & 0x0F) > 9) return 0;
+	}
+
+	return 1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-150210
+  Function Name	: framer_stamp
+  Returns Type	: static uint64_t
+  ----Parameter List
+  1. struct framer *f ,
+  2. uint32_t pos, ring position of a frame's \n
+  ------------------
+  Exit Codes	: arrival time of the read holding pos
+  Side Effects	: forgets the stamps of reads before it
+  --------------------------------------------------------------------
+Comments:
+	Frames come out in order so the search only ever moves forward.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static uint64_t framer_stamp(struct framer *f, uint32_t pos) {
+	if (f->stamp_head == f->stamp_tail) return 0;
+
+	while ((f->stamp_head - f->stamp_tail > 1)
+			&& ((int32_t)(f->stamp_end[f->stamp_tail & FRAMER_STAMP_MASK] - pos) <= 0)) {
+		f->stamp_tail++;
+	}
+
+	return f->stamp_ns[f->stamp_tail & FRAMER_STAMP_MASK];
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-094503
+  Function Name	: framer_next
+  Returns Type	: int
+  ----Parameter List
+  1. struct framer *f ,
+  2. uint8_t *payload, receives the protocol's payload, up to BK390A_PAYLOAD_MAX bytes
+  3. uint64_t *t_ns, receives the frame's arrival time, or NULL
+  ------------------
+  Exit Codes	: 1 = frame available, 0 = need more data
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Each \n closes a candidate frame made of the 11 bytes (the
+	protocol's frame size) ending at it.  If more than 11 bytes
+	preceded the \n then the junk is discarded and counted as a
+	resync, a short or corrupt frame is counted as malformed and
+	skipped.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int framer_next(struct framer *f, uint8_t *payload, uint64_t *t_ns) {
+	const struct proto *p = f->proto;
+	uint32_t size = p->frame_size;
+	uint8_t term = p->terminator[1];
+	uint8_t frame[BK390A_FRAME_MAX];
+
+	while (f->scan != f->head) {
+		uint32_t end, start, len, i;
+
+		if (f->buf[f->scan & FRAMER_MASK] != term) {
+			f->scan++;
+			continue;
+		}
+
+		end = ++f->scan;
+		len = end - f->tail;
+
+		if (len < size) {
+			f->frames_malformed++;
+			f->bytes_dropped += len;
+			f->tail = end;
+			continue;
+		}
+
+		start = end - size;
+		for (i = 0; i < size; i++) {
+			frame[i] = f->buf[(start + i) & FRAMER_MASK];
+		}
+
+		if (!frame_valid(p, frame)) {
+			f->frames_malformed++;
+			f->bytes_dropped += len;
+			f->tail = end;
+			continue;
+		}
+
+		if (len > size) {
+			f->resyncs++;
+			f->bytes_dropped += len - size;
+		}
+
+		f->frames_ok++;
+		f->tail = end;
+		for (i = 0; i < p->layout->payload_size; i++) {
+			payload[i] = frame[i];	// a byte loop, a short memcpy() of a run time length is slower
+		}
+		if (t_ns) *t_ns = framer_stamp(f, end -1);
+		return 1;
+	}
+
+	/*
+	 * Without a \n in sight only the last 10 bytes (a frame less
+	 * one) could still be the start of a frame, so don't let junk
+	 * fill the ring
+	 */
+	if (f->head - f->tail > size - 1) {
+		uint32_t keep = f->head - (size - 1);
+
+		f->bytes_dropped += keep - f->tail;
+		f->tail = keep;
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-214530
+  Function Name	: framer_wanted
+  Returns Type	: uint32_t
+  ----Parameter List
+  1. const struct framer *f ,
+  ------------------
+  Exit Codes	: bytes still to come to complete the frame in progress, at least 1
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Once framer_next() has returned 0 the ring holds no more than
+	the start of one frame; a full frame's worth when it's empty.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+uint32_t framer_wanted(const struct framer *f) {
+	uint32_t pending = f->head - f->tail;
+
+	if (pending >= f->proto->frame_size) return 1;
+
+	return f->proto->frame_size - pending;
+}
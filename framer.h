@@ -0,0 +1,65 @@
+/*
+ * BK Precision Model 390A serial framer
+ *
+ * Bytes read in bulk from the serial port are placed in to a ring
+ * buffer; complete 11 byte frames (9 byte payload + \r\n) are pulled
+ * out, malformed frames are counted and dropped, and the framer
+ * resynchronises on the next \n without losing the following frame.
+ * framer_protocol() sets another frame size and layout, proto.h.
+ *
+ * Each read is committed with the monotonic time it completed, and a
+ * frame comes out stamped with the time of the read that delivered
+ * its terminating \n, however many reads it was spread over and
+ * however late it's pulled out of the ring.
+ *
+ */
+#ifndef __BK390A_FRAMER_H__
+#define __BK390A_FRAMER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "decode.h"
+#include "proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRAMER_BUFFER_SIZE 256	// must be a power of 2
+#define FRAMER_MASK (FRAMER_BUFFER_SIZE - 1)
+#define FRAMER_STAMPS 32		// reads whose arrival time is kept, power of 2
+#define FRAMER_STAMP_MASK (FRAMER_STAMPS - 1)
+
+struct framer {
+	const struct proto *proto;	// frame size and layout, proto_bk390a by default
+	uint8_t buf[FRAMER_BUFFER_SIZE];
+	uint32_t head;	// next byte to be written (free running)
+	uint32_t tail;	// start of the current, unconsumed, frame
+	uint32_t scan;	// next byte to check for \n
+
+	uint64_t bytes;			// total bytes committed
+	uint64_t frames_ok;
+	uint64_t frames_malformed;	// terminated but wrong length/content
+	uint64_t resyncs;		// good frame found after discarding junk
+	uint64_t bytes_dropped;
+
+	uint32_t stamp_end[FRAMER_STAMPS];	// head once the read was committed
+	uint64_t stamp_ns[FRAMER_STAMPS];	// when the read completed
+	uint32_t stamp_head;
+	uint32_t stamp_tail;	// oldest read that may hold unframed bytes
+};
+
+void framer_init(struct framer *f);
+void framer_protocol(struct framer *f, const struct proto *p);
+void framer_discard(struct framer *f);
+uint8_t *framer_write_ptr(struct framer *f, size_t *len);
+void framer_commit(struct framer *f, size_t n, uint64_t t_ns);
+size_t framer_push(struct framer *f, const uint8_t *data, size_t n, uint64_t t_ns);
+int framer_next(struct framer *f, uint8_t *payload, uint64_t *t_ns);
+uint32_t framer_wanted(const struct framer *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
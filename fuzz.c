@@ -0,0 +1,804 @@
+/*
+ * BK Precision Model 390A framer and decoder fuzzing harness
+ *
+ * LLVMFuzzerTestOneInput() takes any byte string and
+ *
+ *		pushes it through every protocol's framer, in reads of the
+ *		sizes its first byte picks, decoding each frame that comes out
+ *		with that protocol's decoder,
+ *
+ *		decodes every window of it as a payload with every decoder,
+ *		bytes the framer would have refused included,
+ *
+ *		decodes the same windows with each batch decoder the CPU has
+ *		and compares every frame with bk390a_decode().
+ *
+ * Every reading is held to what decode.h and proto.h promise; an
+ * accepted frame has a known mode, a unit, prefix and decimal places
+ * within the tables, a count no bigger than the protocol's max_count,
+ * a range of 0..7 and a finite value, and no field of any reading,
+ * accepted or not, depends on what the reading held before.  Its
+ * display string from dispfmt is snprintf()'s, and a short buffer
+ * gets a terminated prefix of it.  Anything else abort()s, which
+ * libFuzzer and AFL both take as a crash.
+ *
+ * Build;
+ *		make check					the corpus, every FUNCTION x STATUS x RANGE byte
+ *									and random mutations of the corpus
+ *		make fuzz CC=clang			libFuzzer; ./bk390a-fuzz-lf corpus
+ *		make bk390a-fuzz CC=afl-gcc	AFL; the standalone build reads stdin
+ *
+ * corpus/ has a frame for every function and range of both protocols'
+ * tables, and corpus/decoded.txt what each decodes to, so a decoder
+ * change that alters a reading shows up in make check as a diff.
+ *
+ */
+
+#define _DEFAULT_SOURCE
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include "decode.h"
+#include "decbatch.h"
+#include "dispfmt.h"
+#include "framer.h"
+#include "proto.h"
+
+#define FUZZ_INPUT_MAX 4096		// bytes of an input looked at, libFuzzer -max_len
+#define FUZZ_DEFAULT_SEED 390
+
+char VERSION[] = "v0.1-Alpha";
+char help[] = " [-x] [-n <inputs>] [-S <seed>] [-l] [-h] [<input> ...]\r\n"\
+			   "\n"\
+			   "\t\tBK-Precision 390A framer and decoder fuzzing harness\r\n"\
+			   "\r\n"\
+			   "\t-h: This help\r\n"\
+			   "\t-x: Decode every FUNCTION x STATUS x RANGE byte of every protocol\r\n"\
+			   "\t-n <inputs>: Also run this many random mutations of the inputs\r\n"\
+			   "\t-S <seed>: Seed for -n (default 390)\r\n"\
+			   "\t-l: List what each input's frames decode to, instead of checking\r\n"\
+			   "\t-v: show version\r\n"\
+			   "\r\n"\
+			   "\tWith no inputs, -x or -n one input is read from stdin, for AFL\r\n"\
+			   "\n\n\texample: bk390a-fuzz -x -n 100000 corpus/*\r\n"\
+			   "\r\n";
+
+struct glb {
+	uint8_t exhaustive;
+	uint8_t list;
+	uint64_t mutations;
+	uint64_t seed;
+	int inputs;				// argv[] index of the first input
+};
+
+/*
+ * The inputs, -n mutates these
+ */
+struct input {
+	uint8_t *data;
+	size_t len;
+};
+
+struct input *inputs;
+int input_count;
+
+uint64_t checked;		// readings checked, for the summary
+
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223010
+  Function Name	: fuzz_fail
+  Returns Type	: void
+  ----Parameter List
+  1. const struct proto *p,
+  2. const uint8_t *d, payload
+  3. const char *why ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: abort()s
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void fuzz_fail( const struct proto *p, const uint8_t *d, const char *why ) {
+	int i;
+
+	fprintf(stderr,"%s: %s; payload", p->name, why);
+	for (i = 0; i < p->layout->payload_size; i++) fprintf(stderr," %02x", d[i]);
+	fprintf(stderr,"\r\n");
+	abort();
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223018
+  Function Name	: format_reading_printf
+  Returns Type	: int
+  ----Parameter List
+  1. char *cmd,
+  2. size_t len,
+  3. const struct bk390a_reading *r ,
+  ------------------
+  Exit Codes	: characters written
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The reference dispfmt is held to, as bench.c has it
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int format_reading_printf( char *cmd, size_t len, const struct bk390a_reading *r ) {
+	static const double scale[] = { 1, 10, 100, 1000, 10000 };
+	const char *prefix = bk390a_prefix_str[BK390A_PREFIX_INDEX(r->si_exp)];
+	const char *units = bk390a_unit_str[r->unit];
+	int digits = proto_list[r->protocol]->layout->digits;
+
+	if (r->status & STATUS_OL) return snprintf(cmd, len, "O.L.");
+
+	return snprintf(cmd, len, "% 0*.*f%s%s", digits + 1 + (r->dps > 0), r->dps, r->count / scale[r->dps], prefix, units);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223026
+  Function Name	: reading_equal
+  Returns Type	: static int
+  ----Parameter List
+  1. const struct bk390a_reading *a,
+  2. const struct bk390a_reading *b ,
+  ------------------
+  Exit Codes	: 1 if every field is the same
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Field by field, the struct's padding is never written
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int reading_equal( const struct bk390a_reading *a, const struct bk390a_reading *b ) {
+	return (a->count == b->count) && (a->dps == b->dps) && (a->si_exp == b->si_exp)
+		&& (a->exp10 == b->exp10) && (a->unit == b->unit) && (a->mode == b->mode)
+		&& (a->status == b->status) && (a->option1 == b->option1)
+		&& (a->option2 == b->option2) && (a->protocol == b->protocol);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223034
+  Function Name	: check_format
+  Returns Type	: static void
+  ----Parameter List
+  1. const struct proto *p,
+  2. const uint8_t *d, payload
+  3. const struct bk390a_reading *r, accepted reading ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: abort()s on a mismatch
+  --------------------------------------------------------------------
+Comments:
+	dispfmt against snprintf(), then every shorter buffer; each
+	must be terminated, hold a prefix of the full string and not be
+	written past.  The wide version must show the same number; its
+	prefix and unit have their own symbols.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void check_format( const struct proto *p, const uint8_t *d, const struct bk390a_reading *r ) {
+	char ref[64], cmd[64], part[64];
+	wchar_t wcmd[64];
+	size_t len, i;
+	int n;
+
+	format_reading_printf(ref, sizeof(ref), r);
+	n = dispfmt_reading(r, 0, cmd, sizeof(cmd));
+	if (strcmp(ref, cmd) != 0) fuzz_fail(p, d, "dispfmt differs from snprintf");
+	if (n != (int)strlen(cmd)) fuzz_fail(p, d, "dispfmt's length is wrong");
+
+	for (len = 1; len <= strlen(cmd); len++) {
+		memset(part, 0x7F, sizeof(part));
+		dispfmt_reading(r, 0, part, len);
+		if (part[len] != 0x7F) fuzz_fail(p, d, "dispfmt wrote past the end of a short buffer");
+		if (strlen(part) >= len) fuzz_fail(p, d, "dispfmt didn't terminate a short buffer");
+		if (strncmp(part, cmd, strlen(part)) != 0) fuzz_fail(p, d, "dispfmt's truncated string isn't a prefix");
+	}
+
+	dispfmt_wreading(r, 0, wcmd, sizeof(wcmd) / sizeof(wcmd[0]));
+	for (i = 0; cmd[i] && strchr(" -.0123456789O", cmd[i]); i++) {
+		if (wcmd[i] != (wchar_t)cmd[i]) fuzz_fail(p, d, "dispfmt_wreading differs from dispfmt_reading");
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223042
+  Function Name	: check_decode
+  Returns Type	: static int
+  ----Parameter List
+  1. const struct proto *p,
+  2. const uint8_t *d, payload, any bytes
+  3. struct bk390a_reading *out, the reading, or NULL ,
+  ------------------
+  Exit Codes	: the decoder's, 0 = accepted
+  Side Effects	: abort()s if an invariant doesn't hold
+  --------------------------------------------------------------------
+Comments:
+	Decoded twice, over readings filled with different junk, and
+	the two compared; nothing from a previous frame may survive.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int check_decode( const struct proto *p, const uint8_t *d, struct bk390a_reading *out ) {
+	const struct proto_layout *l = p->layout;
+	struct bk390a_reading a, b;
+	int ra, rb;
+	double v;
+
+	memset(&a, 0x55, sizeof(a));
+	memset(&b, 0xAA, sizeof(b));
+	ra = p->decode(d, &a);
+	rb = p->decode(d, &b);
+	if ((ra != rb) || !reading_equal(&a, &b)) fuzz_fail(p, d, "reading depends on what it held before");
+	if (a.protocol != p->id) fuzz_fail(p, d, "reading has another protocol's id");
+	checked++;
+	if (out) *out = a;
+	if (ra != 0) return ra;
+
+	if ((a.mode == BK390A_MODE_UNKNOWN) || (a.mode >= BK390A_MODE_COUNT)) fuzz_fail(p, d, "accepted with an unknown mode");
+	if (a.unit >= BK390A_UNIT_COUNT) fuzz_fail(p, d, "accepted with a unit outside of the table");
+	if ((a.si_exp < -9) || (a.si_exp > 6) || ((a.si_exp + 9) % 3)) fuzz_fail(p, d, "accepted with a prefix outside of the table");
+	if ((a.dps < 0) || (a.dps >= l->digits)) fuzz_fail(p, d, "accepted with more decimal places than digits");
+	if (a.exp10 != a.si_exp - a.dps) fuzz_fail(p, d, "exp10 isn't si_exp - dps");
+	if ((a.count > l->max_count) || (a.count < -(int)l->max_count)) fuzz_fail(p, d, "accepted with a count over max_count");
+	if ((d[l->byte_range] & 0x0F) > 7) fuzz_fail(p, d, "accepted with a range over 7");
+
+	v = bk390a_value(&a);
+	if (!isfinite(v)) fuzz_fail(p, d, "accepted with a value that isn't finite");
+	if (fabs(v - a.count * pow(10, a.exp10)) > fabs(v) * 1e-12) fuzz_fail(p, d, "value isn't count x 10^exp10");
+
+	check_format(p, d, &a);
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223050
+  Function Name	: check_batch
+  Returns Type	: static void
+  ----Parameter List
+  1. const uint8_t *data,
+  2. size_t size ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: abort()s if a batch decoder differs from bk390a_decode()
+  --------------------------------------------------------------------
+Comments:
+	Every 9 byte window of the input is a frame, stride 1, so the
+	vector decoders see runs of them and odd tails.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void check_batch( const uint8_t *data, size_t size ) {
+	static int16_t count[FUZZ_INPUT_MAX];
+	static int8_t exp10[FUZZ_INPUT_MAX];
+	static uint8_t unit[FUZZ_INPUT_MAX], mode[FUZZ_INPUT_MAX], flags[FUZZ_INPUT_MAX];
+	struct bk390a_batch b = { count, exp10, unit, mode, flags };
+	struct bk390a_reading r;
+	size_t n, i;
+	int impl, used;
+
+	if (size < BK390A_PAYLOAD_SIZE) return;
+	n = size - BK390A_PAYLOAD_SIZE +1;
+
+	for (impl = BK390A_BATCH_SCALAR; impl < BK390A_BATCH_BEST; impl++) {
+		used = bk390a_decode_batch_use(impl);
+		if (used != impl) break;
+
+		bk390a_decode_batch(data, 1, n, &b);
+		for (i = 0; i < n; i++) {
+			const uint8_t *d = data + i;
+
+			if (bk390a_decode(d, &r) != 0) {
+				if ((b.mode[i] != BK390A_MODE_UNKNOWN) || (b.unit[i] != BK390A_UNIT_NONE) || (b.exp10[i] != 0)) {
+					fuzz_fail(&proto_bk390a, d, bk390a_batch_str[impl]);
+				}
+				continue;
+			}
+			if ((b.count[i] != r.count) || (b.exp10[i] != r.exp10) || (b.unit[i] != r.unit) || (b.mode[i] != r.mode)
+					|| (BK390A_BATCH_STATUS(b.flags[i]) != r.status) || (BK390A_BATCH_OPTION2(b.flags[i]) != r.option2)
+					|| (bk390a_batch_value(&b, i) != bk390a_value(&r))) {
+				fuzz_fail(&proto_bk390a, d, bk390a_batch_str[impl]);
+			}
+		}
+	}
+
+	bk390a_decode_batch_use(BK390A_BATCH_BEST);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223058
+  Function Name	: check_framer
+  Returns Type	: static void
+  ----Parameter List
+  1. const struct proto *p,
+  2. const uint8_t *data,
+  3. size_t size ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: abort()s if the framer or a decoder misbehaves
+  --------------------------------------------------------------------
+Comments:
+	Read sizes cycle through 1..16 from the first byte on, each
+	read stamped with its number.  Frames must be well formed, come
+	out stamped no later than the read in hand and in order, and
+	the counters must account for no more bytes than went in.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void check_framer( const struct proto *p, const uint8_t *data, size_t size ) {
+	const struct proto_layout *l = p->layout;
+	struct framer fr;
+	uint8_t d[BK390A_PAYLOAD_MAX];
+	uint64_t t_ns, last_ns = 0, read_no = 0;
+	size_t done = 0, chunk, n;
+	uint32_t wanted;
+	int i;
+
+	framer_init(&fr);
+	framer_protocol(&fr, p);
+
+	while (done < size) {
+		chunk = (data[(read_no * 7) % size] & 0x0F) +1;
+		if (chunk > size - done) chunk = size - done;
+		read_no++;
+
+		n = framer_push(&fr, data + done, chunk, read_no);
+		done += n;
+
+		while (framer_next(&fr, d, &t_ns)) {
+			for (i = 0; i < l->payload_size; i++) {
+				if ((d[i] & 0xF0) != 0x30) fuzz_fail(p, d, "framer handed out a byte outside of 0x30..0x3F");
+			}
+			for (i = l->byte_digits; i < l->byte_digits + l->digits; i++) {
+				if ((d[i] & 0x0F) > 9) fuzz_fail(p, d, "framer handed out a digit over 9");
+			}
+			if ((t_ns == 0) || (t_ns > read_no) || (t_ns < last_ns)) fuzz_fail(p, d, "frame's time stamp isn't its read's");
+			last_ns = t_ns;
+			check_decode(p, d, NULL);
+		}
+
+		wanted = framer_wanted(&fr);
+		if ((wanted < 1) || (wanted > p->frame_size)) fuzz_fail(p, d, "framer wants an impossible number of bytes");
+	}
+
+	if (fr.bytes != size) fuzz_fail(p, d, "framer lost count of the bytes");
+	if (fr.frames_ok * p->frame_size + fr.bytes_dropped > fr.bytes) fuzz_fail(p, d, "framer accounted for more bytes than it had");
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223106
+  Function Name	: LLVMFuzzerTestOneInput
+  Returns Type	: int
+  ----Parameter List
+  1. const uint8_t *data,
+  2. size_t size ,
+  ------------------
+  Exit Codes	: 0, failures abort()
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The libFuzzer entry point; the standalone main() below calls it
+	the same way.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int LLVMFuzzerTestOneInput( const uint8_t *data, size_t size ) {
+	size_t i;
+	int k;
+
+	if (size == 0) return 0;
+	if (size > FUZZ_INPUT_MAX) size = FUZZ_INPUT_MAX;
+
+	for (k = 0; k < BK390A_PROTOCOL_COUNT; k++) {
+		const struct proto *p = proto_list[k];
+
+		check_framer(p, data, size);
+		for (i = 0; i + p->layout->payload_size <= size; i++) check_decode(p, data + i, NULL);
+	}
+	check_batch(data, size);
+
+	return 0;
+}
+
+#ifndef BK390A_LIBFUZZER
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223114
+  Function Name	: init
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int init( struct glb *g ) {
+	g->exhaustive = 0;
+	g->list = 0;
+	g->mutations = 0;
+	g->seed = FUZZ_DEFAULT_SEED;
+	g->inputs = 0;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223122
+  Function Name	: parse_parameters
+  Returns Type	: int
+  ----Parameter List
+  1. struct glb *g,
+  2.  int argc,
+  3.  char **argv ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The inputs are everything after the options
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int parse_parameters( struct glb *g, int argc, char **argv ) {
+	int i;
+
+	for (i = 1; (i < argc) && (argv[i][0] == '-'); i++) {
+
+		/* parameter */
+		switch (argv[i][1]) {
+			case 'h':
+				fprintf(stdout,"Usage: %s %s", argv[0], help);
+				exit(1);
+				break;
+
+			case 'n':
+			case 'S':
+				if (i +1 >= argc) {
+					fprintf(stderr,"Insufficient parameters; -%c <value>\n", argv[i][1]);
+					exit(1);
+				}
+				if (argv[i][1] == 'n') g->mutations = strtoull(argv[i+1], NULL, 10);
+				else g->seed = strtoull(argv[i+1], NULL, 10);
+				i++;
+				break;
+
+			case 'x': g->exhaustive = 1; break;
+			case 'l': g->list = 1; break;
+
+			case 'v':
+				fprintf(stdout,"%s\r\n", VERSION);
+				exit(0);
+				break;
+
+			default:
+				break;
+		} // switch
+	}
+	g->inputs = i;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223130
+  Function Name	: load_input
+  Returns Type	: int
+  ----Parameter List
+  1. FILE *f ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = no memory
+  Side Effects	: adds to inputs[]
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int load_input( FILE *f ) {
+	struct input *in;
+
+	inputs = realloc(inputs, (input_count +1) * sizeof(struct input));
+	if (inputs == NULL) return -1;
+	in = &(inputs[input_count]);
+
+	in->data = malloc(FUZZ_INPUT_MAX);
+	if (in->data == NULL) return -1;
+	in->len = fread(in->data, 1, FUZZ_INPUT_MAX, f);
+	input_count++;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223138
+  Function Name	: list_input
+  Returns Type	: void
+  ----Parameter List
+  1. const char *name,
+  2. const struct input *in ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Every frame any protocol's framer finds, as
+	<input> <protocol> <mode> <value> <unit> <display string>,
+	or <input> <protocol> rejected for one the decoder refuses.
+	The input's directory is left off.  An input named for a
+	protocol, es51922-..., is only framed as that protocol's.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void list_input( const char *name, const struct input *in ) {
+	const char *base = strrchr(name, '/');
+	struct bk390a_reading r;
+	struct framer fr;
+	uint8_t d[BK390A_PAYLOAD_MAX];
+	char value[32], cmd[64];
+	int k, only = -1;
+
+	base = base ? base +1 : name;
+	for (k = 0; k < BK390A_PROTOCOL_COUNT; k++) {
+		size_t n = strlen(proto_list[k]->name);
+
+		if ((strncmp(base, proto_list[k]->name, n) == 0) && (base[n] == '-')) only = k;
+	}
+
+	for (k = 0; k < BK390A_PROTOCOL_COUNT; k++) {
+		if ((only >= 0) && (k != only)) continue;
+		framer_init(&fr);
+		framer_protocol(&fr, proto_list[k]);
+		framer_push(&fr, in->data, in->len, 1);
+		while (framer_next(&fr, d, NULL)) {
+			if (check_decode(proto_list[k], d, &r) != 0) {
+				fprintf(stdout,"%s %s rejected\n", base, proto_list[k]->name);
+				continue;
+			}
+			bk390a_value_str(&r, value, sizeof(value));
+			dispfmt_reading(&r, 0, cmd, sizeof(cmd));
+			fprintf(stdout,"%s %s %s %s %s %s\n", base, proto_list[k]->name, bk390a_mode_str[r.mode], value, bk390a_unit_str[r.unit], cmd);
+		}
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223146
+  Function Name	: exhaustive
+  Returns Type	: void
+  ----Parameter List
+  ------------------
+  Exit Codes	:
+  Side Effects	: abort()s if an invariant doesn't hold
+  --------------------------------------------------------------------
+Comments:
+	Every FUNCTION, STATUS and RANGE byte, all 256 values of each,
+	with a fixed count; then the 0x30..0x3F block of each at counts
+	around the digits' limits and max_count, either sign.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void exhaustive( void ) {
+	static const int counts[] = { 0, 1, 9, 10, 999, 1234, 9999, 10000, 12345, 21999, 22000, 22001, 99999 };
+	uint8_t d[BK390A_PAYLOAD_MAX];
+	int k, fn, st, rg, c, i, v;
+
+	for (k = 0; k < BK390A_PROTOCOL_COUNT; k++) {
+		const struct proto *p = proto_list[k];
+		const struct proto_layout *l = p->layout;
+
+		memset(d, 0x30, sizeof(d));
+		for (i = 0; i < l->digits; i++) d[l->byte_digits + i] = 0x31 + i;
+
+		for (fn = 0; fn < 256; fn++) {
+			for (st = 0; st < 256; st++) {
+				for (rg = 0; rg < 256; rg++) {
+					d[l->byte_function] = fn;
+					d[l->byte_status] = st;
+					d[l->byte_range] = rg;
+					check_decode(p, d, NULL);
+				}
+			}
+		}
+
+		for (fn = 0x30; fn <= 0x3F; fn++) {
+			for (st = 0x30; st <= 0x3F; st++) {
+				for (rg = 0x30; rg <= 0x3F; rg++) {
+					for (c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++) {
+						if (counts[c] >= (int)pow(10, l->digits)) continue;
+						for (i = l->digits -1, v = counts[c]; i >= 0; i--, v /= 10) d[l->byte_digits + i] = 0x30 + (v % 10);
+						d[l->byte_function] = fn;
+						d[l->byte_status] = st;
+						d[l->byte_range] = rg;
+						check_decode(p, d, NULL);
+					}
+				}
+			}
+		}
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223150
+  Function Name	: xorshift
+  Returns Type	: static uint64_t
+  ----Parameter List
+  1. uint64_t *s, state, not 0 ,
+  ------------------
+  Exit Codes	: the next pseudo random number
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The same sequence for the same -S on any libc, so a failing
+	make check can be run again
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static uint64_t xorshift( uint64_t *s ) {
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223154
+  Function Name	: mutate
+  Returns Type	: size_t
+  ----Parameter List
+  1. uint8_t *buf, FUZZ_INPUT_MAX bytes
+  2. uint64_t *seed, xorshift state ,
+  ------------------
+  Exit Codes	: length of the new input
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	One or two inputs end to end, then 1..8 of; a bit flipped, a
+	byte set (half the time within 0x30..0x3F, where the decoder
+	has to look harder), a byte dropped or a byte repeated.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+size_t mutate( uint8_t *buf, uint64_t *seed ) {
+	size_t len = 0, pos;
+	int i, n;
+
+	n = 1 + (xorshift(seed) & 1);
+	for (i = 0; (i < n) && input_count; i++) {
+		const struct input *in = &(inputs[xorshift(seed) % input_count]);
+		size_t take = (in->len > FUZZ_INPUT_MAX - len) ? FUZZ_INPUT_MAX - len : in->len;
+
+		memcpy(buf + len, in->data, take);
+		len += take;
+	}
+	if (len == 0) {
+		len = 1 + (xorshift(seed) % 64);
+		for (pos = 0; pos < len; pos++) buf[pos] = xorshift(seed);
+	}
+
+	n = 1 + (xorshift(seed) & 7);
+	for (i = 0; i < n; i++) {
+		pos = xorshift(seed) % len;
+		switch (xorshift(seed) & 3) {
+			case 0: buf[pos] ^= 1 << (xorshift(seed) & 7); break;
+			case 1: buf[pos] = (xorshift(seed) & 1) ? (0x30 | (xorshift(seed) & 0x0F)) : xorshift(seed); break;
+			case 2:
+				if (len > 1) {
+					memmove(buf + pos, buf + pos +1, len - pos -1);
+					len--;
+				}
+				break;
+			default:
+				if (len < FUZZ_INPUT_MAX) {
+					memmove(buf + pos +1, buf + pos, len - pos);
+					len++;
+				}
+				break;
+		}
+	}
+
+	return len;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-223202
+  Function Name	: main
+  Returns Type	: int
+  ----Parameter List
+  1. int argc,
+  2.  char **argv ,
+  ------------------
+  Exit Codes	: 0 = every check held, 1 = an input couldn't be read
+  Side Effects	: abort()s on the first invariant broken
+  --------------------------------------------------------------------
+Comments:
+	For builds without libFuzzer, and AFL
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int main( int argc, char **argv ) {
+	struct glb g;
+	static uint8_t buf[FUZZ_INPUT_MAX];
+	uint64_t i, seed;
+	FILE *f;
+	int k;
+
+	init( &g );
+	parse_parameters( &g, argc, argv );
+
+	for (k = g.inputs; k < argc; k++) {
+		f = fopen(argv[k], "rb");
+		if ((f == NULL) || (load_input(f) != 0)) {
+			fprintf(stderr,"Couldn't read '%s'\r\n", argv[k]);
+			exit(1);
+		}
+		fclose(f);
+	}
+	if ((input_count == 0) && !g.exhaustive && !g.mutations) {
+		if (load_input(stdin) != 0) exit(1);
+	}
+
+	if (g.list) {
+		for (k = 0; k < input_count; k++) list_input((k + g.inputs < argc) ? argv[k + g.inputs] : "-", &(inputs[k]));
+		return 0;
+	}
+
+	for (k = 0; k < input_count; k++) LLVMFuzzerTestOneInput(inputs[k].data, inputs[k].len);
+	if (g.exhaustive) exhaustive();
+
+	seed = g.seed ? g.seed : FUZZ_DEFAULT_SEED;
+	for (i = 0; i < g.mutations; i++) {
+		size_t len = mutate(buf, &seed);
+
+		LLVMFuzzerTestOneInput(buf, len);
+	}
+
+	fprintf(stderr,"%d inputs, %llu mutations, %llu readings checked\r\n", input_count, (unsigned long long)g.mutations, (unsigned long long)checked);
+
+	return 0;
+}
+
+#endif
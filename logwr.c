@@ -0,0 +1,663 @@
+/*
+ * Batched, rotating text log writer
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#define fsync _commit
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+#include "logwr.h"
+#include "timebase.h"
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163022
+  Function Name	: logwr_lock
+  Returns Type	: static void
+  ----Parameter List
+  1. struct logwr *lw ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Only ever held for a memcpy or a buffer swap
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void logwr_lock(struct logwr *lw) {
+	while (__atomic_exchange_n(&(lw->lock), 1, __ATOMIC_ACQUIRE)) {
+#ifdef _WIN32
+		Sleep(0);
+#else
+		sched_yield();
+#endif
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163028
+  Function Name	: logwr_unlock
+  Returns Type	: static void
+  ----Parameter List
+  1. struct logwr *lw ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void logwr_unlock(struct logwr *lw) {
+	__atomic_store_n(&(lw->lock), 0, __ATOMIC_RELEASE);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163035
+  Function Name	: logwr_local
+  Returns Type	: static void
+  ----Parameter List
+  1. int64_t wall_ns,
+  2. struct tm *tm ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void logwr_local(int64_t wall_ns, struct tm *tm) {
+	time_t t = (time_t)(wall_ns / 1000000000LL);
+
+#ifdef _WIN32
+	*tm = *localtime(&t);
+#else
+	localtime_r(&t, tm);
+#endif
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163040
+  Function Name	: logwr_hour
+  Returns Type	: static int64_t
+  ----Parameter List
+  1. int64_t wall_ns ,
+  ------------------
+  Exit Codes	: local YYYYMMDDHH
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int64_t logwr_hour(int64_t wall_ns) {
+	struct tm tm;
+
+	logwr_local(wall_ns, &tm);
+
+	return ((int64_t)(tm.tm_year + 1900) * 1000000LL) + ((tm.tm_mon + 1) * 10000) + (tm.tm_mday * 100) + tm.tm_hour;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163048
+  Function Name	: logwr_write_fd
+  Returns Type	: static size_t
+  ----Parameter List
+  1. int fd,
+  2. const char *b,
+  3. size_t n ,
+  ------------------
+  Exit Codes	: bytes written, less than n on an error
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static size_t logwr_write_fd(int fd, const char *b, size_t n) {
+	size_t done = 0;
+
+	while (done < n) {
+		int r = write(fd, b + done, n - done);
+
+		if (r < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		if (r == 0) break;
+		done += r;
+	}
+
+	return done;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163100
+  Function Name	: logwr_file_open
+  Returns Type	: static int
+  ----Parameter List
+  1. struct logwr *lw,
+  2. int64_t wall_ns, now
+  3. int header, write the header lines if set ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = couldn't open
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int logwr_file_open(struct logwr *lw, int64_t wall_ns, int header) {
+	char h[LOGWR_HEADER_MAX];
+	struct stat st;
+
+	lw->fd = open(lw->fn, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (lw->fd < 0) return -1;
+
+	lw->file_bytes = (fstat(lw->fd, &st) == 0) ? (uint64_t)st.st_size : 0;
+	lw->file_wall_ns = wall_ns;
+	lw->file_hour = logwr_hour(wall_ns);
+
+	if (header) {
+		logwr_lock(lw);
+		memcpy(h, lw->header, sizeof(h));
+		logwr_unlock(lw);
+		if (h[0]) lw->file_bytes += logwr_write_fd(lw->fd, h, strlen(h));
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163112
+  Function Name	: logwr_rotate
+  Returns Type	: static void
+  ----Parameter List
+  1. struct logwr *lw,
+  2. int64_t wall_ns, now ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: the current file is renamed <fn>.<YYYYMMDD-HHMMSS>[-n]
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void logwr_rotate(struct logwr *lw, int64_t wall_ns) {
+	char to[LOGWR_NAME_MAX + 32];
+	struct stat st;
+	struct tm tm;
+	size_t n;
+	int i;
+
+	if (lw->fsync_interval_ns) fsync(lw->fd);
+	close(lw->fd);
+	lw->fd = -1;
+
+	logwr_local(lw->file_wall_ns, &tm);
+	n = snprintf(to, sizeof(to), "%s.", lw->fn);
+	strftime(to + n, sizeof(to) - n, "%Y%m%d-%H%M%S", &tm);
+	n = strlen(to);
+	for (i = 1; (stat(to, &st) == 0) && (i < 1000); i++) {
+		snprintf(to + n, sizeof(to) - n, "-%d", i);
+	}
+
+	if (rename(lw->fn, to) != 0) {
+		fprintf(stderr,"Log '%s': couldn't rotate to '%s' (%s)\r\n", lw->fn, to, strerror(errno));
+	} else {
+		lw->rotations++;
+	}
+
+	lw->broken = 0;
+	logwr_file_open(lw, wall_ns, 1);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163125
+  Function Name	: logwr_emit
+  Returns Type	: static void
+  ----Parameter List
+  1. struct logwr *lw,
+  2. const char *b,
+  3. uint32_t n ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: rotates, writes, fsyncs when due
+  --------------------------------------------------------------------
+Comments:
+	Writer thread only
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void logwr_emit(struct logwr *lw, const char *b, uint32_t n) {
+	int64_t wall_ns = timebase_wall_ns();
+	uint64_t now = timebase_now_ns();
+	size_t done;
+
+	if (lw->fd >= 0) {
+		if ((lw->max_bytes && lw->file_bytes && (lw->file_bytes + n > lw->max_bytes))
+				|| (lw->hourly && (logwr_hour(wall_ns) != lw->file_hour))) {
+			logwr_rotate(lw, wall_ns);
+		}
+	} else {
+		logwr_file_open(lw, wall_ns, 1);
+	}
+
+	if (lw->fd < 0) {
+		done = 0;
+
+	} else {
+		if (lw->broken && (logwr_write_fd(lw->fd, "\n", 1) == 1)) {
+			lw->file_bytes++;
+			lw->broken = 0;
+		}
+		done = logwr_write_fd(lw->fd, b, n);
+		lw->file_bytes += done;
+		if ((done > 0) && (b[done -1] != '\n')) lw->broken = 1;
+	}
+
+	lw->written += done;
+	if (done < n) {
+		if (!lw->failing) {
+			fprintf(stderr,"Log '%s': write failed (%s), dropping lines\r\n", lw->fn, strerror(errno));
+		}
+		lw->failing = 1;
+		lw->write_errors++;
+		logwr_lock(lw);
+		lw->dropped += n - done;
+		logwr_unlock(lw);
+
+	} else if (lw->failing) {
+		fprintf(stderr,"Log '%s': writing again, %llu bytes dropped so far\r\n", lw->fn, (unsigned long long)lw->dropped);
+		lw->failing = 0;
+	}
+
+	if ((lw->fd >= 0) && lw->fsync_interval_ns && (now - lw->last_fsync_ns >= lw->fsync_interval_ns)) {
+		fsync(lw->fd);
+		lw->last_fsync_ns = now;
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163132
+  Function Name	: logwr_wake
+  Returns Type	: static void
+  ----Parameter List
+  1. struct logwr *lw ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void logwr_wake(struct logwr *lw) {
+#ifdef _WIN32
+	SetEvent(lw->wake);
+#else
+	pthread_mutex_lock(&(lw->wake_lock));
+	lw->wake = 1;
+	pthread_cond_signal(&(lw->wake_cond));
+	pthread_mutex_unlock(&(lw->wake_lock));
+#endif
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163135
+  Function Name	: logwr_park
+  Returns Type	: static void
+  ----Parameter List
+  1. struct logwr *lw,
+  2. uint32_t seen, bytes the thread found buffered ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: blocks the writer thread
+  --------------------------------------------------------------------
+Comments:
+	Writer thread only.  parked is set before the buffer is looked
+	at again, and logwr_write() fills the buffer before it looks at
+	parked, so either we see the new bytes or the writer sees us
+	parked and wakes us.  It only does that for the first bytes in
+	an empty buffer or for passing half full, which is all that can
+	bring a flush forward; otherwise we wait for the flush interval,
+	or for ever with nothing buffered.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void logwr_park(struct logwr *lw, uint32_t seen) {
+	uint64_t due = seen ? lw->last_flush_ns + lw->flush_interval_ns : 0;
+	uint32_t n;
+
+	__atomic_store_n(&(lw->parked), 1, __ATOMIC_SEQ_CST);
+
+	logwr_lock(lw);
+	n = lw->used[lw->fill];
+	logwr_unlock(lw);
+
+	if (((seen == 0) ? (n == 0) : (n < LOGWR_BUFFER / 2))
+			&& !__atomic_load_n(&(lw->stop), __ATOMIC_SEQ_CST)) {
+#ifdef _WIN32
+		DWORD ms = INFINITE;
+
+		if (due) {
+			uint64_t now = timebase_now_ns();
+
+			ms = (due > now) ? (DWORD)((due - now + 999999) / 1000000) : 0;
+		}
+		WaitForSingleObject(lw->wake, ms);
+#else
+		struct timespec ts;
+		int r = 0;
+
+		if (due) {
+			ts.tv_sec = due / 1000000000ULL;
+			ts.tv_nsec = due % 1000000000ULL;
+		}
+		pthread_mutex_lock(&(lw->wake_lock));
+		while (!lw->wake && (r == 0)) {
+			if (due) r = pthread_cond_timedwait(&(lw->wake_cond), &(lw->wake_lock), &ts);
+			else pthread_cond_wait(&(lw->wake_cond), &(lw->wake_lock));
+		}
+		lw->wake = 0;
+		pthread_mutex_unlock(&(lw->wake_lock));
+#endif
+	}
+
+	__atomic_store_n(&(lw->parked), 0, __ATOMIC_RELAXED);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163138
+  Function Name	: logwr_thread
+  Returns Type	: static void * / DWORD
+  ----Parameter List
+  1. void *arg, struct logwr ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Swaps the buffers every flush interval, or as soon as the fill
+	buffer is half full, and writes out the one it took.  Parks in
+	between.  On stop it keeps going until both are empty.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+#ifdef _WIN32
+static DWORD WINAPI logwr_thread(LPVOID arg) {
+#else
+static void *logwr_thread(void *arg) {
+#endif
+	struct logwr *lw = (struct logwr *)arg;
+
+	while (1) {
+		int stop = __atomic_load_n(&(lw->stop), __ATOMIC_SEQ_CST);
+		uint64_t now = timebase_now_ns();
+		uint32_t n;
+		int out;
+
+		logwr_lock(lw);
+		n = lw->used[lw->fill];
+		if ((n == 0)
+				|| (!stop && (now - lw->last_flush_ns < lw->flush_interval_ns) && (n < LOGWR_BUFFER / 2))) {
+			logwr_unlock(lw);
+			if (stop) break;
+			logwr_park(lw, n);
+			continue;
+		}
+		out = lw->fill;
+		lw->fill ^= 1;
+		lw->used[lw->fill] = 0;
+		logwr_unlock(lw);
+
+		logwr_emit(lw, lw->buf[out], n);
+		lw->last_flush_ns = now;
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163150
+  Function Name	: logwr_open
+  Returns Type	: int
+  ----Parameter List
+  1. struct logwr *lw,
+  2. const char *fn,
+  3. uint32_t flush_ms, longest a line waits to be written
+  4. uint64_t max_bytes, rotate by size, 0 = never
+  5. int hourly, rotate every local wall clock hour
+  6. uint32_t fsync_ms, 0 = never
+  ------------------
+  Exit Codes	: 0 = ok, -1 = couldn't open, -2 = couldn't start the thread
+  Side Effects	: appends to fn if it exists
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int logwr_open(struct logwr *lw, const char *fn, uint32_t flush_ms, uint64_t max_bytes, int hourly, uint32_t fsync_ms) {
+#ifndef _WIN32
+	pthread_condattr_t ca;
+#endif
+
+	memset(lw, 0, offsetof(struct logwr, buf));
+	lw->fd = -1;
+
+	snprintf(lw->fn, sizeof(lw->fn), "%s", fn);
+	lw->max_bytes = max_bytes;
+	lw->hourly = hourly;
+	lw->flush_interval_ns = (uint64_t)flush_ms * 1000000ULL;
+	lw->fsync_interval_ns = (uint64_t)fsync_ms * 1000000ULL;
+	lw->last_flush_ns = lw->last_fsync_ns = timebase_now_ns();
+
+	if (logwr_file_open(lw, timebase_wall_ns(), 0) != 0) return -1;
+
+	lw->running = 1;
+#ifdef _WIN32
+	lw->wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (lw->wake == NULL) lw->thread = NULL;
+	else lw->thread = CreateThread(NULL, 0, logwr_thread, lw, 0, NULL);
+	if (lw->thread == NULL) {
+		if (lw->wake != NULL) CloseHandle(lw->wake);
+#else
+	pthread_mutex_init(&(lw->wake_lock), NULL);
+	pthread_condattr_init(&ca);
+	pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);	// last_flush_ns is timebase_now_ns()
+	pthread_cond_init(&(lw->wake_cond), &ca);
+	pthread_condattr_destroy(&ca);
+	if (pthread_create(&(lw->thread), NULL, logwr_thread, lw) != 0) {
+		pthread_cond_destroy(&(lw->wake_cond));
+		pthread_mutex_destroy(&(lw->wake_lock));
+#endif
+		lw->running = 0;
+		close(lw->fd);
+		lw->fd = -1;
+		return -2;
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163202
+  Function Name	: logwr_header
+  Returns Type	: int
+  ----Parameter List
+  1. struct logwr *lw,
+  2. const char *s, one or more whole lines ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = dropped
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Logged now and repeated at the top of every rotated file
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int logwr_header(struct logwr *lw, const char *s) {
+	logwr_lock(lw);
+	snprintf(lw->header, sizeof(lw->header), "%s", s);
+	logwr_unlock(lw);
+
+	return logwr_write(lw, s, strlen(s));
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163215
+  Function Name	: logwr_write
+  Returns Type	: int
+  ----Parameter List
+  1. struct logwr *lw,
+  2. const char *s,
+  3. size_t n ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = dropped, the buffers are full
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Never waits on the disk, only on the writer thread's buffer swap.
+	Wakes the thread if it's parked and these bytes change when it
+	has to write.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int logwr_write(struct logwr *lw, const char *s, size_t n) {
+	uint32_t was;
+	int r = 0;
+
+	logwr_lock(lw);
+	was = lw->used[lw->fill];
+	if (was + n > LOGWR_BUFFER) {
+		lw->dropped += n;
+		r = -1;
+	} else {
+		memcpy(lw->buf[lw->fill] + was, s, n);
+		lw->used[lw->fill] += n;
+	}
+	logwr_unlock(lw);
+
+	/*
+	 * Empty to pending starts the flush interval, half full flushes now
+	 */
+	if ((r == 0) && (n > 0) && ((was == 0) || ((was < LOGWR_BUFFER / 2) && (was + n >= LOGWR_BUFFER / 2)))
+			&& __atomic_load_n(&(lw->parked), __ATOMIC_SEQ_CST)) {
+		logwr_wake(lw);
+	}
+
+	return r;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163228
+  Function Name	: logwr_close
+  Returns Type	: void
+  ----Parameter List
+  1. struct logwr *lw ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: waits for everything buffered to be written
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void logwr_close(struct logwr *lw) {
+	if (lw->running) {
+		__atomic_store_n(&(lw->stop), 1, __ATOMIC_SEQ_CST);
+		logwr_wake(lw);
+#ifdef _WIN32
+		WaitForSingleObject(lw->thread, INFINITE);
+		CloseHandle(lw->thread);
+		CloseHandle(lw->wake);
+#else
+		pthread_join(lw->thread, NULL);
+		pthread_cond_destroy(&(lw->wake_cond));
+		pthread_mutex_destroy(&(lw->wake_lock));
+#endif
+		lw->running = 0;
+	}
+
+	if (lw->fd >= 0) {
+		if (lw->fsync_interval_ns) fsync(lw->fd);
+		close(lw->fd);
+		lw->fd = -1;
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-163240
+  Function Name	: logwr_parse_size
+  Returns Type	: uint64_t
+  ----Parameter List
+  1. const char *s, ie 500k, 20M, 2G ,
+  ------------------
+  Exit Codes	: bytes, 0 if not understood
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+uint64_t logwr_parse_size(const char *s) {
+	char *end;
+	uint64_t v = strtoull(s, &end, 10);
+
+	switch (*end) {
+		case 'k': case 'K': v *= 1024ULL; end++; break;
+		case 'm': case 'M': v *= 1024ULL * 1024ULL; end++; break;
+		case 'g': case 'G': v *= 1024ULL * 1024ULL * 1024ULL; end++; break;
+		default: break;
+	}
+	if (*end != '\0') return 0;
+
+	return v;
+}
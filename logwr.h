@@ -0,0 +1,94 @@
+/*
+ * Batched, rotating text log writer
+ *
+ * Lines are copied in to a buffer and written out by the writer's own
+ * thread in one large write every flush interval (or sooner if the
+ * buffer fills), so a full disk or a stalled network share only ever
+ * costs log lines, never capture time.  While the writer is stuck the
+ * second buffer fills; once that's full too new lines are dropped and
+ * counted rather than waited for.  With nothing buffered the thread
+ * sleeps until the next line arrives.
+ *
+ * The log is always written to <fn>.  When it reaches the size limit,
+ * or the local wall clock hour changes, it's renamed to
+ * <fn>.<YYYYMMDD-HHMMSS> (the time it was started, with -1, -2... if
+ * that's taken) and a new <fn> is started with the same header lines.
+ * Rotation happens between batches so a file can run a flush interval
+ * past the hour, or one batch past the size limit when a single batch
+ * is bigger than it.
+ *
+ */
+#ifndef __BK390A_LOGWR_H__
+#define __BK390A_LOGWR_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOGWR_BUFFER 65536			// bytes, each of the two buffers
+#define LOGWR_HEADER_MAX 256
+#define LOGWR_NAME_MAX 1024
+#define LOGWR_DEFAULT_FLUSH_MS 1000
+
+struct logwr {
+	char fn[LOGWR_NAME_MAX];
+	char header[LOGWR_HEADER_MAX];	// written at the top of every file
+	int fd;
+	uint64_t max_bytes;			// rotate before passing this, 0 = never
+	int hourly;					// rotate when the local hour changes
+	uint64_t flush_interval_ns;
+	uint64_t fsync_interval_ns;	// 0 = leave it to the OS
+	uint64_t last_flush_ns;
+	uint64_t last_fsync_ns;
+	uint64_t file_bytes;
+	int64_t file_wall_ns;		// when the current file was started
+	int64_t file_hour;			// YYYYMMDDHH (local) it was started in
+	int broken;					// a write was cut short mid line
+	int failing;				// writes are failing, reported once
+
+	/*
+	 * Writers append to buf[fill] under the lock, the thread swaps
+	 * the buffers under the lock and writes the full one without it
+	 */
+	int lock;
+	int fill;
+	uint32_t used[2];
+
+	uint64_t written;			// bytes
+	uint64_t dropped;			// bytes, buffers full or write failed
+	uint64_t rotations;
+	uint64_t write_errors;
+
+	int stop;
+	int running;
+	int parked;					// writer thread is waiting for a line or its flush time
+#ifdef _WIN32
+	void *thread;
+	void *wake;					// auto-reset event
+#else
+	pthread_t thread;
+	pthread_mutex_t wake_lock;
+	pthread_cond_t wake_cond;
+	int wake;					// set under wake_lock, cleared by the thread
+#endif
+	char buf[2][LOGWR_BUFFER];
+};
+
+int logwr_open(struct logwr *lw, const char *fn, uint32_t flush_ms, uint64_t max_bytes, int hourly, uint32_t fsync_ms);
+int logwr_header(struct logwr *lw, const char *s);
+int logwr_write(struct logwr *lw, const char *s, size_t n);
+void logwr_close(struct logwr *lw);
+
+uint64_t logwr_parse_size(const char *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,449 @@
+/*
+ * Pipeline counters and latency histograms
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "metrics.h"
+
+/*
+ * Prometheus histogram bucket bounds, seconds
+ */
+static const double metrics_le[] = {
+	0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005,
+	0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+	0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-174010
+  Function Name	: metrics_index
+  Returns Type	: static int
+  ----Parameter List
+  1. uint64_t v ,
+  ------------------
+  Exit Codes	: bucket
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Values below METRICS_SUB have a bucket each, above that the top
+	METRICS_SUB_BITS bits after the leading one pick the sub bucket
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int metrics_index(uint64_t v) {
+	int msb;
+
+	if (v < METRICS_SUB) return (int)v;
+
+	msb = 63 - __builtin_clzll(v);
+	if (msb >= METRICS_MAX_BITS) return METRICS_BUCKETS -1;
+
+	return ((msb - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS) + (int)((v >> (msb - METRICS_SUB_BITS)) & (METRICS_SUB -1));
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-174022
+  Function Name	: metrics_upper
+  Returns Type	: static uint64_t
+  ----Parameter List
+  1. int i, bucket ,
+  ------------------
+  Exit Codes	: largest value that lands in bucket i
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static uint64_t metrics_upper(int i) {
+	int e;
+
+	if (i < METRICS_SUB) return (uint64_t)i;
+
+	e = (i >> METRICS_SUB_BITS) -1;
+
+	return (((uint64_t)(METRICS_SUB + (i & (METRICS_SUB -1))) << e) + (1ULL << e)) -1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-174035
+  Function Name	: metrics_hist_record
+  Returns Type	: void
+  ----Parameter List
+  1. struct metrics_hist *h,
+  2. uint64_t ns ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Single writer per histogram
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void metrics_hist_record(struct metrics_hist *h, uint64_t ns) {
+	int i = metrics_index(ns);
+
+	__atomic_store_n(&(h->b[i]), h->b[i] +1, __ATOMIC_RELAXED);
+	__atomic_store_n(&(h->sum), h->sum + ns, __ATOMIC_RELAXED);
+	if (ns > h->max) __atomic_store_n(&(h->max), ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&(h->count), h->count +1, __ATOMIC_RELEASE);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-174048
+  Function Name	: metrics_hist_snapshot
+  Returns Type	: void
+  ----Parameter List
+  1. const struct metrics_hist *h, being recorded in to
+  2. struct metrics_hist *out ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The count is taken as the bucket total so percentiles add up
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void metrics_hist_snapshot(const struct metrics_hist *h, struct metrics_hist *out) {
+	int i;
+
+	out->count = 0;
+	out->sum = __atomic_load_n(&(h->sum), __ATOMIC_ACQUIRE);
+	out->max = __atomic_load_n(&(h->max), __ATOMIC_RELAXED);
+	for (i = 0; i < METRICS_BUCKETS; i++) {
+		out->b[i] = __atomic_load_n(&(h->b[i]), __ATOMIC_RELAXED);
+		out->count += out->b[i];
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-174100
+  Function Name	: metrics_hist_percentile
+  Returns Type	: uint64_t
+  ----Parameter List
+  1. const struct metrics_hist *h, a snapshot
+  2. double p, 0..1 ,
+  ------------------
+  Exit Codes	: ns, the top of the bucket the percentile falls in
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+uint64_t metrics_hist_percentile(const struct metrics_hist *h, double p) {
+	uint64_t target, n = 0;
+	uint64_t v;
+	int i;
+
+	if (h->count == 0) return 0;
+
+	target = (uint64_t)(p * h->count + 0.999999);
+	if (target < 1) target = 1;
+
+	for (i = 0; i < METRICS_BUCKETS; i++) {
+		n += h->b[i];
+		if (n >= target) break;
+	}
+	if (i == METRICS_BUCKETS) i--;
+
+	v = metrics_upper(i);
+	if (v > h->max) v = h->max;
+
+	return v;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-174112
+  Function Name	: metrics_meter_init
+  Returns Type	: void
+  ----Parameter List
+  1. struct metrics_meter *m,
+  2. int id, meter id, 0 for single meter tools
+  3. const struct framer *fr, the meter's framer, for its counters ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void metrics_meter_init(struct metrics_meter *m, int id, const struct framer *fr) {
+	memset(m, 0, sizeof(struct metrics_meter));
+	m->id = id;
+	m->fr = fr;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-174125
+  Function Name	: metrics_meter_reading
+  Returns Type	: void
+  ----Parameter List
+  1. struct metrics_meter *m,
+  2. const struct bk390a_reading *r ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void metrics_meter_reading(struct metrics_meter *m, const struct bk390a_reading *r) {
+	uint8_t ol = (r->status & STATUS_OL) ? 1 : 0;
+
+	if (m->seen) {
+		if (r->mode != m->last_mode) m->mode_changes++;
+		if (ol && !m->last_ol) m->overloads++;
+	} else if (ol) {
+		m->overloads++;
+	}
+	m->seen = 1;
+	m->last_mode = r->mode;
+	m->last_ol = ol;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-174138
+  Function Name	: metrics_header
+  Returns Type	: void
+  ----Parameter List
+  1. FILE *f,
+  2. int format, METRICS_TEXT or METRICS_PROMETHEUS
+  3. const char *name,
+  4. const char *type, "counter", "gauge", "histogram"
+  5. const char *help ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Once per metric name, before its series
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void metrics_header(FILE *f, int format, const char *name, const char *type, const char *help) {
+	if (format != METRICS_PROMETHEUS) return;
+
+	fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-174150
+  Function Name	: metrics_counter
+  Returns Type	: void
+  ----Parameter List
+  1. FILE *f,
+  2. int format,
+  3. const char *name,
+  4. const char *labels, ie 'meter="1"', or "" ,
+  5. uint64_t v ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void metrics_counter(FILE *f, int format, const char *name, const char *labels, uint64_t v) {
+	if (labels[0]) fprintf(f, "%s{%s} %llu\n", name, labels, (unsigned long long)v);
+	else fprintf(f, "%s %llu\n", name, (unsigned long long)v);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-174202
+  Function Name	: metrics_hist_write
+  Returns Type	: void
+  ----Parameter List
+  1. FILE *f,
+  2. int format,
+  3. const char *name, Prometheus base name, ie bk390a_sink_latency_seconds
+  4. const char *labels,
+  5. const struct metrics_hist *h, live, a snapshot is taken ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Text is one line, count, mean, percentiles and max in us.
+	Prometheus is the usual cumulative _bucket series at fixed bounds
+	from 10us to 10s (a bucket counts towards a bound when all of
+	it is at or under it) plus _sum and _count.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void metrics_hist_write(FILE *f, int format, const char *name, const char *labels, const struct metrics_hist *h) {
+	static struct metrics_hist s;	// too big for some thread stacks, callers are the main thread
+	const char *sep = labels[0] ? "," : "";
+	uint64_t n = 0;
+	int i, j;
+
+	metrics_hist_snapshot(h, &s);
+
+	if (format != METRICS_PROMETHEUS) {
+		fprintf(f, "%s%s%s%s count %llu mean %.1fus p50 %.1fus p90 %.1fus p99 %.1fus p99.9 %.1fus max %.1fus\n"
+				, name
+				, labels[0] ? "{" : "", labels, labels[0] ? "}" : ""
+				, (unsigned long long)s.count
+				, s.count ? (double)s.sum / s.count / 1e3 : 0.0
+				, metrics_hist_percentile(&s, 0.5) / 1e3
+				, metrics_hist_percentile(&s, 0.9) / 1e3
+				, metrics_hist_percentile(&s, 0.99) / 1e3
+				, metrics_hist_percentile(&s, 0.999) / 1e3
+				, s.max / 1e3
+			   );
+		return;
+	}
+
+	for (i = 0, j = 0; j < (int)(sizeof(metrics_le) / sizeof(metrics_le[0])); j++) {
+		uint64_t le_ns = (uint64_t)(metrics_le[j] * 1e9 + 0.5);
+
+		while ((i < METRICS_BUCKETS) && (metrics_upper(i) <= le_ns)) n += s.b[i++];
+		fprintf(f, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, sep, metrics_le[j], (unsigned long long)n);
+	}
+	fprintf(f, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep, (unsigned long long)s.count);
+	if (labels[0]) {
+		fprintf(f, "%s_sum{%s} %.9f\n", name, labels, s.sum / 1e9);
+		fprintf(f, "%s_count{%s} %llu\n", name, labels, (unsigned long long)s.count);
+	} else {
+		fprintf(f, "%s_sum %.9f\n", name, s.sum / 1e9);
+		fprintf(f, "%s_count %llu\n", name, (unsigned long long)s.count);
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-174215
+  Function Name	: metrics_meters_write
+  Returns Type	: void
+  ----Parameter List
+  1. FILE *f,
+  2. int format,
+  3. const struct metrics_meter *m,
+  4. int n, meters ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Metric at a time, meter at a time, as Prometheus wants each
+	name's series together
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void metrics_meters_write(FILE *f, int format, const struct metrics_meter *m, int n) {
+	static const struct {
+		const char *name;
+		const char *help;
+	} c[] = {
+		{ "bk390a_bytes_read_total", "Bytes read from the serial port" },
+		{ "bk390a_frames_total", "Well formed frames" },
+		{ "bk390a_frames_malformed_total", "Terminated frames of the wrong length or content" },
+		{ "bk390a_resyncs_total", "Times framing recovered after discarding bytes" },
+		{ "bk390a_bytes_dropped_total", "Bytes discarded while resyncing" },
+		{ "bk390a_decode_errors_total", "Well formed frames with an unknown function or range" },
+		{ "bk390a_mode_changes_total", "Readings in a different mode from the one before" },
+		{ "bk390a_overloads_total", "Readings going in to O.L." },
+	};
+	char labels[32];
+	int i, k;
+
+	for (k = 0; k < (int)(sizeof(c) / sizeof(c[0])); k++) {
+		metrics_header(f, format, c[k].name, "counter", c[k].help);
+		for (i = 0; i < n; i++) {
+			const struct framer *fr = m[i].fr;
+			uint64_t v = 0;
+
+			switch (k) {
+				case 0: v = fr->bytes; break;
+				case 1: v = fr->frames_ok; break;
+				case 2: v = fr->frames_malformed; break;
+				case 3: v = fr->resyncs; break;
+				case 4: v = fr->bytes_dropped; break;
+				case 5: v = m[i].decode_errors; break;
+				case 6: v = m[i].mode_changes; break;
+				case 7: v = m[i].overloads; break;
+			}
+			snprintf(labels, sizeof(labels), "meter=\"%d\"", m[i].id);
+			metrics_counter(f, format, c[k].name, labels, v);
+		}
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-174228
+  Function Name	: metrics_write_file
+  Returns Type	: int
+  ----Parameter List
+  1. const char *fn,
+  2. metrics_fn write, writes everything, given METRICS_PROMETHEUS
+  3. void *ctx, for write ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = couldn't write
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Written to <fn>.tmp and renamed in to place, as a textfile
+	collector must never see half a file
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int metrics_write_file(const char *fn, metrics_fn write, void *ctx) {
+	char tmp[1024];
+	FILE *f;
+	int r;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", fn) >= (int)sizeof(tmp)) return -1;
+
+	f = fopen(tmp, "w");
+	if (f == NULL) return -1;
+
+	write(f, METRICS_PROMETHEUS, ctx);
+
+	r = (ferror(f) == 0);
+	if (fclose(f) != 0) r = 0;
+#ifdef _WIN32
+	if (r && (MoveFileExA(tmp, fn, MOVEFILE_REPLACE_EXISTING) == 0)) r = 0;
+#else
+	if (r && (rename(tmp, fn) != 0)) r = 0;
+#endif
+	if (!r) {
+		remove(tmp);
+		return -1;
+	}
+
+	return 0;
+}
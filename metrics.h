@@ -0,0 +1,79 @@
+/*
+ * Pipeline counters and latency histograms
+ *
+ * Counters for each meter's byte stream (from its framer) and decoded
+ * readings, and HDR style latency histograms: log-linear buckets,
+ * METRICS_SUB per power of two, so any latency from 1ns to ~18
+ * minutes is kept to within ~6% in a fixed 4.7k table, and recording
+ * is an index calculation and three adds.
+ *
+ * Each histogram has one writer (the thread whose latency it is);
+ * readers take a snapshot without locking, which at worst is a
+ * reading or two out between the count and the buckets.
+ *
+ * Everything can be written as plain text (the SIGUSR1 dump) or in
+ * the Prometheus text exposition format for a node_exporter textfile
+ * collector or similar.
+ *
+ */
+#ifndef __BK390A_METRICS_H__
+#define __BK390A_METRICS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include "decode.h"
+#include "framer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_SUB_BITS 4
+#define METRICS_SUB (1 << METRICS_SUB_BITS)	// buckets per power of two
+#define METRICS_MAX_BITS 40			// 2^40ns, larger values land in the last bucket
+#define METRICS_BUCKETS ((METRICS_MAX_BITS - METRICS_SUB_BITS + 1) * METRICS_SUB)
+
+#define METRICS_TEXT 0
+#define METRICS_PROMETHEUS 1
+
+struct metrics_hist {
+	uint64_t count;
+	uint64_t sum;			// ns
+	uint64_t max;
+	uint64_t b[METRICS_BUCKETS];
+};
+
+/*
+ * Per meter counters the framer doesn't already keep
+ */
+struct metrics_meter {
+	int id;
+	const struct framer *fr;
+	uint64_t decode_errors;	// well formed frames decode.c refused (unknown function/range)
+	uint64_t mode_changes;
+	uint64_t overloads;		// readings going in to O.L.
+	uint8_t seen;
+	uint8_t last_mode;
+	uint8_t last_ol;
+};
+
+typedef void (*metrics_fn)(FILE *f, int format, void *ctx);
+
+void metrics_hist_record(struct metrics_hist *h, uint64_t ns);
+uint64_t metrics_hist_percentile(const struct metrics_hist *h, double p);
+void metrics_hist_snapshot(const struct metrics_hist *h, struct metrics_hist *out);
+
+void metrics_meter_init(struct metrics_meter *m, int id, const struct framer *fr);
+void metrics_meter_reading(struct metrics_meter *m, const struct bk390a_reading *r);
+
+void metrics_header(FILE *f, int format, const char *name, const char *type, const char *help);
+void metrics_counter(FILE *f, int format, const char *name, const char *labels, uint64_t v);
+void metrics_hist_write(FILE *f, int format, const char *name, const char *labels, const struct metrics_hist *h);
+void metrics_meters_write(FILE *f, int format, const struct metrics_meter *m, int n);
+int metrics_write_file(const char *fn, metrics_fn write, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,471 @@
+/*
+ * Live reading TCP broadcast server (Linux)
+ *
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "netsrv.h"
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-171010
+  Function Name	: netsrv_drop
+  Returns Type	: static void
+  ----Parameter List
+  1. struct netsrv *s,
+  2. struct netsrv_client *c,
+  3. const char *why ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: closes the client's socket, frees its slot
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void netsrv_drop(struct netsrv *s, struct netsrv_client *c, const char *why) {
+	if (c->fd < 0) return;
+
+	if (!s->quiet) fprintf(stderr,"Net: client %s %s\r\n", c->addr, why);
+	epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	c->fd = -1;
+	c->used = 0;
+	c->want_out = 0;
+	s->clients--;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-171022
+  Function Name	: netsrv_send
+  Returns Type	: static void
+  ----Parameter List
+  1. struct netsrv *s,
+  2. struct netsrv_client *c ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: may drop the client
+  --------------------------------------------------------------------
+Comments:
+	Sends what the socket will take without waiting and watches for
+	EPOLLOUT only while something is left over
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void netsrv_send(struct netsrv *s, struct netsrv_client *c) {
+	struct epoll_event ev;
+	ssize_t n;
+
+	while (c->used) {
+		n = send(c->fd, c->buf, c->used, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) break;
+			netsrv_drop(s, c, "disconnected");
+			return;
+		}
+		c->used -= n;
+		if (c->used) memmove(c->buf, c->buf + n, c->used);
+	}
+
+	if ((c->used != 0) != (c->want_out != 0)) {
+		c->want_out = (c->used != 0);
+		ev.events = EPOLLIN | EPOLLRDHUP | (c->want_out ? EPOLLOUT : 0);
+		ev.data.ptr = c;
+		epoll_ctl(s->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-171035
+  Function Name	: netsrv_queue
+  Returns Type	: static int
+  ----Parameter List
+  1. struct netsrv *s,
+  2. struct netsrv_client *c,
+  3. const void *data,
+  4. size_t n ,
+  ------------------
+  Exit Codes	: 0 = queued, -1 = client dropped
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int netsrv_queue(struct netsrv *s, struct netsrv_client *c, const void *data, size_t n) {
+	if (c->used + n > NETSRV_CLIENT_BUFFER) {
+		s->dropped++;
+		netsrv_drop(s, c, "dropped, not keeping up");
+		return -1;
+	}
+
+	memcpy(c->buf + c->used, data, n);
+	c->used += n;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-171048
+  Function Name	: netsrv_format
+  Returns Type	: static size_t
+  ----Parameter List
+  1. const struct netsrv *s,
+  2. uint8_t meter,
+  3. uint64_t t_ns,
+  4. const uint8_t *raw,
+  5. const struct bk390a_reading *r,
+  6. uint8_t *out, at least NETSRV_LINE_MAX bytes
+  ------------------
+  Exit Codes	: bytes in out
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static size_t netsrv_format(const struct netsrv *s, uint8_t meter, uint64_t t_ns, const uint8_t *raw, const struct bk390a_reading *r, uint8_t *out) {
+	char value[32];
+	int n;
+
+	if (s->format == NETSRV_BINARY) {
+		binlog_reading_record((struct binlog_record *)out, meter, t_ns, raw, r);
+		return sizeof(struct binlog_record);
+	}
+
+	if (r->status & STATUS_OL) snprintf(value, sizeof(value), "O.L.");
+	else bk390a_value_str(r, value, sizeof(value));
+
+	n = snprintf((char *)out, NETSRV_LINE_MAX, "%d %0.3f %s %s\n"
+			, meter
+			, (int64_t)(t_ns - s->t0.t_ns) / 1e9
+			, value
+			, bk390a_unit_str[r->unit]
+			);
+	if (n < 0) return 0;
+	if (n >= NETSRV_LINE_MAX) n = NETSRV_LINE_MAX -1;
+
+	return n;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-171100
+  Function Name	: netsrv_accept
+  Returns Type	: static void
+  ----Parameter List
+  1. struct netsrv *s ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	New clients get the session header and the latest reading of
+	every meter straight away
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void netsrv_accept(struct netsrv *s) {
+	struct sockaddr_storage sa;
+	struct epoll_event ev;
+	struct netsrv_client *c;
+	uint8_t rec[NETSRV_LINE_MAX];
+	char host[48], port[8];
+	socklen_t sl;
+	int fd, i, one = 1;
+
+	while (1) {
+		sl = sizeof(sa);
+		fd = accept4(s->listen_fd, (struct sockaddr *)&sa, &sl, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR) continue;
+			return;	// EAGAIN, nothing (more) waiting
+		}
+
+		for (i = 0, c = NULL; i < NETSRV_CLIENTS_MAX; i++) {
+			if (s->c[i].fd < 0) { c = &(s->c[i]); break; }
+		}
+		if (c == NULL) {
+			s->refused++;
+			close(fd);
+			continue;
+		}
+
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if (getnameinfo((struct sockaddr *)&sa, sl, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+			snprintf(host, sizeof(host), "?");
+			snprintf(port, sizeof(port), "?");
+		}
+		snprintf(c->addr, sizeof(c->addr), "%s:%s", host, port);
+
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = c;
+		if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+			close(fd);
+			continue;
+		}
+		c->fd = fd;
+		c->used = 0;
+		c->want_out = 0;
+		s->clients++;
+		s->accepted++;
+		if (!s->quiet) fprintf(stderr,"Net: client %s connected\r\n", c->addr);
+
+		if (s->format == NETSRV_BINARY) {
+			struct binlog_header h;
+			struct binlog_record sr;
+
+			binlog_header_init(&h);
+			binlog_session_record(&sr, &(s->t0));
+			netsrv_queue(s, c, &h, sizeof(h));
+			netsrv_queue(s, c, &sr, sizeof(sr));
+
+		} else {
+			char wall[64];
+			int n;
+
+			timebase_wall_str(s->t0.wall_ns, wall, sizeof(wall));
+			n = snprintf((char *)rec, sizeof(rec), "# session %s wall_ns %lld\n", wall, (long long)s->t0.wall_ns);
+			netsrv_queue(s, c, rec, n);
+		}
+
+		for (i = 0; i < NETSRV_METERS_MAX; i++) {
+			struct netsrv_last *l = &(s->last[i]);
+
+			if (!l->valid) continue;
+			if (netsrv_queue(s, c, rec, netsrv_format(s, i, l->t_ns, l->raw, &(l->r), rec)) != 0) break;
+		}
+
+		if (c->fd >= 0) netsrv_send(s, c);
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-171112
+  Function Name	: netsrv_open
+  Returns Type	: int
+  ----Parameter List
+  1. struct netsrv *s,
+  2. const char *addr, "[host:]port", all interfaces without a host
+  3. int format, NETSRV_LINE or NETSRV_BINARY
+  4. int epoll_fd, the capture loop's
+  5. const struct timebase_anchor *t0, session anchor ,
+  ------------------
+  Exit Codes	: 0 = listening, -1 = bad address, -2 = couldn't listen
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int netsrv_open(struct netsrv *s, const char *addr, int format, int epoll_fd, const struct timebase_anchor *t0) {
+	struct addrinfo hints, *res, *ai;
+	struct epoll_event ev;
+	char host[256];
+	const char *port, *colon;
+	int i, one = 1;
+
+	memset(s, 0, sizeof(struct netsrv));
+	s->listen_fd = -1;
+	s->epoll_fd = epoll_fd;
+	s->format = format;
+	s->t0 = *t0;
+	for (i = 0; i < NETSRV_CLIENTS_MAX; i++) s->c[i].fd = -1;
+
+	/*
+	 * "5390", "127.0.0.1:5390", "[::1]:5390"
+	 */
+	colon = strrchr(addr, ':');
+	if (colon) {
+		size_t hl = colon - addr;
+
+		if (hl >= sizeof(host)) return -1;
+		if ((hl >= 2) && (addr[0] == '[') && (addr[hl -1] == ']')) {
+			memcpy(host, addr +1, hl -2);
+			host[hl -2] = '\0';
+		} else {
+			memcpy(host, addr, hl);
+			host[hl] = '\0';
+		}
+		port = colon +1;
+	} else {
+		host[0] = '\0';
+		port = addr;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if (getaddrinfo(host[0] ? host : NULL, port, &hints, &res) != 0) return -1;
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		s->listen_fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+		if (s->listen_fd < 0) continue;
+		setsockopt(s->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if ((bind(s->listen_fd, ai->ai_addr, ai->ai_addrlen) == 0) && (listen(s->listen_fd, 16) == 0)) break;
+		close(s->listen_fd);
+		s->listen_fd = -1;
+	}
+	freeaddrinfo(res);
+	if (s->listen_fd < 0) return -2;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = s;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s->listen_fd, &ev) != 0) {
+		close(s->listen_fd);
+		s->listen_fd = -1;
+		return -2;
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-171125
+  Function Name	: netsrv_event
+  Returns Type	: int
+  ----Parameter List
+  1. struct netsrv *s,
+  2. void *ptr, the epoll event's data.ptr
+  3. uint32_t events, the epoll event's events ,
+  ------------------
+  Exit Codes	: 1 = handled, 0 = not one of the server's
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Anything a client sends us is read and ignored
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int netsrv_event(struct netsrv *s, void *ptr, uint32_t events) {
+	struct netsrv_client *c = (struct netsrv_client *)ptr;
+	uint8_t junk[256];
+	ssize_t n;
+
+	if (ptr == s) {
+		netsrv_accept(s);
+		return 1;
+	}
+	if ((c < &(s->c[0])) || (c >= &(s->c[NETSRV_CLIENTS_MAX]))) return 0;
+	if (c->fd < 0) return 1;
+
+	if (events & EPOLLIN) {
+		while ((n = recv(c->fd, junk, sizeof(junk), MSG_DONTWAIT)) > 0);
+		if ((n == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))) {
+			netsrv_drop(s, c, "disconnected");
+			return 1;
+		}
+	}
+	if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+		netsrv_drop(s, c, "disconnected");
+		return 1;
+	}
+	if (events & EPOLLOUT) netsrv_send(s, c);
+
+	return 1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-171138
+  Function Name	: netsrv_publish
+  Returns Type	: void
+  ----Parameter List
+  1. struct netsrv *s,
+  2. uint8_t meter, meter id (0 for single meter tools)
+  3. uint64_t t_ns, monotonic time stamp of the frame
+  4. const uint8_t *raw, frame payload, BK390A_PAYLOAD_MAX bytes
+  5. const struct bk390a_reading *r, decoded frame
+  ------------------
+  Exit Codes	:
+  Side Effects	: drops clients that have fallen too far behind
+  --------------------------------------------------------------------
+Comments:
+	Never blocks; called from the capture loop
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void netsrv_publish(struct netsrv *s, uint8_t meter, uint64_t t_ns, const uint8_t *raw, const struct bk390a_reading *r) {
+	struct netsrv_last *l = &(s->last[meter]);
+	uint8_t rec[NETSRV_LINE_MAX];
+	size_t n;
+	int i;
+
+	if (s->listen_fd < 0) return;
+
+	l->t_ns = t_ns;
+	memcpy(l->raw, raw, BK390A_PAYLOAD_MAX);
+	l->r = *r;
+	l->valid = 1;
+
+	if (s->clients == 0) return;
+
+	n = netsrv_format(s, meter, t_ns, raw, r, rec);
+	for (i = 0; i < NETSRV_CLIENTS_MAX; i++) {
+		struct netsrv_client *c = &(s->c[i]);
+
+		if (c->fd < 0) continue;
+		if (netsrv_queue(s, c, rec, n) != 0) continue;
+		if (!c->want_out) netsrv_send(s, c);
+	}
+	s->sent++;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-171150
+  Function Name	: netsrv_close
+  Returns Type	: void
+  ----Parameter List
+  1. struct netsrv *s ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: closes every client, without waiting on them
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void netsrv_close(struct netsrv *s) {
+	int i;
+
+	if (s->listen_fd < 0) return;
+
+	for (i = 0; i < NETSRV_CLIENTS_MAX; i++) {
+		struct netsrv_client *c = &(s->c[i]);
+
+		if (c->fd < 0) continue;
+		if (c->used) netsrv_send(s, c);
+		if (c->fd >= 0) netsrv_drop(s, c, "closed");
+	}
+	close(s->listen_fd);
+	s->listen_fd = -1;
+}
@@ -0,0 +1,82 @@
+/*
+ * Live reading TCP broadcast server (Linux)
+ *
+ * Streams every decoded reading to any number of TCP clients.  The
+ * listening socket and the clients are non-blocking and live in the
+ * capture program's own epoll loop, next to the serial ports.
+ *
+ * Each client has a small output buffer.  A reading is appended to
+ * every client's buffer and sent straight away; whatever the socket
+ * won't take now waits for EPOLLOUT.  A client too slow to keep its
+ * buffer from filling is disconnected, never waited for.
+ *
+ * NETSRV_LINE streams the '# session' line followed by
+ * '<meter> <seconds> <value> <unit>' lines, seconds since the session
+ * anchor and the value in SI base units, as the -l logs.
+ * NETSRV_BINARY streams the binary log format; a binlog header, a
+ * BINLOG_SESSION record then BINLOG_READING records, so a saved stream
+ * is a binary log bk390a-query can read.  Either way a new client is
+ * sent the latest reading of every meter as soon as it connects.
+ *
+ */
+#ifndef __BK390A_NETSRV_H__
+#define __BK390A_NETSRV_H__
+
+#include <stdint.h>
+#include "decode.h"
+#include "binlog.h"
+#include "timebase.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NETSRV_CLIENTS_MAX 32
+#define NETSRV_METERS_MAX 256		// meter ids the latest reading is kept for
+#define NETSRV_CLIENT_BUFFER 16384	// bytes; a client that lets it fill is dropped
+#define NETSRV_LINE_MAX 128
+
+#define NETSRV_LINE 0
+#define NETSRV_BINARY 1
+
+struct netsrv_client {
+	int fd;
+	int want_out;				// EPOLLOUT registered, output is waiting
+	uint32_t used;
+	char addr[64];
+	uint8_t buf[NETSRV_CLIENT_BUFFER];
+};
+
+struct netsrv_last {
+	uint8_t valid;
+	uint64_t t_ns;
+	uint8_t raw[BK390A_PAYLOAD_MAX];
+	struct bk390a_reading r;
+};
+
+struct netsrv {
+	int listen_fd;
+	int epoll_fd;
+	int format;					// NETSRV_LINE, NETSRV_BINARY
+	int quiet;
+	struct timebase_anchor t0;	// session anchor, seconds / BINLOG_SESSION
+	int clients;
+	struct netsrv_client c[NETSRV_CLIENTS_MAX];
+	struct netsrv_last last[NETSRV_METERS_MAX];
+
+	uint64_t accepted;
+	uint64_t refused;			// NETSRV_CLIENTS_MAX already connected
+	uint64_t dropped;			// disconnected for falling behind
+	uint64_t sent;				// readings
+};
+
+int netsrv_open(struct netsrv *s, const char *addr, int format, int epoll_fd, const struct timebase_anchor *t0);
+int netsrv_event(struct netsrv *s, void *ptr, uint32_t events);
+void netsrv_publish(struct netsrv *s, uint8_t meter, uint64_t t_ns, const uint8_t *raw, const struct bk390a_reading *r);
+void netsrv_close(struct netsrv *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
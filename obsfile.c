@@ -0,0 +1,126 @@
+/*
+ * OBS text output, atomic and change-only
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "obsfile.h"
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-132010
+  Function Name	: obsfile_open
+  Returns Type	: int
+  ----Parameter List
+  1. struct obsfile *o,
+  2. char *fn, file OBS is watching
+  ------------------
+  Exit Codes	: 0 = ok, -1 = name too long
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Nothing is written until the first obsfile_update()
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int obsfile_open(struct obsfile *o, char *fn) {
+	memset(o, 0, sizeof(struct obsfile));
+
+	if (snprintf(o->tmp_fn, sizeof(o->tmp_fn), "%s%s", fn, OBSFILE_TMP_SUFFIX) >= (int)sizeof(o->tmp_fn)) return -1;
+	o->fn = fn;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-132024
+  Function Name	: obsfile_update
+  Returns Type	: int
+  ----Parameter List
+  1. struct obsfile *o,
+  2. const char *text, display string
+  ------------------
+  Exit Codes	: 1 = written, 0 = unchanged, -1 = couldn't write
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The file content is the string and its \0, as it always was
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int obsfile_update(struct obsfile *o, const char *text) {
+	size_t len;
+	int r;
+
+	if (o->fn == NULL) return -1;
+
+	len = strlen(text);
+
+	if (o->valid && (len == o->last_len) && (memcmp(text, o->last, len) == 0)) {
+		o->unchanged++;
+		return 0;
+	}
+
+#ifdef _WIN32
+	FILE *f = fopen(o->tmp_fn, "wb");
+
+	if (f == NULL) return -1;
+	r = (fwrite(text, 1, len +1, f) == len +1);
+	if (fclose(f) != 0) r = 0;
+	if (r && (MoveFileExA(o->tmp_fn, o->fn, MOVEFILE_REPLACE_EXISTING) == 0)) r = 0;
+#else
+	int fd = open(o->tmp_fn, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (fd < 0) return -1;
+	r = (write(fd, text, len +1) == (ssize_t)(len +1));
+	if (close(fd) != 0) r = 0;
+	if (r && (rename(o->tmp_fn, o->fn) != 0)) r = 0;
+#endif
+	if (!r) {
+		remove(o->tmp_fn);
+		return -1;
+	}
+
+	o->valid = (len < OBSFILE_TEXT_MAX);
+	if (o->valid) {
+		memcpy(o->last, text, len);
+		o->last_len = len;
+	}
+	o->writes++;
+
+	return 1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-132040
+  Function Name	: obsfile_close
+  Returns Type	: void
+  ----Parameter List
+  1. struct obsfile *o ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: removes a temporary file left by a failed rename
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void obsfile_close(struct obsfile *o) {
+	if (o->fn == NULL) return;
+
+	remove(o->tmp_fn);
+	o->fn = NULL;
+}
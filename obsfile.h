@@ -0,0 +1,43 @@
+/*
+ * OBS text output
+ *
+ * OBS's text source re-reads the file whenever it changes, so the
+ * file is only rewritten when the display string actually changes,
+ * and then by writing a temporary file beside it and renaming it in
+ * to place.  OBS sees either the old or the new string, never a
+ * half written or truncated one, and nothing is left over from a
+ * longer previous string.
+ *
+ */
+#ifndef __BK390A_OBSFILE_H__
+#define __BK390A_OBSFILE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OBSFILE_TEXT_MAX 1024
+#define OBSFILE_TMP_SUFFIX ".tmp"
+
+struct obsfile {
+	char *fn;
+	char tmp_fn[1024];
+	char last[OBSFILE_TEXT_MAX];
+	size_t last_len;
+	int valid;			// last holds what's on disk
+	uint64_t writes;
+	uint64_t unchanged;
+};
+
+int obsfile_open(struct obsfile *o, char *fn);
+int obsfile_update(struct obsfile *o, const char *text);
+void obsfile_close(struct obsfile *o);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * Cyrustek style meter frame protocols
+ *
+ * proto_decode() is written once against a struct proto_layout and
+ * forced inline in to each protocol's decoder with that protocol's
+ * static const layout, so the compiler sees every offset, the digit
+ * count and the digit masks as constants and specialises it; what's
+ * left per frame is the same handful of loads and masks bk390a_decode()
+ * does by hand.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "decode.h"
+#include "proto.h"
+
+#if defined(__GNUC__)
+#define PROTO_SPECIALISE static inline __attribute__((always_inline))
+#else
+#define PROTO_SPECIALISE static inline
+#endif
+
+#define R(dps, exp, unit, mode) { dps, exp, BK390A_UNIT_##unit, BK390A_MODE_##mode }
+#define ALL8(x) { x, x, x, x, x, x, x, x }
+#define FN(f) [(f) & 0x0F]
+
+/*
+ * Any byte outside of 0x30..0x3F, or a digit nibble over 9, in 8 bytes
+ * loaded as a word; see bk390a_decode()
+ */
+#define PROTO_BAD(w, dm) ((((w) & 0xF0F0F0F0F0F0F0F0ULL) ^ 0x3030303030303030ULL) \
+		| ((((w) & 0x0F0F0F0F0F0F0F0FULL) + 0x0606060606060606ULL) & 0x1010101010101010ULL & (dm)))
+
+/*
+ * ES51922, 14 byte frames at 19200:7o1; UNI-T UT61E and the like.  The
+ * range byte, 5 digits, function and status bytes are laid out as the
+ * 390A's with one more digit, then four option bytes.
+ */
+#define ES51922_OPTION_1 8		// MAX, MIN, REL, RMR
+#define ES51922_OPTION_2 9		// UL, PMAX, PMIN
+#define ES51922_OPTION_3 10		// DC, AC, AUTO, VAHZ
+#define ES51922_OPTION_4 11		// VBAR, HOLD, LPF
+
+#define ES51922_FUNCTION_VOLTAGE 0b00111011
+#define ES51922_FUNCTION_CURRENT_UA 0b00111101
+#define ES51922_FUNCTION_CURRENT_MA 0b00111111
+#define ES51922_FUNCTION_CURRENT_A 0b00110000
+#define ES51922_FUNCTION_CURRENT_A_MANUAL 0b00111001
+#define ES51922_FUNCTION_OHMS 0b00110011
+#define ES51922_FUNCTION_CONTINUITY 0b00110101
+#define ES51922_FUNCTION_DIODE 0b00110001
+#define ES51922_FUNCTION_FREQUENCY 0b00110010
+#define ES51922_FUNCTION_CAPACITANCE 0b00110110
+
+#define ES51922_OPTION2_PMIN 0x02
+#define ES51922_OPTION2_PMAX 0x04
+
+static const struct proto_layout bk390a_layout = {
+	BK390A_PAYLOAD_SIZE, BYTE_RANGE, BYTE_DIGIT_3, 4, BYTE_FUNCTION, BYTE_STATUS, 9999,
+	{ 0, 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0 }
+};
+
+static const struct proto_layout es51922_layout = {
+	12, 0, 1, 5, 6, 7, 22000,
+	{ 0, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0, 0, 0 }
+};
+
+/*
+ * [FUNCTION & 0x0F][STATUS_JUDGE][RANGE & 0x07], as bk390a_range_table[].
+ * Only the functions and ranges of the chip's published range table
+ * are filled in, anything else decodes as BK390A_MODE_UNKNOWN.
+ */
+static const struct bk390a_range es51922_range_table[17][2][8] = {
+	FN(ES51922_FUNCTION_VOLTAGE) = {
+		{ R(4, 0, VOLT, VOLTS), R(3, 0, VOLT, VOLTS), R(2, 0, VOLT, VOLTS), R(1, 0, VOLT, VOLTS), R(2, -3, VOLT, VOLTS) },
+		{ R(4, 0, VOLT, VOLTS), R(3, 0, VOLT, VOLTS), R(2, 0, VOLT, VOLTS), R(1, 0, VOLT, VOLTS), R(2, -3, VOLT, VOLTS) }
+	},
+
+	FN(ES51922_FUNCTION_CURRENT_UA) = {
+		{ R(2, -6, AMP, AMPS), R(1, -6, AMP, AMPS) },
+		{ R(2, -6, AMP, AMPS), R(1, -6, AMP, AMPS) }
+	},
+
+	FN(ES51922_FUNCTION_CURRENT_MA) = {
+		{ R(3, -3, AMP, AMPS), R(2, -3, AMP, AMPS) },
+		{ R(3, -3, AMP, AMPS), R(2, -3, AMP, AMPS) }
+	},
+
+	FN(ES51922_FUNCTION_CURRENT_A) = {
+		ALL8(R(3, 0, AMP, AMPS)),
+		ALL8(R(3, 0, AMP, AMPS))
+	},
+
+	FN(ES51922_FUNCTION_CURRENT_A_MANUAL) = {
+		ALL8(R(3, 0, AMP, AMPS)),
+		ALL8(R(3, 0, AMP, AMPS))
+	},
+
+	FN(ES51922_FUNCTION_OHMS) = {
+		{ R(2, 0, OHM, RESISTANCE), R(4, 3, OHM, RESISTANCE), R(3, 3, OHM, RESISTANCE), R(2, 3, OHM, RESISTANCE),
+			R(4, 6, OHM, RESISTANCE), R(3, 6, OHM, RESISTANCE), R(2, 6, OHM, RESISTANCE) },
+		{ R(2, 0, OHM, RESISTANCE), R(4, 3, OHM, RESISTANCE), R(3, 3, OHM, RESISTANCE), R(2, 3, OHM, RESISTANCE),
+			R(4, 6, OHM, RESISTANCE), R(3, 6, OHM, RESISTANCE), R(2, 6, OHM, RESISTANCE) }
+	},
+
+	FN(ES51922_FUNCTION_CONTINUITY) = {
+		ALL8(R(2, 0, OHM, CONTINUITY)),
+		ALL8(R(2, 0, OHM, CONTINUITY))
+	},
+
+	FN(ES51922_FUNCTION_DIODE) = {
+		ALL8(R(4, 0, VOLT, DIODE)),
+		ALL8(R(4, 0, VOLT, DIODE))
+	},
+
+	FN(ES51922_FUNCTION_FREQUENCY) = {
+		/* range 2 isn't used */
+		{ R(2, 0, HZ, FREQUENCY), R(1, 0, HZ, FREQUENCY), R(0, 0, NONE, UNKNOWN), R(3, 3, HZ, FREQUENCY),
+			R(2, 3, HZ, FREQUENCY), R(4, 6, HZ, FREQUENCY), R(3, 6, HZ, FREQUENCY), R(2, 6, HZ, FREQUENCY) },
+		{ R(2, 0, HZ, FREQUENCY), R(1, 0, HZ, FREQUENCY), R(0, 0, NONE, UNKNOWN), R(3, 3, HZ, FREQUENCY),
+			R(2, 3, HZ, FREQUENCY), R(4, 6, HZ, FREQUENCY), R(3, 6, HZ, FREQUENCY), R(2, 6, HZ, FREQUENCY) }
+	},
+
+	FN(ES51922_FUNCTION_CAPACITANCE) = {
+		{ R(3, -9, FARAD, CAPACITANCE), R(2, -9, FARAD, CAPACITANCE), R(4, -6, FARAD, CAPACITANCE), R(3, -6, FARAD, CAPACITANCE),
+			R(2, -6, FARAD, CAPACITANCE), R(4, -3, FARAD, CAPACITANCE), R(3, -3, FARAD, CAPACITANCE), R(2, -3, FARAD, CAPACITANCE) },
+		{ R(3, -9, FARAD, CAPACITANCE), R(2, -9, FARAD, CAPACITANCE), R(4, -6, FARAD, CAPACITANCE), R(3, -6, FARAD, CAPACITANCE),
+			R(2, -6, FARAD, CAPACITANCE), R(4, -3, FARAD, CAPACITANCE), R(3, -3, FARAD, CAPACITANCE), R(2, -3, FARAD, CAPACITANCE) }
+	},
+};
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-201410
+  Function Name	: proto_decode
+  Returns Type	: static int
+  ----Parameter List
+  1. const struct proto_layout *l, a static const layout
+  2. const struct bk390a_range (*table)[2][8], its range table
+  3. const uint8_t *d, frame payload
+  4. struct bk390a_reading *r, decoded result
+  ------------------
+  Exit Codes	: 0 = success, -1 = unknown function/range or malformed
+  Side Effects	: r is written apart from option1, option2 and protocol,
+			which are left to the caller
+  --------------------------------------------------------------------
+Comments:
+	bk390a_decode() for any layout, and checked the same way; every
+	payload byte in the 0x30..0x3F block, digits 0..9, range 0..7 and
+	a count no more than the layout's max_count.  The payload is covered by its
+	first 8 bytes and its last 8, overlapping, each checked as a word.
+
+	Only ever called with a constant layout, which it's inlined and
+	specialised for.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+PROTO_SPECIALISE int proto_decode(const struct proto_layout *l, const struct bk390a_range (*table)[2][8], const uint8_t *d, struct bk390a_reading *r) {
+	const struct bk390a_range *e;
+	uint64_t w, dm, bad;
+	unsigned int fn, neg, i;
+	int count;
+
+	fn = d[l->byte_function];
+	fn = ((fn & 0xF0) == 0x30) ? (fn & 0x0F) : 16;
+	e = &table[fn][(d[l->byte_status] & STATUS_JUDGE) >> 3][d[l->byte_range] & 0x07];
+
+	memcpy(&w, d, sizeof(w));
+	memcpy(&dm, l->digit_mask, sizeof(dm));
+	bad = PROTO_BAD(w, dm);
+	memcpy(&w, d + l->payload_size - sizeof(w), sizeof(w));
+	memcpy(&dm, l->digit_mask + l->payload_size - sizeof(dm), sizeof(dm));
+	bad |= PROTO_BAD(w, dm);
+
+	count = 0;
+#pragma GCC unroll 8
+	for (i = 0; i < l->digits; i++) {
+		count = (count * 10) + (d[l->byte_digits + i] & 0x0F);
+	}
+	bad |= (count > l->max_count);
+	bad |= d[l->byte_range] & 0x08;
+
+	neg = (d[l->byte_status] & STATUS_SIGN) >> 2;
+	r->count = (int16_t)((count ^ -(int)neg) + (int)neg);
+
+	r->dps = e->dps;
+	r->si_exp = e->si_exp;
+	r->exp10 = e->si_exp - e->dps;
+	r->unit = e->unit;
+	r->mode = e->mode;
+	r->status = d[l->byte_status] & 0x0F;
+
+	return ((e->mode == BK390A_MODE_UNKNOWN) || bad) ? -1 : 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-201425
+  Function Name	: es51922_decode
+  Returns Type	: static int
+  ----Parameter List
+  1. const uint8_t *d, 12 byte frame payload
+  2. struct bk390a_reading *r, decoded result
+  ------------------
+  Exit Codes	: 0 = success, -1 = unknown function/range or malformed
+  Side Effects	: r is always fully written, from this frame only
+  --------------------------------------------------------------------
+Comments:
+	PMAX/PMIN sit a bit lower in OPTION_2 than the 390A's OPTION1
+	has them, and OPTION_3 holds DC/AC/AUTO in the 390A's OPTION2
+	bits with VAHZ in bit 0.  There's no APO.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int es51922_decode(const uint8_t *d, struct bk390a_reading *r) {
+	int ret = proto_decode(&es51922_layout, es51922_range_table, d, r);
+
+	r->option1 = ((d[ES51922_OPTION_2] & (ES51922_OPTION2_PMIN | ES51922_OPTION2_PMAX)) << 1)
+		| (d[ES51922_OPTION_3] & OPTION1_VAHZ);
+	r->option2 = d[ES51922_OPTION_3] & (OPTION2_AUTO | OPTION2_AC | OPTION2_DC);
+	r->protocol = BK390A_PROTOCOL_ES51922;
+
+	return ret;
+}
+
+const struct proto proto_bk390a = {
+	"bk390a", "BK Precision 390A, 11 byte frames, 4 digits",
+	BK390A_PROTOCOL_BK390A, BK390A_FRAME_SIZE, { '\r', '\n' }, "2400:7o1",
+	&bk390a_layout, bk390a_range_table, bk390a_decode
+};
+
+const struct proto proto_es51922 = {
+	"es51922", "Cyrustek ES51922 (UNI-T UT61E ...), 14 byte frames, 5 digits",
+	BK390A_PROTOCOL_ES51922, 14, { '\r', '\n' }, "19200:7o1",
+	&es51922_layout, es51922_range_table, es51922_decode
+};
+
+const struct proto *proto_list[BK390A_PROTOCOL_COUNT] = { &proto_bk390a, &proto_es51922 };
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-201440
+  Function Name	: proto_find
+  Returns Type	: const struct proto *
+  ----Parameter List
+  1. const char *name, eg "es51922" ,
+  ------------------
+  Exit Codes	: the protocol, NULL if there's none of that name
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+const struct proto *proto_find(const char *name) {
+	int i;
+
+	for (i = 0; i < BK390A_PROTOCOL_COUNT; i++) {
+		if (strcmp(proto_list[i]->name, name) == 0) return proto_list[i];
+	}
+
+	return NULL;
+}
@@ -0,0 +1,68 @@
+/*
+ * Cyrustek style meter frame protocols
+ *
+ * The 390A's frame, a range byte, BCD digits, function, status and
+ * option bytes all in the 0x30..0x3F block and then \r\n, is shared
+ * with small changes by a family of multimeter chipsets.  A protocol
+ * describes one of them; the frame layout, the FUNCTION x JUDGE x
+ * RANGE table, the meter's own serial settings and the decoder built
+ * for that layout.
+ *
+ * Each decoder is the one generic decoder in proto.c instantiated
+ * with its protocol's layout as compile time constants, so the byte
+ * offsets, digit count and checks fold in to straight line code; the
+ * 390A's is bk390a_decode() itself.  Every decoder fills in the same
+ * struct bk390a_reading, the option bits mapped on to the 390A's
+ * OPTION1_/OPTION2_ meanings, so everything past the decoder serves
+ * any of the meters.
+ *
+ */
+#ifndef __BK390A_PROTO_H__
+#define __BK390A_PROTO_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Frame layout; the digits are consecutive bytes, most significant
+ * first.  payload_size is 8..BK390A_PAYLOAD_MAX.
+ */
+struct proto_layout {
+	uint8_t payload_size;
+	uint8_t byte_range;
+	uint8_t byte_digits;	// most significant digit
+	uint8_t digits;
+	uint8_t byte_function;
+	uint8_t byte_status;
+	uint16_t max_count;		// largest display count accepted
+	uint8_t digit_mask[BK390A_PAYLOAD_MAX];	// 0xFF for each digit byte
+};
+
+struct proto {
+	const char *name;		// -y <name>
+	const char *desc;
+	uint8_t id;				// enum bk390a_protocol
+	uint8_t frame_size;		// payload + terminator
+	char terminator[2];		// the framer scans for terminator[1]
+	const char *serial_params;	// the meter's own, eg "2400:7o1"
+	const struct proto_layout *layout;
+	const struct bk390a_range (*range_table)[2][8];
+	int (*decode)(const uint8_t *d, struct bk390a_reading *r);
+};
+
+extern const struct proto proto_bk390a;
+extern const struct proto proto_es51922;
+extern const struct proto *proto_list[BK390A_PROTOCOL_COUNT];
+
+const struct proto *proto_find(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,547 @@
+/*
+ * Raw serial capture, pcap style, and its replay
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "rawcap.h"
+#include "timebase.h"
+
+typedef char rawcap_header_size_check[(sizeof(struct rawcap_header) == RAWCAP_HEADER_SIZE) ? 1 : -1];
+typedef char rawcap_record_size_check[(sizeof(struct rawcap_record) == RAWCAP_RECORD_SIZE) ? 1 : -1];
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200010
+  Function Name	: rawcap_open
+  Returns Type	: int
+  ----Parameter List
+  1. struct rawcap *rc,
+  2. const char *fn,
+  3. const struct timebase_anchor *a, the session's log 'zero'
+  4. const char *serial_params, as the port was opened, eg "2400:7o1"
+  5. uint16_t meters, highest meter id to be recorded
+  6. uint32_t flush_ms, longest time a record is held in the buffer ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = couldn't create the file
+  Side Effects	: replaces fn, writes the header
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int rawcap_open(struct rawcap *rc, const char *fn, const struct timebase_anchor *a, const char *serial_params, uint16_t meters, uint32_t flush_ms) {
+	struct rawcap_header h;
+
+	rc->used = 0;
+	rc->records = 0;
+	rc->flush_interval_ns = (uint64_t)flush_ms * 1000000ULL;
+	rc->last_flush_ns = timebase_now_ns();
+
+	rc->f = fopen(fn, "wb");
+	if (rc->f == NULL) return -1;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, RAWCAP_MAGIC, sizeof(h.magic));
+	h.version = RAWCAP_VERSION;
+	h.header_size = RAWCAP_HEADER_SIZE;
+	h.record_size = RAWCAP_RECORD_SIZE;
+	h.meters = meters;
+	h.t0_ns = a->t_ns;
+	h.wall_ns = a->wall_ns;
+	if (serial_params) snprintf(h.serial_params, sizeof(h.serial_params), "%s", serial_params);
+
+	if (fwrite(&h, sizeof(h), 1, rc->f) != 1) {
+		fclose(rc->f);
+		rc->f = NULL;
+		return -1;
+	}
+
+	return rawcap_flush(rc);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200024
+  Function Name	: rawcap_record
+  Returns Type	: static int
+  ----Parameter List
+  1. struct rawcap *rc,
+  2. const struct rawcap_record *rec ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = write error
+  Side Effects	: flushes first if the buffer can't take it
+  --------------------------------------------------------------------
+Comments:
+	Room is left for the record's rec->len data bytes, which the
+	caller copies in straight after; an outage record has none.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int rawcap_record(struct rawcap *rc, const struct rawcap_record *rec) {
+	int r = 0;
+
+	if (rc->used + sizeof(struct rawcap_record) + rec->len > RAWCAP_BUFFER_SIZE) r = rawcap_flush(rc);
+
+	memcpy(rc->buf + rc->used, rec, sizeof(struct rawcap_record));
+	rc->used += sizeof(struct rawcap_record);
+	rc->records++;
+
+	return r;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200038
+  Function Name	: rawcap_append
+  Returns Type	: int
+  ----Parameter List
+  1. struct rawcap *rc,
+  2. uint8_t meter, meter id
+  3. uint8_t protocol, the meter's enum bk390a_protocol
+  4. uint64_t t_ns, when the read completed
+  5. const uint8_t *data, as read
+  6. size_t len ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = write error
+  Side Effects	: may flush the buffer
+  --------------------------------------------------------------------
+Comments:
+	Called with every read, before anything else looks at the bytes
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int rawcap_append(struct rawcap *rc, uint8_t meter, uint8_t protocol, uint64_t t_ns, const uint8_t *data, size_t len) {
+	struct rawcap_record rec;
+	int r = 0;
+
+	if (rc->f == NULL) return -1;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.t_ns = t_ns;
+	rec.meter = meter;
+	rec.type = RAWCAP_DATA;
+	rec.protocol = protocol;
+
+	while (len) {
+		rec.len = (len > RAWCAP_CHUNK_MAX) ? RAWCAP_CHUNK_MAX : len;
+		if (rawcap_record(rc, &rec) != 0) r = -1;
+		memcpy(rc->buf + rc->used, data, rec.len);
+		rc->used += rec.len;
+		data += rec.len;
+		len -= rec.len;
+	}
+
+	if (t_ns - rc->last_flush_ns >= rc->flush_interval_ns) {
+		if (rawcap_flush(rc) != 0) r = -1;
+	}
+
+	return r;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200052
+  Function Name	: rawcap_down
+  Returns Type	: int
+  ----Parameter List
+  1. struct rawcap *rc,
+  2. uint8_t meter, meter id
+  3. uint64_t t_ns, when the port was closed
+  4. uint8_t cause, RECONN_LOST or RECONN_STALLED ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = write error
+  Side Effects	: flushes the buffer
+  --------------------------------------------------------------------
+Comments:
+	So a replay closes the port where the capture did, and reports
+	the same outage
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int rawcap_down(struct rawcap *rc, uint8_t meter, uint64_t t_ns, uint8_t cause) {
+	struct rawcap_record rec;
+
+	if (rc->f == NULL) return -1;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.t_ns = t_ns;
+	rec.meter = meter;
+	rec.type = RAWCAP_DOWN;
+	rec.cause = cause;
+	rawcap_record(rc, &rec);
+
+	return rawcap_flush(rc);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200058
+  Function Name	: rawcap_due
+  Returns Type	: uint64_t
+  ----Parameter List
+  1. const struct rawcap *rc ,
+  ------------------
+  Exit Codes	: monotonic ns the buffer is due to be flushed, 0 = empty
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	For the capture loop's timer; otherwise the buffer only goes out
+	with the next read, which a quiet port may never have.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+uint64_t rawcap_due(const struct rawcap *rc) {
+	if ((rc->f == NULL) || (rc->used == 0)) return 0;
+
+	return rc->last_flush_ns + rc->flush_interval_ns;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200102
+  Function Name	: rawcap_tick
+  Returns Type	: int
+  ----Parameter List
+  1. struct rawcap *rc,
+  2. uint64_t now_ns, monotonic ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = write error
+  Side Effects	: flushes the buffer if it's due
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int rawcap_tick(struct rawcap *rc, uint64_t now_ns) {
+	uint64_t due = rawcap_due(rc);
+
+	if ((due == 0) || (now_ns < due)) return 0;
+
+	return rawcap_flush(rc);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200106
+  Function Name	: rawcap_flush
+  Returns Type	: int
+  ----Parameter List
+  1. struct rawcap *rc ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = write error
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int rawcap_flush(struct rawcap *rc) {
+	int r = 0;
+
+	if (rc->f == NULL) return -1;
+
+	if (rc->used) {
+		if (fwrite(rc->buf, 1, rc->used, rc->f) != rc->used) r = -1;
+		rc->used = 0;
+	}
+	if (fflush(rc->f) != 0) r = -1;
+	rc->last_flush_ns = timebase_now_ns();
+
+	return r;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200120
+  Function Name	: rawcap_close
+  Returns Type	: void
+  ----Parameter List
+  1. struct rawcap *rc ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void rawcap_close(struct rawcap *rc) {
+	if (rc->f == NULL) return;
+
+	rawcap_flush(rc);
+	fclose(rc->f);
+	rc->f = NULL;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200134
+  Function Name	: rawcap_replay_open
+  Returns Type	: int
+  ----Parameter List
+  1. struct rawcap_reader *r,
+  2. const char *fn,
+  3. double speed, 1 = as recorded, 2 = twice as fast.. 0 = as fast as possible ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = couldn't open, -2 = not a compatible capture
+  Side Effects	: the replay's clock starts now
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int rawcap_replay_open(struct rawcap_reader *r, const char *fn, double speed) {
+	memset(r, 0, sizeof(struct rawcap_reader));
+	r->speed = (speed > 0) ? speed : 0;
+
+	r->f = fopen(fn, "rb");
+	if (r->f == NULL) return -1;
+
+	if ((fread(&(r->h), sizeof(r->h), 1, r->f) != 1)
+			|| (memcmp(r->h.magic, RAWCAP_MAGIC, sizeof(r->h.magic)) != 0)
+			|| (r->h.version != RAWCAP_VERSION)
+			|| (r->h.header_size < RAWCAP_HEADER_SIZE)
+			|| (r->h.record_size != RAWCAP_RECORD_SIZE)
+			|| (fseek(r->f, r->h.header_size, SEEK_SET) != 0)) {
+		fclose(r->f);
+		r->f = NULL;
+		return -2;
+	}
+	r->h.serial_params[sizeof(r->h.serial_params) -1] = '\0';
+	r->start_ns = timebase_now_ns();
+	r->last_ns = r->start_ns;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200148
+  Function Name	: rawcap_replay_anchor
+  Returns Type	: void
+  ----Parameter List
+  1. const struct rawcap_reader *r,
+  2. struct timebase_anchor *a ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The capture's session anchor moved to the replay's start, for
+	the outputs to use as their log 'zero'
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void rawcap_replay_anchor(const struct rawcap_reader *r, struct timebase_anchor *a) {
+	a->t_ns = r->start_ns;
+	a->wall_ns = r->h.wall_ns;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200202
+  Function Name	: rawcap_replay_load
+  Returns Type	: static int
+  ----Parameter List
+  1. struct rawcap_reader *r ,
+  ------------------
+  Exit Codes	: 0 = a record is loaded, -1 = end of the capture,
+				  -2 = damaged record
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	A capture cut short mid record (power lost) just ends there
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int rawcap_replay_load(struct rawcap_reader *r) {
+	if (r->have) return 0;
+	if (r->f == NULL) return -1;
+
+	if (fread(&(r->rec), sizeof(r->rec), 1, r->f) != 1) return -1;
+	if ((r->rec.type > RAWCAP_DOWN) || (r->rec.len > RAWCAP_CHUNK_MAX)) return -2;
+	if (r->rec.type != RAWCAP_DATA) r->rec.len = 0;
+	if (r->rec.len && (fread(r->data, 1, r->rec.len, r->f) != r->rec.len)) return -1;
+
+	r->used = 0;
+	r->have = 1;
+	r->records++;
+	r->bytes += r->rec.len;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200216
+  Function Name	: rawcap_replay_wait_ms
+  Returns Type	: int
+  ----Parameter List
+  1. struct rawcap_reader *r ,
+  ------------------
+  Exit Codes	: ms until the next record is due (0 = now, never more
+				  than RAWCAP_REPLAY_WAIT_MAX_MS), -1 = end of the
+				  capture, -2 = damaged record
+  Side Effects	: reads the next record in
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int rawcap_replay_wait_ms(struct rawcap_reader *r) {
+	int64_t since;
+	uint64_t due, now;
+	int e;
+
+	e = rawcap_replay_load(r);
+	if (e != 0) return e;
+	if (r->speed == 0) return 0;
+
+	since = (int64_t)(r->rec.t_ns - r->h.t0_ns);
+	if (since <= 0) return 0;
+
+	due = r->start_ns + (uint64_t)(since / r->speed);
+	now = timebase_now_ns();
+	if (due <= now) return 0;
+	if (due - now >= (uint64_t)RAWCAP_REPLAY_WAIT_MAX_MS * 1000000ULL) return RAWCAP_REPLAY_WAIT_MAX_MS;
+
+	return (int)((due - now + 999999) / 1000000);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200230
+  Function Name	: rawcap_replay_next
+  Returns Type	: int
+  ----Parameter List
+  1. struct rawcap_reader *r,
+  2. struct rawcap_record *rec, receives the record
+  3. uint8_t *buf, receives up to len of its bytes
+  4. size_t len ,
+  ------------------
+  Exit Codes	: 1 = record, 0 = not due yet, -1 = end of the capture,
+				  -2 = damaged record
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	rec->t_ns is moved to the replay's clock, rec->len is the bytes
+	put in buf.  A record longer than len is handed out over as many
+	calls as it takes, each with the same time stamp, as a read of
+	that size would have been.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int rawcap_replay_next(struct rawcap_reader *r, struct rawcap_record *rec, uint8_t *buf, size_t len) {
+	size_t n;
+	int e;
+
+	e = rawcap_replay_wait_ms(r);
+	if (e < 0) return e;
+	if (e > 0) return 0;
+
+	*rec = r->rec;
+	rec->t_ns = r->start_ns + (r->rec.t_ns - r->h.t0_ns);
+	if ((int64_t)(rec->t_ns - r->last_ns) > 0) r->last_ns = rec->t_ns;
+
+	n = r->rec.len - r->used;
+	if (n > len) n = len;
+	if (n) memcpy(buf, r->data + r->used, n);
+	r->used += n;
+	rec->len = n;
+	if (r->used == r->rec.len) r->have = 0;
+
+	return 1;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-220110
+  Function Name	: rawcap_replay_now
+  Returns Type	: uint64_t
+  ----Parameter List
+  1. const struct rawcap_reader *r ,
+  ------------------
+  Exit Codes	: the replay's clock, how far in to the capture it has got
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Replayed frames are stamped on this clock, not the monotonic
+	one; faster than recorded they run ahead of it, so time since
+	a replayed stamp (an outage's length, a statistics window) has
+	to be measured against this instead.  Paced, it moves on with
+	the monotonic clock times the speed; as fast as possible, it
+	only moves with the records.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+uint64_t rawcap_replay_now(const struct rawcap_reader *r) {
+	uint64_t t;
+
+	if (r->speed == 0) return r->last_ns;
+
+	t = r->start_ns + (uint64_t)((timebase_now_ns() - r->start_ns) * r->speed);
+
+	return ((int64_t)(t - r->last_ns) > 0) ? t : r->last_ns;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-220124
+  Function Name	: rawcap_replay_timed
+  Returns Type	: int
+  ----Parameter List
+  1. const struct rawcap_reader *r ,
+  ------------------
+  Exit Codes	: 1 if the replay's clock is the monotonic clock
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Only a replay at -X 1 (or none at all, r->f NULL) has latencies
+	worth recording; see rawcap_replay_now().
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int rawcap_replay_timed(const struct rawcap_reader *r) {
+	return (r->f == NULL) || (r->speed == 1);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-200244
+  Function Name	: rawcap_replay_close
+  Returns Type	: void
+  ----Parameter List
+  1. struct rawcap_reader *r ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void rawcap_replay_close(struct rawcap_reader *r) {
+	if (r->f == NULL) return;
+
+	fclose(r->f);
+	r->f = NULL;
+}
@@ -0,0 +1,115 @@
+/*
+ * Raw serial capture, pcap style, and its replay
+ *
+ * Every chunk read from a port is recorded as it was read, with the
+ * monotonic time the read completed and the meter it came from, so a
+ * field problem can be fed back through the framer, decoder and
+ * outputs later exactly as it happened.
+ *
+ * A 64 byte header, holding the session anchor (the log 'zero' time
+ * and the wall time then) and the serial settings, is followed by
+ * records of a 16 byte record header and then record.len bytes, all
+ * little-endian.  A capture is one session; the file is replaced when
+ * a capture starts.  Writes are buffered for up to the flush interval;
+ * the capture loop calls rawcap_tick() by rawcap_due() so they go out
+ * on time with the port quiet.
+ *
+ * Replay hands the records back with their time stamps moved to the
+ * replay's own start, paced at the recorded rate times the speed, or
+ * as fast as they can be taken with speed 0.  Times relative to the
+ * anchor, which is all the logs show, are unchanged, so a replay at
+ * any speed logs exactly what the capture did.
+ *
+ */
+#ifndef __BK390A_RAWCAP_H__
+#define __BK390A_RAWCAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "timebase.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RAWCAP_MAGIC "BK390RAW"
+#define RAWCAP_VERSION 1
+#define RAWCAP_HEADER_SIZE 64
+#define RAWCAP_RECORD_SIZE 16		// record header, the chunk follows it
+#define RAWCAP_CHUNK_MAX 4096		// bytes per record, longer reads are split
+#define RAWCAP_BUFFER_SIZE 65536
+#define RAWCAP_REPLAY_WAIT_MAX_MS 100	// longest rawcap_replay_wait_ms(), stays responsive
+
+/*
+ * Record types
+ */
+#define RAWCAP_DATA 0		// bytes as read from the port
+#define RAWCAP_DOWN 1		// port closed at t_ns, lost or stalled, cause holds RECONN_*
+
+struct rawcap_header {
+	char magic[8];			// RAWCAP_MAGIC, not terminated
+	uint16_t version;
+	uint16_t header_size;
+	uint16_t record_size;
+	uint16_t meters;		// highest meter id recorded, 0 for single meter tools
+	uint64_t t0_ns;			// session anchor, monotonic
+	int64_t wall_ns;		// Unix epoch ns at t0_ns
+	char serial_params[16];	// eg "2400:7o1", terminated
+	uint8_t reserved[16];
+};
+
+struct rawcap_record {
+	uint64_t t_ns;			// monotonic ns the read completed
+	uint16_t len;			// bytes following, RAWCAP_DATA
+	uint8_t meter;			// meter id, 1.. (0 for single meter tools)
+	uint8_t type;			// RAWCAP_DATA, RAWCAP_DOWN
+	uint8_t cause;			// RAWCAP_DOWN, RECONN_LOST or RECONN_STALLED
+	uint8_t protocol;		// RAWCAP_DATA, the meter's enum bk390a_protocol
+	uint8_t reserved[2];
+};
+
+struct rawcap {
+	FILE *f;
+	uint64_t flush_interval_ns;
+	uint64_t last_flush_ns;
+	uint64_t records;
+	size_t used;
+	uint8_t buf[RAWCAP_BUFFER_SIZE];
+};
+
+struct rawcap_reader {
+	FILE *f;
+	struct rawcap_header h;
+	double speed;			// 1 = as recorded, 0 = as fast as possible
+	uint64_t start_ns;		// when the replay started, the anchor's new time
+	struct rawcap_record rec;	// current record, its time stamp as recorded
+	uint8_t data[RAWCAP_CHUNK_MAX];
+	size_t used;			// of data, handed out so far
+	int have;				// rec/data hold a record not yet all handed out
+	uint64_t records;
+	uint64_t bytes;
+	uint64_t last_ns;		// latest record handed out, on the replay's clock
+};
+
+int rawcap_open(struct rawcap *rc, const char *fn, const struct timebase_anchor *a, const char *serial_params, uint16_t meters, uint32_t flush_ms);
+int rawcap_append(struct rawcap *rc, uint8_t meter, uint8_t protocol, uint64_t t_ns, const uint8_t *data, size_t len);
+int rawcap_down(struct rawcap *rc, uint8_t meter, uint64_t t_ns, uint8_t cause);
+uint64_t rawcap_due(const struct rawcap *rc);
+int rawcap_tick(struct rawcap *rc, uint64_t now_ns);
+int rawcap_flush(struct rawcap *rc);
+void rawcap_close(struct rawcap *rc);
+
+int rawcap_replay_open(struct rawcap_reader *r, const char *fn, double speed);
+void rawcap_replay_anchor(const struct rawcap_reader *r, struct timebase_anchor *a);
+int rawcap_replay_wait_ms(struct rawcap_reader *r);
+int rawcap_replay_next(struct rawcap_reader *r, struct rawcap_record *rec, uint8_t *buf, size_t len);
+uint64_t rawcap_replay_now(const struct rawcap_reader *r);
+int rawcap_replay_timed(const struct rawcap_reader *r);
+void rawcap_replay_close(struct rawcap_reader *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * Serial connection state machine, for reconnecting without a restart
+ *
+ */
+
+#include <stdint.h>
+#include "reconn.h"
+
+const char *reconn_cause_str[2] = { "lost", "stalled" };
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-190010
+  Function Name	: reconn_init
+  Returns Type	: void
+  ----Parameter List
+  1. struct reconn *c,
+  2. uint32_t stall_ms, 0 for no stall detection
+  3. uint64_t now, the port has just been opened ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Starts UP, the stall time counting from now
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void reconn_init(struct reconn *c, uint32_t stall_ms, uint64_t now) {
+	c->state = RECONN_UP;
+	c->cause = RECONN_LOST;
+	c->stall_ns = (uint64_t)stall_ms * 1000000ULL;
+	c->backoff_ns = (uint64_t)RECONN_BACKOFF_MIN_MS * 1000000ULL;
+	c->last_frame_ns = now;
+	c->retry_ns = 0;
+	c->outage_ns = 0;
+	c->attempts = 0;
+	c->outages = 0;
+	c->outage_total_ns = 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-190024
+  Function Name	: reconn_down
+  Returns Type	: int
+  ----Parameter List
+  1. struct reconn *c,
+  2. int cause, RECONN_LOST or RECONN_STALLED
+  3. uint64_t now ,
+  ------------------
+  Exit Codes	: 1 if this starts an outage, 0 if one was already on
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The caller has closed the port.  A lost port is retried after
+	the current backoff, a stalled one straight away (it's already
+	been silent for the stall time).
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int reconn_down(struct reconn *c, int cause, uint64_t now) {
+	int started = 0;
+
+	if (c->state == RECONN_UP) {
+		c->cause = cause;
+		c->outage_ns = (cause == RECONN_STALLED) ? c->last_frame_ns : now;
+		c->attempts = 0;
+		c->outages++;
+		started = 1;
+	}
+
+	c->state = RECONN_DOWN;
+	if ((cause == RECONN_STALLED) && started) {
+		c->retry_ns = now;
+	} else {
+		c->retry_ns = now + c->backoff_ns;
+		c->backoff_ns *= 2;
+		if (c->backoff_ns > (uint64_t)RECONN_BACKOFF_MAX_MS * 1000000ULL) c->backoff_ns = (uint64_t)RECONN_BACKOFF_MAX_MS * 1000000ULL;
+	}
+
+	return started;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-190038
+  Function Name	: reconn_due
+  Returns Type	: int
+  ----Parameter List
+  1. const struct reconn *c,
+  2. uint64_t now ,
+  ------------------
+  Exit Codes	: RECONN_NONE, RECONN_REOPEN or RECONN_CLOSE
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Call whenever the loop wakes, reconn_timeout_ms() says how long
+	it can sleep before something is due
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int reconn_due(const struct reconn *c, uint64_t now) {
+	if (c->state == RECONN_DOWN) return (now >= c->retry_ns) ? RECONN_REOPEN : RECONN_NONE;
+	if (c->stall_ns && (now - c->last_frame_ns >= c->stall_ns)) return RECONN_CLOSE;
+
+	return RECONN_NONE;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-190052
+  Function Name	: reconn_reopened
+  Returns Type	: void
+  ----Parameter List
+  1. struct reconn *c,
+  2. uint64_t now ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The outage goes on until a frame arrives; the stall time runs
+	from now
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void reconn_reopened(struct reconn *c, uint64_t now) {
+	c->state = RECONN_WAITING;
+	c->last_frame_ns = now;
+	c->attempts++;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-190106
+  Function Name	: reconn_failed
+  Returns Type	: void
+  ----Parameter List
+  1. struct reconn *c,
+  2. uint64_t now ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The reopen didn't work, back off
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void reconn_failed(struct reconn *c, uint64_t now) {
+	c->attempts++;
+	reconn_down(c, c->cause, now);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-190120
+  Function Name	: reconn_frame
+  Returns Type	: int
+  ----Parameter List
+  1. struct reconn *c,
+  2. uint64_t now, the frame's arrival ,
+  ------------------
+  Exit Codes	: 1 if this frame ends an outage
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Cheap enough for every frame; the outage's length is
+	now - outage_ns, before the next one starts
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int reconn_frame(struct reconn *c, uint64_t now) {
+	int ended = (c->state != RECONN_UP);
+
+	c->last_frame_ns = now;
+	if (ended) {
+		c->state = RECONN_UP;
+		c->backoff_ns = (uint64_t)RECONN_BACKOFF_MIN_MS * 1000000ULL;
+		c->outage_total_ns += now - c->outage_ns;
+	}
+
+	return ended;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-190134
+  Function Name	: reconn_timeout_ms
+  Returns Type	: int
+  ----Parameter List
+  1. const struct reconn *c,
+  2. uint64_t now ,
+  ------------------
+  Exit Codes	: ms until reconn_due() has something, -1 for never
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int reconn_timeout_ms(const struct reconn *c, uint64_t now) {
+	uint64_t due;
+
+	if (c->state == RECONN_DOWN) due = c->retry_ns;
+	else if (c->stall_ns) due = c->last_frame_ns + c->stall_ns;
+	else return -1;
+
+	if (due <= now) return 0;
+
+	return (int)((due - now + 999999) / 1000000);
+}
@@ -0,0 +1,84 @@
+/*
+ * Serial connection state machine, for reconnecting without a restart
+ *
+ * Only the timing and the decisions live here; the front ends do the
+ * opening, closing and reading on their own platform and tell the
+ * state machine what happened.
+ *
+ *		UP ---- read error / EOF / hangup --------> DOWN
+ *		UP ---- no frame for the stall time ------> DOWN
+ *		DOWN -- retry time, reopen fails ---------> DOWN, backoff doubles
+ *		DOWN -- retry time, reopen works ---------> WAITING
+ *		WAITING -- first good frame ---------------> UP, outage over
+ *		WAITING -- no frame for the stall time ----> DOWN
+ *
+ * An outage runs from the moment the port was lost (or, for a stall,
+ * the last good frame) to the first good frame after it, not to the
+ * port reopening, so a port that opens but stays silent is still an
+ * outage.  Backoff runs from RECONN_BACKOFF_MIN_MS to
+ * RECONN_BACKOFF_MAX_MS and only resets once frames are arriving
+ * again, so a device that opens and then fails isn't hammered.
+ *
+ */
+#ifndef __BK390A_RECONN_H__
+#define __BK390A_RECONN_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RECONN_DEFAULT_STALL_MS 5000	// the meter sends ~2.5 frames a second
+#define RECONN_BACKOFF_MIN_MS 250
+#define RECONN_BACKOFF_MAX_MS 30000
+
+/*
+ * States
+ */
+#define RECONN_UP 0			// open, frames arriving
+#define RECONN_DOWN 1		// closed, waiting to reopen
+#define RECONN_WAITING 2	// reopened, no frame yet
+
+/*
+ * Causes
+ */
+#define RECONN_LOST 0		// read error, EOF or hangup
+#define RECONN_STALLED 1	// open, but nothing framed for the stall time
+
+/*
+ * reconn_due() actions
+ */
+#define RECONN_NONE 0
+#define RECONN_REOPEN 1		// try reopening the port now
+#define RECONN_CLOSE 2		// stalled; close the port, then reconn_down(RECONN_STALLED)
+
+struct reconn {
+	int state;
+	int cause;
+	uint64_t stall_ns;			// 0 = no stall detection
+	uint64_t backoff_ns;		// next delay
+	uint64_t last_frame_ns;		// or when the port was (re)opened
+	uint64_t retry_ns;			// DOWN; next reopen
+	uint64_t outage_ns;			// start of the current outage
+	uint32_t attempts;			// reopens this outage
+
+	uint64_t outages;
+	uint64_t outage_total_ns;	// completed outages
+};
+
+void reconn_init(struct reconn *c, uint32_t stall_ms, uint64_t now);
+int reconn_down(struct reconn *c, int cause, uint64_t now);
+int reconn_due(const struct reconn *c, uint64_t now);
+void reconn_reopened(struct reconn *c, uint64_t now);
+void reconn_failed(struct reconn *c, uint64_t now);
+int reconn_frame(struct reconn *c, uint64_t now);
+int reconn_timeout_ms(const struct reconn *c, uint64_t now);
+
+extern const char *reconn_cause_str[2];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
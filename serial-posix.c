@@ -0,0 +1,173 @@
+/*
+ * POSIX termios serial backend (Linux)
+ *
+ * The port is opened non-blocking for use with epoll.  VMIN is set to
+ * the protocol's frame length with VTIME at zero, which the tty layer
+ * honours for poll/epoll readiness too, so an epoll_wait() on the port
+ * wakes once per frame (11 bytes from a 390A) rather than once per
+ * byte.  The reader moves VMIN to the bytes the framer still needs,
+ * serial_set_vmin(), so a lost or extra byte doesn't leave every later
+ * wake up part way through the next frame.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "serial.h"
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-102210
+  Function Name	: serial_device_path
+  Returns Type	: char *
+  ----Parameter List
+  1. const char *port, "/dev/ttyS0" or a USB adaptor number "0"
+  2. char *buf,
+  3. int len ,
+  ------------------
+  Exit Codes	: buf
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Keeps '-p 4' working the same way it does on Windows, a bare
+	number means the 4th USB serial adaptor, /dev/ttyUSB4
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+char *serial_device_path(const char *port, char *buf, int len) {
+	if (port[0] == '/') snprintf(buf, len, "%s", port);
+	else snprintf(buf, len, "/dev/ttyUSB%s", port);
+
+	return buf;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-181505
+  Function Name	: serial_set_params
+  Returns Type	: int
+  ----Parameter List
+  1. int fd, open tty
+  2. const struct serial_params *sp,
+  3. int frame_size, the protocol's, proto.h ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 on error (errno set)
+  Side Effects	: discards anything already received
+  --------------------------------------------------------------------
+Comments:
+	Separate from serial_open() so the port can be switched between
+	settings without being reopened, see serprobe.c
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int serial_set_params(int fd, const struct serial_params *sp, int frame_size) {
+	struct termios tio;
+	speed_t speed;
+
+	switch (sp->baud) {
+		case 19200: speed = B19200; break;
+		case 9600: speed = B9600; break;
+		case 4800: speed = B4800; break;
+		case 2400: speed = B2400; break;
+		case 1200: speed = B1200; break;
+		default: errno = EINVAL; return -1;
+	}
+
+	if (tcgetattr(fd, &tio) != 0) return -1;
+
+	cfmakeraw(&tio);
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+
+	tio.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+	tio.c_cflag |= CREAD | CLOCAL;
+	tio.c_cflag |= (sp->bits == 7) ? CS7 : CS8;
+	if (sp->parity == 'o') tio.c_cflag |= PARENB | PARODD;
+	else if (sp->parity == 'e') tio.c_cflag |= PARENB;
+	if (sp->stop == 2) tio.c_cflag |= CSTOPB;
+
+	tio.c_cc[VMIN] = frame_size;
+	tio.c_cc[VTIME] = 0;
+
+	if (tcsetattr(fd, TCSANOW, &tio) != 0) return -1;
+
+	tcflush(fd, TCIFLUSH);
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-214510
+  Function Name	: serial_set_vmin
+  Returns Type	: int
+  ----Parameter List
+  1. int fd, open tty
+  2. int vmin, bytes to wake the reader at, 1..255 ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 on error (errno set)
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Nothing received is discarded.  The tty layer wakes any poll on
+	a termios change, so bytes already waiting that now reach vmin
+	are reported straight away.
+
+	With VMIN fixed at the frame size a dropped byte would put each
+	wake up one byte in to the following frame from then on, and
+	every frame would be read (and stamped) a frame period late;
+	set to framer_wanted() after each read instead the wake ups come
+	back in to line with the frame ends at the next frame.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int serial_set_vmin(int fd, int vmin) {
+	struct termios tio;
+
+	if (tcgetattr(fd, &tio) != 0) return -1;
+
+	tio.c_cc[VMIN] = vmin;
+
+	return tcsetattr(fd, TCSANOW, &tio);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-102231
+  Function Name	: serial_open
+  Returns Type	: int
+  ----Parameter List
+  1. const char *device, path to the tty
+  2. const struct serial_params *sp,
+  3. int frame_size, the protocol's, proto.h ,
+  ------------------
+  Exit Codes	: file descriptor, or -1 on error (errno set)
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int serial_open(const char *device, const struct serial_params *sp, int frame_size) {
+	int fd;
+
+	fd = open(device, O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) return -1;
+
+	if (serial_set_params(fd, sp, frame_size) != 0) {
+		int e = errno;
+		close(fd);
+		errno = e;
+		return -1;
+	}
+
+	return fd;
+}
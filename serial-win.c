@@ -0,0 +1,73 @@
+/*
+ * Win32 serial backend
+ *
+ * The one place the COM port is opened and configured, so that a
+ * reconnect after the adaptor has been unplugged gets exactly the same
+ * DCB and time-outs as the first open did.
+ *
+ */
+#ifdef _WIN32
+
+#include <windows.h>
+#include "serial.h"
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-191010
+  Function Name	: serial_open_win
+  Returns Type	: void *
+  ----Parameter List
+  1. const char *device, ie "\\\\.\\COM4"
+  2. const struct serial_params *sp ,
+  ------------------
+  Exit Codes	: HANDLE, or INVALID_HANDLE_VALUE on error (GetLastError())
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Non overlapped.  The comm time-outs end a ReadFile() at the gap
+	between frames, so a read normally returns a whole frame.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void *serial_open_win(const char *device, const struct serial_params *sp) {
+	HANDLE h;
+	DCB dcb = { 0 };
+	COMMTIMEOUTS timeouts = { 0 };
+	DWORD e;
+
+	h = CreateFileA( device,	// Name of port
+			GENERIC_READ,		// Read Access
+			0,					// No Sharing
+			NULL,				// No Security
+			OPEN_EXISTING,		// Open existing port only
+			0,					// Non overlapped I/O
+			NULL);				// Null for comm devices
+	if (h == INVALID_HANDLE_VALUE) return INVALID_HANDLE_VALUE;
+
+	dcb.DCBlength = sizeof(dcb);
+	timeouts.ReadIntervalTimeout         = 50;
+	timeouts.ReadTotalTimeoutConstant    = 50;
+	timeouts.ReadTotalTimeoutMultiplier  = 10;
+	timeouts.WriteTotalTimeoutConstant   = 50;
+	timeouts.WriteTotalTimeoutMultiplier = 10;
+
+	if (GetCommState(h, &dcb)) {
+		dcb.BaudRate = sp->baud;
+		dcb.ByteSize = sp->bits;
+		dcb.StopBits = (sp->stop == 2) ? TWOSTOPBITS : ONESTOPBIT;
+		if (sp->parity == 'e') dcb.Parity = EVENPARITY;
+		else if (sp->parity == 'n') dcb.Parity = NOPARITY;
+		else dcb.Parity = ODDPARITY;
+
+		if (SetCommState(h, &dcb) && SetCommTimeouts(h, &timeouts) && SetCommMask(h, EV_RXCHAR)) return h;
+	}
+
+	e = GetLastError();
+	CloseHandle(h);
+	SetLastError(e);
+
+	return INVALID_HANDLE_VALUE;
+}
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Serial port parameter parsing, shared by all front ends
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "serial.h"
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-101532
+  Function Name	: serial_default_params
+  Returns Type	: void
+  ----Parameter List
+  1. struct serial_params *sp ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void serial_default_params(struct serial_params *sp) {
+	sp->baud = SERIAL_DEFAULT_BAUD;
+	sp->bits = SERIAL_DEFAULT_BITS;
+	sp->parity = SERIAL_DEFAULT_PARITY;
+	sp->stop = SERIAL_DEFAULT_STOP;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-101547
+  Function Name	: serial_parse_params
+  Returns Type	: int
+  ----Parameter List
+  1. const char *s, ie "2400:7o1"
+  2. struct serial_params *sp ,
+  ------------------
+  Exit Codes	: SERIAL_PARAM_OK, or SERIAL_PARAM_* for the first
+				  field that was invalid
+  Side Effects	: sp is only partially set on failure
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int serial_parse_params(const char *s, struct serial_params *sp) {
+	const char *p = s;
+
+	if (strncmp(p, "19200:", 6) == 0) sp->baud = 19200;
+	else if (strncmp(p, "9600:", 5) == 0) sp->baud = 9600;
+	else if (strncmp(p, "4800:", 5) == 0) sp->baud = 4800;
+	else if (strncmp(p, "2400:", 5) == 0) sp->baud = 2400;
+	else if (strncmp(p, "1200:", 5) == 0) sp->baud = 1200;
+	else return SERIAL_PARAM_SPEED;
+
+	p = strchr(s, ':') +1;
+	if (*p == '7') sp->bits = 7;
+	else if (*p == '8') sp->bits = 8;
+	else return SERIAL_PARAM_BITS;
+
+	p++;
+	if ((*p == 'o') || (*p == 'e') || (*p == 'n')) sp->parity = *p;
+	else return SERIAL_PARAM_PARITY;
+
+	p++;
+	if (*p == '1') sp->stop = 1;
+	else if (*p == '2') sp->stop = 2;
+	else return SERIAL_PARAM_STOP;
+
+	return SERIAL_PARAM_OK;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-181520
+  Function Name	: serial_params_str
+  Returns Type	: char *
+  ----Parameter List
+  1. const struct serial_params *sp,
+  2. char *buf,
+  3. int len ,
+  ------------------
+  Exit Codes	: buf
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The -s form, ie "2400:7o1"
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+char *serial_params_str(const struct serial_params *sp, char *buf, int len) {
+	snprintf(buf, len, "%d:%d%c%d", sp->baud, sp->bits, sp->parity, sp->stop);
+
+	return buf;
+}
@@ -0,0 +1,56 @@
+/*
+ * Serial port parameters and the POSIX (termios) serial backend
+ *
+ * The -s <[19200|9600|4800|2400|1200]:[7|8][o|e|n][1|2]> parameter is parsed
+ * the same way for every front end and platform by serial_parse_params()
+ *
+ * serial-posix.c opens and configures the port on Linux, serial-win.c
+ * on Windows
+ *
+ */
+#ifndef __BK390A_SERIAL_H__
+#define __BK390A_SERIAL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SERIAL_PARAM_OK 0
+#define SERIAL_PARAM_SPEED -1
+#define SERIAL_PARAM_BITS -2
+#define SERIAL_PARAM_PARITY -3
+#define SERIAL_PARAM_STOP -4
+
+/*
+ * Defaults are the BK-390A's own, 2400:7o1
+ */
+#define SERIAL_DEFAULT_BAUD 2400
+#define SERIAL_DEFAULT_BITS 7
+#define SERIAL_DEFAULT_PARITY 'o'
+#define SERIAL_DEFAULT_STOP 1
+
+struct serial_params {
+	int baud;		// 19200, 9600, 4800, 2400, 1200
+	int bits;		// 7 or 8
+	char parity;	// 'o', 'e', 'n'
+	int stop;		// 1 or 2
+};
+
+void serial_default_params(struct serial_params *sp);
+int serial_parse_params(const char *s, struct serial_params *sp);
+char *serial_params_str(const struct serial_params *sp, char *buf, int len);
+
+#ifdef _WIN32
+void *serial_open_win(const char *device, const struct serial_params *sp);	// HANDLE
+#else
+char *serial_device_path(const char *port, char *buf, int len);
+int serial_open(const char *device, const struct serial_params *sp, int frame_size);
+int serial_set_params(int fd, const struct serial_params *sp, int frame_size);
+int serial_set_vmin(int fd, int vmin);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,341 @@
+/*
+ * Serial port auto-detection (Linux)
+ *
+ * One epoll loop over every candidate port, each port with its own
+ * framer, setting and deadline.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "decode.h"
+#include "serprobe.h"
+#include "timebase.h"
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-182010
+  Function Name	: serprobe_init
+  Returns Type	: void
+  ----Parameter List
+  1. struct serprobe *s,
+  2. const struct serial_params *first, tried first on every port ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The meter's own 2400 (or the given settings) first, then the
+	other speeds, each at 7o1, 7e1 and 8n1
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void serprobe_init(struct serprobe *s, const struct serial_params *first) {
+	static const int speeds[] = { 2400, 9600, 19200, 4800, 1200 };
+	static const struct { int bits; char parity; } frames[] = { { 7, 'o' }, { 7, 'e' }, { 8, 'n' } };
+	int i, j;
+
+	memset(s, 0, sizeof(struct serprobe));
+	s->proto = &proto_bk390a;
+	s->setting[s->settings++] = *first;
+
+	for (i = 0; i < (int)(sizeof(speeds) / sizeof(speeds[0])); i++) {
+		for (j = 0; j < (int)(sizeof(frames) / sizeof(frames[0])); j++) {
+			struct serial_params *sp = &(s->setting[s->settings]);
+
+			sp->baud = speeds[i];
+			sp->bits = frames[j].bits;
+			sp->parity = frames[j].parity;
+			sp->stop = 1;
+			if ((sp->baud == first->baud) && (sp->bits == first->bits) && (sp->parity == first->parity) && (sp->stop == first->stop)) continue;
+			if (s->settings < SERPROBE_SETTINGS_MAX) s->settings++;
+		}
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-182024
+  Function Name	: serprobe_add
+  Returns Type	: int
+  ----Parameter List
+  1. struct serprobe *s,
+  2. const char *device, path to the tty ,
+  ------------------
+  Exit Codes	: 0 = added (or already there), -1 = too many ports
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int serprobe_add(struct serprobe *s, const char *device) {
+	struct serprobe_port *p;
+	int i;
+
+	for (i = 0; i < s->count; i++) {
+		if (strcmp(s->p[i].device, device) == 0) return 0;
+	}
+	if (s->count >= SERPROBE_PORTS_MAX) return -1;
+
+	p = &(s->p[s->count++]);
+	snprintf(p->device, sizeof(p->device), "%s", device);
+	p->fd = -1;
+	p->state = SERPROBE_PROBING;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-182037
+  Function Name	: serprobe_add_candidates
+  Returns Type	: int
+  ----Parameter List
+  1. struct serprobe *s ,
+  ------------------
+  Exit Codes	: ports now in the probe
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	USB serial adaptors, USB CDC and the on board UARTs.  The ttyS
+	nodes that have no UART behind them fail at tcgetattr() and drop
+	out as SERPROBE_OPEN_FAILED.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int serprobe_add_candidates(struct serprobe *s) {
+	static const char *patterns[] = { "/dev/ttyUSB*", "/dev/ttyACM*", "/dev/ttyS*" };
+	glob_t gl;
+	size_t j;
+	int i;
+
+	for (i = 0; i < (int)(sizeof(patterns) / sizeof(patterns[0])); i++) {
+		if (glob(patterns[i], 0, NULL, &gl) != 0) continue;
+		for (j = 0; j < gl.gl_pathc; j++) serprobe_add(s, gl.gl_pathv[j]);
+		globfree(&gl);
+	}
+
+	return s->count;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-182051
+  Function Name	: port_setting
+  Returns Type	: int
+  ----Parameter List
+  1. struct serprobe *s,
+  2. struct serprobe_port *p,
+  3. uint32_t window_ms ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = couldn't configure the port (errno set)
+  Side Effects	: restarts the port's framer and window
+  --------------------------------------------------------------------
+Comments:
+	With INPCK (and neither IGNPAR nor PARMRK) a byte with a parity
+	error reads as \0, which no frame survives
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int port_setting(struct serprobe *s, struct serprobe_port *p, uint32_t window_ms) {
+	const struct serial_params *sp = &(s->setting[p->setting]);
+	struct termios tio;
+
+	if (serial_set_params(p->fd, sp, s->proto->frame_size) != 0) return -1;
+	if (sp->parity != 'n') {
+		if (tcgetattr(p->fd, &tio) != 0) return -1;
+		tio.c_iflag |= INPCK;
+		tio.c_iflag &= ~(IGNPAR | PARMRK);
+		if (tcsetattr(p->fd, TCSANOW, &tio) != 0) return -1;
+	}
+
+	framer_init(&(p->fr));
+	framer_protocol(&(p->fr), s->proto);
+	p->frames = 0;
+	p->malformed = 0;
+	p->deadline_ns = timebase_now_ns() + (uint64_t)window_ms * 1000000ULL;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-182105
+  Function Name	: port_done
+  Returns Type	: void
+  ----Parameter List
+  1. struct serprobe_port *p,
+  2. int state, SERPROBE_* ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: closes the port, which also takes it out of epoll
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void port_done(struct serprobe_port *p, int state) {
+	if (state == SERPROBE_OPEN_FAILED) p->err = errno;
+	if (p->fd >= 0) close(p->fd);
+	p->fd = -1;
+	p->state = state;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-182119
+  Function Name	: serprobe_run
+  Returns Type	: int
+  ----Parameter List
+  1. struct serprobe *s,
+  2. uint32_t window_ms, per setting
+  3. int stop_at_first, finish as soon as any port matches ,
+  ------------------
+  Exit Codes	: ports matched, -1 on error or interrupted (errno set)
+  Side Effects	: every port is closed again on return
+  --------------------------------------------------------------------
+Comments:
+	Matched ports have state SERPROBE_MATCH and their settings in
+	sp.  A port is given the whole window at a setting unless it
+	matches, garbage at the wrong speed doesn't end it early, as the
+	meter may simply not have sent yet.
+
+	A port that receives nothing at all for a window has nothing
+	sending to it; the wrong speed or parity still delivers bytes,
+	if only framing errors, so it's given up on without trying the
+	other settings.  Probing all the ports takes a single window
+	unless a port has something on it.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int serprobe_run(struct serprobe *s, uint32_t window_ms, int stop_at_first) {
+	struct epoll_event ev, events[SERPROBE_PORTS_MAX];
+	int epoll_fd, active, i, n, ret = 0;	// ret, errno if epoll_wait() failed
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0) return -1;
+
+	active = 0;
+	for (i = 0; i < s->count; i++) {
+		struct serprobe_port *p = &(s->p[i]);
+
+		p->setting = 0;
+		p->fd = open(p->device, O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+		if ((p->fd < 0) || (port_setting(s, p, window_ms) != 0)) {
+			port_done(p, SERPROBE_OPEN_FAILED);
+			continue;
+		}
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = p;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, p->fd, &ev) != 0) {
+			port_done(p, SERPROBE_OPEN_FAILED);
+			continue;
+		}
+		active++;
+	}
+
+	while (active && !(stop_at_first && s->matches)) {
+		uint64_t now, next = UINT64_MAX;
+		int timeout_ms;
+
+		now = timebase_now_ns();
+		for (i = 0; i < s->count; i++) {
+			if ((s->p[i].state == SERPROBE_PROBING) && (s->p[i].deadline_ns < next)) next = s->p[i].deadline_ns;
+		}
+		timeout_ms = (next > now) ? (int)((next - now + 999999) / 1000000) : 0;
+
+		n = epoll_wait(epoll_fd, events, SERPROBE_PORTS_MAX, timeout_ms);
+		if (n < 0) {
+			ret = errno;
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			struct serprobe_port *p = events[i].data.ptr;
+			uint8_t d[BK390A_PAYLOAD_MAX];
+			struct bk390a_reading r;
+			uint8_t *wp;
+			size_t wlen;
+			ssize_t bytes_read;
+			uint64_t t_ns;
+
+			if (p->state != SERPROBE_PROBING) continue;
+
+			wp = framer_write_ptr(&(p->fr), &wlen);
+			bytes_read = read(p->fd, wp, wlen);
+			if (bytes_read <= 0) {
+				if ((bytes_read < 0) && (errno == EAGAIN)) continue;
+				if (bytes_read == 0) errno = EIO;
+				port_done(p, SERPROBE_OPEN_FAILED);
+				active--;
+				continue;
+			}
+			framer_commit(&(p->fr), bytes_read, timebase_now_ns());
+
+			while (framer_next(&(p->fr), d, &t_ns)) {
+				if (p->fr.frames_malformed != p->malformed) {
+					p->malformed = p->fr.frames_malformed;
+					p->frames = 0;
+				}
+				if (s->proto->decode(d, &r) == 0) p->frames++;
+				else p->frames = 0;
+
+				if (p->frames >= SERPROBE_FRAMES) {
+					p->sp = s->setting[p->setting];
+					port_done(p, SERPROBE_MATCH);
+					s->matches++;
+					active--;
+					break;
+				}
+			}
+		}
+
+		/*
+		 * Window's up, on to the next setting
+		 */
+		now = timebase_now_ns();
+		for (i = 0; i < s->count; i++) {
+			struct serprobe_port *p = &(s->p[i]);
+
+			if ((p->state != SERPROBE_PROBING) || (p->fd < 0) || (now < p->deadline_ns)) continue;
+
+			p->setting++;
+			if ((p->setting >= s->settings) || (p->fr.bytes == 0)) {
+				port_done(p, SERPROBE_NO_MATCH);
+				active--;
+			} else if (port_setting(s, p, window_ms) != 0) {
+				port_done(p, SERPROBE_OPEN_FAILED);
+				active--;
+			}
+		}
+	}
+
+	for (i = 0; i < s->count; i++) {
+		if (s->p[i].fd >= 0) {
+			close(s->p[i].fd);
+			s->p[i].fd = -1;
+		}
+	}
+	close(epoll_fd);
+
+	if (ret) {
+		errno = ret;
+		return -1;
+	}
+
+	return s->matches;
+}
@@ -0,0 +1,74 @@
+/*
+ * Serial port auto-detection (Linux)
+ *
+ * Finds the port(s) a 390A is talking on, and at what settings, by
+ * listening for its frames.  Every candidate port is opened at once and
+ * watched from a single epoll loop, so the probe takes as long as the
+ * slowest port rather than the sum of them.
+ *
+ * Each port steps through the settings on its own; the -s (or default)
+ * settings first, then every supported speed with 7o1, 7e1 and 8n1.  A
+ * port that shows SERPROBE_FRAMES well formed, decodable frames in a row
+ * within the window matches; otherwise it moves on to the next setting,
+ * unless nothing at all was received, when it's given up on.
+ * Parity is checked while probing, so a stream at the right speed but
+ * the wrong parity doesn't frame.
+ *
+ * Only receiving is involved, the meter is never written to.  The
+ * frames listened for are the 390A's unless serprobe.proto is set
+ * after serprobe_init().
+ *
+ */
+#ifndef __BK390A_SERPROBE_H__
+#define __BK390A_SERPROBE_H__
+
+#include <stdint.h>
+#include "framer.h"
+#include "serial.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SERPROBE_PORTS_MAX 64
+#define SERPROBE_SETTINGS_MAX 16
+#define SERPROBE_DEFAULT_WINDOW_MS 2000	// per setting, a few frames at the meter's ~2.5/s
+#define SERPROBE_FRAMES 2				// good frames in a row to call it a meter
+
+#define SERPROBE_PROBING 0
+#define SERPROBE_MATCH 1
+#define SERPROBE_NO_MATCH 2
+#define SERPROBE_OPEN_FAILED 3
+
+struct serprobe_port {
+	char device[256];
+	int fd;
+	int state;					// SERPROBE_*
+	int err;					// errno, SERPROBE_OPEN_FAILED
+	int setting;				// index in to serprobe settings[]
+	int frames;					// good frames in a row at this setting
+	uint64_t malformed;			// framer's count when the run started
+	uint64_t deadline_ns;
+	struct serial_params sp;	// the match, SERPROBE_MATCH
+	struct framer fr;
+};
+
+struct serprobe {
+	const struct proto *proto;	// frames to listen for
+	int count;
+	int matches;
+	int settings;
+	struct serial_params setting[SERPROBE_SETTINGS_MAX];
+	struct serprobe_port p[SERPROBE_PORTS_MAX];
+};
+
+void serprobe_init(struct serprobe *s, const struct serial_params *first);
+int serprobe_add(struct serprobe *s, const char *device);
+int serprobe_add_candidates(struct serprobe *s);
+int serprobe_run(struct serprobe *s, uint32_t window_ms, int stop_at_first);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ * Latest reading shared memory segment
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "shmpub.h"
+#include "timebase.h"
+
+typedef char shmpub_header_size_check[(sizeof(struct shmpub_header) == 64) ? 1 : -1];
+typedef char shmpub_slot_size_check[(sizeof(struct shmpub_slot) == 64) ? 1 : -1];
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-134110
+  Function Name	: shmpub_map
+  Returns Type	: static int
+  ----Parameter List
+  1. struct shmpub *sp,
+  2. const char *name,
+  3. size_t size, 0 = existing segment, use its size
+  4. int create,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = couldn't create/open/map
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Windows mapping names can't start with '/', and are made
+	Local\ so they don't need any privileges
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static int shmpub_map(struct shmpub *sp, const char *name, size_t size, int create) {
+#ifdef _WIN32
+	char wname[300];
+	HANDLE h;
+	void *p;
+
+	snprintf(wname, sizeof(wname), "Local\\%s", (name[0] == '/') ? name +1 : name);
+	if (create) {
+		h = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)size, wname);
+	} else {
+		h = OpenFileMappingA(FILE_MAP_READ, FALSE, wname);
+	}
+	if (h == NULL) return -1;
+
+	p = MapViewOfFile(h, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size);
+	if (p == NULL) {
+		CloseHandle(h);
+		return -1;
+	}
+	if (size == 0) {
+		MEMORY_BASIC_INFORMATION mbi;
+
+		VirtualQuery(p, &mbi, sizeof(mbi));
+		size = mbi.RegionSize;
+	}
+	sp->handle = h;
+#else
+	int fd;
+	void *p;
+
+	fd = shm_open(name, create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+	if (fd < 0) return -1;
+
+	if (create) {
+		if (ftruncate(fd, size) != 0) {
+			close(fd);
+			shm_unlink(name);
+			return -1;
+		}
+	} else {
+		struct stat st;
+
+		if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(struct shmpub_header))) {
+			close(fd);
+			return -1;
+		}
+		size = st.st_size;
+	}
+
+	p = mmap(NULL, size, create ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		if (create) shm_unlink(name);
+		return -1;
+	}
+#endif
+
+	sp->h = (struct shmpub_header *)p;
+	sp->s = (struct shmpub_slot *)((uint8_t *)p + sizeof(struct shmpub_header));
+	sp->size = size;
+	snprintf(sp->name, sizeof(sp->name), "%s", name);
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-134125
+  Function Name	: shmpub_open
+  Returns Type	: int
+  ----Parameter List
+  1. struct shmpub *sp,
+  2. const char *name, segment name, eg /bk390a
+  3. int slots, one per meter
+  ------------------
+  Exit Codes	: 0 = ok, -1 = couldn't create the segment
+  Side Effects	: replaces any segment of the same name
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int shmpub_open(struct shmpub *sp, const char *name, int slots) {
+	size_t size;
+
+	memset(sp, 0, sizeof(struct shmpub));
+	if ((slots < 1) || (slots > SHMPUB_SLOTS_MAX)) return -1;
+
+	size = sizeof(struct shmpub_header) + slots * sizeof(struct shmpub_slot);
+	if (shmpub_map(sp, name, size, 1) != 0) {
+		sp->h = NULL;
+		return -1;
+	}
+	sp->owner = 1;
+
+	memset(sp->h, 0, size);
+	sp->h->version = SHMPUB_VERSION;
+	sp->h->header_size = sizeof(struct shmpub_header);
+	sp->h->slot_size = sizeof(struct shmpub_slot);
+	sp->h->slots = slots;
+#ifdef _WIN32
+	sp->h->pid = GetCurrentProcessId();
+#else
+	sp->h->pid = getpid();
+#endif
+	sp->h->running = 1;
+
+	/*
+	 * Magic last, readers ignore the segment until it's there
+	 */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(sp->h->magic, SHMPUB_MAGIC, sizeof(sp->h->magic));
+
+	timebase_anchor(&(sp->anchor));
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-134140
+  Function Name	: shmpub_update
+  Returns Type	: void
+  ----Parameter List
+  1. struct shmpub *sp,
+  2. int slot,
+  3. uint8_t meter, meter id
+  4. uint64_t t_ns, monotonic time stamp of the frame
+  5. const struct bk390a_reading *r, decoded frame
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Never waits; there's only one writer per slot.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void shmpub_update(struct shmpub *sp, int slot, uint8_t meter, uint64_t t_ns, const struct bk390a_reading *r) {
+	struct shmpub_slot *s;
+	uint32_t seq;
+
+	if ((sp->h == NULL) || (slot < 0) || (slot >= sp->h->slots)) return;
+
+	s = &(sp->s[slot]);
+	seq = s->seq;
+	__atomic_store_n(&(s->seq), seq +1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	s->meter = meter;
+	s->mode = r->mode;
+	s->unit = r->unit;
+	s->status = r->status;
+	s->value = bk390a_value(r);
+	s->count = r->count;
+	s->dps = r->dps;
+	s->si_exp = r->si_exp;
+	s->option1 = r->option1;
+	s->option2 = r->option2;
+	s->t_ns = t_ns;
+	s->wall_ns = timebase_to_wall(&(sp->anchor), t_ns);
+	s->readings++;
+
+	__atomic_store_n(&(s->seq), seq +2, __ATOMIC_RELEASE);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-134155
+  Function Name	: shmpub_close
+  Returns Type	: void
+  ----Parameter List
+  1. struct shmpub *sp ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: the publisher removes the segment name, readers
+				  that are attached keep their mapping
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void shmpub_close(struct shmpub *sp) {
+	if (sp->h == NULL) return;
+
+	if (sp->owner) __atomic_store_n(&(sp->h->running), 0, __ATOMIC_RELEASE);
+
+#ifdef _WIN32
+	UnmapViewOfFile(sp->h);
+	CloseHandle(sp->handle);
+#else
+	munmap(sp->h, sp->size);
+	if (sp->owner) shm_unlink(sp->name);
+#endif
+	sp->h = NULL;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-134210
+  Function Name	: shmpub_attach
+  Returns Type	: int
+  ----Parameter List
+  1. struct shmpub *sp,
+  2. const char *name ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = no such segment, -2 = not a compatible segment
+  Side Effects	: maps the segment read only
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int shmpub_attach(struct shmpub *sp, const char *name) {
+	memset(sp, 0, sizeof(struct shmpub));
+
+	if (shmpub_map(sp, name, 0, 0) != 0) {
+		sp->h = NULL;
+		return -1;
+	}
+
+	if ((memcmp(sp->h->magic, SHMPUB_MAGIC, sizeof(sp->h->magic)) != 0)
+			|| (sp->h->version != SHMPUB_VERSION)
+			|| (sp->h->slot_size != sizeof(struct shmpub_slot))
+			|| (sizeof(struct shmpub_header) + (size_t)sp->h->slots * sizeof(struct shmpub_slot) > sp->size)) {
+		shmpub_close(sp);
+		return -2;
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-134225
+  Function Name	: shmpub_read
+  Returns Type	: int
+  ----Parameter List
+  1. const struct shmpub *sp,
+  2. int slot,
+  3. struct shmpub_slot *out, consistent copy of the slot
+  ------------------
+  Exit Codes	: 0 = ok, -1 = no such slot, -2 = kept changing
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int shmpub_read(const struct shmpub *sp, int slot, struct shmpub_slot *out) {
+	const struct shmpub_slot *s;
+	uint32_t seq0, seq1;
+	int i;
+
+	if ((sp->h == NULL) || (slot < 0) || (slot >= sp->h->slots)) return -1;
+	s = &(sp->s[slot]);
+
+	for (i = 0; i < SHMPUB_RETRIES; i++) {
+		seq0 = __atomic_load_n(&(s->seq), __ATOMIC_ACQUIRE);
+		if (seq0 & 1) continue;
+
+		memcpy(out, s, sizeof(struct shmpub_slot));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq1 = __atomic_load_n(&(s->seq), __ATOMIC_RELAXED);
+		if (seq0 == seq1) {
+			out->seq = seq0;
+			return 0;
+		}
+	}
+
+	return -2;
+}
@@ -0,0 +1,84 @@
+/*
+ * Latest reading shared memory segment
+ *
+ * The capture process publishes each meter's latest decoded reading
+ * in to a named shared memory segment (shm_open() on Linux, a named
+ * file mapping on Windows); a header followed by one 64 byte slot
+ * per meter.  Each slot is guarded by a seqlock, the writer makes
+ * the sequence number odd while it updates the slot and even again
+ * afterwards, so any number of readers can sample it without locks
+ * and without ever holding up the acquisition loop; a reader that
+ * sees an odd or changed sequence number just tries again.
+ *
+ */
+#ifndef __BK390A_SHMPUB_H__
+#define __BK390A_SHMPUB_H__
+
+#include <stdint.h>
+#include "decode.h"
+#include "timebase.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHMPUB_MAGIC "BK390SHM"
+#define SHMPUB_VERSION 1
+#define SHMPUB_DEFAULT_NAME "/bk390a"
+#define SHMPUB_SLOTS_MAX 256
+#define SHMPUB_RETRIES 1000		// reader attempts before giving up on a slot
+
+struct shmpub_header {
+	char magic[8];
+	uint16_t version;
+	uint16_t header_size;
+	uint16_t slot_size;
+	uint16_t slots;
+	uint32_t pid;			// publishing process
+	uint32_t running;		// 0 once the publisher has gone
+	uint8_t reserved[40];
+};
+
+struct shmpub_slot {
+	uint32_t seq;			// seqlock, odd while being written
+	uint8_t meter;			// meter id
+	uint8_t mode;			// enum bk390a_mode
+	uint8_t unit;			// enum bk390a_unit
+	uint8_t status;			// STATUS_* bits
+	double value;			// SI base units
+	int16_t count;			// display count and
+	int8_t dps;				// decimal places and
+	int8_t si_exp;			// prefix, for exact display
+	uint8_t option1;
+	uint8_t option2;
+	uint8_t reserved[2];
+	uint64_t t_ns;			// monotonic time stamp
+	int64_t wall_ns;		// Unix epoch ns
+	uint64_t readings;		// readings published in to this slot
+	uint8_t pad[16];
+};
+
+struct shmpub {
+	struct shmpub_header *h;
+	struct shmpub_slot *s;
+	size_t size;
+	char name[256];
+	int owner;				// we created it, remove it on close
+	struct timebase_anchor anchor;
+#ifdef _WIN32
+	void *handle;
+#endif
+};
+
+int shmpub_open(struct shmpub *sp, const char *name, int slots);
+void shmpub_update(struct shmpub *sp, int slot, uint8_t meter, uint64_t t_ns, const struct bk390a_reading *r);
+void shmpub_close(struct shmpub *sp);
+
+int shmpub_attach(struct shmpub *sp, const char *name);
+int shmpub_read(const struct shmpub *sp, int slot, struct shmpub_slot *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
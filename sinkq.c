@@ -0,0 +1,406 @@
+/*
+ * Bounded lock-free single producer / single consumer reading queue
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+#include "sinkq.h"
+#include "timebase.h"
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-141010
+  Function Name	: sinkq_sleep_us
+  Returns Type	: static void
+  ----Parameter List
+  1. uint32_t us ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void sinkq_sleep_us(uint32_t us) {
+#ifdef _WIN32
+	Sleep((us +999) / 1000);
+#else
+	struct timespec ts;
+
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-141015
+  Function Name	: sinkq_wake
+  Returns Type	: static void
+  ----Parameter List
+  1. struct sinkq *q ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: releases a parked consumer
+  --------------------------------------------------------------------
+Comments:
+	The wakeup is latched, so one sent between the consumer
+	deciding to park and it waiting isn't lost.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void sinkq_wake(struct sinkq *q) {
+#ifdef _WIN32
+	SetEvent(q->wake);
+#else
+	pthread_mutex_lock(&(q->lock));
+	q->wake = 1;
+	pthread_cond_signal(&(q->cond));
+	pthread_mutex_unlock(&(q->lock));
+#endif
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-141018
+  Function Name	: sinkq_park
+  Returns Type	: static void
+  ----Parameter List
+  1. struct sinkq *q ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: blocks the consumer thread
+  --------------------------------------------------------------------
+Comments:
+	Consumer side only.  parked is set before the queue is looked
+	at again, and sinkq_push() publishes head before it looks at
+	parked, so either we see the new reading or the producer sees
+	us parked and wakes us.  Waits no longer than tick_ns.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void sinkq_park(struct sinkq *q) {
+	__atomic_store_n(&(q->parked), 1, __ATOMIC_SEQ_CST);
+
+	if ((__atomic_load_n(&(q->head), __ATOMIC_SEQ_CST) == q->tail)
+			&& !__atomic_load_n(&(q->stop), __ATOMIC_SEQ_CST)) {
+#ifdef _WIN32
+		DWORD ms = INFINITE;
+
+		if (q->tick_ns) {
+			uint64_t now = timebase_now_ns();
+
+			ms = (q->tick_ns > now) ? (DWORD)((q->tick_ns - now + 999999) / 1000000) : 0;
+		}
+		WaitForSingleObject(q->wake, ms);
+#else
+		struct timespec ts;
+		int r = 0;
+
+		if (q->tick_ns) {
+			ts.tv_sec = q->tick_ns / 1000000000ULL;
+			ts.tv_nsec = q->tick_ns % 1000000000ULL;
+		}
+		pthread_mutex_lock(&(q->lock));
+		while (!q->wake && (r == 0)) {
+			if (q->tick_ns) r = pthread_cond_timedwait(&(q->cond), &(q->lock), &ts);
+			else pthread_cond_wait(&(q->cond), &(q->lock));
+		}
+		q->wake = 0;
+		pthread_mutex_unlock(&(q->lock));
+#endif
+	}
+
+	__atomic_store_n(&(q->parked), 0, __ATOMIC_RELAXED);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-141022
+  Function Name	: sinkq_init
+  Returns Type	: int
+  ----Parameter List
+  1. struct sinkq *q,
+  2. const char *name, for the statistics
+  3. uint32_t size, slots, rounded up to a power of two
+  4. int policy, SINKQ_DROP_OLDEST or SINKQ_BLOCK
+  ------------------
+  Exit Codes	: 0 = ok, -1 = no memory
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int sinkq_init(struct sinkq *q, const char *name, uint32_t size, int policy) {
+	memset(q, 0, sizeof(struct sinkq));
+
+	q->size = 2;
+	while (q->size < size) q->size <<= 1;
+	q->mask = q->size -1;
+	q->name = name;
+	q->policy = policy;
+
+	q->slots = (struct sinkq_slot *)calloc(q->size, sizeof(struct sinkq_slot));
+	if (q->slots == NULL) return -1;
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-141035
+  Function Name	: sinkq_push
+  Returns Type	: void
+  ----Parameter List
+  1. struct sinkq *q,
+  2. const struct sinkq_event *e ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: SINKQ_BLOCK may wait for the consumer
+  --------------------------------------------------------------------
+Comments:
+	Producer side only.  Wakes the consumer thread if it's parked.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void sinkq_push(struct sinkq *q, const struct sinkq_event *e) {
+	uint64_t h = q->head;
+	struct sinkq_slot *slot;
+
+	if (q->slots == NULL) return;
+
+	if (q->policy == SINKQ_BLOCK) {
+		if (h - __atomic_load_n(&(q->tail), __ATOMIC_ACQUIRE) >= q->size) {
+			q->waits++;
+			while ((h - __atomic_load_n(&(q->tail), __ATOMIC_ACQUIRE) >= q->size)
+					&& __atomic_load_n(&(q->running), __ATOMIC_ACQUIRE)) {
+				sinkq_sleep_us(100);
+			}
+		}
+	}
+
+	slot = &(q->slots[h & q->mask]);
+	__atomic_store_n(&(slot->seq), 2*h +1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(&(slot->e), e, sizeof(struct sinkq_event));
+	__atomic_store_n(&(slot->seq), 2*h +2, __ATOMIC_RELEASE);
+
+	__atomic_store_n(&(q->head), h +1, __ATOMIC_SEQ_CST);
+	q->pushed++;
+
+	if (__atomic_load_n(&(q->parked), __ATOMIC_SEQ_CST)) sinkq_wake(q);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-141050
+  Function Name	: sinkq_pop
+  Returns Type	: int
+  ----Parameter List
+  1. struct sinkq *q,
+  2. struct sinkq_event *e ,
+  ------------------
+  Exit Codes	: 1 = got a reading, 0 = queue empty
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Consumer side only.  If the producer has lapped us the slot's
+	sequence number is newer than the one we want; skip forward to
+	the oldest slot the producer can't be writing.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int sinkq_pop(struct sinkq *q, struct sinkq_event *e) {
+	uint64_t c = q->tail;
+	uint64_t s0, s1, h;
+	struct sinkq_slot *slot;
+
+	if (q->slots == NULL) return 0;
+
+	while (1) {
+		slot = &(q->slots[c & q->mask]);
+		s0 = __atomic_load_n(&(slot->seq), __ATOMIC_ACQUIRE);
+		if (s0 < 2*c +2) return 0;
+
+		if (s0 == 2*c +2) {
+			memcpy(e, &(slot->e), sizeof(struct sinkq_event));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			s1 = __atomic_load_n(&(slot->seq), __ATOMIC_RELAXED);
+			if (s1 == s0) {
+				__atomic_store_n(&(q->tail), c +1, __ATOMIC_RELEASE);
+				q->consumed++;
+				return 1;
+			}
+		}
+
+		/*
+		 * Lapped
+		 */
+		h = __atomic_load_n(&(q->head), __ATOMIC_ACQUIRE);
+		if ((h +1 > q->size) && (h - q->size +1 > c)) {
+			q->overflows += (h - q->size +1) - c;
+			c = h - q->size +1;
+			__atomic_store_n(&(q->tail), c, __ATOMIC_RELEASE);
+		}
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-141105
+  Function Name	: sinkq_thread
+  Returns Type	: static
+  ----Parameter List
+  1. void *arg, struct sinkq
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Consumes until told to stop, then drains what's left, parking
+	whenever the queue is empty.  fn gets a SINKQ_TICK when the
+	tick_ns it set comes round.  The time
+	from each reading's arrival to its output returning goes in to
+	the queue's latency histogram, unless the queue is untimed.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+#ifdef _WIN32
+static DWORD WINAPI sinkq_thread(LPVOID arg) {
+#else
+static void *sinkq_thread(void *arg) {
+#endif
+	struct sinkq *q = (struct sinkq *)arg;
+	struct sinkq_event e;
+
+	while (1) {
+		if (q->tick_ns && (timebase_now_ns() >= q->tick_ns)) {
+			q->tick_ns = 0;
+			e.type = SINKQ_TICK;
+			e.t_ns = timebase_now_ns();
+			q->fn(q->ctx, &e);
+		}
+		if (sinkq_pop(q, &e)) {
+			q->fn(q->ctx, &e);
+			if ((e.type == SINKQ_READING) && !q->untimed) metrics_hist_record(&(q->latency), timebase_now_ns() - e.t_ns);
+			continue;
+		}
+		if (__atomic_load_n(&(q->stop), __ATOMIC_ACQUIRE)) break;
+		sinkq_park(q);
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-141120
+  Function Name	: sinkq_start
+  Returns Type	: int
+  ----Parameter List
+  1. struct sinkq *q,
+  2. sinkq_fn fn, called on the consumer thread for every reading
+  3. void *ctx ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = couldn't start the thread
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Queues can also be consumed without a thread, with sinkq_pop()
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int sinkq_start(struct sinkq *q, sinkq_fn fn, void *ctx) {
+#ifndef _WIN32
+	pthread_condattr_t ca;
+#endif
+
+	if (q->slots == NULL) return -1;
+
+	q->fn = fn;
+	q->ctx = ctx;
+	q->stop = 0;
+	q->parked = 0;
+	q->running = 1;
+
+#ifdef _WIN32
+	q->wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (q->wake == NULL) {
+		q->running = 0;
+		return -1;
+	}
+	q->thread = CreateThread(NULL, 0, sinkq_thread, q, 0, NULL);
+	if (q->thread == NULL) {
+		CloseHandle(q->wake);
+#else
+	q->wake = 0;
+	pthread_mutex_init(&(q->lock), NULL);
+	pthread_condattr_init(&ca);
+	pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);	// tick_ns is timebase_now_ns()
+	pthread_cond_init(&(q->cond), &ca);
+	pthread_condattr_destroy(&ca);
+	if (pthread_create(&(q->thread), NULL, sinkq_thread, q) != 0) {
+		pthread_cond_destroy(&(q->cond));
+		pthread_mutex_destroy(&(q->lock));
+#endif
+		q->running = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-141135
+  Function Name	: sinkq_stop
+  Returns Type	: void
+  ----Parameter List
+  1. struct sinkq *q ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: waits for the consumer to finish what's queued
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void sinkq_stop(struct sinkq *q) {
+	if (q->running) {
+		__atomic_store_n(&(q->stop), 1, __ATOMIC_SEQ_CST);
+		sinkq_wake(q);
+#ifdef _WIN32
+		WaitForSingleObject(q->thread, INFINITE);
+		CloseHandle(q->thread);
+		CloseHandle(q->wake);
+#else
+		pthread_join(q->thread, NULL);
+		pthread_cond_destroy(&(q->cond));
+		pthread_mutex_destroy(&(q->lock));
+#endif
+		__atomic_store_n(&(q->running), 0, __ATOMIC_RELEASE);
+	}
+
+	free(q->slots);
+	q->slots = NULL;
+}
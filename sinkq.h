@@ -0,0 +1,114 @@
+/*
+ * Bounded lock-free single producer / single consumer reading queue
+ *
+ * The acquisition loop pushes each decoded reading in to one queue
+ * per output (log, OBS file, display...) and each output consumes
+ * its queue on its own thread, so a slow disk flush or repaint never
+ * delays reading the next frame.
+ *
+ * Every slot carries a sequence number, odd while the producer is
+ * writing it.  With SINKQ_DROP_OLDEST the producer never waits; when
+ * it laps a slow consumer the consumer notices the newer sequence
+ * number, skips to the oldest reading still in the queue and counts
+ * what it missed as overflows.  With SINKQ_BLOCK the producer waits
+ * for space instead (and counts the waits).
+ *
+ * A consumer thread that finds its queue empty parks until the
+ * producer wakes it; the producer only pays for the wakeup when the
+ * consumer is actually parked.  An output with time based work (a
+ * flush interval) sets tick_ns and is handed a SINKQ_TICK then, queue
+ * empty or not.
+ *
+ */
+#ifndef __BK390A_SINKQ_H__
+#define __BK390A_SINKQ_H__
+
+#include <stdint.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include "decode.h"
+#include "metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SINKQ_DEFAULT_SIZE 1024	// slots, power of two
+
+#define SINKQ_DROP_OLDEST 0
+#define SINKQ_BLOCK 1
+
+/*
+ * Event types
+ */
+#define SINKQ_READING 0
+#define SINKQ_NO_COMMS 1	// outage; the serial port was lost or stalled at t_ns
+#define SINKQ_COMMS_BACK 2	// outage over, the first frame since arrived at t_ns
+#define SINKQ_TICK 3		// consumer thread only, the queue's tick_ns has come; t_ns is now
+
+struct sinkq_event {
+	uint64_t t_ns;			// monotonic time stamp
+	uint8_t type;
+	uint8_t meter;
+	uint8_t cause;			// SINKQ_NO_COMMS, RECONN_LOST or RECONN_STALLED
+	uint64_t since_ns;		// SINKQ_COMMS_BACK, when the outage started
+	uint8_t raw[BK390A_PAYLOAD_MAX];
+	struct bk390a_reading r;
+};
+
+struct sinkq_slot {
+	uint64_t seq;			// 2n+1 while reading n is written, 2n+2 once it's there
+	struct sinkq_event e;
+};
+
+typedef void (*sinkq_fn)(void *ctx, const struct sinkq_event *e);
+
+struct sinkq {
+	const char *name;
+	struct sinkq_slot *slots;
+	uint32_t size;
+	uint32_t mask;
+	int policy;
+
+	/*
+	 * Producer and consumer positions on their own cache lines
+	 */
+	uint64_t head __attribute__((aligned(64)));
+	uint64_t pushed;
+	uint64_t waits;			// SINKQ_BLOCK, times the producer found the queue full
+
+	uint64_t tail __attribute__((aligned(64)));
+	uint64_t consumed;
+	uint64_t overflows;		// SINKQ_DROP_OLDEST, readings the consumer missed
+	struct metrics_hist latency;	// frame arrival to the output being done with it
+	int untimed;			// stamps aren't the monotonic clock's (a fast replay), no latency
+	int parked;			// consumer thread is waiting for a push
+	uint64_t tick_ns;		// monotonic, when fn next wants a SINKQ_TICK, 0 = never; fn sets it
+
+	int stop __attribute__((aligned(64)));
+	int running;
+	sinkq_fn fn;
+	void *ctx;
+#ifdef _WIN32
+	void *thread;
+	void *wake;			// auto-reset event
+#else
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int wake;			// set under lock, cleared by the consumer
+#endif
+};
+
+int sinkq_init(struct sinkq *q, const char *name, uint32_t size, int policy);
+void sinkq_push(struct sinkq *q, const struct sinkq_event *e);
+int sinkq_pop(struct sinkq *q, struct sinkq_event *e);
+int sinkq_start(struct sinkq *q, sinkq_fn fn, void *ctx);
+void sinkq_stop(struct sinkq *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,375 @@
+/*
+ * Streaming reading statistics
+ *
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "stats.h"
+
+const uint64_t stats_window_ns[STATS_WINDOWS] = { 1000000000ULL, 10000000000ULL, 60000000000ULL };
+const char *stats_window_str[STATS_WINDOWS] = { "1s", "10s", "1m" };
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-144010
+  Function Name	: stats_window_reset
+  Returns Type	: static void
+  ----Parameter List
+  1. struct stats *s ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+static void stats_window_reset(struct stats *s) {
+	int w, i;
+
+	for (w = 0; w < STATS_WINDOWS; w++) {
+		s->w[w].bucket_ns = stats_window_ns[w] / STATS_BUCKETS;
+		for (i = 0; i < STATS_BUCKETS; i++) {
+			s->w[w].id[i] = UINT64_MAX;
+			memset(&(s->w[w].b[i]), 0, sizeof(struct stats_acc));
+		}
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-144022
+  Function Name	: stats_init
+  Returns Type	: void
+  ----Parameter List
+  1. struct stats *s,
+  2. uint8_t meter, meter id
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void stats_init(struct stats *s, uint8_t meter) {
+	memset(s, 0, sizeof(struct stats));
+	s->meter = meter;
+	s->unit = BK390A_UNIT_NONE;
+	stats_window_reset(s);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-144035
+  Function Name	: stats_acc_add
+  Returns Type	: void
+  ----Parameter List
+  1. struct stats_acc *a,
+  2. double v ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Welford's update
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void stats_acc_add(struct stats_acc *a, double v) {
+	double delta;
+
+	if (a->n == 0) {
+		a->n = 1;
+		a->mean = a->min = a->max = v;
+		a->m2 = 0.0;
+		return;
+	}
+
+	a->n++;
+	delta = v - a->mean;
+	a->mean += delta / a->n;
+	a->m2 += delta * (v - a->mean);
+	if (v < a->min) a->min = v;
+	if (v > a->max) a->max = v;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-144048
+  Function Name	: stats_acc_merge
+  Returns Type	: void
+  ----Parameter List
+  1. struct stats_acc *a, accumulates b
+  2. const struct stats_acc *b ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void stats_acc_merge(struct stats_acc *a, const struct stats_acc *b) {
+	double delta;
+	uint64_t n;
+
+	if (b->n == 0) return;
+	if (a->n == 0) {
+		*a = *b;
+		return;
+	}
+
+	n = a->n + b->n;
+	delta = b->mean - a->mean;
+	a->mean += delta * b->n / n;
+	a->m2 += b->m2 + delta * delta * ((double)a->n * b->n / n);
+	a->n = n;
+	if (b->min < a->min) a->min = b->min;
+	if (b->max > a->max) a->max = b->max;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-144100
+  Function Name	: stats_acc_stddev
+  Returns Type	: double
+  ----Parameter List
+  1. const struct stats_acc *a ,
+  ------------------
+  Exit Codes	: sample standard deviation, 0 for < 2 samples
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+double stats_acc_stddev(const struct stats_acc *a) {
+	if (a->n < 2) return 0.0;
+	return sqrt(a->m2 / (a->n -1));
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-144112
+  Function Name	: stats_add
+  Returns Type	: void
+  ----Parameter List
+  1. struct stats *s,
+  2. uint64_t t_ns, monotonic time stamp of the reading
+  3. const struct bk390a_reading *r ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void stats_add(struct stats *s, uint64_t t_ns, const struct bk390a_reading *r) {
+	double v;
+	int w;
+
+	s->readings++;
+
+	if (r->status & STATUS_OL) {
+		s->overloads++;
+		return;
+	}
+
+	v = bk390a_value(r);
+
+	if (r->option1 & (OPTION1_PMIN | OPTION1_PMAX)) {
+		s->held++;
+		if (r->option1 & OPTION1_PMIN) { s->hw_min = v; s->hw_min_valid = 1; }
+		if (r->option1 & OPTION1_PMAX) { s->hw_max = v; s->hw_max_valid = 1; }
+		return;
+	}
+
+	if (r->unit >= BK390A_UNIT_COUNT) return;
+
+	if (r->unit != s->unit) {
+		stats_window_reset(s);
+		s->unit = r->unit;
+	}
+
+	stats_acc_add(&(s->session[r->unit]), v);
+
+	for (w = 0; w < STATS_WINDOWS; w++) {
+		struct stats_window *sw = &(s->w[w]);
+		uint64_t id = t_ns / sw->bucket_ns;
+		int i = id % STATS_BUCKETS;
+
+		if (sw->id[i] != id) {
+			sw->id[i] = id;
+			memset(&(sw->b[i]), 0, sizeof(struct stats_acc));
+		}
+		stats_acc_add(&(sw->b[i]), v);
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-144125
+  Function Name	: stats_window_get
+  Returns Type	: void
+  ----Parameter List
+  1. const struct stats *s,
+  2. int w, window index, see stats_window_str
+  3. uint64_t now_ns,
+  4. struct stats_acc *out ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Merges the buckets of the last STATS_BUCKETS bucket periods,
+	including the current, partly filled, one
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void stats_window_get(const struct stats *s, int w, uint64_t now_ns, struct stats_acc *out) {
+	const struct stats_window *sw = &(s->w[w]);
+	uint64_t now_id = now_ns / sw->bucket_ns;
+	int i;
+
+	memset(out, 0, sizeof(struct stats_acc));
+	for (i = 0; i < STATS_BUCKETS; i++) {
+		if (sw->id[i] == UINT64_MAX) continue;
+		if ((sw->id[i] > now_id) || (now_id - sw->id[i] >= STATS_BUCKETS)) continue;
+		stats_acc_merge(out, &(sw->b[i]));
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-144140
+  Function Name	: stats_write
+  Returns Type	: void
+  ----Parameter List
+  1. FILE *f,
+  2. const struct stats *s,
+  3. uint64_t now_ns ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	One line per window with samples, then the session per unit;
+
+	<meter> <window|session> <unit> <n> <mean> <stddev> <min> <max>
+
+	and a line of counts, and the meter's held MIN/MAX if any
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void stats_write(FILE *f, const struct stats *s, uint64_t now_ns) {
+	struct stats_acc a;
+	int i;
+
+	for (i = 0; i < STATS_WINDOWS; i++) {
+		stats_window_get(s, i, now_ns, &a);
+		if (a.n == 0) continue;
+		fprintf(f, "%d %s %s %llu %0.9g %0.9g %0.9g %0.9g\n"
+				, s->meter
+				, stats_window_str[i]
+				, bk390a_unit_str[s->unit]
+				, (unsigned long long)a.n
+				, a.mean
+				, stats_acc_stddev(&a)
+				, a.min
+				, a.max
+			   );
+	}
+
+	for (i = 0; i < BK390A_UNIT_COUNT; i++) {
+		a = s->session[i];
+		if (a.n == 0) continue;
+		fprintf(f, "%d session %s %llu %0.9g %0.9g %0.9g %0.9g\n"
+				, s->meter
+				, bk390a_unit_str[i]
+				, (unsigned long long)a.n
+				, a.mean
+				, stats_acc_stddev(&a)
+				, a.min
+				, a.max
+			   );
+	}
+
+	fprintf(f, "%d counts readings %llu overloads %llu held %llu\n"
+			, s->meter
+			, (unsigned long long)s->readings
+			, (unsigned long long)s->overloads
+			, (unsigned long long)s->held
+		   );
+
+	if (s->hw_min_valid || s->hw_max_valid) {
+		fprintf(f, "%d meter-hold", s->meter);
+		if (s->hw_min_valid) fprintf(f, " min %0.9g", s->hw_min);
+		if (s->hw_max_valid) fprintf(f, " max %0.9g", s->hw_max);
+		fprintf(f, "\n");
+	}
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-144155
+  Function Name	: stats_write_file
+  Returns Type	: int
+  ----Parameter List
+  1. const char *fn,
+  2. struct stats * const *s, one per meter
+  3. int count,
+  4. uint64_t now_ns ,
+  ------------------
+  Exit Codes	: 0 = ok, -1 = couldn't write
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Written to <fn>.tmp and renamed in to place so anything
+	watching the file never sees half of it
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int stats_write_file(const char *fn, struct stats * const *s, int count, uint64_t now_ns) {
+	char tmp[1024];
+	FILE *f;
+	int i, r;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", fn) >= (int)sizeof(tmp)) return -1;
+
+	f = fopen(tmp, "w");
+	if (f == NULL) return -1;
+
+	fprintf(f, "# meter window unit n mean stddev min max\n");
+	for (i = 0; i < count; i++) stats_write(f, s[i], now_ns);
+
+	r = (ferror(f) == 0);
+	if (fclose(f) != 0) r = 0;
+#ifdef _WIN32
+	if (r && (MoveFileExA(tmp, fn, MOVEFILE_REPLACE_EXISTING) == 0)) r = 0;
+#else
+	if (r && (rename(tmp, fn) != 0)) r = 0;
+#endif
+	if (!r) {
+		remove(tmp);
+		return -1;
+	}
+
+	return 0;
+}
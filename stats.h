@@ -0,0 +1,77 @@
+/*
+ * Streaming reading statistics
+ *
+ * Count, min, max, mean and variance (Welford) of the decoded values
+ * over the whole session and over sliding 1s, 10s and 1 minute
+ * windows, O(1) per reading.
+ *
+ * Each window is split in to STATS_BUCKETS time buckets, a reading
+ * only updates the current bucket and a query merges the buckets
+ * still inside the window (Chan et al.'s pairwise combination), so
+ * the window edge moves in steps of 1/STATS_BUCKETS of its width.
+ *
+ * Values are in SI base units.  The session figures are kept per unit
+ * (volts aren't averaged with ohms), the windows restart when the unit
+ * changes.  O.L. readings and the meter's own held MIN/MAX readings
+ * (OPTION1_PMIN / OPTION1_PMAX) are counted but aren't live samples;
+ * the last held values are kept separately.
+ *
+ */
+#ifndef __BK390A_STATS_H__
+#define __BK390A_STATS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include "decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STATS_WINDOWS 3
+#define STATS_BUCKETS 10
+#define STATS_WRITE_INTERVAL_NS 1000000000ULL	// live stats file refresh
+
+struct stats_acc {
+	uint64_t n;
+	double mean;
+	double m2;		// sum of squared differences from the mean
+	double min;
+	double max;
+};
+
+struct stats_window {
+	uint64_t bucket_ns;
+	uint64_t id[STATS_BUCKETS];	// t_ns / bucket_ns of what's in the bucket
+	struct stats_acc b[STATS_BUCKETS];
+};
+
+struct stats {
+	uint8_t meter;
+	uint8_t unit;			// unit of the current windows
+	uint64_t readings;
+	uint64_t overloads;		// O.L.
+	uint64_t held;			// meter MIN/MAX hold readings
+	double hw_min, hw_max;	// last held MIN and MAX
+	uint8_t hw_min_valid, hw_max_valid;
+	struct stats_acc session[BK390A_UNIT_COUNT];
+	struct stats_window w[STATS_WINDOWS];
+};
+
+extern const uint64_t stats_window_ns[STATS_WINDOWS];
+extern const char *stats_window_str[STATS_WINDOWS];
+
+void stats_init(struct stats *s, uint8_t meter);
+void stats_add(struct stats *s, uint64_t t_ns, const struct bk390a_reading *r);
+void stats_acc_add(struct stats_acc *a, double v);
+void stats_acc_merge(struct stats_acc *a, const struct stats_acc *b);
+double stats_acc_stddev(const struct stats_acc *a);
+void stats_window_get(const struct stats *s, int w, uint64_t now_ns, struct stats_acc *out);
+void stats_write(FILE *f, const struct stats *s, uint64_t now_ns);
+int stats_write_file(const char *fn, struct stats * const *s, int count, uint64_t now_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,169 @@
+/*
+ * Monotonic time base
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "timebase.h"
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-110412
+  Function Name	: timebase_now_ns
+  Returns Type	: uint64_t
+  ----Parameter List
+  1. void ,
+  ------------------
+  Exit Codes	: monotonic time in nanoseconds, arbitrary epoch
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+uint64_t timebase_now_ns(void) {
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER c;
+
+	if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&c);
+
+	return (uint64_t)(c.QuadPart / freq.QuadPart) * 1000000000ULL
+		+ (uint64_t)(c.QuadPart % freq.QuadPart) * 1000000000ULL / freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-113002
+  Function Name	: timebase_wall_ns
+  Returns Type	: int64_t
+  ----Parameter List
+  1. void ,
+  ------------------
+  Exit Codes	: wall clock time in nanoseconds since the Unix epoch
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Only used to anchor the monotonic time base to wall time once
+	per session, never for stamping readings.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int64_t timebase_wall_ns(void) {
+#ifdef _WIN32
+	FILETIME ft;
+	uint64_t t;
+
+	GetSystemTimeAsFileTime(&ft);
+	t = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+
+	/* 100ns ticks since 1601 */
+	return (int64_t)(t - 116444736000000000ULL) * 100;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-150410
+  Function Name	: timebase_anchor
+  Returns Type	: void
+  ----Parameter List
+  1. struct timebase_anchor *a ,
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	The wall clock is read between two monotonic reads and paired
+	with their midpoint, so a preemption while sampling can't skew
+	the anchor by more than half the gap.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void timebase_anchor(struct timebase_anchor *a) {
+	uint64_t t0, t1;
+
+	t0 = timebase_now_ns();
+	a->wall_ns = timebase_wall_ns();
+	t1 = timebase_now_ns();
+
+	a->t_ns = t0 + (t1 - t0) / 2;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-150422
+  Function Name	: timebase_to_wall
+  Returns Type	: int64_t
+  ----Parameter List
+  1. const struct timebase_anchor *a,
+  2. uint64_t t_ns, monotonic time stamp
+  ------------------
+  Exit Codes	: Unix epoch ns
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int64_t timebase_to_wall(const struct timebase_anchor *a, uint64_t t_ns) {
+	return a->wall_ns + (int64_t)(t_ns - a->t_ns);
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-150435
+  Function Name	: timebase_wall_str
+  Returns Type	: int
+  ----Parameter List
+  1. int64_t wall_ns,
+  2. char *buf,
+  3. size_t len ,
+  ------------------
+  Exit Codes	: characters written
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Local 'YYYY-MM-DD HH:MM:SS.mmm'
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+int timebase_wall_str(int64_t wall_ns, char *buf, size_t len) {
+	time_t t = (time_t)(wall_ns / 1000000000LL);
+	struct tm tm;
+	size_t n;
+
+#ifdef _WIN32
+	tm = *localtime(&t);
+#else
+	localtime_r(&t, &tm);
+#endif
+	n = strftime(buf, len, "%Y-%m-%d %H:%M:%S", &tm);
+	if (n == 0) return 0;
+
+	return n + snprintf(buf + n, len - n, ".%03d", (int)((wall_ns / 1000000LL) % 1000));
+}
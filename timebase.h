@@ -0,0 +1,38 @@
+/*
+ * Monotonic time base
+ *
+ * All readings are stamped in nanoseconds from a single monotonic
+ * clock so that readings from several meters (and the logs) share
+ * one time base that doesn't jump with wall clock adjustments.
+ *
+ * Wall time is only looked at once per session, to anchor the
+ * monotonic clock; a reading's wall time is the anchor's plus the
+ * monotonic time since.
+ *
+ */
+#ifndef __BK390A_TIMEBASE_H__
+#define __BK390A_TIMEBASE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct timebase_anchor {
+	uint64_t t_ns;		// monotonic
+	int64_t wall_ns;	// Unix epoch ns at t_ns
+};
+
+uint64_t timebase_now_ns(void);
+int64_t timebase_wall_ns(void);
+void timebase_anchor(struct timebase_anchor *a);
+int64_t timebase_to_wall(const struct timebase_anchor *a, uint64_t t_ns);
+int timebase_wall_str(int64_t wall_ns, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -20,6 +20,13 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include <wchar.h>
+#include "decode.h"
+#include "dispfmt.h"
+#include "framer.h"
+#include "reconn.h"
+#include "serial.h"
+#include "sinkq.h"
+#include "timebase.h"
 
 char VERSION[] = "v0.5 Beta";
 char help[] = "BK-Precision 390A Multimeter serial data decoder\r\n"
@@ -30,7 +37,7 @@ char help[] = "BK-Precision 390A Multimeter serial data decoder\r\n"
 "\r\n"
 "\t-h: This help\r\n"
 "\t-p <comport>: Set the com port for the meter, eg: -p 2\r\n"
-"\t-s <[9600|4800|2400|1200]:[7|8][o|e|n][1|2]>, eg: -s 2400:7o1\r\n"
+"\t-s <[19200|9600|4800|2400|1200]:[7|8][o|e|n][1|2]>, eg: -s 2400:7o1\r\n"
 "\t-m: show multimeter mode (second line of text)\r\n"
 "\t-z: Font size (default 72, max 256pt)\r\n"
 "\t-fn <font name>: Font name (default 'Andale')\r\n"
@@ -47,45 +54,6 @@ char help[] = "BK-Precision 390A Multimeter serial data decoder\r\n"
 "\r\n"
 "\texample: bk390a.exe -z 120 -p 4 -s 2400:7o1 -m -fc #10ff10 -bc #000000 -wx 480 -wy 60 -fw 600\r\n";
 
-#define BYTE_RANGE 0
-#define BYTE_DIGIT_3 1
-#define BYTE_DIGIT_2 2
-#define BYTE_DIGIT_1 3
-#define BYTE_DIGIT_0 4
-#define BYTE_FUNCTION 5
-#define BYTE_STATUS 6
-#define BYTE_OPTION_1 7
-#define BYTE_OPTION_2 8
-
-#define FUNCTION_VOLTAGE 0b00111011
-#define FUNCTION_CURRENT_UA 0b00111101
-#define FUNCTION_CURRENT_MA 0b00111001
-#define FUNCTION_CURRENT_A 0b00111111
-#define FUNCTION_OHMS 0b00110011
-#define FUNCTION_CONTINUITY 0b00110101
-#define FUNCTION_DIODE 0b00110001
-#define FUNCTION_FQ_RPM 0b00110010
-#define FUNCTION_CAPACITANCE 0b00110110
-#define FUNCTION_TEMPERATURE 0b00110100
-#define FUNCTION_ADP0 0b00111110
-#define FUNCTION_ADP1 0b00111100
-#define FUNCTION_ADP2 0b00111000
-#define FUNCTION_ADP3 0b00111010
-
-#define STATUS_OL 0x01
-#define STATUS_BATT 0x02
-#define STATUS_SIGN 0x04
-#define STATUS_JUDGE 0x08
-
-#define OPTION1_VAHZ 0x01
-#define OPTION1_PMIN 0x04
-#define OPTION1_PMAX 0x08
-
-#define OPTION2_APO 0x01
-#define OPTION2_AUTO 0x02
-#define OPTION2_AC 0x04
-#define OPTION2_DC 0x08
-
 #define WINDOWS_DPI_DEFAULT 72
 #define FONT_NAME_SIZE 1024
 #define SSIZE 1024
@@ -99,6 +67,8 @@ char help[] = "BK-Precision 390A Multimeter serial data decoder\r\n"
 #define DEFAULT_WINDOW_WIDTH 9999
 #define DEFAULT_COM_PORT 99
 
+#define WM_BK390A_READING (WM_APP + 1)	// the acquisition thread has queued readings
+
 struct glb {
 	int window_x, window_y;
 	uint8_t debug;
@@ -115,6 +85,8 @@ struct glb {
 	COLORREF font_color, background_color;
 
 	char serial_params[SSIZE];
+	char device[SSIZE];			// \\.\COM<n>
+	struct serial_params sp;	// as opened, and reopened after an outage
 };
 
 /*
@@ -140,6 +112,16 @@ wchar_t line1[SSIZE];
 wchar_t line2[SSIZE];
 struct glb *glbs;
 
+/*
+ * The serial port is read and decoded on its own thread, readings
+ * are queued to the GUI thread so a slow repaint never delays
+ * reading the next frame
+ */
+struct sinkq q_gui;
+HANDLE hAcquire;
+volatile LONG acquire_stop = 0;
+volatile LONG gui_pending = 0;	// a WM_BK390A_READING is on its way
+
 /*-----------------------------------------------------------------\
   Date Code:	: 20180127-220248
   Function Name	: init
@@ -173,6 +155,7 @@ int init(struct glb *g) {
 	g->background_color = RGB(0, 0, 0);
 
 	g->serial_params[0] = '\0';
+	g->device[0] = '\0';
 
 	return 0;
 }
@@ -319,6 +302,188 @@ int parse_parameters(struct glb *g) {
  */
 LRESULT CALLBACK WindowProcedure(HWND, UINT, WPARAM, LPARAM);
 
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-143010
+  Function Name	: acquire_thread
+  Returns Type	: DWORD WINAPI
+  ----Parameter List
+  1. LPVOID arg, struct glb
+  ------------------
+  Exit Codes	:
+  Side Effects	:
+  --------------------------------------------------------------------
+Comments:
+	Whatever the port has available is read in one go straight
+	in to the framer's ring buffer.  The comm time-outs end the
+	ReadFile() at the gap between frames so this is normally a
+	single call per frame.  Complete, well formed frames are
+	decoded and queued for the GUI thread.
+
+	The function/range matrix from the data sheet lives in decode.c
+	and is shared with bk390a; frames with an unknown function or
+	range are dropped rather than shown with stale units.
+
+	A failed read (adaptor unplugged or bumped), or no frames for
+	RECONN_DEFAULT_STALL_MS, closes the port and shows N/C; it's
+	reopened with the same DCB, backing off, until frames arrive.
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+DWORD WINAPI acquire_thread(LPVOID arg) {
+	struct glb *g = (struct glb *)arg;
+	uint8_t d[BK390A_PAYLOAD_SIZE]; // Serial data packet
+	struct framer fr;    // Assembles frames from the serial bytes
+	struct sinkq_event se; // Decoded frame, as handed to the GUI
+	struct reconn rc;      // Port up, lost or stalled, and when to reopen it
+	DWORD bytes_read;      // Number of bytes read by ReadFile()
+	uint64_t t_rx;         // When the last read completed, then the frame's arrival
+	int cause, timeout_ms;
+	BOOL com_ok;
+	int i;
+
+	framer_init(&fr);
+	memset(&se, 0, sizeof(se));
+	reconn_init(&rc, RECONN_DEFAULT_STALL_MS, timebase_now_ns());
+
+	while (!acquire_stop) {
+		t_rx = timebase_now_ns();
+		cause = -1;
+		switch (reconn_due(&rc, t_rx)) {
+			case RECONN_CLOSE:
+				cause = RECONN_STALLED;
+				break;
+
+			case RECONN_REOPEN:
+				hComm = (HANDLE)serial_open_win(g->device, &(g->sp));
+				if (hComm == INVALID_HANDLE_VALUE) reconn_failed(&rc, t_rx);
+				else reconn_reopened(&rc, t_rx);
+				break;
+
+			default: break;
+		}
+
+		if ((cause < 0) && (hComm == INVALID_HANDLE_VALUE)) {
+			timeout_ms = reconn_timeout_ms(&rc, timebase_now_ns());
+			Sleep(((timeout_ms < 0) || (timeout_ms > 100)) ? 100 : timeout_ms); // stay responsive to acquire_stop
+			continue;
+		}
+
+		if (cause < 0) {
+			if (framer_next(&fr, d, &t_rx) == 0) {
+				uint8_t *wp;
+				size_t wlen;
+
+				wp = framer_write_ptr(&fr, &wlen);
+				com_ok = ReadFile(hComm, wp, wlen, &bytes_read, NULL);
+				t_rx = timebase_now_ns();
+				if (com_ok == FALSE) {
+					cause = RECONN_LOST;
+
+				} else {
+					if (g->debug) {
+						wprintf(L"DATA START: ");
+						for (i = 0; i < (int)bytes_read; i++) { wprintf(L"%02x ", wp[i]); }
+						wprintf(L":END\r\n");
+					}
+
+					framer_commit(&fr, bytes_read, t_rx);
+					continue;
+				}
+
+			} else {
+				reconn_frame(&rc, t_rx); // the next reading replaces the N/C
+				if (bk390a_decode(d, &(se.r)) != 0) continue;
+				se.type = SINKQ_READING;
+				se.t_ns = t_rx;
+				memcpy(se.raw, d, BK390A_PAYLOAD_SIZE);
+			}
+		}
+
+		/*
+		 * Lost or stalled; close the port, the reopen is left to
+		 * reconn_due() above, and the GUI is told once per outage
+		 */
+		if (cause >= 0) {
+			CloseHandle(hComm);
+			hComm = INVALID_HANDLE_VALUE;
+			framer_discard(&fr);
+			if (reconn_down(&rc, cause, t_rx) == 0) continue;
+			se.type = SINKQ_NO_COMMS;
+			se.cause = cause;
+			se.t_ns = rc.outage_ns;
+		}
+
+		sinkq_push(&q_gui, &se);
+		if (InterlockedExchange(&gui_pending, 1) == 0) PostMessage(hstatic, WM_BK390A_READING, 0, 0);
+	}
+
+	return 0;
+}
+
+/*-----------------------------------------------------------------\
+  Date Code:	: 20261016-143025
+  Function Name	: show_readings
+  Returns Type	: void
+  ----Parameter List
+  1. void ,
+  ------------------
+  Exit Codes	:
+  Side Effects	: updates line1/line2 and repaints
+  --------------------------------------------------------------------
+Comments:
+	GUI thread; only the latest queued reading is shown
+
+--------------------------------------------------------------------
+Changes:
+
+\------------------------------------------------------------------*/
+void show_readings(void) {
+	struct sinkq_event e, next;
+	int have = 0;
+	int n;
+
+	InterlockedExchange(&gui_pending, 0);
+	while (sinkq_pop(&q_gui, &next)) {
+		e = next;
+		have = 1;
+	}
+	if (!have) return;
+
+	/*
+	 * Both lines are padded to 40 characters so a shorter reading
+	 * paints over the tail of a longer one
+	 */
+	if (e.type == SINKQ_NO_COMMS) {
+		n = dispfmt_wappend(line1, 0, SSIZE, L"N/C");
+		dispfmt_wpad(line1, n, SSIZE, 40);
+		n = dispfmt_wappend(line2, 0, SSIZE, L"Check RS232");
+		dispfmt_wpad(line2, n, SSIZE, 40);
+
+	} else {
+		/*
+		 * Prefix string is a single space when there's no prefix, prevents
+		 * annoying string width jump (on monospace, can't stop
+		 * it with variable width strings unless we draw the 
+		 * prefix+units separately in a fixed location
+		 * ( see https://www.youtube.com/watch?v=5HUyEykicEQ )
+		 *
+		 */
+		n = dispfmt_wreading(&(e.r), DISPFMT_PREFIX_SPACE, line1, SSIZE);
+		dispfmt_wpad(line1, n, SSIZE, 40);
+
+		/*
+		 * If we're not showing the meter mode, then just
+		 * blank the second line
+		 */
+		n = dispfmt_wappend(line2, 0, SSIZE, glbs->show_mode ? bk390a_mode_wstr[e.r.mode] : L"");
+		dispfmt_wpad(line2, n, SSIZE, 40);
+	}
+
+	InvalidateRect(hstatic, NULL, FALSE);
+}
+
 /*-----------------------------------------------------------------\
   Date Code:	: 20180127-220307
   Function Name	: main
@@ -337,25 +502,13 @@ Changes:
 
 \------------------------------------------------------------------*/
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdLine, int nCmdShow) {
-	wchar_t linetmp[SSIZE]; // temporary string for building main line of text
-	wchar_t prefix[SSIZE]; // Units prefix u, m, k, M etc
-	wchar_t units[SSIZE];  // Measurement units F, V, A, R
-	wchar_t mmmode[SSIZE]; // Multimeter mode, Resistance/diode/cap etc
-
-	uint8_t d[SSIZE];      // Serial data packet
-	uint8_t dps = 0;     // Number of decimal places
 	struct glb g;        // Global structure for passing variables around
-	int i = 0;           // Generic counter
 	MSG msg;
 	WNDCLASSW wc = {0};
-	wchar_t com_port[SSIZE]; // com port path / ie, \\.COM4
-	BOOL com_read_status;  // return status of various com port functions
-	DWORD dwEventMask;     // Event mask to trigger
-	char temp_char;        // Temporary character
-	DWORD bytes_read;      // Number of bytes read by ReadFile()
 	HDC dc;
 
 	glbs = &g;
+	hComm = INVALID_HANDLE_VALUE;
 
 	/*
 	 * Initialise the global structure
@@ -374,121 +527,38 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdLin
 		wprintf(L"Require com port address for BK-390A meter, ie, -p 2 (for COM2)\r\n");
 		exit(1);
 	} else {
-		snwprintf(com_port, sizeof(com_port), L"\\\\.\\COM%d", g.com_address);
+		snprintf(g.device, sizeof(g.device), "\\\\.\\COM%d", g.com_address);
 	}
 
 	if (g.comms_enabled) {
-		/*
-		 * Open the serial port
-		 */
-		hComm = CreateFile(com_port,      // Name of port
-				GENERIC_READ,  // Read Access
-				0,             // No Sharing
-				NULL,          // No Security
-				OPEN_EXISTING, // Open existing port only
-				0,             // Non overlapped I/O
-				NULL);         // Null for comm devices
-
-		/*
-		 * Check the outcome of the attempt to create the handle for the com port
-		 */
-		if (hComm == INVALID_HANDLE_VALUE) {
-			wprintf(L"Error while trying to open com port 'COM%d'\r\n", g.com_address);
-			exit(1);
-		} else {
-			if (!g.quiet) wprintf(L"Port COM%d Opened\r\n", g.com_address);
-		}
-
-		/*
-		 * Set serial port parameters
-		 */
-		DCB dcbSerialParams = {0}; // Init DCB structure
-		dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
-
-		com_read_status = GetCommState(hComm, &dcbSerialParams); // Retrieve current settings
-		if (com_read_status == FALSE) {
-			wprintf(L"Error in getting GetCommState()\r\n");
-		}
-
-		dcbSerialParams.BaudRate = CBR_2400;
-		dcbSerialParams.ByteSize = 7;
-		dcbSerialParams.StopBits = ONESTOPBIT;
-		dcbSerialParams.Parity = ODDPARITY;
-
+		serial_default_params(&(g.sp));
 		if (g.serial_params[0] != '\0') {
-			char *p = g.serial_params;
-
-			if (strncmp(p, "9600:", 5) == 0) dcbSerialParams.BaudRate = CBR_9600; // BaudRate = 9600
-			else if (strncmp(p, "4800:", 5) == 0) dcbSerialParams.BaudRate = CBR_4800; // BaudRate = 4800
-			else if (strncmp(p, "2400:", 5) == 0) dcbSerialParams.BaudRate = CBR_2400; // BaudRate = 2400
-			else if (strncmp(p, "1200:", 5) == 0) dcbSerialParams.BaudRate = CBR_1200; // BaudRate = 1200
-			else {
-				wprintf(L"Invalid serial speed\r\n");
-				exit(1);
-			}
-
-			p = &(g.serial_params[5]);
-			if (*p == '7') dcbSerialParams.ByteSize = 7;
-			else if (*p == '8') dcbSerialParams.ByteSize = 8;
-			else {
-				wprintf(L"Invalid serial byte size '%c'\r\n", *p);
-				exit(1);
-			}
-
-			p++;
-			if (*p == 'o') dcbSerialParams.Parity = ODDPARITY;
-			else if (*p == 'e') dcbSerialParams.Parity = EVENPARITY;
-			else if (*p == 'n') dcbSerialParams.Parity = NOPARITY;
-			else {
-				wprintf(L"Invalid serial parity type '%c'\r\n", *p);
-				exit(1);
-			}
-
-			p++;
-			if (*p == '1') dcbSerialParams.StopBits = ONESTOPBIT;
-			else if (*p == '2') dcbSerialParams.StopBits = TWOSTOPBITS;
-			else {
-				wprintf(L"Invalid serial stop bits '%c'\r\n", *p);
-				exit(1);
+			switch (serial_parse_params(g.serial_params, &(g.sp))) {
+				case SERIAL_PARAM_OK: break;
+				case SERIAL_PARAM_SPEED: wprintf(L"Invalid serial speed\r\n"); exit(1);
+				case SERIAL_PARAM_BITS: wprintf(L"Invalid serial byte size in '%s'\r\n", g.serial_params); exit(1);
+				case SERIAL_PARAM_PARITY: wprintf(L"Invalid serial parity type in '%s'\r\n", g.serial_params); exit(1);
+				default: wprintf(L"Invalid serial stop bits in '%s'\r\n", g.serial_params); exit(1);
 			}
 		}
 
-		com_read_status = SetCommState(hComm, &dcbSerialParams);
-		if (com_read_status == FALSE) {
-			wprintf(L"Error setting com port configuration (2400/7/1/O etc)\r\n");
+		/*
+		 * Open the serial port, serial-win.c sets the DCB and
+		 * time-outs, the same way again if it has to be reopened
+		 */
+		hComm = (HANDLE)serial_open_win(g.device, &(g.sp));
+		if (hComm == INVALID_HANDLE_VALUE) {
+			wprintf(L"Error while trying to open or configure com port 'COM%d' (%lu)\r\n", g.com_address, (unsigned long)GetLastError());
 			exit(1);
-
 		} else {
 			if (!g.quiet) {
-				wprintf(L"\tBaudrate = %ld\r\n", dcbSerialParams.BaudRate);
-				wprintf(L"\tByteSize = %ld\r\n", dcbSerialParams.ByteSize);
-				wprintf(L"\tStopBits = %d\r\n", dcbSerialParams.StopBits);
-				wprintf(L"\tParity   = %d\r\n", dcbSerialParams.Parity);
+				wprintf(L"Port COM%d Opened\r\n", g.com_address);
+				wprintf(L"\tBaudrate = %d\r\n", g.sp.baud);
+				wprintf(L"\tByteSize = %d\r\n", g.sp.bits);
+				wprintf(L"\tStopBits = %d\r\n", g.sp.stop);
+				wprintf(L"\tParity   = %c\r\n", g.sp.parity);
 			}
 		}
-
-		COMMTIMEOUTS timeouts = {0};
-		timeouts.ReadIntervalTimeout = 50;
-		timeouts.ReadTotalTimeoutConstant = 50;
-		timeouts.ReadTotalTimeoutMultiplier = 10;
-		timeouts.WriteTotalTimeoutConstant = 50;
-		timeouts.WriteTotalTimeoutMultiplier = 10;
-		if (SetCommTimeouts(hComm, &timeouts) == FALSE) {
-			wprintf(L"\tError in setting time-outs\r\n");
-			exit(1);
-
-		} else {
-			if (!g.quiet) { wprintf(L"\tSetting time-outs successful\r\n"); }
-		}
-
-		com_read_status = SetCommMask(hComm, EV_RXCHAR); // Configure Windows to Monitor the serial device for Character Reception
-		if (com_read_status == FALSE) {
-			wprintf(L"\tError in setting CommMask\r\n");
-			exit(1);
-
-		} else {
-			if (!g.quiet) { wprintf(L"\tCommMask successful\r\n"); }
-		}
 	} // comms enabled
 
 	/*
@@ -539,267 +609,41 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdLin
 
 
 	/*
-	 * Keep reading, interpreting and converting data until someone
-	 * presses ctrl-c or there's an error
+	 * Start reading the meter, the readings come back to us as
+	 * WM_BK390A_READING messages
 	 */
-	while (msg.message != WM_QUIT) {
-		char *p, *q;
-		double v = 0.0;
-		int end_of_frame_received = 0;
-
-		linetmp[0] = '\0';
-
-		/*
-		 *
-		 * Let Windows handle itself first
-		 *
-		 */
+	if (sinkq_init(&q_gui, "Display", SINKQ_DEFAULT_SIZE, SINKQ_DROP_OLDEST) != 0) {
+		wprintf(L"Couldn't allocate the reading queue\r\n");
+		exit(1);
+	}
 
-		// while (PeekMessage (&msg, NULL, 0, 0, PM_REMOVE))
-		if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
-			if (msg.message == WM_QUIT) break;
-			TranslateMessage(&msg);
-			DispatchMessage(&msg);
+	if (g.comms_enabled) {
+		hAcquire = CreateThread(NULL, 0, acquire_thread, &g, 0, NULL);
+		if (hAcquire == NULL) {
+			wprintf(L"Couldn't start the serial port thread\r\n");
+			exit(1);
 		}
+	} else {
+		StringCbPrintf(line1, sizeof(line1), L"%-40s", L"N/C");
+		StringCbPrintf(line2, sizeof(line2), L"%-40s", L"Check RS232");
+	}
 
-		/*
-		 * Time to start receiving the serial block data
-		 *
-		 * We initially "stage" here waiting for there to
-		 * be something happening on the com port.  Soon as
-		 * something happens, then we move forward to trying
-		 * to read the data.
-		 *
-		 */
-		com_read_status = WaitCommEvent(hComm, &dwEventMask, NULL); // Wait for the character to be received
-		if (com_read_status == FALSE) {
-			StringCbPrintf(linetmp, sizeof(linetmp), L"N/C");
-			StringCbPrintf(mmmode, sizeof(mmmode), L"Check RS232");
-
-		} else {
-			/*
-			 * If we're not in debug mode, then read the data from the
-			 * com port until we get a \n character, which is the
-			 * end-of-frame marker.
-			 *
-			 * This is the section where we're capturing the data bytes
-			 * from the multimeter.
-			 *
-			 */
-
-			if (g.debug) { wprintf(L"DATA START: "); }
-			end_of_frame_received = 0;
-			i = 0;
-			do {
-				com_read_status = ReadFile(hComm, &temp_char, sizeof(temp_char), &bytes_read, NULL);
-				d[i] = temp_char;
-
-				if (g.debug) { wprintf(L"%02x ", d[i]); }
-
-				if (temp_char == '\n') {
-					end_of_frame_received = 1;
-					break;
-				}
-				i++;
-			} while ((bytes_read > 0) && (i < sizeof(d)));
-
-			if (g.debug) { wprintf(L":END\r\n"); }
-
-			/*
-			 * Initialise the strings used for units, prefix and mode
-			 * so we don't end up with uncleared prefixes etc
-			 * ( see https://www.youtube.com/watch?v=5HUyEykicEQ )
-			 *
-			 * Prefix string initialised to single space, prevents 
-			 * annoying string width jump (on monospace, can't stop
-			 * it with variable width strings unless we draw the 
-			 * prefix+units separately in a fixed location
-			 *
-			 */
-			StringCbPrintf(prefix, sizeof(prefix), L" ");
-			units[0] = '\0';
-			mmmode[0] = '\0';
-
-			/*
-			 * Decode our data.
-			 *
-			 * While the data sheet gives a very nice matrix for the RANGE and FUNCTION values
-			 * it's probably more human-readable to break it down in to longer code on a per
-			 * function selection.
-			 *
-			 */
-			switch (d[BYTE_FUNCTION]) {
-				case FUNCTION_VOLTAGE:
-					StringCbPrintf(units, sizeof(units), L"V");
-					StringCbPrintf(mmmode, sizeof(mmmode), L"Volts");
-
-					switch (d[BYTE_RANGE] & 0x0F) {
-						case 0:
-							dps = 1;
-							StringCbPrintf(prefix, sizeof(prefix), L"m");
-							break;
-						case 1: dps = 3; break;
-						case 2: dps = 2; break;
-						case 3: dps = 1; break;
-						case 4: dps = 0; break;
-					}      // test the range byte for voltages
-					break; // FUNCTION_VOLTAGE
-
-				case FUNCTION_CURRENT_UA:
-					StringCbPrintf(units, sizeof(units), L"A");
-					StringCbPrintf(prefix, sizeof(prefix), L"m");
-					StringCbPrintf(mmmode, sizeof(mmmode), L"Amps");
-
-					switch (d[BYTE_RANGE] & 0x0F) {
-						case 0: dps = 2; break;
-						case 1: dps = 1; break;
-					}
-					break; // FUNCTION_CURRENT_UA
-
-				case FUNCTION_CURRENT_MA:
-					StringCbPrintf(units, sizeof(units), L"A");
-					StringCbPrintf(prefix, sizeof(prefix), L"\u00B5");
-					StringCbPrintf(mmmode, sizeof(mmmode), L"Amps");
-
-					switch (d[BYTE_RANGE] & 0x0F) {
-						case 0: dps = 1; break;
-						case 1: dps = 0; break;
-					}
-					break; // FUNCTION_CURRENT_MA
-
-				case FUNCTION_CURRENT_A:
-					StringCbPrintf(units, sizeof(units), L"A");
-					StringCbPrintf(mmmode, sizeof(mmmode), L"Amps");
-					break; // FUNCTION_CURRENT_A
-
-				case FUNCTION_OHMS:
-					StringCbPrintf(mmmode, sizeof(mmmode), L"Resistance");
-					StringCbPrintf(units, sizeof(units), L"\u2126");
-
-					switch (d[BYTE_RANGE] & 0x0F) {
-						case 0: dps = 1; break;
-						case 1: dps = 3; StringCbPrintf(prefix, sizeof(prefix), L"k"); break;
-						case 2: dps = 2; StringCbPrintf(prefix, sizeof(prefix), L"k"); break;
-						case 3: dps = 1; StringCbPrintf(prefix, sizeof(prefix), L"k"); break;
-						case 4: dps = 3; StringCbPrintf(prefix, sizeof(prefix), L"M"); break;
-						case 5: dps = 2; StringCbPrintf(prefix, sizeof(prefix), L"M"); break;
-					}
-					break; // FUNCTION_OHMS
-
-				case FUNCTION_CONTINUITY:
-					StringCbPrintf(mmmode, sizeof(mmmode), L"Continuity");
-					StringCbPrintf(units, sizeof(units), L"\u2126");
-					dps = 1;
-					break; // FUNCTION_CONTINUITY
-
-				case FUNCTION_DIODE:
-					StringCbPrintf(mmmode, sizeof(mmmode), L"DIODE");
-					StringCbPrintf(units, sizeof(units), L"V");
-					dps = 3;
-					break; // FUNCTION_DIODE
-
-				case FUNCTION_FQ_RPM:
-					if (d[BYTE_STATUS] & STATUS_JUDGE) {
-						StringCbPrintf(mmmode, sizeof(mmmode), L"Frequency");
-						StringCbPrintf(units, sizeof(units), L"Hz");
-						switch (d[BYTE_RANGE] & 0x0F) {
-							case 0: dps = 3; StringCbPrintf(prefix, sizeof(prefix), L"k"); break;
-							case 1: dps = 2; StringCbPrintf(prefix, sizeof(prefix), L"k"); break;
-							case 2: dps = 1; StringCbPrintf(prefix, sizeof(prefix), L"k"); break;
-							case 3: dps = 3; StringCbPrintf(prefix, sizeof(prefix), L"M"); break;
-							case 4: dps = 2; StringCbPrintf(prefix, sizeof(prefix), L"M"); break;
-							case 5: dps = 1; StringCbPrintf(prefix, sizeof(prefix), L"M"); break;
-						} // switch
-
-					} else {
-						StringCbPrintf(mmmode, sizeof(mmmode), L"RPM");
-						StringCbPrintf(units, sizeof(units), L"rpm");
-						switch (d[BYTE_RANGE] & 0x0F) {
-							case 0: dps = 2; StringCbPrintf(prefix, sizeof(prefix), L"k"); break;
-							case 1: dps = 1; StringCbPrintf(prefix, sizeof(prefix), L"k"); break;
-							case 2: dps = 3; StringCbPrintf(prefix, sizeof(prefix), L"M"); break;
-							case 3: dps = 2; StringCbPrintf(prefix, sizeof(prefix), L"M"); break;
-							case 4: dps = 1; StringCbPrintf(prefix, sizeof(prefix), L"M"); break;
-							case 5: dps = 0; StringCbPrintf(prefix, sizeof(prefix), L"M"); break;
-						} // switch
-					}
-					break; // FUNCTION_FQ_RPM
-
-				case FUNCTION_CAPACITANCE:
-					StringCbPrintf(mmmode, sizeof(mmmode), L"Capacitance");
-					StringCbPrintf(units, sizeof(units), L"F");
-					switch (d[BYTE_RANGE] & 0x0F) {
-						case 0: dps = 3; StringCbPrintf(prefix, sizeof(prefix), L"n"); break;
-						case 1: dps = 2; StringCbPrintf(prefix, sizeof(prefix), L"n"); break;
-						case 2: dps = 1; StringCbPrintf(prefix, sizeof(prefix), L"n"); break;
-						case 3: dps = 3; StringCbPrintf(prefix, sizeof(prefix), L"\u00B5"); break;
-						case 4: dps = 2; StringCbPrintf(prefix, sizeof(prefix), L"\u00B5"); break;
-						case 5: dps = 1; StringCbPrintf(prefix, sizeof(prefix), L"\u00B5"); break;
-						case 6: dps = 3; StringCbPrintf(prefix, sizeof(prefix), L"m"); break;
-						case 7: dps = 2; StringCbPrintf(prefix, sizeof(prefix), L"m"); break;
-					}
-					break; // FUNCTION_CAPACITANCE
-
-				case FUNCTION_TEMPERATURE:
-					StringCbPrintf(mmmode, sizeof(mmmode), L"Temperature");
-					if (d[BYTE_STATUS] & STATUS_JUDGE) {
-						StringCbPrintf(units, sizeof(units), L"\u00B0C");
-					} else {
-						StringCbPrintf(units, sizeof(units), L"\u00B0F");
-					}
-					break; // FUNCTION_TEMPERATURE
-			}
-
-			/*
-			 * Decode the digit data in to human-readable
-			 *
-			 * bytes 1..4 are ASCII char codes for 0000-9999
-			 *
-			 */
-			v = ((d[1] & 0x0F) * 1000) 
-				+ ((d[2] & 0x0F) * 100) 
-				+ ((d[3] & 0x0F) * 10) 
-				+ ((d[4] & 0x0F) * 1);
-
-			/*
-			 * Sign of output (+/-)
-			 */
-			if (d[BYTE_STATUS] & STATUS_SIGN) {
-				v = -v;
-			}
-
-			/*
-			 * If we're not showing the meter mode, then just
-			 * zero the string we generated previously
-			 */
-			if (g.show_mode == 0) {
-				mmmode[0] = 0;
-			}
-
-			/** range checks **/
-			if ((d[BYTE_STATUS] & STATUS_OL) == 1) {
-				StringCbPrintf(linetmp, sizeof(linetmp), L"O.L.");
-
-			} else {
-				if (dps < 0) dps = 0;
-				if (dps > 3) dps = 3;
-
-				switch (dps) {
-					case 0: StringCbPrintf(linetmp, sizeof(linetmp), L"% 05.0f%s%s", v, prefix, units); break;
-					case 1: StringCbPrintf(linetmp, sizeof(linetmp), L"% 06.1f%s%s", v / 10, prefix, units); break;
-					case 2: StringCbPrintf(linetmp, sizeof(linetmp), L"% 06.2f%s%s", v / 100, prefix, units); break;
-					case 3: StringCbPrintf(linetmp, sizeof(linetmp), L"% 06.3f%s%s", v / 1000, prefix, units); break;
-				}
-			}
-		} // if com-read status == TRUE
-
-		StringCbPrintf(line1, sizeof(line1), L"%-40s", linetmp);
-		StringCbPrintf(line2, sizeof(line2), L"%-40s", mmmode);
-		InvalidateRect(hstatic, NULL, FALSE);
-
+	/*
+	 * Windows message loop, until the window is closed
+	 */
+	while (GetMessage(&msg, NULL, 0, 0) > 0) {
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
 	} // Windows message loop
 
-	CloseHandle(hComm); // Closing the Serial Port
+	if (hAcquire) {
+		InterlockedExchange(&acquire_stop, 1);
+		WaitForSingleObject(hAcquire, INFINITE);
+		CloseHandle(hAcquire);
+	}
+	sinkq_stop(&q_gui);
+
+	if (hComm != INVALID_HANDLE_VALUE) CloseHandle(hComm); // Closing the Serial Port
 
 	return (int)msg.wParam;
 }
@@ -830,6 +674,10 @@ LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 
 		case WM_COMMAND: break;
 
+		case WM_BK390A_READING:
+			show_readings();
+			break;
+
 		case WM_DESTROY:
 			DeleteObject(hFont);
 			PostQuitMessage(0); /* send a WM_QUIT to the message queue */